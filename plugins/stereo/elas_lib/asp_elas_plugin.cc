@@ -0,0 +1,218 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file asp_elas_plugin.cc
+///
+/// The LIBELAS stereo algorithm as a stereo plugin library, which
+/// stereo_corr calls in-process, rather than invoking the elas program for
+/// each tile. It implements the interface in StereoPluginApi.h. As libelas
+/// is released under GPL, this is not built with ASP, but can be built
+/// against the ASP fork of libelas as:
+///
+///   g++ -O3 -fPIC -shared -I<ASP src>/src -I<libelas>/src            \
+///     asp_elas_plugin.cc -o lib/libasp_elas_plugin.so                \
+///     -L<libelas>/lib -lelas -Wl,-rpath,<libelas>/lib
+///
+/// and registered in plugins/stereo/plugin_list.txt as:
+///
+///   libelas_lib  plugins/stereo/elas_lib/lib/libasp_elas_plugin.so
+
+#include <asp/Core/StereoPluginApi.h>
+
+#include <elas.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Parse the options, which are as for the elas program. The disparity
+// range, if not set, is the one estimated by ASP.
+void parse_options(int argc, char const* const* argv, int min_disp, int max_disp,
+                   Elas::parameters & param) {
+
+  // Same defaults as the elas program
+  std::map<std::string, double> vals;
+  vals["-disp_min"] = min_disp;
+  vals["-disp_max"] = max_disp;
+  vals["-support_threshold"] = 0.85;
+  vals["-support_texture"] = 10;
+  vals["-candidate_stepsize"] = 5;
+  vals["-incon_window_size"] = 5;
+  vals["-incon_threshold"] = 5;
+  vals["-incon_min_support"] = 5;
+  vals["-add_corners"] = 0;
+  vals["-grid_size"] = 20;
+  vals["-beta"] = 0.02;
+  vals["-gamma"] = 3;
+  vals["-sigma"] = 1;
+  vals["-sradius"] = 2;
+  vals["-match_texture"] = 1;
+  vals["-lr_threshold"] = 2;
+  vals["-speckle_sim_threshold"] = 1;
+  vals["-speckle_size"] = 200;
+  vals["-ipol_gap_width"] = 3;
+  vals["-filter_median"] = 0;
+  vals["-filter_adaptive_mean"] = 1;
+  vals["-postprocess_only_left"] = 0;
+  // Accepted for compatibility with the elas program, but not used
+  vals["-verbose"] = 0;
+  vals["-debug_images"] = 0;
+
+  for (int it = 0; it < argc; it += 2) {
+    std::string opt = argv[it];
+    if (vals.find(opt) == vals.end())
+      throw std::runtime_error("Unknown option: " + opt);
+    if (it + 1 >= argc)
+      throw std::runtime_error("Missing value for option: " + opt);
+    char * end = NULL;
+    double val = strtod(argv[it + 1], &end);
+    if (end == argv[it + 1] || *end != '\0')
+      throw std::runtime_error("Invalid value for option " + opt + ": " + argv[it + 1]);
+    vals[opt] = val;
+  }
+
+  param.disp_min              = int32_t(vals["-disp_min"]);
+  param.disp_max              = int32_t(vals["-disp_max"]);
+  param.support_threshold     = vals["-support_threshold"];
+  param.support_texture       = int32_t(vals["-support_texture"]);
+  param.candidate_stepsize    = int32_t(vals["-candidate_stepsize"]);
+  param.incon_window_size     = int32_t(vals["-incon_window_size"]);
+  param.incon_threshold       = int32_t(vals["-incon_threshold"]);
+  param.incon_min_support     = int32_t(vals["-incon_min_support"]);
+  param.add_corners           = (vals["-add_corners"] != 0);
+  param.grid_size             = int32_t(vals["-grid_size"]);
+  param.beta                  = vals["-beta"];
+  param.gamma                 = vals["-gamma"];
+  param.sigma                 = vals["-sigma"];
+  param.sradius               = vals["-sradius"];
+  param.match_texture         = int32_t(vals["-match_texture"]);
+  param.lr_threshold          = int32_t(vals["-lr_threshold"]);
+  param.speckle_sim_threshold = vals["-speckle_sim_threshold"];
+  param.speckle_size          = int32_t(vals["-speckle_size"]);
+  param.ipol_gap_width        = int32_t(vals["-ipol_gap_width"]);
+  param.filter_median         = (vals["-filter_median"] != 0);
+  param.filter_adaptive_mean  = (vals["-filter_adaptive_mean"] != 0);
+  param.postprocess_only_left = (vals["-postprocess_only_left"] != 0);
+  param.subsampling           = false;
+
+  if (param.disp_min > param.disp_max)
+    throw std::runtime_error("The minimum disparity must not exceed the maximum one.");
+}
+
+// Run libelas. The ASP convention is that left pixel col corresponds to
+// right pixel col + d, with d of any sign, while libelas expects it to be
+// col - d, with d non-negative. So shift the right image to the left by
+// max_disp, find the libelas disparity in [0, max_disp - min_disp], and
+// convert it back.
+void run_elas(int cols, int rows, float const* left, float const* right,
+              Elas::parameters param, float * disparity) {
+
+  int min_disp = param.disp_min, max_disp = param.disp_max;
+  param.disp_min = 0;
+  param.disp_max = max_disp - min_disp;
+
+  // Scale both images to bytes with the same transform, so the intensities
+  // stay comparable. No-data pixels become 0.
+  float min_val = std::numeric_limits<float>::max();
+  float max_val = -min_val;
+  for (int it = 0; it < cols * rows; it++) {
+    if (!std::isnan(left[it])) {
+      min_val = std::min(min_val, left[it]);
+      max_val = std::max(max_val, left[it]);
+    }
+    if (!std::isnan(right[it])) {
+      min_val = std::min(min_val, right[it]);
+      max_val = std::max(max_val, right[it]);
+    }
+  }
+  float scale = (max_val > min_val) ? 255.0 / (max_val - min_val) : 0.0;
+
+  std::vector<uint8_t> left_u8(cols * rows, 0), right_u8(cols * rows, 0);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      float l = left[row * cols + col];
+      if (!std::isnan(l))
+        left_u8[row * cols + col] = uint8_t(std::round(scale * (l - min_val)));
+      int right_col = col + max_disp;
+      if (right_col < 0 || right_col >= cols)
+        continue;
+      float r = right[row * cols + right_col];
+      if (!std::isnan(r))
+        right_u8[row * cols + col] = uint8_t(std::round(scale * (r - min_val)));
+    }
+  }
+
+  std::vector<float> left_disp(cols * rows, 0), right_disp(cols * rows, 0);
+  int32_t dims[3] = {cols, rows, cols}; // width, height, bytes per line
+  Elas elas(param);
+  elas.process(&left_u8[0], &right_u8[0], &left_disp[0], &right_disp[0], dims);
+
+  // libelas marks invalid disparities with negative values. Also invalidate
+  // the disparities at no-data pixels, or pointing to such pixels.
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      int k = row * cols + col;
+      disparity[k] = nan;
+      if (left_disp[k] < 0 || std::isnan(left[k]))
+        continue;
+      float d = max_disp - left_disp[k];
+      int right_col = int(std::round(col + d));
+      if (right_col < 0 || right_col >= cols || std::isnan(right[row * cols + right_col]))
+        continue;
+      disparity[k] = d;
+    }
+  }
+}
+
+} // end anonymous namespace
+
+extern "C" {
+
+int asp_stereo_plugin_api_version(void) {
+  return ASP_STEREO_PLUGIN_API_VERSION;
+}
+
+int asp_stereo_plugin_run(int argc, char const* const* argv,
+                          int cols, int rows,
+                          float const* left, float const* right,
+                          int min_disp, int max_disp,
+                          float * disparity,
+                          char * err_msg, int err_msg_len) {
+  try {
+    Elas::parameters param;
+    parse_options(argc, argv, min_disp, max_disp, param);
+    run_elas(cols, rows, left, right, param, disparity);
+  } catch (std::exception const& e) {
+    if (err_msg_len > 0) {
+      strncpy(err_msg, e.what(), err_msg_len - 1);
+      err_msg[err_msg_len - 1] = '\0';
+    }
+    return 1;
+  }
+  return 0;
+}
+
+}
@@ -20,6 +20,7 @@
 
 #include <asp/Camera/BundleAdjustCamera.h>
 #include <asp/Core/IpMatchingAlgs.h>
+#include <asp/Core/MatchDb.h>
 #include <asp/Camera/CameraResectioning.h>
 #include <asp/Camera/CsmModel.h>
 #include <asp/Camera/Covariance.h>
@@ -37,10 +38,12 @@
 #include <vw/Math/Statistics.h>
 #include <vw/Math/Geometry.h>
 #include <vw/Math/Functors.h>
+#include <vw/Math/RandomSet.h>
 #include <vw/Camera/CameraUtilities.h>
 #include <vw/Camera/LensDistortion.h>
 
 #include <boost/random/uniform_int_distribution.hpp>
+#include <boost/filesystem.hpp>
 
 #include <string>
 
@@ -1372,6 +1375,156 @@ void processMatchPair(size_t left_index, size_t right_index,
   return;
 }
 
+// Find the feature a given feature is merged with, with path compression
+int featureRoot(std::vector<int> & parent, int fid) {
+  while (parent[fid] != fid) {
+    parent[fid] = parent[parent[fid]];
+    fid = parent[fid];
+  }
+  return fid;
+}
+
+// Build a control network from opt.match_files. Without a match database this
+// is vw::ba::build_control_network(). With one, given by opt.match_db, the
+// matches in it are read from it directly, and the rest from .match files on
+// disk. Then, as in the VW function, interest points at the same pixel in the
+// same image are the same feature, the features linked by matches form a
+// control point, and control points that fail to triangulate are dropped.
+bool buildControlNetwork(asp::BaBaseOptions const& opt,
+                         vw::ba::ControlNetwork & cnet) {
+
+  if (opt.match_db.empty()) {
+    bool triangulate_control_points = true;
+    return vw::ba::build_control_network(triangulate_control_points,
+                                         cnet, // output
+                                         opt.camera_models, opt.image_files,
+                                         opt.match_files, opt.min_matches,
+                                         opt.min_triangulation_angle*(M_PI/180.0),
+                                         opt.forced_triangulation_distance,
+                                         opt.max_pairwise_matches);
+  }
+
+  boost::shared_ptr<asp::MatchDb> db(new asp::MatchDb(opt.match_db));
+
+  // Wipe the output and add the images
+  cnet = vw::ba::ControlNetwork("ASP_control_network");
+  int num_images = opt.image_files.size();
+  for (int i = 0; i < num_images; i++)
+    cnet.add_image_name(opt.image_files[i]);
+
+  // Assign an index to each distinct feature, and link the matched ones
+  std::vector<std::map<std::pair<float, float>, int>> pix_to_fid(num_images);
+  std::vector<vw::ip::InterestPoint> features;
+  std::vector<int> feature_cam, parent;
+  int num_pairs = 0;
+  for (auto const& it: opt.match_files) {
+    int cam1 = it.first.first, cam2 = it.first.second;
+    std::string const& match_file = it.second;
+    if (!asp::matchFileExists(db.get(), match_file))
+      continue;
+
+    std::vector<vw::ip::InterestPoint> ip1, ip2;
+    asp::readMatchFile(db.get(), match_file, ip1, ip2);
+
+    if (opt.max_pairwise_matches >= 0 &&
+        (int)ip1.size() > opt.max_pairwise_matches) {
+      std::vector<int> subset;
+      vw::math::pick_random_indices_in_range(ip1.size(), opt.max_pairwise_matches,
+                                             subset);
+      std::sort(subset.begin(), subset.end());
+      std::vector<vw::ip::InterestPoint> ip1_sub, ip2_sub;
+      for (size_t k = 0; k < subset.size(); k++) {
+        ip1_sub.push_back(ip1[subset[k]]);
+        ip2_sub.push_back(ip2[subset[k]]);
+      }
+      ip1.swap(ip1_sub);
+      ip2.swap(ip2_sub);
+    }
+
+    if ((int)ip1.size() < opt.min_matches) {
+      vw_out() << "Skipping " << match_file << " as it has " << ip1.size()
+               << " matches, fewer than " << opt.min_matches << ".\n";
+      continue;
+    }
+
+    int cams[2] = {cam1, cam2};
+    std::vector<vw::ip::InterestPoint> const* ips[2] = {&ip1, &ip2};
+    for (size_t k = 0; k < ip1.size(); k++) {
+      int fids[2];
+      for (int side = 0; side < 2; side++) {
+        vw::ip::InterestPoint const& ip = (*ips[side])[k];
+        auto pix = std::make_pair(ip.x, ip.y);
+        auto fid_it = pix_to_fid[cams[side]].find(pix);
+        if (fid_it == pix_to_fid[cams[side]].end()) {
+          fid_it = pix_to_fid[cams[side]].insert(std::make_pair(pix,
+                                                  (int)features.size())).first;
+          features.push_back(ip);
+          feature_cam.push_back(cams[side]);
+          parent.push_back(fid_it->second);
+        }
+        fids[side] = fid_it->second;
+      }
+      int root1 = featureRoot(parent, fids[0]), root2 = featureRoot(parent, fids[1]);
+      if (root1 != root2)
+        parent[std::max(root1, root2)] = std::min(root1, root2);
+    }
+    num_pairs++;
+  }
+  vw_out() << "Loaded matches for " << num_pairs << " image pairs.\n";
+
+  // Gather the features of each control point, in the order they were seen
+  std::map<int, int> root_to_pid;
+  std::vector<std::vector<int>> pid_to_fids;
+  for (int fid = 0; fid < (int)features.size(); fid++) {
+    int root = featureRoot(parent, fid);
+    auto pid_it = root_to_pid.find(root);
+    if (pid_it == root_to_pid.end()) {
+      pid_it = root_to_pid.insert(std::make_pair(root, (int)pid_to_fids.size())).first;
+      pid_to_fids.push_back(std::vector<int>());
+    }
+    pid_to_fids[pid_it->second].push_back(fid);
+  }
+
+  // Form and triangulate the control points. A point having more than one
+  // feature in the same image is inconsistent, and is skipped.
+  int num_conflicts = 0, num_failed = 0;
+  double min_angle = opt.min_triangulation_angle*(M_PI/180.0);
+  for (size_t pid = 0; pid < pid_to_fids.size(); pid++) {
+    std::set<int> cams;
+    vw::ba::ControlPoint cp;
+    cp.set_type(vw::ba::ControlPoint::TiePoint);
+    for (int fid: pid_to_fids[pid]) {
+      cams.insert(feature_cam[fid]);
+      vw::ip::InterestPoint const& ip = features[fid];
+      cp.add_measure(vw::ba::ControlMeasure(ip.x, ip.y, ip.scale, ip.scale,
+                                            feature_cam[fid]));
+    }
+    if (cams.size() != pid_to_fids[pid].size()) {
+      num_conflicts++;
+      continue;
+    }
+
+    double err = vw::ba::triangulate_control_point(cp, opt.camera_models, min_angle,
+                                                   opt.forced_triangulation_distance);
+    if (err < 0 || cp.position() == Vector3()) {
+      num_failed++;
+      continue;
+    }
+    cnet.add_control_point(cp);
+  }
+
+  if (num_conflicts > 0)
+    vw_out() << "Skipped " << num_conflicts << " control points having more "
+             << "than one interest point in the same image.\n";
+  if (num_failed > 0)
+    vw_out() << "Skipped " << num_failed << " control points that failed to "
+             << "triangulate or have a convergence angle under "
+             << opt.min_triangulation_angle << " degrees.\n";
+  vw_out() << "Built a control network with " << cnet.size() << " points.\n";
+
+  return cnet.size() > 0;
+}
+
 // Calculate convergence angles. Remove the outliers flagged earlier,
 // if remove_outliers is true. Compute offsets of mapprojected matches,
 // if a DEM is given. These are done together as they rely on
@@ -1464,6 +1617,19 @@ void matchFilesProcessing(vw::ba::ControlNetwork       const& cnet,
     }
   }
   
+  // Matches may be read from a match database, and then the clean matches
+  // are written to a database as well, rather than to individual files.
+  boost::shared_ptr<asp::MatchDb> match_db;
+  boost::shared_ptr<asp::MatchDbWriter> clean_match_db;
+  if (!opt.match_db.empty()) {
+    match_db.reset(new asp::MatchDb(opt.match_db));
+    if (opt.output_cnet_type == "match-files" && save_clean_matches) {
+      std::string clean_match_db_file = opt.out_prefix + "-clean-matches.mdb";
+      vw_out() << "Writing clean matches to: " << clean_match_db_file << "\n";
+      clean_match_db.reset(new asp::MatchDbWriter(clean_match_db_file));
+    }
+  }
+
   // Work on individual image pairs
   for (const auto& match_it: local_match_files) {
    
@@ -1494,14 +1660,14 @@ void matchFilesProcessing(vw::ba::ControlNetwork       const& cnet,
       
     } else {
       // Read existing matches. Skip over match files that don't exist.
-      if (!boost::filesystem::exists(match_file)) {
+      if (!asp::matchFileExists(match_db.get(), match_file)) {
         vw_out() << "Skipping non-existent match file: " << match_file << std::endl;
         continue;
       }
       // Read the original IP, to ensure later we write to disk only
       // the subset of the IP from the control network which
       // are part of these original ones. 
-      vw::ip::read_binary_match_file(match_file, orig_left_ip, orig_right_ip);
+      asp::readMatchFile(match_db.get(), match_file, orig_left_ip, orig_right_ip);
     }
 
     // Create a new convergence angle storage struct
@@ -1592,11 +1758,18 @@ void matchFilesProcessing(vw::ba::ControlNetwork       const& cnet,
     }
     
     vw_out() << "Saving " << left_ip.size() << " filtered interest points.\n";
+    if (clean_match_db) {
+      clean_match_db->write(clean_match_file, left_ip, right_ip);
+      continue;
+    }
     vw_out() << "Writing: " << clean_match_file << std::endl;
     vw::ip::write_binary_match_file(clean_match_file, left_ip, right_ip);
 
   } // End loop through the match files
 
+  if (clean_match_db)
+    clean_match_db->close();
+
   // Save the produced files  
   
   std::string conv_angles_file = opt.out_prefix + "-convergence_angles.txt";
@@ -78,7 +78,7 @@ struct BaBaseOptions: public vw::GdalWriteOptions {
     clean_match_files_prefix, heights_from_dem, reference_terrain, mapproj_dem, weight_image,
     isis_cnet, nvm, nvm_no_shift, output_cnet_type,
     image_list, camera_list, mapprojected_data_list,
-    fixed_image_list, camera_position_uncertainty_str;
+    fixed_image_list, camera_position_uncertainty_str, jacobian_method, match_db;
   int overlap_limit, min_matches, max_pairwise_matches, num_iterations,
     ip_edge_buffer_percent, max_num_reference_points, num_passes;
   std::set<std::pair<std::string, std::string>> overlap_list;
@@ -542,6 +542,12 @@ void saveMapprojOffsets(std::string                       const& out_prefix,
                         std::vector<std::vector<float>>        & mapprojOffsetsPerCam,
                         std::vector<std::string>          const& imageFiles);
 
+// Build a control network from opt.match_files. Without a match database this
+// is vw::ba::build_control_network(). Otherwise the matches in the database
+// given by opt.match_db are read from it directly.
+bool buildControlNetwork(asp::BaBaseOptions const& opt,
+                         vw::ba::ControlNetwork & cnet);
+
 // Calculate convergence angles. Remove the outliers flagged earlier,
 // if remove_outliers is true. Compute offsets of mapprojected matches,
 // if a DEM is given. These are done together as they rely on
@@ -27,6 +27,8 @@
 #include <vw/Camera/CameraUtilities.h>
 #include <vw/Cartography/GeoReferenceBaseUtils.h>
 
+#include <ceres/rotation.h>
+
 using namespace vw;
 using namespace vw::camera;
 
@@ -49,6 +51,22 @@ std::vector<int> CeresBundleModelBase::get_block_sizes() const {
   return result;
 }
 
+// The point about which AdjustedCameraModel applies its rotation. Its
+// constructor sets this to the camera center at the origin pixel.
+vw::Vector3 adjustmentRotationCenter(boost::shared_ptr<vw::camera::CameraModel> cam) {
+  return cam->camera_center(vw::Vector2());
+}
+
+AdjustedCameraBundleModel::AdjustedCameraBundleModel
+  (boost::shared_ptr<vw::camera::CameraModel> cam):
+    m_underlying_camera(cam), m_rotation_center(adjustmentRotationCenter(cam)) {}
+
+// The adjusted camera projects R^T (X - C0 - T) + C0, with C0 the rotation center
+// and T the translation.
+vw::Vector3 AdjustedCameraBundleModel::pose_center(double const* raw_pose) const {
+  return m_rotation_center + vw::Vector3(raw_pose[0], raw_pose[1], raw_pose[2]);
+}
+
 // Read in all of the parameters and compute the residuals.
 vw::Vector2 AdjustedCameraBundleModel::evaluate(
   std::vector<double const*> const param_blocks) const {
@@ -204,6 +222,14 @@ vw::Vector2  OpticalBarBundleModel::evaluate(
   return vw::Vector2(g_big_pixel_value, g_big_pixel_value);
 }
 
+// The rotation center does not depend on the intrinsics, so it is found once.
+CsmBundleModel::CsmBundleModel(boost::shared_ptr<asp::CsmModel> cam):
+  m_underlying_camera(cam), m_rotation_center(adjustmentRotationCenter(cam)) {}
+
+vw::Vector3 CsmBundleModel::pose_center(double const* raw_pose) const {
+  return m_rotation_center + vw::Vector3(raw_pose[0], raw_pose[1], raw_pose[2]);
+}
+
 std::vector<int> CsmBundleModel::get_block_sizes() const {
   std::vector<int> result = CeresBundleModelBase::get_block_sizes();
   result.push_back(asp::NUM_CENTER_PARAMS);
@@ -271,6 +297,18 @@ vw::Vector2 CsmBundleModel::evaluate(std::vector<double const*> const param_bloc
   return vw::Vector2(g_big_pixel_value, g_big_pixel_value);
 }
 
+// Count the failures to compute residuals, and print the first few
+void reportResidualError(std::exception const& e) {
+  Mutex::Lock lock(g_ba_mutex);
+  g_ba_num_errors++;
+  if (g_ba_num_errors < 100) {
+    vw_out(ErrorMessage) << e.what() << std::endl;
+  }else if (g_ba_num_errors == 100) {
+    vw_out() << "Will print no more error messages about "
+              << "failing to compute residuals.\n";
+  }
+}
+
 // Call to work with ceres::DynamicCostFunctions.
 // - Takes array of arrays.
 bool BaReprojectionError::operator()(double const * const * parameters, 
@@ -293,16 +331,7 @@ bool BaReprojectionError::operator()(double const * const * parameters,
 
   } catch (std::exception const& e) { // TODO: Catch only projection errors?
     // Failed to compute residuals
-
-    Mutex::Lock lock(g_ba_mutex);
-    g_ba_num_errors++;
-    if (g_ba_num_errors < 100) {
-      vw_out(ErrorMessage) << e.what() << std::endl;
-    }else if (g_ba_num_errors == 100) {
-      vw_out() << "Will print no more error messages about "
-                << "failing to compute residuals.\n";
-    }
-
+    reportResidualError(e);
     residuals[0] = g_big_pixel_value;
     residuals[1] = g_big_pixel_value;
     return false;
@@ -332,6 +361,151 @@ BaReprojectionError::Create(Vector2 const& observation,
   return cost_function;
 }
 
+BaReprojectionErrorAnalytic::BaReprojectionErrorAnalytic
+  (vw::Vector2 const& observation, vw::Vector2 const& pixel_sigma,
+   boost::shared_ptr<CeresBundleModelBase> camera_wrapper):
+    m_observation(observation), m_pixel_sigma(pixel_sigma),
+    m_block_sizes(camera_wrapper->get_block_sizes()),
+    m_camera_wrapper(camera_wrapper) {
+
+  if (!camera_wrapper->rigid_pose())
+    vw_throw(ArgumentErr() << "Analytic reprojection error Jacobians are not "
+             << "supported for this camera.\n");
+
+  // The residual size is always the same.
+  const int NUM_RESIDUALS = 2;
+  set_num_residuals(NUM_RESIDUALS);
+  for (size_t i = 0; i < m_block_sizes.size(); i++)
+    mutable_parameter_block_sizes()->push_back(m_block_sizes[i]);
+}
+
+// The relative step for centered differences. The same as for Ceres
+// numerical differentiation, so the results agree with BaReprojectionError.
+const double g_ba_relative_step = 1e-6;
+
+bool BaReprojectionErrorAnalytic::Evaluate(double const* const* parameters,
+                                           double* residuals,
+                                           double** jacobians) const {
+
+  size_t num_blocks = m_block_sizes.size();
+  std::vector<double const*> param_blocks(parameters, parameters + num_blocks);
+  try {
+    Vector2 prediction = m_camera_wrapper->evaluate(param_blocks);
+    residuals[0] = (prediction[0] - m_observation[0])/m_pixel_sigma[0];
+    residuals[1] = (prediction[1] - m_observation[1])/m_pixel_sigma[1];
+
+    if (jacobians == NULL)
+      return true;
+
+    // Work on a copy of the parameters, as these will be perturbed
+    std::vector<std::vector<double>> params(num_blocks);
+    for (size_t b = 0; b < num_blocks; b++) {
+      params[b].assign(parameters[b], parameters[b] + m_block_sizes[b]);
+      param_blocks[b] = &params[b][0];
+    }
+
+    // Centered differences in the point, which are needed for the pose
+    // as well, and in the intrinsics. The Jacobian of the pixel in the
+    // point is saved, before dividing by sigma.
+    int point_block = 0, pose_block = 1;
+    bool need_pose = (jacobians[pose_block] != NULL);
+    vw::Matrix<double, 2, 3> G;
+    for (size_t b = 0; b < num_blocks; b++) {
+      if (int(b) == pose_block)
+        continue;
+      bool need_block = (jacobians[b] != NULL || (int(b) == point_block && need_pose));
+      if (!need_block)
+        continue;
+
+      for (int j = 0; j < m_block_sizes[b]; j++) {
+        double x = params[b][j];
+        double h = std::abs(x) * g_ba_relative_step;
+        if (h == 0.0)
+          h = g_ba_relative_step;
+
+        params[b][j] = x + h;
+        Vector2 pix_plus = m_camera_wrapper->evaluate(param_blocks);
+        params[b][j] = x - h;
+        Vector2 pix_minus = m_camera_wrapper->evaluate(param_blocks);
+        params[b][j] = x;
+        Vector2 d = (pix_plus - pix_minus) / (2.0 * h);
+
+        if (int(b) == point_block) {
+          G(0, j) = d[0];
+          G(1, j) = d[1];
+        }
+        if (jacobians[b] != NULL) {
+          jacobians[b][j]                   = d[0] / m_pixel_sigma[0];
+          jacobians[b][m_block_sizes[b] + j] = d[1] / m_pixel_sigma[1];
+        }
+      }
+    }
+
+    if (need_pose) {
+      // The pixel is a function of p = R^T (X - C), with X the point, C the
+      // center, and R the rotation given by the axis-angle vector w. Then
+      // d pix / dX = F'(p) R^T = G, so d pix / dC = -G, and
+      // d pix / dw = F'(p) dp/dw = G R dp/dw.
+      double const* raw_pose = parameters[pose_block];
+      Vector3 X(parameters[point_block][0], parameters[point_block][1],
+                parameters[point_block][2]);
+      Vector3 v = X - m_camera_wrapper->pose_center(raw_pose);
+
+      // Find dp/dw with automatic differentiation. Use that R^T = R(-w).
+      typedef ceres::Jet<double, 3> JetT;
+      JetT minus_w[3], v_jet[3], p_jet[3];
+      for (int i = 0; i < 3; i++) {
+        minus_w[i] = JetT(-raw_pose[3 + i], i);
+        v_jet[i]   = JetT(v[i]);
+      }
+      ceres::AngleAxisRotatePoint(minus_w, v_jet, p_jet);
+      vw::Matrix3x3 dp_dw;
+      for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++)
+          dp_dw(r, c) = -p_jet[r].v[c];
+      }
+
+      vw::Matrix3x3 R = CameraAdjustment(raw_pose).pose().rotation_matrix();
+      vw::Matrix<double, 2, 3> J_rot = G * R * dp_dw;
+
+      int n = m_block_sizes[pose_block];
+      for (int r = 0; r < 2; r++) {
+        for (int c = 0; c < 3; c++) {
+          jacobians[pose_block][r * n + c]     = -G(r, c) / m_pixel_sigma[r];
+          jacobians[pose_block][r * n + 3 + c] = J_rot(r, c) / m_pixel_sigma[r];
+        }
+      }
+    }
+
+  } catch (std::exception const& e) {
+    reportResidualError(e);
+    residuals[0] = g_big_pixel_value;
+    residuals[1] = g_big_pixel_value;
+    return false;
+  }
+
+  return true;
+}
+
+ceres::CostFunction*
+BaReprojectionErrorAnalytic::Create(Vector2 const& observation,
+                                    Vector2 const& pixel_sigma,
+                                    boost::shared_ptr<CeresBundleModelBase> camera_wrapper) {
+  return new BaReprojectionErrorAnalytic(observation, pixel_sigma, camera_wrapper);
+}
+
+// Create the reprojection error cost function, with numerical or analytic Jacobian
+ceres::CostFunction* 
+reprojectionCostFunction(vw::Vector2 const& observation,
+                         vw::Vector2 const& pixel_sigma,
+                         boost::shared_ptr<CeresBundleModelBase> camera_wrapper,
+                         std::string const& jacobian_method) {
+  if (jacobian_method == "analytic" && camera_wrapper->rigid_pose())
+    return BaReprojectionErrorAnalytic::Create(observation, pixel_sigma, camera_wrapper);
+
+  return BaReprojectionError::Create(observation, pixel_sigma, camera_wrapper);
+}
+
 // Adaptor to work with ceres::DynamicCostFunctions.
 bool BaDispXyzError::operator()(double const* const* parameters, double* residuals) const {
 
@@ -569,7 +743,7 @@ void add_reprojection_residual_block(vw::Vector2 const& observation,
     // the adjustments are external and intrinsics are not solved for.
     boost::shared_ptr<CeresBundleModelBase> wrapper(new AdjustedCameraBundleModel(camera_model));
       ceres::CostFunction* cost_function =
-        BaReprojectionError::Create(observation, pixel_sigma, wrapper);
+        reprojectionCostFunction(observation, pixel_sigma, wrapper, opt.jacobian_method);
       problem.AddResidualBlock(cost_function, loss_function, point, camera);
 
   } else { // Solve for intrinsics for Pinhole, optical bar, or CSM camera
@@ -610,7 +784,7 @@ void add_reprojection_residual_block(vw::Vector2 const& observation,
     }
 
     ceres::CostFunction* cost_function =
-      BaReprojectionError::Create(observation, pixel_sigma, wrapper);
+      reprojectionCostFunction(observation, pixel_sigma, wrapper, opt.jacobian_method);
     problem.AddResidualBlock(cost_function, loss_function, point, camera, 
                             center, focus, distortion);
 
@@ -73,6 +73,16 @@ public:
   /// Read in all of the parameters and generate an output pixel observation.
   /// - Throws if the point does not project in to the camera.
   virtual vw::Vector2 evaluate(std::vector<double const*> const param_blocks) const = 0;
+
+  /// If true, the pixel depends on the point X and the pose block only via
+  /// R^T (X - C), with R the rotation in the pose block and C given by
+  /// pose_center(). Then the derivatives with respect to the pose can be
+  /// found from the ones with respect to the point.
+  virtual bool rigid_pose() const { return false; }
+
+  /// The center C from above. It must change with the position in the pose
+  /// block with unit derivative.
+  virtual vw::Vector3 pose_center(double const* raw_pose) const { return vw::Vector3(); }
   
 }; // End class CeresBundleModelBase
 
@@ -83,8 +93,7 @@ public:
 class AdjustedCameraBundleModel: public CeresBundleModelBase {
 public:
 
-  AdjustedCameraBundleModel(boost::shared_ptr<vw::camera::CameraModel> cam):
-    m_underlying_camera(cam) {}
+  AdjustedCameraBundleModel(boost::shared_ptr<vw::camera::CameraModel> cam);
 
   virtual int num_intrinsic_params() const {return 0;}
 
@@ -95,11 +104,17 @@ public:
   /// Read in all of the parameters and compute the residuals.
   virtual vw::Vector2 evaluate(std::vector<double const*> const param_blocks) const;
 
+  virtual bool rigid_pose() const { return true; }
+  virtual vw::Vector3 pose_center(double const* raw_pose) const;
+
 private:
 
   /// This camera will be adjusted by the input parameters.
   boost::shared_ptr<vw::camera::CameraModel> m_underlying_camera;
 
+  /// The point about which the adjustment rotation is applied
+  vw::Vector3 m_rotation_center;
+
 }; // End class CeresBundleModelBase
 
 /// "Full service" pinhole model which solves for all desired camera parameters.
@@ -127,6 +142,12 @@ public:
   /// Read in all of the parameters and compute the residuals.
   virtual vw::Vector2 evaluate(std::vector<double const*> const param_blocks) const;
 
+  /// The pose block has the camera center and orientation
+  virtual bool rigid_pose() const { return true; }
+  virtual vw::Vector3 pose_center(double const* raw_pose) const {
+    return vw::Vector3(raw_pose[0], raw_pose[1], raw_pose[2]);
+  }
+
 private:
 
   // TODO: Cache the constructed camera to save time when just the point changes!
@@ -156,6 +177,13 @@ public:
 
   /// Read in all of the parameters and compute the residuals.
   virtual vw::Vector2 evaluate(std::vector<double const*> const param_blocks) const;
+
+  /// The pose block has the camera center and orientation. The motion
+  /// during the scan is along a direction fixed in the camera frame.
+  virtual bool rigid_pose() const { return true; }
+  virtual vw::Vector3 pose_center(double const* raw_pose) const {
+    return vw::Vector3(raw_pose[0], raw_pose[1], raw_pose[2]);
+  }
   
 private:
 
@@ -173,8 +201,7 @@ private:
 class CsmBundleModel: public CeresBundleModelBase {
 public:
 
-  CsmBundleModel(boost::shared_ptr<asp::CsmModel> cam):
-   m_underlying_camera(cam) {}
+  CsmBundleModel(boost::shared_ptr<asp::CsmModel> cam);
 
   /// The number of lens distortion parameters.
   int num_dist_params() const {
@@ -194,6 +221,10 @@ public:
 
   /// Read in all of the parameters and compute the residuals.
   virtual vw::Vector2 evaluate(std::vector<double const*> const param_blocks) const;
+
+  /// The pose block adjusts the camera, as for AdjustedCameraBundleModel
+  virtual bool rigid_pose() const { return true; }
+  virtual vw::Vector3 pose_center(double const* raw_pose) const;
   
 private:
 
@@ -203,6 +234,9 @@ private:
   /// This camera is used for all of the intrinsic values.
   boost::shared_ptr<asp::CsmModel> m_underlying_camera;
 
+  /// The point about which the adjustment rotation is applied
+  vw::Vector3 m_rotation_center;
+
 }; // End class CsmBundleModel
 
 //=========================================================================
@@ -237,6 +271,42 @@ private:
 
 }; // End class BaReprojectionError
 
+/// The same residual as BaReprojectionError, with the Jacobian found
+/// without differencing the camera in each parameter. The derivatives
+/// in the point are found with centered differences. The derivatives in
+/// the pose follow from those by the chain rule, with no more projections.
+/// The intrinsics, if floated, are differenced as before. Needs a camera
+/// wrapper with rigid_pose() true.
+class BaReprojectionErrorAnalytic: public ceres::CostFunction {
+public:
+  BaReprojectionErrorAnalytic(vw::Vector2 const& observation, vw::Vector2 const& pixel_sigma,
+                              boost::shared_ptr<CeresBundleModelBase> camera_wrapper);
+
+  virtual bool Evaluate(double const* const* parameters, double* residuals,
+                        double** jacobians) const;
+
+  // Factory to hide the construction of the CostFunction object from the client code.
+  static ceres::CostFunction* Create(vw::Vector2 const& observation,
+                                     vw::Vector2 const& pixel_sigma,
+                                     boost::shared_ptr<CeresBundleModelBase> camera_wrapper);
+
+private:
+  vw::Vector2 m_observation; ///< The pixel observation for this camera/point pair.
+  vw::Vector2 m_pixel_sigma;
+  std::vector<int> m_block_sizes;
+  boost::shared_ptr<CeresBundleModelBase> m_camera_wrapper; ///< Pointer to the camera model object.
+
+}; // End class BaReprojectionErrorAnalytic
+
+/// Create the reprojection error cost function. With jacobian_method set to
+/// "analytic", and if the camera wrapper supports it, use
+/// BaReprojectionErrorAnalytic, else BaReprojectionError.
+ceres::CostFunction* 
+reprojectionCostFunction(vw::Vector2 const& observation,
+                         vw::Vector2 const& pixel_sigma,
+                         boost::shared_ptr<CeresBundleModelBase> camera_wrapper,
+                         std::string const& jacobian_method);
+
 /// A ceres cost function. Here we float two pinhole camera's
 /// intrinsic and extrinsic parameters. We take as input a reference
 /// xyz point and a disparity from left to right image. The
@@ -61,6 +61,7 @@ void BaOptions::copy_to_asp_settings() const {
   asp::stereo_settings().ip_debug_images            = ip_debug_images;
   asp::stereo_settings().ip_normalize_tiles         = ip_normalize_tiles;
   asp::stereo_settings().flann_method               = flann_method;
+  asp::stereo_settings().epipolar_band_matching     = epipolar_band_matching;
   asp::stereo_settings().propagate_errors           = propagate_errors;
   asp::stereo_settings().ip_nodata_radius           = ip_nodata_radius;
   
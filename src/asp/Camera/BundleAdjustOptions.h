@@ -39,7 +39,8 @@ struct BaOptions: public asp::BaBaseOptions {
     fix_gcp_xyz, solve_intrinsics, 
     ip_normalize_tiles, ip_debug_images, stop_after_stats, 
     calc_normalization_bounds, calc_ip, stop_after_matching,
-    skip_matching, apply_initial_transform_only, save_vwip;
+    skip_matching, apply_initial_transform_only, save_vwip, warm_start_passes,
+    epipolar_band_matching;
   std::string camera_position_file, initial_transform_file, dem_file_for_overlap;
   double semi_major, semi_minor, position_filter_dist;
   std::string remove_outliers_params_str;
@@ -72,7 +73,8 @@ struct BaOptions: public asp::BaBaseOptions {
              pct_for_overlap(-1), skip_rough_homography(false),
              individually_normalize(false), use_llh_error(false), 
              force_reuse_match_files(false), no_poses_from_nvm(false),
-             save_cnet_as_csv(false), aster_use_csm(false), query_num_image_pairs(false) {}
+             save_cnet_as_csv(false), aster_use_csm(false), query_num_image_pairs(false),
+             warm_start_passes(false), epipolar_band_matching(false) {}
 
   /// Bundle adjustment settings that must be passed to the asp settings
   void copy_to_asp_settings() const;
@@ -35,7 +35,9 @@ using namespace vw::ba;
 namespace  asp {
 
 // Compute the bundle_adjust residuals. Multiply the pixel residuals
-// by their sigmas, to get back the pixel reprojection errors.
+// by their sigmas, to get back the pixel reprojection errors. If residual
+// blocks were removed from the problem, Ceres reorders the remaining ones,
+// so then the blocks must be passed in, in the order they were added.
 void compute_residuals(asp::BaBaseOptions const& opt,
                        asp::CRNJ const& crn,
                        asp::BAParams const& param_storage,
@@ -48,7 +50,8 @@ void compute_residuals(asp::BaBaseOptions const& opt,
                        std::vector<vw::Vector3> const& reference_vec,
                        ceres::Problem & problem,
                        // Output
-                       std::vector<double> & residuals) {
+                       std::vector<double> & residuals,
+                       std::vector<ceres::ResidualBlockId> const* residual_blocks) {
 
   double cost = 0.0;
   ceres::Problem::EvaluateOptions eval_options;
@@ -58,6 +61,8 @@ void compute_residuals(asp::BaBaseOptions const& opt,
     eval_options.num_threads = 1; // ISIS must be single threaded!
   else
     eval_options.num_threads = opt.num_threads;
+  if (residual_blocks != NULL)
+    eval_options.residual_blocks = *residual_blocks;
 
   problem.Evaluate(eval_options, &cost, &residuals, 0, 0);
   const size_t num_residuals = residuals.size();
@@ -311,7 +316,8 @@ void write_residual_logs(std::string const& residual_prefix,
                          std::vector<vw::Vector3> const& reference_vec,
                          vw::ba::ControlNetwork const& cnet, 
                          asp::CRNJ const& crn, 
-                         ceres::Problem &problem) {
+                         ceres::Problem &problem,
+                         std::vector<ceres::ResidualBlockId> const* residual_blocks) {
 
   std::vector<double> residuals;
   asp::compute_residuals(opt, crn, param_storage,
@@ -321,7 +327,7 @@ void write_residual_logs(std::string const& residual_prefix,
                     num_tri_residuals, num_cam_position_residuals,
                     reference_vec, problem,
                     // Output
-                    residuals);
+                    residuals, residual_blocks);
     
   const size_t num_residuals = residuals.size();
 
@@ -686,7 +692,8 @@ void saveCameraOffsets(vw::cartography::Datum                const& datum,
 void compute_residuals(asp::BaBaseOptions const& opt,
                        ceres::Problem & problem,
                        // Output
-                       std::vector<double> & residuals) {
+                       std::vector<double> & residuals,
+                       std::vector<ceres::ResidualBlockId> const* residual_blocks) {
 
   double cost = 0.0;
   ceres::Problem::EvaluateOptions eval_options;
@@ -44,7 +44,9 @@ void compute_residuals(asp::BaBaseOptions const& opt,
                        std::vector<vw::Vector3> const& reference_vec,
                        ceres::Problem & problem,
                        // Output
-                       std::vector<double> & residuals);
+                       std::vector<double> & residuals,
+                       // If not null, evaluate these blocks, in this order
+                       std::vector<ceres::ResidualBlockId> const* residual_blocks = NULL);
 
 /// Compute residual map by averaging all the reprojection error at a given point
 void compute_mean_residuals_at_xyz(asp::CRNJ const& crn,
@@ -78,7 +80,8 @@ void write_residual_logs(std::string const& residual_prefix,
                          std::vector<vw::Vector3> const& reference_vec,
                          vw::ba::ControlNetwork const& cnet, 
                          asp::CRNJ const& crn, 
-                         ceres::Problem &problem);
+                         ceres::Problem &problem,
+                         std::vector<ceres::ResidualBlockId> const* residual_blocks = NULL);
 
 // Find and save the offsets between initial and final triangulated points
 void saveTriOffsetsPerCamera(std::vector<std::string> const& image_files,
@@ -48,6 +48,7 @@
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
 
+#include <algorithm>
 #include <streambuf>
 
 namespace dll = boost::dll;
@@ -710,6 +711,157 @@ Vector3 CsmModel::camera_center(Vector2 const& pix) const {
   return ecefCoordToVector(ecef);
 }
 
+// The look direction of a linescan pixel in the sensor frame. This follows
+// UsgsAstroLsSensorModel::losToEcf(), with no parameter adjustments, as used
+// by imageToRemoteImagingLocus().
+void lsCameraLook(UsgsAstroLsSensorModel const* ls_model,
+                  csm::ImageCoord const& imagePt, double cameraLook[3]) {
+
+  double fractionalLine = imagePt.line - floor(imagePt.line);
+  double distortedX = 0.0, distortedY = 0.0;
+  computeDistortedFocalPlaneCoordinates(fractionalLine, imagePt.samp,
+                                        ls_model->m_detectorSampleOrigin,
+                                        ls_model->m_detectorLineOrigin,
+                                        ls_model->m_detectorSampleSumming,
+                                        ls_model->m_detectorLineSumming,
+                                        ls_model->m_startingDetectorSample,
+                                        ls_model->m_startingDetectorLine,
+                                        ls_model->m_iTransS, ls_model->m_iTransL,
+                                        distortedX, distortedY);
+
+  double undistortedX = 0.0, undistortedY = 0.0;
+  removeDistortion(distortedX, distortedY, undistortedX, undistortedY,
+                   ls_model->m_opticalDistCoeffs, ls_model->m_focalLength,
+                   ls_model->m_distortionType);
+
+  createCameraLookVector(undistortedX, undistortedY, ls_model->m_zDirection,
+                         ls_model->m_focalLength, cameraLook);
+}
+
+// Find the rays for linescan pixels. The sensor position and orientation are
+// interpolated once per distinct pixel time, as all pixels on an image line
+// share it, and only the look direction in the sensor frame is found per
+// pixel.
+//
+// Of what UsgsAstroLsSensorModel::imageToRemoteImagingLocus() does, this
+// reproduces the pixel to focal plane conversion, the removal of lens
+// distortion, the look vector in the sensor frame, the interpolation of the
+// quaternions, and the interpolation of the positions. Parameter adjustments
+// are not needed, as that function uses none. Not reproduced are any further
+// corrections in getAdjSensorPosVel() and losToEcf(), such as for light
+// aberration in some usgscsm versions.
+//
+// Hence the result is checked against the CSM model at several pixels spread
+// over the times in the batch, including the earliest and latest. If they
+// disagree anywhere, return false, and then the CSM model must be used per
+// pixel.
+bool lsPixelsToRays(UsgsAstroLsSensorModel const* ls_model, double desired_precision,
+                    std::vector<Vector2> const& pixels,
+                    std::vector<Vector3> & ctrs,
+                    std::vector<Vector3> & dirs) {
+
+  // Find the pixel times, and sort the pixels by time
+  int num_pix = pixels.size();
+  std::vector<double> times(num_pix, 0.0);
+  std::vector<int> order;
+  csm::ImageCoord imagePt;
+  for (int it = 0; it < num_pix; it++) {
+    if (pixels[it] != pixels[it]) // NaN
+      continue;
+    toCsmPixel(pixels[it], imagePt);
+    times[it] = ls_model->getImageTime(imagePt);
+    order.push_back(it);
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&times](int a, int b) { return times[a] < times[b]; });
+
+  bool have_pose = false;
+  double pose_time = 0.0, cam2body[9];
+  Vector3 ctr;
+  for (size_t k = 0; k < order.size(); k++) {
+    int it = order[k];
+    if (!have_pose || times[it] != pose_time) {
+      double pos[3], q[4];
+      interpPositions(ls_model, times[it], pos);
+      interpQuaternions(ls_model, times[it], q);
+      calculateRotationMatrixFromQuaternions(q, cam2body);
+      ctr = Vector3(pos[0], pos[1], pos[2]);
+      pose_time = times[it];
+      have_pose = true;
+    }
+
+    toCsmPixel(pixels[it], imagePt);
+    double look[3];
+    lsCameraLook(ls_model, imagePt, look);
+    Vector3 dir;
+    for (int row = 0; row < 3; row++)
+      dir[row] = cam2body[3 * row + 0] * look[0] + cam2body[3 * row + 1] * look[1]
+               + cam2body[3 * row + 2] * look[2];
+    ctrs[it] = ctr;
+    dirs[it] = dir;
+  }
+
+  if (order.empty())
+    return true;
+
+  int num_checks = std::min(5, int(order.size()));
+  for (int c = 0; c < num_checks; c++) {
+    int k = (num_checks == 1) ? 0 : c * (int(order.size()) - 1) / (num_checks - 1);
+    int it = order[k];
+    toCsmPixel(pixels[it], imagePt);
+    double achievedPrecision = -1.0;
+    csm::EcefLocus locus = ls_model->imageToRemoteImagingLocus(imagePt, desired_precision,
+                                                               &achievedPrecision);
+    if (norm_2(ecefCoordToVector(locus.point) - ctrs[it]) >= 1e-6 ||
+        norm_2(ecefVectorToVector(locus.direction) - dirs[it]) >= 1e-10)
+      return false;
+  }
+
+  return true;
+}
+
+void CsmModel::pixels_to_rays(std::vector<Vector2> const& pixels,
+                              std::vector<Vector3> & ctrs,
+                              std::vector<Vector3> & dirs) const {
+  throw_if_not_init();
+
+  int num_pix = pixels.size();
+  ctrs.assign(num_pix, Vector3());
+  dirs.assign(num_pix, Vector3());
+
+  UsgsAstroLsSensorModel const* ls_model
+    = dynamic_cast<UsgsAstroLsSensorModel const*>(m_gm_model.get());
+  if (ls_model != NULL) {
+    try {
+      if (lsPixelsToRays(ls_model, m_desired_precision, pixels, ctrs, dirs))
+        return;
+    } catch (...) {}
+    ctrs.assign(num_pix, Vector3());
+    dirs.assign(num_pix, Vector3());
+  }
+
+  // The CSM model per pixel. The locus starts at the camera center.
+  csm::ImageCoord imagePt;
+  for (int it = 0; it < num_pix; it++) {
+    Vector2 const& pix = pixels[it];
+    if (pix != pix) // NaN
+      continue;
+
+    toCsmPixel(pix, imagePt);
+    try {
+      double achievedPrecision = -1.0; // will be modified in the function
+      csm::EcefLocus locus = m_gm_model->imageToRemoteImagingLocus(imagePt,
+                                                                   m_desired_precision,
+                                                                   &achievedPrecision);
+      ctrs[it] = ecefCoordToVector(locus.point);
+      dirs[it] = ecefVectorToVector(locus.direction);
+    } catch (...) {
+      ctrs[it] = Vector3();
+      dirs[it] = Vector3();
+    }
+  }
+}
+
 // Apply a transform to the model state in json format
 template<class ModelT>
 void applyTransformToState(ModelT const * model,
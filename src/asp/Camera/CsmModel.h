@@ -78,6 +78,16 @@ namespace asp {
 
     virtual vw::Vector3 camera_center(vw::Vector2 const& pix) const;
 
+    /// Find the camera centers and ray directions for a batch of pixels, such
+    /// as a row of an image. For linescan cameras, the sensor position and
+    /// orientation are interpolated once for all pixels on the same image
+    /// line. Then the rays are checked against the CSM model at several
+    /// pixels, and found one pixel at a time if they disagree. The outputs
+    /// are the zero vector for NaN pixels, or where the ray cannot be found.
+    void pixels_to_rays(std::vector<vw::Vector2> const& pixels,
+                        std::vector<vw::Vector3> & ctrs,
+                        std::vector<vw::Vector3> & dirs) const;
+
     virtual vw::Quaternion<double> camera_pose(vw::Vector2 const& pix) const {
       vw_throw(vw::NoImplErr() << "CsmModel: Cannot retrieve camera_pose!");
       return vw::Quaternion<double>();
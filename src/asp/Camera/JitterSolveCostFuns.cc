@@ -40,6 +40,8 @@
 #include <vw/Image/Interpolation.h>
 #include <vw/Cartography/Map2CamTrans.h>
 
+#include <usgscsm/Utilities.h>
+
 #include <algorithm>
 #include <iostream>
 #include <iterator>
@@ -101,6 +103,57 @@ private:
   int m_begPosIndex, m_endPosIndex;
 }; // End class LsPixelReprojErr
 
+// The same error as LsPixelReprojErr, with the Jacobian found without
+// differencing the camera in each parameter. The pixel depends on the
+// position and quaternion samples only via their Lagrange interpolation at
+// the time of the pixel. Shifting all samples by the same amount shifts the
+// interpolated value by that amount, as the weights add up to 1. That gives
+// the derivatives with respect to the interpolated position and quaternion.
+// The derivative with respect to a sample is that times its weight, so it is
+// zero for samples outside the interpolation window. This takes 21
+// projections into the camera, rather than two per parameter.
+class LsPixelReprojErrAnalytic: public ceres::CostFunction {
+public:
+  LsPixelReprojErrAnalytic(vw::Vector2 const& observation, double weight,
+                           UsgsAstroLsSensorModel* ls_model,
+                           int begQuatIndex, int endQuatIndex, 
+                           int begPosIndex, int endPosIndex):
+    m_observation(observation), m_weight(weight),
+    m_begQuatIndex(begQuatIndex), m_endQuatIndex(endQuatIndex),
+    m_begPosIndex(begPosIndex),   m_endPosIndex(endPosIndex),
+    m_ls_model(ls_model) {
+
+    // The same parameter blocks as for LsPixelReprojErr
+    set_num_residuals(PIXEL_SIZE);
+    for (int it = begQuatIndex; it < endQuatIndex; it++)
+      mutable_parameter_block_sizes()->push_back(NUM_QUAT_PARAMS);
+    for (int it = begPosIndex; it < endPosIndex; it++)
+      mutable_parameter_block_sizes()->push_back(NUM_XYZ_PARAMS);
+    mutable_parameter_block_sizes()->push_back(NUM_XYZ_PARAMS);
+  }
+
+  // The implementation is further down
+  virtual bool Evaluate(double const* const* parameters, double* residuals,
+                        double** jacobians) const;
+
+  // Factory to hide the construction of the CostFunction object from the client code.
+  static ceres::CostFunction* Create(vw::Vector2 const& observation, double weight,
+                                     UsgsAstroLsSensorModel* ls_model,
+                                     int begQuatIndex, int endQuatIndex,
+                                     int begPosIndex, int endPosIndex) {
+    return new LsPixelReprojErrAnalytic(observation, weight, ls_model,
+                                        begQuatIndex, endQuatIndex,
+                                        begPosIndex, endPosIndex);
+  }
+
+private:
+  vw::Vector2 m_observation; // The pixel observation for this camera/point pair
+  double m_weight;
+  UsgsAstroLsSensorModel* m_ls_model;
+  int m_begQuatIndex, m_endQuatIndex;
+  int m_begPosIndex, m_endPosIndex;
+}; // End class LsPixelReprojErrAnalytic
+
 // An error function minimizing the error of projecting an xyz point
 // into a given CSM Frame camera pixel. The variables of optimization are 
 // the camera position, quaternion, and triangulation point.
@@ -214,6 +267,172 @@ bool LsPixelReprojErr::operator()(double const * const * parameters,
   return true;
 }
 
+// Project a point into the linescan camera, with the pixel in ASP conventions
+vw::Vector2 lsProject(UsgsAstroLsSensorModel const& cam, csm::EcefCoord const& P) {
+  // Do not use here anything lower than 1e-8, as the linescan model will then
+  // return junk.
+  double desired_precision = asp::DEFAULT_CSM_DESIRED_PRECISION;
+  csm::ImageCoord imagePt = cam.groundToImage(P, desired_precision);
+  vw::Vector2 pix;
+  asp::fromCsmPixel(pix, imagePt);
+  return pix;
+}
+
+// Find the derivatives of the pixel with respect to the given coordinate
+// of the samples in the range [beg, end), when all of those are shifted by the
+// same amount. The samples are restored when done.
+vw::Vector2 lsSampleShiftDerivative(UsgsAstroLsSensorModel & cam,
+                                    std::vector<double> & samples,
+                                    int vectorLength, int coord, int beg, int end,
+                                    csm::EcefCoord const& P) {
+
+  // Same step as Ceres uses for numerical differentiation
+  double h = 0.0;
+  for (int it = beg; it < end; it++)
+    h = std::max(h, 1e-6 * std::abs(samples[it * vectorLength + coord]));
+  if (h == 0.0)
+    h = 1e-6;
+
+  std::vector<double> orig(end - beg);
+  for (int it = beg; it < end; it++)
+    orig[it - beg] = samples[it * vectorLength + coord];
+
+  for (int it = beg; it < end; it++)
+    samples[it * vectorLength + coord] = orig[it - beg] + h;
+  vw::Vector2 pix_plus = lsProject(cam, P);
+  for (int it = beg; it < end; it++)
+    samples[it * vectorLength + coord] = orig[it - beg] - h;
+  vw::Vector2 pix_minus = lsProject(cam, P);
+  for (int it = beg; it < end; it++)
+    samples[it * vectorLength + coord] = orig[it - beg];
+
+  return (pix_plus - pix_minus) / (2.0 * h);
+}
+
+// Fill in the Jacobians for the samples in [begIndex, endIndex) which are
+// parameter blocks starting at block blockShift. The Jacobian for each is
+// the weight of the sample times the derivative for the shift of all samples.
+void lsSampleJacobians(UsgsAstroLsSensorModel & cam, std::vector<double> & samples,
+                       int vectorLength, double t0, double dt, double time, int order,
+                       int begIndex, int endIndex, int blockShift,
+                       csm::EcefCoord const& P, double weight, double** jacobians) {
+
+  bool need_jac = false;
+  for (int it = begIndex; it < endIndex; it++)
+    need_jac = need_jac || (jacobians[it - begIndex + blockShift] != NULL);
+  if (!need_jac)
+    return;
+
+  int numTimes = samples.size() / vectorLength;
+  int wBeg = 0;
+  std::vector<double> wts;
+  calcLagrangeWeights(numTimes, t0, dt, time, order, wBeg, wts);
+  int wEnd = wBeg + wts.size();
+
+  // Shift both the samples in the interpolation window and the ones being
+  // optimized, so that the shift is uniform even if the time moves a bit.
+  int shiftBeg = std::min(wBeg, begIndex), shiftEnd = std::max(wEnd, endIndex);
+  for (int coord = 0; coord < vectorLength; coord++) {
+    vw::Vector2 d = lsSampleShiftDerivative(cam, samples, vectorLength, coord,
+                                            shiftBeg, shiftEnd, P);
+    for (int it = std::max(begIndex, wBeg); it < std::min(endIndex, wEnd); it++) {
+      double* jac = jacobians[it - begIndex + blockShift];
+      if (jac == NULL)
+        continue;
+      double w = weight * wts[it - wBeg];
+      jac[coord]                = w * d[0];
+      jac[vectorLength + coord] = w * d[1];
+    }
+  }
+}
+
+// See the documentation higher up in the file.
+bool LsPixelReprojErrAnalytic::Evaluate(double const* const* parameters,
+                                        double* residuals,
+                                        double** jacobians) const {
+
+  int numQuatBlocks = m_endQuatIndex - m_begQuatIndex;
+  int numPosBlocks  = m_endPosIndex - m_begPosIndex;
+  int numBlocks     = numQuatBlocks + numPosBlocks + 1;
+  
+  try {
+    // Make a copy of the model, as we will update quaternion and position
+    // values that are being modified now. This is done once per evaluation.
+    UsgsAstroLsSensorModel cam = *m_ls_model;
+    int shift = 0;
+    csm::EcefCoord P;
+    updateLsModelTriPt(parameters, m_begQuatIndex, m_endQuatIndex,
+                       m_begPosIndex, m_endPosIndex, shift, cam, P);
+
+    vw::Vector2 pix = lsProject(cam, P);
+    residuals[0] = m_weight*(pix[0] - m_observation[0]);
+    residuals[1] = m_weight*(pix[1] - m_observation[1]);
+
+    if (jacobians == NULL)
+      return true;
+
+    // Most entries are zero
+    for (int b = 0; b < numBlocks; b++) {
+      if (jacobians[b] != NULL)
+        std::fill(jacobians[b], jacobians[b] + PIXEL_SIZE * parameter_block_sizes()[b], 0.0);
+    }
+    
+    // The time at which to interpolate
+    csm::ImageCoord imagePt;
+    asp::toCsmPixel(pix, imagePt);
+    double time = cam.getImageTime(imagePt);
+
+    // The interpolation orders, as in interpQuaternions() and interpPositions()
+    int nOrder = 8;
+    if (cam.m_platformFlag == 0)
+      nOrder = 4;
+    int nOrderQuat = nOrder;
+    if (cam.m_numQuaternions/4 < 6 && nOrder == 8)
+      nOrderQuat = 4;
+
+    lsSampleJacobians(cam, cam.m_quaternions, NUM_QUAT_PARAMS, cam.m_t0Quat, cam.m_dtQuat,
+                      time, nOrderQuat, m_begQuatIndex, m_endQuatIndex, 0,
+                      P, m_weight, jacobians);
+    lsSampleJacobians(cam, cam.m_positions, NUM_XYZ_PARAMS, cam.m_t0Ephem, cam.m_dtEphem,
+                      time, nOrder, m_begPosIndex, m_endPosIndex, numQuatBlocks,
+                      P, m_weight, jacobians);
+
+    // Centered differences for the triangulated point
+    double* jac = jacobians[numBlocks - 1];
+    if (jac != NULL) {
+      double xyz[3] = {P.x, P.y, P.z};
+      for (int coord = 0; coord < NUM_XYZ_PARAMS; coord++) {
+        double h = std::max(1e-6 * std::abs(xyz[coord]), 1e-6);
+        double xyz_plus[3] = {xyz[0], xyz[1], xyz[2]};
+        double xyz_minus[3] = {xyz[0], xyz[1], xyz[2]};
+        xyz_plus[coord] += h;
+        xyz_minus[coord] -= h;
+        vw::Vector2 d = (lsProject(cam, csm::EcefCoord(xyz_plus[0], xyz_plus[1], xyz_plus[2]))
+                         - lsProject(cam, csm::EcefCoord(xyz_minus[0], xyz_minus[1],
+                                                         xyz_minus[2]))) / (2.0 * h);
+        jac[coord]                  = m_weight * d[0];
+        jac[NUM_XYZ_PARAMS + coord] = m_weight * d[1];
+      }
+    }
+
+  } catch (std::exception const& e) {
+    residuals[0] = g_big_pixel_value;
+    residuals[1] = g_big_pixel_value;
+    // The residuals do not change with the parameters, so the Jacobians are zero.
+    // They may have been partially filled in before the failure.
+    if (jacobians != NULL) {
+      for (int b = 0; b < numBlocks; b++) {
+        if (jacobians[b] != NULL)
+          std::fill(jacobians[b], jacobians[b] + PIXEL_SIZE * parameter_block_sizes()[b],
+                    0.0);
+      }
+    }
+    return true; // accept the solution anyway
+  }
+
+  return true;
+}
+
 // See the .h file for the documentation.
 bool FramePixelReprojErr::operator()(double const * const * parameters, 
                                      double * residuals) const {
@@ -448,6 +667,30 @@ void calcIndexBounds(double time1, double time2, double t0, double dt, int numVa
   return;
 }
 
+// Find the weights with which the samples enter the Lagrange interpolation at
+// the given time. Apply lagrangeInterp() to the rows of an identity matrix, one
+// per sample. The range of samples extends beyond the interpolation window on
+// each side, unless clipped by the ends of the sequence, so the window is the
+// same as for the full sequence.
+void calcLagrangeWeights(int numTimes, double t0, double dt, double time, int order,
+                         // Outputs
+                         int & beg, std::vector<double> & weights) {
+
+  int margin = 8; // no less than the largest interpolation order
+  int index = static_cast<int>(floor((time - t0) / dt));
+  index = std::max(0, std::min(index, numTimes - 1));
+  beg = std::max(0, index - margin);
+  int end = std::min(numTimes, index + margin + 1);
+  int num = end - beg;
+
+  std::vector<double> identity(num * num, 0.0);
+  for (int k = 0; k < num; k++)
+    identity[k * num + k] = 1.0;
+
+  weights.resize(num);
+  lagrangeInterp(num, &identity[0], t0 + beg * dt, dt, time, num, order, &weights[0]);
+}
+
 // Find the positions and orientations in the current linescan model
 // that can affect the given pixel.
 void calcPosQuatIndexBounds(double line_extra,
@@ -483,6 +726,22 @@ void calcPosQuatIndexBounds(double line_extra,
   return;
 }
    
+// See the .h file for the documentation.
+ceres::CostFunction* createLsReprojErr(std::string const& jacobian_method,
+                                       vw::Vector2 const& observation, double weight,
+                                       UsgsAstroLsSensorModel* ls_model,
+                                       int begQuatIndex, int endQuatIndex,
+                                       int begPosIndex, int endPosIndex) {
+  if (jacobian_method == "analytic")
+    return LsPixelReprojErrAnalytic::Create(observation, weight, ls_model,
+                                            begQuatIndex, endQuatIndex,
+                                            begPosIndex, endPosIndex);
+  
+  return LsPixelReprojErr::Create(observation, weight, ls_model,
+                                  begQuatIndex, endQuatIndex,
+                                  begPosIndex, endPosIndex);
+}
+
 // Add the linescan model reprojection error to the cost function
 void addLsReprojectionErr(asp::BaBaseOptions  const& opt,
                           UsgsAstroLsSensorModel   * ls_model,
@@ -500,10 +759,9 @@ void addLsReprojectionErr(asp::BaBaseOptions  const& opt,
   calcPosQuatIndexBounds(line_extra, ls_model, observation, 
                          begPosIndex, endPosIndex, begQuatIndex, endQuatIndex); // outputs
   
-  ceres::CostFunction* pixel_cost_function =
-    LsPixelReprojErr::Create(observation, weight, ls_model,
-                             begQuatIndex, endQuatIndex,
-                             begPosIndex, endPosIndex);
+  ceres::CostFunction* pixel_cost_function 
+    = createLsReprojErr(opt.jacobian_method, observation, weight, ls_model,
+                        begQuatIndex, endQuatIndex, begPosIndex, endPosIndex);
   ceres::LossFunction* pixel_loss_function = new ceres::CauchyLoss(opt.robust_threshold);
 
   // The variable of optimization are camera quaternions and positions stored in the
@@ -56,6 +56,13 @@ void calcIndexBounds(double time1, double time2, double t0, double dt, int numVa
                      // Outputs
                      int & begIndex, int & endIndex);
 
+// Find the weights with which the samples at indices beg, ..., beg +
+// weights.size() - 1 enter the Lagrange interpolation at the given time, as
+// done by lagrangeInterp() in usgscsm. Other samples have zero weight.
+void calcLagrangeWeights(int numTimes, double t0, double dt, double time, int order,
+                         // Outputs
+                         int & beg, std::vector<double> & weights);
+
 // Update the linescan model with the latest optimized values of the position
 // and quaternion parameters. Also update the triangulated point.
 void updateLsModelTriPt(double const * const * parameters, 
@@ -65,6 +72,16 @@ void updateLsModelTriPt(double const * const * parameters,
                         UsgsAstroLsSensorModel & cam,
                         csm::EcefCoord & P);
 
+// Create the reprojection error for a linescan camera, with the Jacobian found
+// numerically, or analytically if jacobian_method is "analytic". The
+// parameter blocks are the quaternions and positions in the given ranges,
+// followed by the triangulated point.
+ceres::CostFunction* createLsReprojErr(std::string const& jacobian_method,
+                                       vw::Vector2 const& observation, double weight,
+                                       UsgsAstroLsSensorModel* ls_model,
+                                       int begQuatIndex, int endQuatIndex,
+                                       int begPosIndex, int endPosIndex);
+
 // Add reprojection errors. Collect data that will be used to add camera
 // constraints that scale with the number of reprojection errors and GSD.
 void addReprojCamErrs(asp::BaBaseOptions                    const & opt,
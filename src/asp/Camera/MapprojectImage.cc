@@ -21,6 +21,7 @@
 // It is best to avoid adding more code here.
 
 #include <asp/Camera/MapprojectImage.h>
+#include <asp/Camera/RpcMap2CamTrans.h>
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/Common.h>
 
@@ -287,8 +288,9 @@ void project_image_alpha(asp::MapprojOptions & opt,
 
 }
 
-// The two "pick" functions below select between the Map2CamTrans and Datum2CamTrans
-// transform classes which will be passed to the image projection function.
+// The two "pick" functions below select between the Map2CamTrans, Datum2CamTrans,
+// and RpcMap2CamTrans transform classes which will be passed to the image
+// projection function.
 // - TODO: Is there a good reason for the transform classes to be CRTP instead of virtual?
 
 template <class ImagePixelT>
@@ -301,7 +303,16 @@ void project_image_nodata_pick_transform(asp::MapprojOptions & opt,
                           BBox2i       const& croppedImageBB,
                           boost::shared_ptr<camera::CameraModel> const& camera_model) {
   const bool        call_from_mapproject = true;
-  if (fs::path(opt.dem_file).extension() != "") {
+  bool use_dem = (fs::path(opt.dem_file).extension() != "");
+  if (RpcMap2CamTrans::is_supported(camera_model.get())) {
+    // Project all ground points in a tile into an RPC camera at once
+    return project_image_nodata<ImagePixelT>(opt, croppedGeoRef,
+                                             virtual_image_size, croppedImageBB,
+                                             RpcMap2CamTrans(camera_model.get(), target_georef,
+                                                             dem_georef,
+                                                             use_dem ? opt.dem_file : "",
+                                                             opt.datum_offset));
+  } else if (use_dem) {
     // A DEM file was provided
     return project_image_nodata<ImagePixelT>(opt, croppedGeoRef,
                                              virtual_image_size, croppedImageBB,
@@ -337,7 +348,16 @@ void project_image_alpha_pick_transform(asp::MapprojOptions & opt,
                                         camera_model) {
   
   const bool call_from_mapproject = true;
-  if (fs::path(opt.dem_file).extension() != "") {
+  bool use_dem = (fs::path(opt.dem_file).extension() != "");
+  if (RpcMap2CamTrans::is_supported(camera_model.get())) {
+    // Project all ground points in a tile into an RPC camera at once
+    return project_image_alpha<ImagePixelT>(opt, croppedGeoRef,
+                                            virtual_image_size, croppedImageBB, camera_model,
+                                            RpcMap2CamTrans(camera_model.get(), target_georef,
+                                                            dem_georef,
+                                                            use_dem ? opt.dem_file : "",
+                                                            opt.datum_offset));
+  } else if (use_dem) {
     // A DEM file was provided
     return project_image_alpha<ImagePixelT>(opt, croppedGeoRef,
                                             virtual_image_size, croppedImageBB, camera_model, 
@@ -495,6 +495,150 @@ RPCModel::geodetic_to_pixel_numerical_Jacobian(Vector3 const& geodetic,
   return J;
 }
 
+namespace {
+
+// The number of points for which the RPC polynomials are evaluated together.
+// The loops over the points in a block have no dependencies between
+// iterations, so the compiler can vectorize them.
+const int RPC_BLOCK_SIZE = 8;
+
+// Evaluate the normalized pixel for up to RPC_BLOCK_SIZE normalized
+// lon-lat-height values, given as separate arrays. If jac is not NULL, also
+// find the Jacobian of the normalized pixel in respect to the normalized
+// lon-lat, as in normalizedLlhToPixJac(), with 4 values per point.
+void rpcBlockEval(double const coeffs[4][20], int n,
+                  double const* x, double const* y, double const* z,
+                  double * samp, double * line, double * jac) {
+
+  double t[20][RPC_BLOCK_SIZE];
+  for (int k = 0; k < n; k++) {
+    t[ 0][k] = 1.0;
+    t[ 1][k] = x[k];
+    t[ 2][k] = y[k];
+    t[ 3][k] = z[k];
+    t[ 4][k] = x[k]*y[k];
+    t[ 5][k] = x[k]*z[k];
+    t[ 6][k] = y[k]*z[k];
+    t[ 7][k] = x[k]*x[k];
+    t[ 8][k] = y[k]*y[k];
+    t[ 9][k] = z[k]*z[k];
+    t[10][k] = x[k]*y[k]*z[k];
+    t[11][k] = x[k]*x[k]*x[k];
+    t[12][k] = x[k]*y[k]*y[k];
+    t[13][k] = x[k]*z[k]*z[k];
+    t[14][k] = x[k]*x[k]*y[k];
+    t[15][k] = y[k]*y[k]*y[k];
+    t[16][k] = y[k]*z[k]*z[k];
+    t[17][k] = x[k]*x[k]*z[k];
+    t[18][k] = y[k]*y[k]*z[k];
+    t[19][k] = z[k]*z[k]*z[k];
+  }
+
+  // The sample and line numerator and denominator, in that order
+  double p[4][RPC_BLOCK_SIZE];
+  for (int q = 0; q < 4; q++) {
+    for (int k = 0; k < n; k++)
+      p[q][k] = 0.0;
+    for (int i = 0; i < 20; i++) {
+      double c = coeffs[q][i];
+      for (int k = 0; k < n; k++)
+        p[q][k] += c * t[i][k];
+    }
+  }
+
+  for (int k = 0; k < n; k++) {
+    samp[k] = p[0][k] / p[1][k];
+    line[k] = p[2][k] / p[3][k];
+  }
+
+  if (jac == NULL)
+    return;
+
+  // Partial derivatives of the terms in respect to x and y, as in
+  // terms_Jacobian2(). The zero ones are skipped.
+  double dx[20][RPC_BLOCK_SIZE], dy[20][RPC_BLOCK_SIZE];
+  for (int k = 0; k < n; k++) {
+    dx[ 0][k] = 0.0;              dy[ 0][k] = 0.0;
+    dx[ 1][k] = 1.0;              dy[ 1][k] = 0.0;
+    dx[ 2][k] = 0.0;              dy[ 2][k] = 1.0;
+    dx[ 3][k] = 0.0;              dy[ 3][k] = 0.0;
+    dx[ 4][k] = y[k];             dy[ 4][k] = x[k];
+    dx[ 5][k] = z[k];             dy[ 5][k] = 0.0;
+    dx[ 6][k] = 0.0;              dy[ 6][k] = z[k];
+    dx[ 7][k] = 2.0*x[k];         dy[ 7][k] = 0.0;
+    dx[ 8][k] = 0.0;              dy[ 8][k] = 2.0*y[k];
+    dx[ 9][k] = 0.0;              dy[ 9][k] = 0.0;
+    dx[10][k] = y[k]*z[k];        dy[10][k] = x[k]*z[k];
+    dx[11][k] = 3.0*x[k]*x[k];    dy[11][k] = 0.0;
+    dx[12][k] = y[k]*y[k];        dy[12][k] = 2.0*x[k]*y[k];
+    dx[13][k] = z[k]*z[k];        dy[13][k] = 0.0;
+    dx[14][k] = 2.0*x[k]*y[k];    dy[14][k] = x[k]*x[k];
+    dx[15][k] = 0.0;              dy[15][k] = 3.0*y[k]*y[k];
+    dx[16][k] = 0.0;              dy[16][k] = z[k]*z[k];
+    dx[17][k] = 2.0*x[k]*z[k];    dy[17][k] = 0.0;
+    dx[18][k] = 0.0;              dy[18][k] = 2.0*y[k]*z[k];
+    dx[19][k] = 0.0;              dy[19][k] = 0.0;
+  }
+
+  // Derivatives of the numerators and denominators
+  double px[4][RPC_BLOCK_SIZE], py[4][RPC_BLOCK_SIZE];
+  for (int q = 0; q < 4; q++) {
+    for (int k = 0; k < n; k++) {
+      px[q][k] = 0.0;
+      py[q][k] = 0.0;
+    }
+    for (int i = 0; i < 20; i++) {
+      double c = coeffs[q][i];
+      for (int k = 0; k < n; k++) {
+        px[q][k] += c * dx[i][k];
+        py[q][k] += c * dy[i][k];
+      }
+    }
+  }
+
+  // The quotient rule
+  for (int k = 0; k < n; k++) {
+    double ds = p[1][k] * p[1][k], dl = p[3][k] * p[3][k];
+    jac[4*k + 0] = (p[1][k] * px[0][k] - p[0][k] * px[1][k]) / ds;
+    jac[4*k + 1] = (p[1][k] * py[0][k] - p[0][k] * py[1][k]) / ds;
+    jac[4*k + 2] = (p[3][k] * px[2][k] - p[2][k] * px[3][k]) / dl;
+    jac[4*k + 3] = (p[3][k] * py[2][k] - p[2][k] * py[3][k]) / dl;
+  }
+}
+
+// Copy the coefficients in the order expected by rpcBlockEval()
+void rpcBlockCoeffs(RPCModel const& rpc, double coeffs[4][20]) {
+  for (int i = 0; i < 20; i++) {
+    coeffs[0][i] = rpc.sample_num_coeff()[i];
+    coeffs[1][i] = rpc.sample_den_coeff()[i];
+    coeffs[2][i] = rpc.line_num_coeff()[i];
+    coeffs[3][i] = rpc.line_den_coeff()[i];
+  }
+}
+
+// The heights at which rays are intersected with the ground to find the ray
+// through a pixel. Try to have the ray end points not too far from the
+// center of the valid region. This can make a difference if the region is
+// tall and the rays are curved.
+void rpcRayHeights(RPCModel const& rpc, double & height_up, double & height_dn) {
+  const double VERT_SCALE_FACTOR = 0.9; // - The virtual center should be above the terrain
+  double delta = rpc.lonlatheight_scale()[2]*VERT_SCALE_FACTOR; // measured in meters
+  delta = std::min(delta, 50.0);
+  delta = std::max(delta, 0.1);
+
+  // Center of valid region to bottom of valid region (normalized)
+  height_up = rpc.lonlatheight_offset()[2] + delta;
+  height_dn = rpc.lonlatheight_offset()[2] - delta;
+}
+
+// Set the origin location very far in the opposite direction of the pointing vector,
+// to put it high above the terrain. Normally the precise position along the ray
+// should not make any difference, except perhaps in error propagation
+// (see Covariance.cc).
+const double RPC_LONG_SCALE_UP = 100000.0; // 100 km above ground
+
+} // end anonymous namespace
+
 // A class that computes the normalized pixel and Jacobian via two versions of
 // operator(), in a way suitable to pass to the NewtonRaphson solver.
 struct RpcFunJac {
@@ -566,16 +710,8 @@ Vector2 RPCModel::image_to_ground(Vector2 const& pixel, double height,
 void RPCModel::point_and_dir(Vector2 const& pix, Vector3 & P, Vector3 & dir) const {
 
   // For an RPC model there is no defined origin so it and the ray need to be computed.
-  // Try to have the ray end points not too far from the center of the valid region.
-  // This can make a difference if the region is tall and the rays are curved.
-  const double VERT_SCALE_FACTOR = 0.9; // - The virtual center should be above the terrain
-  double delta = m_lonlatheight_scale[2]*VERT_SCALE_FACTOR; // measured in meters
-  delta = std::min(delta, 50.0);
-  delta = std::max(delta, 0.1);
-
-  // Center of valid region to bottom of valid region (normalized)
-  double  height_up = m_lonlatheight_offset[2] + delta;
-  double  height_dn = m_lonlatheight_offset[2] - delta;
+  double height_up = 0.0, height_dn = 0.0;
+  rpcRayHeights(*this, height_up, height_dn);
 
   // Given the pixel and elevation, estimate lon-lat.
   // Use m_lonlatheight_offset as initial guess for lonlat_up,
@@ -592,15 +728,163 @@ void RPCModel::point_and_dir(Vector2 const& pix, Vector3 & P, Vector3 & dir) con
 
   dir = normalize(P_dn - P_up);
   
-  // Set the origin location very far in the opposite direction of the pointing vector,
-  //  to put it high above the terrain. Normally the precise position along the ray
-  // should not make any difference, except perhaps in error propagation
-  // (see Covariance.cc).
+  // Put the origin high above the terrain (see RPC_LONG_SCALE_UP).
   // TODO(oalexan1): Use the logic from cam_gen.cc to shoot rays from the ground
   // up and estimate where they intersect. That will give a better idea of the true
   // elevation of the camera above the ground.
-  const double LONG_SCALE_UP = 100000.0; // 100 km above ground
-  P = P_up - dir*LONG_SCALE_UP;
+  P = P_up - dir*RPC_LONG_SCALE_UP;
+}
+
+void RPCModel::geodetic_to_pixels(std::vector<Vector3> const& geodetic,
+                                  std::vector<Vector2> & pixels) const {
+
+  double coeffs[4][20];
+  rpcBlockCoeffs(*this, coeffs);
+
+  int num = geodetic.size();
+  pixels.resize(num);
+
+  double x[RPC_BLOCK_SIZE], y[RPC_BLOCK_SIZE], z[RPC_BLOCK_SIZE];
+  double samp[RPC_BLOCK_SIZE], line[RPC_BLOCK_SIZE];
+  for (int start = 0; start < num; start += RPC_BLOCK_SIZE) {
+    int n = std::min(RPC_BLOCK_SIZE, num - start);
+    for (int k = 0; k < n; k++) {
+      Vector3 const& g = geodetic[start + k];
+      x[k] = (g[0] - m_lonlatheight_offset[0]) / m_lonlatheight_scale[0];
+      y[k] = (g[1] - m_lonlatheight_offset[1]) / m_lonlatheight_scale[1];
+      z[k] = (g[2] - m_lonlatheight_offset[2]) / m_lonlatheight_scale[2];
+    }
+    rpcBlockEval(coeffs, n, x, y, z, samp, line, NULL);
+    for (int k = 0; k < n; k++)
+      pixels[start + k] = Vector2(samp[k] * m_xy_scale[0] + m_xy_offset[0],
+                                  line[k] * m_xy_scale[1] + m_xy_offset[1]);
+  }
+}
+
+void RPCModel::points_to_pixels(std::vector<Vector3> const& points,
+                                std::vector<Vector2> & pixels) const {
+  std::vector<Vector3> geodetic(points.size());
+  for (size_t it = 0; it < points.size(); it++)
+    geodetic[it] = m_datum.cartesian_to_geodetic(points[it]);
+  geodetic_to_pixels(geodetic, pixels);
+}
+
+// Same as image_to_ground() for a single pixel, but each Newton iteration
+// is done for all pixels that did not converge yet, several at a time.
+void RPCModel::image_to_ground(std::vector<Vector2> const& pixels, double height,
+                               std::vector<Vector2> const& lonlat_guesses,
+                               std::vector<Vector2> & lonlats) const {
+
+  if (!lonlat_guesses.empty() && lonlat_guesses.size() != pixels.size())
+    vw_throw(ArgumentErr() << "RPCModel::image_to_ground(): Expecting as many "
+             << "guesses as pixels.\n");
+
+  // Same tolerance as for a single pixel
+  double tol = 1e-10;
+  int max_iter = 100;
+
+  double coeffs[4][20];
+  rpcBlockCoeffs(*this, coeffs);
+
+  vw::Vector2 ll_off   = subvector(m_lonlatheight_offset, 0, 2);
+  vw::Vector2 ll_scale = subvector(m_lonlatheight_scale, 0, 2);
+  double normalized_height
+    = (height - m_lonlatheight_offset[2]) / m_lonlatheight_scale[2];
+  double nan = std::numeric_limits<double>::quiet_NaN();
+
+  // The normalized pixels to reach, the current normalized lon-lat values,
+  // and the pixels that are not done
+  int num = pixels.size();
+  std::vector<Vector2> targets(num), curr(num);
+  std::vector<int> active;
+  lonlats.resize(num);
+  for (int it = 0; it < num; it++) {
+    lonlats[it] = Vector2(nan, nan);
+    if (pixels[it] != pixels[it]) // NaN
+      continue;
+    targets[it] = elem_quot(pixels[it] - m_xy_offset, m_xy_scale);
+    Vector2 guess = ll_off;
+    if (!lonlat_guesses.empty() && lonlat_guesses[it] != Vector2(0.0, 0.0))
+      guess = lonlat_guesses[it];
+    curr[it] = elem_quot(guess - ll_off, ll_scale);
+    active.push_back(it);
+  }
+
+  double x[RPC_BLOCK_SIZE], y[RPC_BLOCK_SIZE], z[RPC_BLOCK_SIZE];
+  double samp[RPC_BLOCK_SIZE], line[RPC_BLOCK_SIZE], jac[4*RPC_BLOCK_SIZE];
+  for (int k = 0; k < RPC_BLOCK_SIZE; k++)
+    z[k] = normalized_height;
+
+  for (int iter = 0; iter < max_iter && !active.empty(); iter++) {
+
+    std::vector<int> next_active;
+    for (size_t start = 0; start < active.size(); start += RPC_BLOCK_SIZE) {
+      int n = std::min(RPC_BLOCK_SIZE, int(active.size() - start));
+      for (int k = 0; k < n; k++) {
+        x[k] = curr[active[start + k]][0];
+        y[k] = curr[active[start + k]][1];
+      }
+      rpcBlockEval(coeffs, n, x, y, z, samp, line, jac);
+
+      for (int k = 0; k < n; k++) {
+        int it = active[start + k];
+        double rs = targets[it][0] - samp[k];
+        double rl = targets[it][1] - line[k];
+        if (std::sqrt(rs * rs + rl * rl) < tol) {
+          // Converged. Undo the normalization.
+          lonlats[it] = elem_prod(curr[it], ll_scale) + ll_off;
+          continue;
+        }
+
+        // Solve J * delta = residual, with J = [a b; c d]. If J is singular,
+        // stop and return the current iterate, as for a single pixel.
+        double a = jac[4*k + 0], b = jac[4*k + 1], c = jac[4*k + 2], d = jac[4*k + 3];
+        double det = a * d - b * c;
+        if (det == 0.0 || det != det) {
+          lonlats[it] = elem_prod(curr[it], ll_scale) + ll_off;
+          continue;
+        }
+        curr[it][0] += ( d * rs - b * rl) / det;
+        curr[it][1] += (-c * rs + a * rl) / det;
+        next_active.push_back(it);
+      }
+    }
+    active.swap(next_active);
+  }
+
+  // Without convergence, return the last iterate, as for a single pixel
+  for (size_t k = 0; k < active.size(); k++)
+    lonlats[active[k]] = elem_prod(curr[active[k]], ll_scale) + ll_off;
+}
+
+void RPCModel::pixels_to_rays(std::vector<Vector2> const& pixels,
+                              std::vector<Vector3> & ctrs,
+                              std::vector<Vector3> & dirs) const {
+
+  double height_up = 0.0, height_dn = 0.0;
+  rpcRayHeights(*this, height_up, height_dn);
+
+  // Use the lon-lat for the upper height as the guess for the lower one
+  std::vector<Vector2> no_guesses, lonlats_up, lonlats_dn;
+  image_to_ground(pixels, height_up, no_guesses, lonlats_up);
+  image_to_ground(pixels, height_dn, lonlats_up, lonlats_dn);
+
+  int num = pixels.size();
+  ctrs.resize(num);
+  dirs.resize(num);
+  for (int it = 0; it < num; it++) {
+    ctrs[it] = Vector3();
+    dirs[it] = Vector3();
+    Vector2 const& up = lonlats_up[it];
+    Vector2 const& dn = lonlats_dn[it];
+    if (up != up || dn != dn) // NaN
+      continue;
+
+    Vector3 P_up = m_datum.geodetic_to_cartesian(Vector3(up[0], up[1], height_up));
+    Vector3 P_dn = m_datum.geodetic_to_cartesian(Vector3(dn[0], dn[1], height_dn));
+    dirs[it] = normalize(P_dn - P_up);
+    ctrs[it] = P_up - dirs[it]*RPC_LONG_SCALE_UP;
+  }
 }
 
 Vector3 RPCModel::camera_center(Vector2 const& pix) const{
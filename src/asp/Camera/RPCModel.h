@@ -36,6 +36,7 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
 
 namespace vw {
   class DiskImageResourceGDAL;
@@ -136,6 +137,28 @@ namespace asp {
     /// and the direction of the ray going through that point.
     void point_and_dir(vw::Vector2 const& pix, vw::Vector3 & P, vw::Vector3 & dir) const;
 
+    /// Batch versions of geodetic_to_pixel() and point_to_pixel(). The
+    /// polynomials are evaluated for several points at a time, which is
+    /// faster than doing one point at a time.
+    void geodetic_to_pixels(std::vector<vw::Vector3> const& geodetic,
+                            std::vector<vw::Vector2> & pixels) const;
+    void points_to_pixels(std::vector<vw::Vector3> const& points,
+                          std::vector<vw::Vector2> & pixels) const;
+
+    /// Batch version of image_to_ground(), doing the Newton iterations for all
+    /// pixels together. If not empty, the guesses must be as many as the
+    /// pixels. The output is NaN for NaN pixels. As for a single pixel, if
+    /// there is no convergence, the output is the last iterate.
+    void image_to_ground(std::vector<vw::Vector2> const& pixels, double height,
+                         std::vector<vw::Vector2> const& lonlat_guesses,
+                         std::vector<vw::Vector2> & lonlats) const;
+
+    /// Batch version of point_and_dir(), used in triangulation. The outputs are
+    /// the zero vector for NaN pixels, or where the ray cannot be found.
+    void pixels_to_rays(std::vector<vw::Vector2> const& pixels,
+                        std::vector<vw::Vector3> & ctrs,
+                        std::vector<vw::Vector3> & dirs) const;
+
     // Will be read only for DG RPC camera models and set to 0 for the rest
     double m_err_bias, m_err_rand;
     
@@ -0,0 +1,248 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file RpcMap2CamTrans.cc
+///
+
+#include <asp/Camera/RpcMap2CamTrans.h>
+#include <asp/Camera/RPCModel.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/LinearAlgebra.h>
+#include <vw/Image/MaskViews.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelTypeInfo.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/FileIO/DiskImageResource.h>
+
+#include <atomic>
+#include <cmath>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+// A camera pixel for a ground point with no DEM height, far outside the image
+const Vector2 g_invalid_pix(-1.0e+6, -1.0e+6);
+
+// The camera pixels found by the latest call to reverse_bbox() in this
+// thread. The tile is then rasterized in the same thread.
+struct RpcMap2CamCache {
+  int id;
+  BBox2i box;
+  std::vector<Vector2> pixels;
+  RpcMap2CamCache(): id(-1) {}
+};
+thread_local RpcMap2CamCache g_cache;
+
+std::atomic<int> g_next_id(0);
+
+// Bilinear interpolation into a DEM crop starting at crop_box.min(). Return
+// false if a neighbor has no data or the pixel is outside the crop.
+bool demHeight(ImageView<PixelMask<float>> const& dem, BBox2i const& crop_box,
+               Vector2 const& pix, double & height) {
+
+  double x = pix[0] - crop_box.min().x(), y = pix[1] - crop_box.min().y();
+  if (!(x >= 0 && y >= 0 && x <= dem.cols() - 1 && y <= dem.rows() - 1))
+    return false; // this also handles NaN
+
+  int c0 = int(floor(x)), r0 = int(floor(y));
+  int c1 = std::min(c0 + 1, dem.cols() - 1), r1 = std::min(r0 + 1, dem.rows() - 1);
+  if (!is_valid(dem(c0, r0)) || !is_valid(dem(c1, r0)) ||
+      !is_valid(dem(c0, r1)) || !is_valid(dem(c1, r1)))
+    return false;
+
+  double dx = x - c0, dy = y - r0;
+  height = (1.0 - dy) * ((1.0 - dx) * dem(c0, r0).child() + dx * dem(c1, r0).child()) +
+           dy         * ((1.0 - dx) * dem(c0, r1).child() + dx * dem(c1, r1).child());
+  return true;
+}
+
+} // end anonymous namespace
+
+RpcMap2CamTrans::RpcMap2CamTrans(vw::camera::CameraModel const* cam,
+                                 vw::cartography::GeoReference const& image_georef,
+                                 vw::cartography::GeoReference const& dem_georef,
+                                 std::string const& dem_file, double datum_offset):
+  m_rpc(NULL), m_adjusted(false), m_image_georef(image_georef),
+  m_dem_georef(dem_georef), m_use_dem(dem_file != ""), m_datum_offset(datum_offset),
+  m_id(g_next_id++) {
+
+  if (!is_supported(cam))
+    vw_throw(ArgumentErr() << "RpcMap2CamTrans: Expecting an RPC camera.\n");
+
+  // An adjusted camera projects a point into the wrapped camera after
+  // applying the inverse of the adjustment to it
+  vw::camera::AdjustedCameraModel const* adj_cam
+    = dynamic_cast<vw::camera::AdjustedCameraModel const*>(cam);
+  if (adj_cam != NULL) {
+    Matrix4x4 T = adj_cam->ecef_transform();
+    m_inv_rotation = vw::math::inverse(Matrix3x3(submatrix(T, 0, 0, 3, 3)));
+    m_shift = Vector3(T(0, 3), T(1, 3), T(2, 3));
+    m_adjusted = true;
+    cam = adj_cam->unadjusted_model().get();
+  }
+  m_rpc = dynamic_cast<RPCModel const*>(cam);
+
+  if (m_use_dem) {
+    boost::shared_ptr<DiskImageResource> dem_rsrc(DiskImageResourcePtr(dem_file));
+    DiskImageView<float> dem(dem_rsrc);
+    if (dem_rsrc->has_nodata_read())
+      m_dem = create_mask(dem, dem_rsrc->nodata_read());
+    else
+      m_dem = pixel_cast<PixelMask<float>>(dem);
+  }
+}
+
+bool RpcMap2CamTrans::is_supported(vw::camera::CameraModel const* cam) {
+  vw::camera::AdjustedCameraModel const* adj_cam
+    = dynamic_cast<vw::camera::AdjustedCameraModel const*>(cam);
+  if (adj_cam != NULL) {
+    if (adj_cam->pixel_offset() != Vector2() || adj_cam->scale() != 1.0)
+      return false;
+    cam = adj_cam->unadjusted_model().get();
+  }
+  return dynamic_cast<RPCModel const*>(cam) != NULL;
+}
+
+void RpcMap2CamTrans::project(std::vector<Vector2> const& map_pixels,
+                              std::vector<Vector2> & cam_pixels) const {
+
+  int num = map_pixels.size();
+  cam_pixels.assign(num, g_invalid_pix);
+
+  // Find where the pixels are in the DEM
+  std::vector<Vector2> lonlats(num), dem_pixels(num);
+  BBox2 dem_box;
+  bool have_dem_pix = false;
+  for (int k = 0; k < num; k++) {
+    lonlats[k] = m_image_georef.pixel_to_lonlat(map_pixels[k]);
+    if (m_use_dem) {
+      dem_pixels[k] = m_dem_georef.lonlat_to_pixel(lonlats[k]);
+      if (dem_pixels[k] == dem_pixels[k]) { // not NaN
+        dem_box.grow(dem_pixels[k]);
+        have_dem_pix = true;
+      }
+    }
+  }
+
+  // Read in memory the part of the DEM that is needed
+  ImageView<PixelMask<float>> dem_crop;
+  BBox2i crop_box;
+  if (m_use_dem) {
+    if (!have_dem_pix)
+      return;
+    crop_box = grow_bbox_to_int(dem_box);
+    crop_box.expand(1);
+    if (!crop_box.intersects(bounding_box(m_dem)))
+      return;
+    crop_box.crop(bounding_box(m_dem));
+    dem_crop = crop(m_dem, crop_box);
+  }
+
+  // Use the geodetic coordinates directly if the RPC model has the same datum
+  // and there is no adjustment. Otherwise go through ECEF.
+  vw::cartography::Datum const& dem_datum = m_dem_georef.datum();
+  vw::cartography::Datum const& rpc_datum = m_rpc->datum();
+  bool same_datum = (dem_datum.semi_major_axis() == rpc_datum.semi_major_axis() &&
+                     dem_datum.semi_minor_axis() == rpc_datum.semi_minor_axis());
+  double lon_off = m_rpc->lonlatheight_offset()[0];
+
+  std::vector<Vector3> geodetic;
+  std::vector<int> index;
+  for (int k = 0; k < num; k++) {
+    double height = m_datum_offset;
+    if (m_use_dem && !demHeight(dem_crop, crop_box, dem_pixels[k], height))
+      continue;
+    Vector3 llh(lonlats[k][0], lonlats[k][1], height);
+    if (llh != llh) // NaN
+      continue;
+
+    if (m_adjusted || !same_datum) {
+      Vector3 xyz = dem_datum.geodetic_to_cartesian(llh);
+      if (m_adjusted)
+        xyz = m_inv_rotation * (xyz - m_shift);
+      llh = rpc_datum.cartesian_to_geodetic(xyz);
+    }
+
+    // The RPC polynomials are for longitudes close to the offset
+    while (llh[0] - lon_off > 180.0)
+      llh[0] -= 360.0;
+    while (llh[0] - lon_off < -180.0)
+      llh[0] += 360.0;
+
+    geodetic.push_back(llh);
+    index.push_back(k);
+  }
+
+  std::vector<Vector2> pixels;
+  m_rpc->geodetic_to_pixels(geodetic, pixels);
+  for (size_t j = 0; j < index.size(); j++)
+    cam_pixels[index[j]] = pixels[j];
+}
+
+Vector2 RpcMap2CamTrans::reverse(Vector2 const& p) const {
+
+  // Look up the pixel among the cached ones
+  Vector2i ip(int(round(p[0])), int(round(p[1])));
+  if (g_cache.id == m_id && Vector2(ip) == p && g_cache.box.contains(ip)) {
+    BBox2i const& box = g_cache.box;
+    return g_cache.pixels[(ip.y() - box.min().y()) * box.width() + (ip.x() - box.min().x())];
+  }
+
+  std::vector<Vector2> map_pixels(1, p), cam_pixels;
+  project(map_pixels, cam_pixels);
+  return cam_pixels[0];
+}
+
+BBox2i RpcMap2CamTrans::reverse_bbox(BBox2i const& bbox) const {
+
+  std::vector<Vector2> map_pixels;
+  map_pixels.reserve(bbox.width() * bbox.height());
+  for (int row = bbox.min().y(); row < bbox.max().y(); row++) {
+    for (int col = bbox.min().x(); col < bbox.max().x(); col++)
+      map_pixels.push_back(Vector2(col, row));
+  }
+
+  g_cache.id = m_id;
+  g_cache.box = bbox;
+  project(map_pixels, g_cache.pixels);
+
+  BBox2 cam_box;
+  bool found = false;
+  for (size_t k = 0; k < g_cache.pixels.size(); k++) {
+    if (g_cache.pixels[k] == g_invalid_pix)
+      continue;
+    cam_box.grow(g_cache.pixels[k]);
+    found = true;
+  }
+
+  // If no pixel projects into the camera, return a small box, as
+  // all pixels will be invalid anyway.
+  if (!found)
+    return BBox2i(0, 0, 1, 1);
+
+  // Leave room for bicubic interpolation
+  BBox2i out_box = grow_bbox_to_int(cam_box);
+  out_box.expand(2);
+  return out_box;
+}
+
+} // end namespace asp
@@ -0,0 +1,84 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file RpcMap2CamTrans.h
+///
+/// A transform from the pixels of a mapprojected image to the pixels of an
+/// RPC camera, for use in mapproject. It does the same as Map2CamTrans and
+/// Datum2CamTrans, but projects all the ground points of a tile into the
+/// camera at once with RPCModel::geodetic_to_pixels().
+
+#ifndef __ASP_CAMERA_RPC_MAP2CAM_TRANS_H__
+#define __ASP_CAMERA_RPC_MAP2CAM_TRANS_H__
+
+#include <vw/Math/Matrix.h>
+#include <vw/Image/Transform.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Camera/CameraModel.h>
+
+#include <string>
+#include <vector>
+
+namespace asp {
+
+class RPCModel;
+
+class RpcMap2CamTrans: public vw::TransformBase<RpcMap2CamTrans> {
+public:
+
+  // Project onto the DEM in the given file. If the file name is empty,
+  // project onto the datum of dem_georef, shifted by datum_offset.
+  RpcMap2CamTrans(vw::camera::CameraModel const* cam,
+                  vw::cartography::GeoReference const& image_georef,
+                  vw::cartography::GeoReference const& dem_georef,
+                  std::string const& dem_file, double datum_offset);
+
+  // If the camera is an RPC model, or an adjusted RPC model with no pixel
+  // adjustment, so that this transform can be used.
+  static bool is_supported(vw::camera::CameraModel const* cam);
+
+  // The camera pixel for the given pixel in the mapprojected image. This
+  // is looked up among the pixels found by reverse_bbox(), if possible.
+  vw::Vector2 reverse(vw::Vector2 const& p) const;
+
+  // Find the camera pixels for all pixels in the box, and the box in the
+  // camera image containing them.
+  vw::BBox2i reverse_bbox(vw::BBox2i const& bbox) const;
+
+private:
+
+  // Find the camera pixels for the given pixels in the mapprojected image,
+  // or an invalid pixel outside the image if there is no DEM height.
+  void project(std::vector<vw::Vector2> const& map_pixels,
+               std::vector<vw::Vector2> & cam_pixels) const;
+
+  RPCModel const* m_rpc;
+  bool m_adjusted;
+  vw::Matrix3x3 m_inv_rotation;
+  vw::Vector3 m_shift;
+  vw::cartography::GeoReference m_image_georef, m_dem_georef;
+  bool m_use_dem;
+  double m_datum_offset;
+  vw::ImageViewRef<vw::PixelMask<float>> m_dem;
+  int m_id; // to find the pixels cached by reverse_bbox(), also in copies
+};
+
+} // end namespace asp
+
+#endif // __ASP_CAMERA_RPC_MAP2CAM_TRANS_H__
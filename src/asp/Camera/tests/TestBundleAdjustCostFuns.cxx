@@ -0,0 +1,150 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/BundleAdjustCostFuns.h>
+#include <vw/Camera/PinholeModel.h>
+#include <vw/Camera/OpticalBarModel.h>
+#include <vw/Camera/LensDistortion.h>
+#include <vw/Math/Quaternion.h>
+#include <test/Helpers.h>
+
+using namespace vw;
+using namespace asp;
+
+// Evaluate the numerical and analytic reprojection error Jacobians for
+// the given parameters and check that they agree.
+void compareJacobians(boost::shared_ptr<CeresBundleModelBase> wrapper,
+                      Vector2 const& observation,
+                      std::vector<std::vector<double>> const& params) {
+
+  Vector2 pixel_sigma(1.0, 2.0);
+  boost::shared_ptr<ceres::CostFunction>
+    numeric(reprojectionCostFunction(observation, pixel_sigma, wrapper, "numeric")),
+    analytic(reprojectionCostFunction(observation, pixel_sigma, wrapper, "analytic"));
+
+  std::vector<int> block_sizes = wrapper->get_block_sizes();
+  ASSERT_EQ(block_sizes.size(), params.size());
+  std::vector<double const*> param_ptrs;
+  std::vector<std::vector<double>> jac1(params.size()), jac2(params.size());
+  std::vector<double*> jac1_ptrs, jac2_ptrs;
+  for (size_t b = 0; b < params.size(); b++) {
+    param_ptrs.push_back(&params[b][0]);
+    jac1[b].resize(2 * block_sizes[b]);
+    jac2[b].resize(2 * block_sizes[b]);
+    jac1_ptrs.push_back(&jac1[b][0]);
+    jac2_ptrs.push_back(&jac2[b][0]);
+  }
+
+  double res1[2], res2[2];
+  ASSERT_TRUE(numeric->Evaluate(&param_ptrs[0], res1, &jac1_ptrs[0]));
+  ASSERT_TRUE(analytic->Evaluate(&param_ptrs[0], res2, &jac2_ptrs[0]));
+  EXPECT_NEAR(res1[0], res2[0], 1e-10);
+  EXPECT_NEAR(res1[1], res2[1], 1e-10);
+
+  // Compare each block relative to its largest entry
+  for (size_t b = 0; b < params.size(); b++) {
+    double max_val = 0.0;
+    for (size_t it = 0; it < jac1[b].size(); it++)
+      max_val = std::max(max_val, std::abs(jac1[b][it]));
+    EXPECT_GT(max_val, 0.0);
+    for (size_t it = 0; it < jac1[b].size(); it++)
+      EXPECT_NEAR(jac1[b][it], jac2[b][it], 1e-5 * max_val) << "block " << b;
+  }
+}
+
+TEST(BundleAdjustCostFuns, AnalyticJacobian) {
+
+  // A camera in orbit looking down, with some distortion
+  Vector3 ctr(6.4e+6 + 5.0e+5, 1.0e+3, -2.0e+3);
+  Matrix3x3 rot(0, 0, -1,
+                -1, 0, 0,
+                0, 1, 0);
+  Vector<double> dist(5);
+  dist[0] = 1e-2; dist[1] = -1e-3; dist[2] = 1e-4; dist[3] = -2e-4; dist[4] = 1e-5;
+  camera::TsaiLensDistortion lens(dist);
+  double focal_length = 10000.0, pitch = 1.0;
+  boost::shared_ptr<camera::PinholeModel>
+    pin(new camera::PinholeModel(ctr, rot, focal_length, focal_length,
+                                 500.0, 400.0, &lens, pitch));
+
+  // A point seen by the camera, and an observation near its projection
+  Vector2 pix(300.0, 200.0);
+  Vector3 xyz = ctr + 5.0e+5 * pin->pixel_to_vector(pix);
+  Vector2 observation = pix + Vector2(0.5, -0.7);
+  std::vector<double> point(xyz.begin(), xyz.end());
+
+  // Pinhole camera, solving for the pose and intrinsics. Perturb the pose.
+  {
+    boost::shared_ptr<CeresBundleModelBase> wrapper(new PinholeBundleModel(pin));
+    Vector3 axis_angle = pin->camera_pose().axis_angle();
+    std::vector<double> pose = {ctr[0] + 3.0, ctr[1] - 2.0, ctr[2] + 1.0,
+                                axis_angle[0] + 1e-4, axis_angle[1] - 2e-4,
+                                axis_angle[2] + 3e-4};
+    std::vector<double> center = {1.0, 1.0}, focus = {1.0};
+    std::vector<double> lens_scale(dist.size(), 1.0);
+    compareJacobians(wrapper, observation, {point, pose, center, focus, lens_scale});
+  }
+
+  // The pinhole camera with an external adjustment
+  {
+    boost::shared_ptr<CeresBundleModelBase> wrapper(new AdjustedCameraBundleModel(pin));
+    std::vector<double> adjustment = {2.0, -3.0, 4.0, 2e-4, -1e-4, 5e-4};
+    compareJacobians(wrapper, observation, {point, adjustment});
+  }
+
+  // A CSM frame camera with the same pose and radial-tangential distortion,
+  // with an adjustment, solving for the intrinsics
+  {
+    double a = 6378137.0, b = 6356752.314245;
+    std::vector<double> csm_dist = {1e-2, -1e-3, 1e-4, -2e-4, 1e-5};
+    boost::shared_ptr<CsmModel> csm(new CsmModel);
+    csm->createFrameModel(1000, 800, 500.0, 400.0, focal_length, a, b, ctr, rot,
+                          "radtan", csm_dist);
+    Vector3 csm_xyz = ctr + 5.0e+5 * csm->pixel_to_vector(pix);
+    std::vector<double> csm_point(csm_xyz.begin(), csm_xyz.end());
+    boost::shared_ptr<CeresBundleModelBase> wrapper(new CsmBundleModel(csm));
+    std::vector<double> adjustment = {2.0, -3.0, 4.0, 2e-4, -1e-4, 5e-4};
+    std::vector<double> center = {1.0, 1.0}, focus = {1.0};
+    std::vector<double> dist_scale(csm_dist.size(), 1.0);
+    compareJacobians(wrapper, observation,
+                     {csm_point, adjustment, center, focus, dist_scale});
+  }
+
+  // An optical bar camera with the same pose, solving for the pose and
+  // intrinsics. Its motion during the scan is fixed in the camera frame.
+  {
+    Vector3 axis_angle = Quat(rot).axis_angle();
+    double pixel_size = 7.0e-6, ob_focal_length = 0.61, scan_time = 0.5;
+    double forward_tilt = 0.26, speed = 7700.0, mcf = 1.0;
+    bool scan_left_to_right = true;
+    boost::shared_ptr<camera::OpticalBarModel>
+      ob(new camera::OpticalBarModel(Vector2i(80000, 10000), Vector2(40000.0, 5000.0),
+                                     pixel_size, ob_focal_length, scan_time,
+                                     scan_left_to_right, forward_tilt, ctr, axis_angle,
+                                     speed, mcf));
+    Vector2 ob_pix(39000.0, 5300.0);
+    Vector3 ob_xyz = ob->camera_center(ob_pix) + 5.0e+5 * ob->pixel_to_vector(ob_pix);
+    std::vector<double> ob_point(ob_xyz.begin(), ob_xyz.end());
+    Vector2 ob_observation = ob_pix + Vector2(0.5, -0.7);
+    boost::shared_ptr<CeresBundleModelBase> wrapper(new OpticalBarBundleModel(ob));
+    std::vector<double> pose = {ctr[0] + 3.0, ctr[1] - 2.0, ctr[2] + 1.0,
+                                axis_angle[0] + 1e-4, axis_angle[1] - 2e-4,
+                                axis_angle[2] + 3e-4};
+    std::vector<double> center = {1.0, 1.0}, focus = {1.0}, intrin = {1.0, 1.0, 1.0};
+    compareJacobians(wrapper, ob_observation, {ob_point, pose, center, focus, intrin});
+  }
+}
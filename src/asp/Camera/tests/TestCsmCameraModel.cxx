@@ -16,9 +16,13 @@
 // __END_LICENSE__
 
 #include <asp/Camera/CsmModel.h>
+#include <asp/Camera/CsmUtils.h>
+#include <vw/Cartography/Datum.h>
+#include <vw/Math/EulerAngles.h>
 #include <boost/scoped_ptr.hpp>
 #include <test/Helpers.h>
 #include <iomanip>
+#include <limits>
 
 using namespace vw;
 using namespace asp;
@@ -62,3 +66,89 @@ TEST(CSM_camera, basic_check) {
 
 
 
+TEST(CSM_camera, pixels_to_rays) {
+
+  // A frame camera looking down at the Earth from 500 km
+  CsmModel csm;
+  double a = 6378137.0, b = 6356752.314245;
+  Vector3 C(a + 500000.0, 0, 0);
+  Matrix3x3 R;
+  R(0, 2) = -1; R(1, 0) = 1; R(2, 1) = -1; // camera z axis points to the planet center
+  csm.createFrameModel(1000, 800, 500.0, 400.0, 10000.0, a, b, C, R);
+
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  std::vector<Vector2> pixels;
+  pixels.push_back(Vector2(0, 0));
+  pixels.push_back(Vector2(10.5, 20.25));
+  pixels.push_back(Vector2(nan, nan));
+  pixels.push_back(Vector2(999, 799));
+
+  std::vector<Vector3> ctrs, dirs;
+  csm.pixels_to_rays(pixels, ctrs, dirs);
+  ASSERT_EQ(ctrs.size(), pixels.size());
+  ASSERT_EQ(dirs.size(), pixels.size());
+
+  for (size_t it = 0; it < pixels.size(); it++) {
+    if (pixels[it] != pixels[it]) {
+      EXPECT_EQ(ctrs[it], Vector3());
+      EXPECT_EQ(dirs[it], Vector3());
+      continue;
+    }
+    EXPECT_VECTOR_NEAR(ctrs[it], csm.camera_center(pixels[it]), 1e-8);
+    EXPECT_VECTOR_NEAR(dirs[it], csm.pixel_to_vector(pixels[it]), 1e-12);
+  }
+}
+
+TEST(CSM_camera, linescan_pixels_to_rays) {
+
+  // A linescan camera 500 km above the equator, looking down, moving north,
+  // with the orientation varying in time.
+  vw::cartography::Datum datum("WGS84");
+  double height = 500000.0, speed = 7000.0;
+  double first_line_time = 0.0, dt_line = 1e-3;
+  double t0 = -0.5, dt = 0.1;
+  int num_samples = 30;
+  Vector2i image_size(1000, 2000);
+  Matrix3x3 nadir;
+  nadir(0, 2) = -1; nadir(1, 0) = 1; nadir(2, 1) = -1;
+  std::vector<Vector3> positions, velocities;
+  std::vector<Matrix3x3> cam2world;
+  for (int it = 0; it < num_samples; it++) {
+    double t = t0 + it * dt;
+    positions.push_back(Vector3(datum.semi_major_axis() + height, 0, speed * t));
+    velocities.push_back(Vector3(0, 0, speed));
+    Matrix3x3 wobble = vw::math::euler_to_rotation_matrix(1e-5 * sin(3.0 * t),
+                                                          2e-5 * cos(2.0 * t),
+                                                          1e-5 * sin(t), "xyz");
+    cam2world.push_back(wobble * nadir);
+  }
+  CsmModel csm;
+  populateCsmLinescan(first_line_time, dt_line, t0, dt, t0, dt, 70000.0,
+                      Vector2(500.0, 0.0), image_size, datum, "test",
+                      positions, velocities, cam2world, csm);
+
+  // Pixels on the same line, on fractional lines, out of order, and NaN
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  std::vector<Vector2> pixels;
+  for (int col = 0; col < 1000; col += 111)
+    pixels.push_back(Vector2(col, 700));
+  pixels.push_back(Vector2(nan, nan));
+  pixels.push_back(Vector2(12.3, 1500.7));
+  pixels.push_back(Vector2(988.1, 10.25));
+  pixels.push_back(Vector2(500.0, 700));
+
+  std::vector<Vector3> ctrs, dirs;
+  csm.pixels_to_rays(pixels, ctrs, dirs);
+  ASSERT_EQ(ctrs.size(), pixels.size());
+  ASSERT_EQ(dirs.size(), pixels.size());
+
+  for (size_t it = 0; it < pixels.size(); it++) {
+    if (pixels[it] != pixels[it]) {
+      EXPECT_EQ(ctrs[it], Vector3());
+      EXPECT_EQ(dirs[it], Vector3());
+      continue;
+    }
+    EXPECT_VECTOR_NEAR(ctrs[it], csm.camera_center(pixels[it]), 1e-6);
+    EXPECT_VECTOR_NEAR(dirs[it], csm.pixel_to_vector(pixels[it]), 1e-10);
+  }
+}
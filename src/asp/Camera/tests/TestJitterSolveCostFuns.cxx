@@ -0,0 +1,164 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Camera/JitterSolveCostFuns.h>
+#include <asp/Camera/CsmUtils.h>
+#include <vw/Cartography/Datum.h>
+#include <vw/Math/EulerAngles.h>
+#include <boost/shared_ptr.hpp>
+#include <usgscsm/Utilities.h>
+#include <test/Helpers.h>
+
+#include <cstdlib>
+
+using namespace asp;
+
+// The Lagrange weights must reproduce the interpolation done by usgscsm,
+// including near the ends of the sequence.
+TEST(JitterSolveCostFuns, LagrangeWeights) {
+
+  int numTimes = 40;
+  double t0 = 100.0, dt = 0.25;
+  std::srand(1);
+  std::vector<double> vals(numTimes);
+  for (int it = 0; it < numTimes; it++)
+    vals[it] = double(std::rand())/RAND_MAX;
+
+  int orders[] = {4, 8};
+  for (int order: orders) {
+    for (double time = t0 - dt; time < t0 + (numTimes + 1) * dt; time += 0.37 * dt) {
+
+      double expected = 0.0;
+      lagrangeInterp(numTimes, &vals[0], t0, dt, time, 1, order, &expected);
+
+      int beg = 0;
+      std::vector<double> weights;
+      calcLagrangeWeights(numTimes, t0, dt, time, order, beg, weights);
+
+      double sum = 0.0, val = 0.0;
+      for (size_t k = 0; k < weights.size(); k++) {
+        sum += weights[k];
+        val += weights[k] * vals[beg + k];
+      }
+      EXPECT_NEAR(sum, 1.0, 1e-10);
+      EXPECT_NEAR(val, expected, 1e-10);
+    }
+  }
+}
+
+// The analytic Jacobian of the linescan reprojection error must agree with
+// the numerical one, for a synthetic camera with some jitter.
+TEST(JitterSolveCostFuns, LsReprojErrAnalyticJacobian) {
+
+  // A camera at 500 km above the equator, looking down, moving north
+  vw::cartography::Datum datum("WGS84");
+  double height = 500000.0, speed = 7000.0;
+  double first_line_time = 0.0, dt_line = 1e-3;
+  double t0 = -0.5, dt = 0.1;
+  int num_samples = 30;
+  vw::Vector2i image_size(1000, 2000);
+  double focal_length = 70000.0;
+  vw::Vector2 optical_center(500.0, 0.0);
+  vw::Matrix3x3 nadir;
+  nadir(0, 2) = -1; nadir(1, 0) = 1; nadir(2, 1) = -1;
+
+  std::vector<vw::Vector3> positions, velocities;
+  std::vector<vw::Matrix3x3> cam2world;
+  for (int it = 0; it < num_samples; it++) {
+    double t = t0 + it * dt;
+    positions.push_back(vw::Vector3(datum.semi_major_axis() + height, 0, speed * t));
+    velocities.push_back(vw::Vector3(0, 0, speed));
+    // A small wobble, so that the orientation varies from sample to sample
+    vw::Matrix3x3 wobble 
+      = vw::math::euler_to_rotation_matrix(1e-5 * sin(3.0 * t), 2e-5 * cos(2.0 * t),
+                                           1e-5 * sin(t), "xyz");
+    cam2world.push_back(wobble * nadir);
+  }
+
+  asp::CsmModel model;
+  asp::populateCsmLinescan(first_line_time, dt_line, t0, dt, t0, dt, focal_length,
+                           optical_center, image_size, datum, "test", 
+                           positions, velocities, cam2world, model);
+  UsgsAstroLsSensorModel * ls_model
+    = dynamic_cast<UsgsAstroLsSensorModel*>(model.m_gm_model.get());
+  ASSERT_TRUE(ls_model != NULL);
+
+  // A ground point, slightly off from the observation
+  vw::Vector2 observation(400.0, 1000.0);
+  vw::Vector3 ctr = model.camera_center(observation);
+  vw::Vector3 ground = ctr + height * model.pixel_to_vector(observation);
+  double tri_point[3] = {ground[0] + 3.0, ground[1] - 2.0, ground[2] + 1.0};
+
+  // The samples that affect the pixel, with some extra lines on each side
+  double time = asp::get_time_at_line(observation[1], ls_model);
+  double extra = 20 * dt_line;
+  int begQuatIndex = -1, endQuatIndex = -1, begPosIndex = -1, endPosIndex = -1;
+  calcIndexBounds(time - extra, time + extra, ls_model->m_t0Quat, ls_model->m_dtQuat,
+                  ls_model->m_quaternions.size() / NUM_QUAT_PARAMS, 
+                  begQuatIndex, endQuatIndex);
+  calcIndexBounds(time - extra, time + extra, ls_model->m_t0Ephem, ls_model->m_dtEphem,
+                  ls_model->m_positions.size() / NUM_XYZ_PARAMS, 
+                  begPosIndex, endPosIndex);
+
+  std::vector<double*> params;
+  for (int it = begQuatIndex; it < endQuatIndex; it++)
+    params.push_back(&ls_model->m_quaternions[it * NUM_QUAT_PARAMS]);
+  for (int it = begPosIndex; it < endPosIndex; it++)
+    params.push_back(&ls_model->m_positions[it * NUM_XYZ_PARAMS]);
+  params.push_back(tri_point);
+
+  double weight = 2.0;
+  std::string methods[] = {"numeric", "analytic"};
+  std::vector<double> residuals[2];
+  std::vector<std::vector<double>> jacobians[2];
+  for (int m = 0; m < 2; m++) {
+    boost::shared_ptr<ceres::CostFunction> cost
+      (createLsReprojErr(methods[m], observation, weight, ls_model,
+                         begQuatIndex, endQuatIndex, begPosIndex, endPosIndex));
+    std::vector<int> const& sizes = cost->parameter_block_sizes();
+    ASSERT_EQ(sizes.size(), params.size());
+    residuals[m].resize(PIXEL_SIZE);
+    jacobians[m].resize(sizes.size());
+    std::vector<double*> jac_ptrs(sizes.size());
+    for (size_t b = 0; b < sizes.size(); b++) {
+      jacobians[m][b].resize(PIXEL_SIZE * sizes[b]);
+      jac_ptrs[b] = &jacobians[m][b][0];
+    }
+    ASSERT_TRUE(cost->Evaluate(&params[0], &residuals[m][0], &jac_ptrs[0]));
+  }
+
+  // The residuals are in pixels, and not small, so the point is off
+  for (int c = 0; c < PIXEL_SIZE; c++) {
+    EXPECT_NEAR(residuals[0][c], residuals[1][c], 1e-8);
+    EXPECT_GT(std::abs(residuals[0][c]), 0.01);
+  }
+
+  // Compare each block, relative to its largest entry
+  int num_nonzero = 0;
+  for (size_t b = 0; b < params.size(); b++) {
+    double max_val = 0.0;
+    for (size_t k = 0; k < jacobians[0][b].size(); k++)
+      max_val = std::max(max_val, std::abs(jacobians[0][b][k]));
+    if (max_val > 0)
+      num_nonzero++;
+    for (size_t k = 0; k < jacobians[0][b].size(); k++)
+      EXPECT_NEAR(jacobians[0][b][k], jacobians[1][b][k], 1e-4 * max_val + 1e-8)
+        << "block " << b << ", entry " << k;
+  }
+  // The point and the samples in the interpolation window
+  EXPECT_GT(num_nonzero, 8);
+}
@@ -30,8 +30,13 @@
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/RPCStereoModel.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Camera/RpcMap2CamTrans.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/Cartography/Map2CamTrans.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
+#include <limits>
+
 
 using namespace vw;
 using namespace vw::stereo;
@@ -192,6 +197,67 @@ TEST( StereoSessionRPC, InstantiateTest ) {
   xercesc::XMLPlatformUtils::Terminate();
 }
 
+TEST(RPCModel, BatchMatchesSingle) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file("dg_example1.xml");
+  RPCModel model(*xml.rpc_ptr());
+
+  // A grid of pixels over the image, and one NaN pixel
+  std::vector<Vector2> pixels;
+  for (int r = 0; r < 50; r++) {
+    for (int c = 0; c < 50; c++)
+      pixels.push_back(Vector2(c * 700.0, r * 470.0));
+  }
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  pixels.push_back(Vector2(nan, nan));
+  int num = pixels.size();
+
+  // Points on the ground, to project into the camera
+  double h = 2000.0;
+  std::vector<Vector3> geodetic(num - 1);
+  for (int it = 0; it < num - 1; it++) {
+    Vector2 lonlat = model.image_to_ground(pixels[it], h);
+    geodetic[it] = Vector3(lonlat[0], lonlat[1], h);
+  }
+
+  std::vector<Vector2> pixels1(num - 1);
+  for (int it = 0; it < num - 1; it++)
+    pixels1[it] = model.geodetic_to_pixel(geodetic[it]);
+  std::vector<Vector2> pixels2;
+  model.geodetic_to_pixels(geodetic, pixels2);
+  ASSERT_EQ(pixels2.size(), pixels1.size());
+  for (int it = 0; it < num - 1; it++)
+    EXPECT_VECTOR_NEAR(pixels1[it], pixels2[it], 1e-8);
+
+  // Find the rays one pixel at a time and all at once
+  std::vector<Vector3> ctrs1(num - 1), dirs1(num - 1);
+  for (int it = 0; it < num - 1; it++)
+    model.point_and_dir(pixels[it], ctrs1[it], dirs1[it]);
+  std::vector<Vector3> ctrs2, dirs2;
+  model.pixels_to_rays(pixels, ctrs2, dirs2);
+  ASSERT_EQ(int(dirs2.size()), num);
+  for (int it = 0; it < num - 1; it++) {
+    EXPECT_LT(norm_2(ctrs1[it] - ctrs2[it]), 1e-3);
+    EXPECT_LT(norm_2(dirs1[it] - dirs2[it]), 1e-8);
+  }
+  EXPECT_EQ(dirs2[num - 1], Vector3());
+  EXPECT_EQ(ctrs2[num - 1], Vector3());
+
+  // The batch intersection with the ground must project back into the pixels
+  std::vector<Vector2> no_guesses, lonlats;
+  model.image_to_ground(pixels, h, no_guesses, lonlats);
+  ASSERT_EQ(int(lonlats.size()), num);
+  for (int it = 0; it < num - 1; it++) {
+    Vector2 pix = model.geodetic_to_pixel(Vector3(lonlats[it][0], lonlats[it][1], h));
+    EXPECT_LT(norm_2(pix - pixels[it]), 1.0e-6);
+  }
+  EXPECT_TRUE(lonlats[num - 1] != lonlats[num - 1]); // NaN
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
 TEST( StereoSessionRPC, CheckStereo ) {
 
   xercesc::XMLPlatformUtils::Initialize();
@@ -248,3 +314,101 @@ TEST( StereoSessionRPC, CheckRpcCrop ) {
 
   xercesc::XMLPlatformUtils::Terminate();
 }
+
+// A camera pixel found by a mapproject transform where there is no DEM height
+bool noHeightPixel(Vector2 const& pix) {
+  return pix != pix || pix[0] < -1.0e+5 || pix[1] < -1.0e+5;
+}
+
+// RpcMap2CamTrans must agree with Map2CamTrans and Datum2CamTrans, used before
+// for RPC cameras in mapproject, with and without an adjustment, also where
+// the DEM has no data.
+TEST(RpcMap2CamTrans, MatchesMap2CamTrans) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+  boost::shared_ptr<vw::camera::CameraModel> rpc = load_rpc_camera_model("dg_example1.xml");
+  Vector2i image_size(35491, 24240);
+
+  Vector3 translation(3.0, -2.0, 1.5);
+  Quat rotation(math::euler_to_rotation_matrix(1e-6, 2e-6, -1e-6, "xyz"));
+  boost::shared_ptr<vw::camera::CameraModel>
+    adj_rpc(new vw::camera::AdjustedCameraModel(rpc, translation, rotation, Vector2()));
+  ASSERT_TRUE(RpcMap2CamTrans::is_supported(rpc.get()));
+  ASSERT_TRUE(RpcMap2CamTrans::is_supported(adj_rpc.get()));
+
+  // A small DEM with about 10 m pixels near the RPC model center, with a hole
+  cartography::GeoReference dem_georef;
+  dem_georef.set_well_known_geogcs("WGS84");
+  Matrix3x3 affine = math::identity_matrix<3>();
+  affine(0, 0) = 1e-4;
+  affine(1, 1) = -1e-4;
+  affine(0, 2) = -105.2903 - 15e-4;
+  affine(1, 2) = 39.7454 + 10e-4;
+  dem_georef.set_transform(affine);
+  double nodata = -32768.0;
+  ImageView<float> dem(30, 20);
+  for (int col = 0; col < dem.cols(); col++) {
+    for (int row = 0; row < dem.rows(); row++) {
+      dem(col, row) = 2281.0 + 20.0 * sin(col / 5.0) + 0.5 * row;
+      if (col >= 10 && col < 15 && row >= 5 && row < 9)
+        dem(col, row) = nodata;
+    }
+  }
+  UnlinkName dem_file("rpc_map2cam_dem.tif");
+  vw::GdalWriteOptions opt;
+  TerminalProgressCallback tpc("asp", ": ");
+  bool has_georef = true, has_nodata = true;
+  vw::cartography::block_write_gdal_image(dem_file, dem, has_georef, dem_georef,
+                                          has_nodata, nodata, opt, tpc);
+
+  // The mapprojected image has half the grid size, so its pixels fall between
+  // the DEM pixels. Stay away from the DEM boundary.
+  cartography::GeoReference image_georef = dem_georef;
+  affine(0, 0) = 0.5e-4;
+  affine(1, 1) = -0.5e-4;
+  image_georef.set_transform(affine);
+  BBox2i map_box(2, 2, 54, 34);
+
+  bool call_from_mapproject = true, nearest_neighbor = false;
+  double datum_offset = 2300.0;
+  std::vector<boost::shared_ptr<vw::camera::CameraModel>> cams = {rpc, adj_rpc};
+  for (auto const& cam: cams) {
+    for (int use_dem = 0; use_dem < 2; use_dem++) {
+      RpcMap2CamTrans rpc_trans(cam.get(), image_georef, dem_georef,
+                                use_dem ? std::string(dem_file) : "", datum_offset);
+      vw::cartography::Map2CamTrans
+        map_trans(cam.get(), image_georef, dem_georef, dem_file, image_size,
+                  call_from_mapproject, nearest_neighbor);
+      vw::cartography::Datum2CamTrans
+        datum_trans(cam.get(), image_georef, dem_georef, datum_offset,
+                    image_size, call_from_mapproject, nearest_neighbor);
+
+      // The pixels cached by reverse_bbox(), and some in between
+      rpc_trans.reverse_bbox(map_box);
+      int num_no_height = 0;
+      for (int col = map_box.min().x(); col < map_box.max().x(); col++) {
+        for (int row = map_box.min().y(); row < map_box.max().y(); row++) {
+          for (int frac = 0; frac < 2; frac++) {
+            Vector2 p(col + 0.25 * frac, row + 0.5 * frac);
+            Vector2 rpc_pix = rpc_trans.reverse(p);
+            Vector2 ref_pix = use_dem ? map_trans.reverse(p) : datum_trans.reverse(p);
+            EXPECT_EQ(noHeightPixel(rpc_pix), noHeightPixel(ref_pix));
+            if (noHeightPixel(ref_pix)) {
+              num_no_height++;
+              continue;
+            }
+            EXPECT_VECTOR_NEAR(rpc_pix, ref_pix, 1e-4);
+          }
+        }
+      }
+
+      // The hole in the DEM is seen only when using the DEM
+      if (use_dem)
+        EXPECT_GT(num_no_height, 0);
+      else
+        EXPECT_EQ(num_no_height, 0);
+    }
+  }
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
@@ -674,6 +674,35 @@ namespace asp {
     return vw::Vector3();
   }
 
+  Vector3 BathyStereoModel::triangulateRays(std::vector<Vector3> const& camDirs,
+                                            std::vector<Vector3> const& camCtrs,
+                                            Vector3 & errorVec) const {
+
+    errorVec = Vector3();
+    if (m_least_squares)
+      vw::vw_throw(vw::NoImplErr() << "Least squares refinement is not "
+                   << "implemented when triangulating rays.");
+
+    // Not enough valid rays
+    if (camDirs.size() < 2)
+      return Vector3();
+
+    if (are_nearly_parallel(m_least_squares, m_angle_tol, camDirs))
+      return Vector3();
+
+    Vector3 tri_pt = triangulate_point(camDirs, camCtrs, errorVec);
+
+    // Reflect points that fall behind one of the two cameras
+    bool reflect = false;
+    for (int p = 0; p < (int)camCtrs.size(); p++)
+      if (dot_prod(tri_pt - camCtrs[p], camDirs[p]) < 0)
+        reflect = true;
+    if (reflect)
+      tri_pt = -tri_pt + 2*camCtrs[0];
+
+    return tri_pt;
+  }
+
   Vector3 BathyStereoModel::operator()(std::vector<Vector2> const& pixVec,
                                        double& error) const {
     vw::vw_throw(vw::NoImplErr() << "Not implemented for BathyStereoModel.");
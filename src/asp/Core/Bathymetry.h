@@ -88,6 +88,14 @@ namespace asp {
     virtual vw::Vector3 operator()(vw::Vector2 const& pix1, vw::Vector2 const& pix2,
                                    double & error) const;
     
+    /// Triangulate with no bathymetry correction, given the rays through the
+    /// valid pixels, such as found in batch for many pixels. Same as the base
+    /// class operator(), which finds the rays itself. Least squares
+    /// refinement is not supported, as it needs the pixels.
+    vw::Vector3 triangulateRays(std::vector<vw::Vector3> const& camDirs,
+                                std::vector<vw::Vector3> const& camCtrs,
+                                vw::Vector3 & errorVec) const;
+
     // Settings used for bathymetry correction. The left and right images
     // get individual bathy plane settings, but they may be identical.
     void set_bathy(double refraction_index,
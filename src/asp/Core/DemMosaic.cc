@@ -20,6 +20,23 @@
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/FileIO/DiskImageResourceGDAL.h>
 #include <vw/Image/Filter.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+
+namespace fs  = boost::filesystem;
+namespace bg  = boost::geometry;
+namespace bgi = boost::geometry::index;
 
 namespace asp {
 
@@ -30,9 +47,8 @@ void blurWeights(ImageView<double> & weights, double sigma) {
   if (sigma <= 0)
     return;
 
-  // Blur the weights. To try to make the weights not drop much at the
-  // boundary, expand the weights with zero, blur, crop back to the
-  // original region.
+  // Blur the weights, with zero outside the image, to try to make the
+  // weights not drop much at the boundary. 
 
   // It is highly important to note that blurring can increase the weights
   // at the boundary, even with the extension done above. Erosion before
@@ -41,33 +57,142 @@ void blurWeights(ImageView<double> & weights, double sigma) {
   // huge holes. To get smooth weights, if really desired one should
   // use the weights-exponent option.
 
-  int half_kernel = vw::compute_kernel_size(sigma)/2;
-  int extra = half_kernel + 1; // to guarantee we stay zero at boundary
+  // The Gaussian is separable, so blur the rows, then the columns. Each
+  // pass adds shifted copies of whole rows, so the inner loops go over
+  // contiguous memory and can be vectorized. Rows with no positive
+  // weights are skipped, which is common for DEMs with irregular
+  // boundaries.
+  std::vector<double> kernel;
+  vw::generate_gaussian_kernel(kernel, sigma, vw::compute_kernel_size(sigma));
+  int kernel_size = kernel.size();
+  int half_kernel = kernel_size/2;
 
   int cols = weights.cols(), rows = weights.rows();
+  ImageView<double> horiz_wts(cols, rows);
+  fill(horiz_wts, 0.0);
+  std::vector<double> row_wts(cols);
+  std::vector<char> has_data(rows, 0);
+  for (int row = 0; row < rows; row++) {
+
+    for (int col = 0; col < cols; col++) {
+      row_wts[col] = (weights(col, row) > 0) ? weights(col, row) : 0.0;
+      if (row_wts[col] > 0)
+        has_data[row] = 1;
+    }
+    if (!has_data[row])
+      continue;
+
+    // out[col] += kernel[k] * in[col + k - half_kernel], for in-bounds values
+    double * out = &horiz_wts(0, row);
+    for (int k = 0; k < kernel_size; k++) {
+      int shift = k - half_kernel;
+      int beg = std::max(0, -shift), end = std::min(cols, cols - shift);
+      double kval = kernel[k];
+      double const* in = &row_wts[0] + shift;
+      for (int col = beg; col < end; col++)
+        out[col] += kval * in[col];
+    }
+  }
 
-  ImageView<double> extra_wts(cols + 2*extra, rows + 2*extra);
-  fill(extra_wts, 0);
-  for (int col = 0; col < cols; col++) {
-    for (int row = 0; row < rows; row++) {
-      if (weights(col,row) > 0)
-        extra_wts(col + extra, row + extra) = weights(col, row);
-      else
-        extra_wts(col + extra, row + extra) = 0;
+  // Blur the columns and copy back. The weights must not grow. In
+  // particular, where the original weights were zero, the new weights must
+  // also be zero, as at those points there is no DEM data.
+  std::vector<double> blurred(cols);
+  for (int row = 0; row < rows; row++) {
+
+    if (!has_data[row])
+      continue; // no positive weights to update
+
+    std::fill(blurred.begin(), blurred.end(), 0.0);
+    for (int k = 0; k < kernel_size; k++) {
+      int in_row = row + k - half_kernel;
+      if (in_row < 0 || in_row >= rows || !has_data[in_row])
+        continue;
+      double kval = kernel[k];
+      double const* in = &horiz_wts(0, in_row);
+      for (int col = 0; col < cols; col++)
+        blurred[col] += kval * in[col];
+    }
+
+    for (int col = 0; col < cols; col++) {
+      if (weights(col, row) > 0)
+        weights(col, row) = blurred[col];
     }
   }
 
-  ImageView<double> blurred_wts = gaussian_filter(extra_wts, sigma);
+}
+
+// The weight at given distance from the center of a row or column, with
+// given half-width. It is not normalized. This is a bugfix. Normalized
+// weights result in higher weights in narrow regions, which is not what we
+// want.
+inline double plateauedWeight(double dist, double max_dist, double max_weight_val) {
 
-  // Copy back.  The weights must not grow. In particular, where the
-  // original weights were zero, the new weights must also be zero, as
-  // at those points there is no DEM data.
-  for (int col = 0; col < cols; col++) {
-    for (int row = 0; row < rows; row++) {
-      if (weights(col, row) > 0) {
-        weights(col, row) = blurred_wts(col + extra, row + extra);
+  if (max_dist <= 0 || dist < 0)
+    return 0;
+
+  // We want to make sure the weight is positive (even if small) at
+  // the first/last valid pixel.
+  double tol = 1e-8*max_dist;
+  
+  double weight = std::max(0.0, max_dist - dist + tol);
+  return std::min(max_weight_val, weight);
+}
+
+void centerlineWeights(ImageView<uint8> const& valid,
+                       ImageView<double> & weights,
+                       double max_weight_val, double hole_fill_value,
+                       double border_fill_value) {
+
+  int numRows = valid.rows();
+  int numCols = valid.cols();
+
+  // The first and last valid column in each row, and row in each column
+  std::vector<int> minValInRow(numRows, numCols), maxValInRow(numRows, 0);
+  std::vector<int> minValInCol(numCols, numRows), maxValInCol(numCols, 0);
+
+  // Note that we do just a single pass through the image to compute
+  // both the horizontal and vertical min/max values.
+  for (int row = 0; row < numRows; row++) {
+    uint8 const* valid_row = &valid(0, row);
+    for (int col = 0; col < numCols; col++) {
+      if (!valid_row[col])
+        continue;
+      minValInRow[row] = std::min(minValInRow[row], col);
+      maxValInRow[row] = std::max(maxValInRow[row], col);
+      minValInCol[col] = std::min(minValInCol[col], row);
+      maxValInCol[col] = std::max(maxValInCol[col], row);
+    }
+  }
+  
+  // For each column, the central row and half the valid extent
+  std::vector<double> vCenterLine(numCols), vHalfDist(numCols);
+  for (int col = 0; col < numCols; col++) {
+    vCenterLine[col] = (minValInCol[col] + maxValInCol[col])/2.0;
+    vHalfDist[col] = std::max(maxValInCol[col] - minValInCol[col], 0)/2.0;
+  }
+
+  // Compute the weight for each pixel, a row at a time
+  weights.set_size(numCols, numRows);
+  for (int row = 0; row < numRows; row++) {
+
+    double hCenterLine = (minValInRow[row] + maxValInRow[row])/2.0;
+    double hHalfDist   = std::max(maxValInRow[row] - minValInRow[row], 0)/2.0;
+    uint8 const* valid_row = &valid(0, row);
+    double * out = &weights(0, row);
+
+    for (int col = 0; col < numCols; col++) {
+      if (valid_row[col]) {
+        double weight_h = plateauedWeight(std::abs(col - hCenterLine), hHalfDist,
+                                          max_weight_val);
+        double weight_v = plateauedWeight(std::abs(row - vCenterLine[col]), vHalfDist[col],
+                                          max_weight_val);
+        out[col] = weight_h * weight_v;
+      } else {
+        bool inner_row = ((row >= minValInCol[col]) && (row <= maxValInCol[col]));
+        bool inner_col = ((col >= minValInRow[row]) && (col <= maxValInRow[row]));
+        out[col] = (inner_row && inner_col) ? hole_fill_value : border_fill_value;
       }
-      //weights(col, row) = std::min(weights(col, row), blurred_wts(col + extra, row + extra));
     }
   }
 
@@ -131,4 +256,424 @@ void applyExternalWeights(std::string const& weight_file,
   return;
 }
 
+QuantileSketchTile::QuantileSketchTile(int cols, int rows, int level_size,
+                                       int num_levels):
+  m_cols(cols), m_rows(rows), m_level_size(level_size), m_num_levels(num_levels) {
+
+  if (m_level_size < 2 || m_level_size % 2 != 0 ||
+      m_level_size > std::numeric_limits<std::uint16_t>::max())
+    vw_throw(ArgumentErr() << "The sketch size must be a positive even number.\n");
+  if (m_num_levels < 1)
+    vw_throw(ArgumentErr() << "The sketch must have at least one level.\n");
+
+  std::int64_t num_pix = std::int64_t(cols) * rows;
+  m_samples.resize(m_num_levels);
+  m_counts.resize(m_num_levels);
+  m_num_values.assign(num_pix, 0);
+  m_rank_error.assign(num_pix, 0.0);
+  m_parity.assign(num_pix, 0);
+}
+
+// Add a sample with the given weight at a level. The weight is used only at
+// the last level, as below that it is 2^level.
+void QuantileSketchTile::push(std::int64_t pix, int level, float val, double wt) {
+
+  if (m_samples[level].empty()) {
+    std::int64_t num_pix = std::int64_t(m_cols) * m_rows;
+    m_samples[level].resize(num_pix * m_level_size);
+    m_counts[level].assign(num_pix, 0);
+    if (level == m_num_levels - 1)
+      m_top_weights.resize(num_pix * m_level_size);
+  }
+
+  if (m_counts[level][pix] == m_level_size)
+    compact(pix, level);
+
+  std::int64_t pos = pix * m_level_size + m_counts[level][pix];
+  m_samples[level][pos] = val;
+  if (level == m_num_levels - 1)
+    m_top_weights[pos] = wt;
+  m_counts[level][pix]++;
+}
+
+// Sort the samples at a level and pair up neighbors, keeping one from each
+// pair. The kept sample stands for both, so any rank changes by at most
+// the weight of a pair.
+void QuantileSketchTile::compact(std::int64_t pix, int level) {
+
+  int num = m_counts[level][pix];
+  std::int64_t beg = pix * m_level_size;
+  int parity = m_parity[pix];
+  m_parity[pix] = 1 - parity;
+
+  if (level < m_num_levels - 1) {
+    float * vals = &m_samples[level][beg];
+    std::sort(vals, vals + num);
+    m_counts[level][pix] = 0;
+    double wt = double(1 << level);
+    m_rank_error[pix] += wt;
+    for (int it = parity; it < num; it += 2)
+      push(pix, level + 1, vals[it], 2.0 * wt);
+    return;
+  }
+
+  // The last level. Samples have their own weights.
+  std::vector<std::pair<float, double>> vals(num);
+  for (int it = 0; it < num; it++)
+    vals[it] = std::make_pair(m_samples[level][beg + it], m_top_weights[beg + it]);
+  std::sort(vals.begin(), vals.end());
+  double max_wt = 0.0;
+  int out = 0;
+  for (int it = 0; it + 1 < num; it += 2) {
+    double wt = vals[it].second + vals[it + 1].second;
+    max_wt = std::max(max_wt, wt);
+    m_samples[level][beg + out] = vals[it + parity].first;
+    m_top_weights[beg + out] = wt;
+    out++;
+  }
+  if (num % 2 == 1) { // can't happen with an even level size, but be careful
+    m_samples[level][beg + out] = vals[num - 1].first;
+    m_top_weights[beg + out] = vals[num - 1].second;
+    out++;
+  }
+  m_counts[level][pix] = out;
+  m_rank_error[pix] += max_wt;
+}
+
+void QuantileSketchTile::add(ImageView<double> const& tile, double nodata) {
+
+  if (tile.cols() != m_cols || tile.rows() != m_rows)
+    vw_throw(ArgumentErr() << "QuantileSketchTile: Tile size mismatch.\n");
+
+  for (int row = 0; row < m_rows; row++) {
+    for (int col = 0; col < m_cols; col++) {
+      double val = tile(col, row);
+      if (val == nodata)
+        continue;
+      std::int64_t pix = std::int64_t(row) * m_cols + col;
+      push(pix, 0, val, 1.0);
+      m_num_values[pix]++;
+    }
+  }
+}
+
+// All samples of a pixel with their weights
+void QuantileSketchTile::samples(std::int64_t pix,
+                                 std::vector<std::pair<float, double>> & out) const {
+  out.clear();
+  for (int level = 0; level < m_num_levels; level++) {
+    if (m_samples[level].empty())
+      break;
+    std::int64_t beg = pix * m_level_size;
+    for (int it = 0; it < m_counts[level][pix]; it++) {
+      double wt = (level < m_num_levels - 1) ? double(1 << level) :
+        m_top_weights[beg + it];
+      out.push_back(std::make_pair(m_samples[level][beg + it], wt));
+    }
+  }
+}
+
+// The median of weighted samples, sorted in place. With unit weights and an
+// even number of samples, the two middle ones are averaged.
+double weightedMedian(std::vector<std::pair<float, double>> & vals) {
+
+  std::sort(vals.begin(), vals.end());
+  double total = 0.0;
+  for (size_t it = 0; it < vals.size(); it++)
+    total += vals[it].second;
+
+  double half = total / 2.0, cum = 0.0;
+  double lower = vals.back().first, upper = vals.back().first;
+  bool found_lower = false;
+  for (size_t it = 0; it < vals.size(); it++) {
+    cum += vals[it].second;
+    if (!found_lower && cum >= half) {
+      lower = vals[it].first;
+      found_lower = true;
+    }
+    if (cum > half) {
+      upper = vals[it].first;
+      break;
+    }
+  }
+
+  return (lower + upper) / 2.0;
+}
+
+bool QuantileSketchTile::median(int col, int row, double & val) const {
+  std::int64_t pix = std::int64_t(row) * m_cols + col;
+  if (m_num_values[pix] == 0)
+    return false;
+
+  std::vector<std::pair<float, double>> vals;
+  samples(pix, vals);
+  val = weightedMedian(vals);
+  return true;
+}
+
+bool QuantileSketchTile::nmad(int col, int row, double & val) const {
+  std::int64_t pix = std::int64_t(row) * m_cols + col;
+  if (m_num_values[pix] == 0)
+    return false;
+
+  std::vector<std::pair<float, double>> vals;
+  samples(pix, vals);
+  double med = weightedMedian(vals);
+  for (size_t it = 0; it < vals.size(); it++)
+    vals[it].first = std::abs(vals[it].first - med);
+  val = 1.4826 * weightedMedian(vals);
+  return true;
+}
+
+double QuantileSketchTile::rank_error(int col, int row) const {
+  std::int64_t pix = std::int64_t(row) * m_cols + col;
+  if (m_num_values[pix] == 0)
+    return 0.0;
+  return m_rank_error[pix] / double(m_num_values[pix]);
+}
+
+// A string identifying the version of a file on disk. A cached header is
+// used only if the file still has the same stamp.
+std::string fileStamp(std::string const& file) {
+  std::ostringstream os;
+  os << fs::file_size(file) << " " << fs::last_write_time(file);
+  return os.str();
+}
+
+// Parse a number with strtod, which, unlike streams, handles nan and inf,
+// which can show up as no-data values.
+bool parseDouble(std::istream & is, double & val) {
+  std::string token;
+  if (!(is >> token))
+    return false;
+  char * end = NULL;
+  val = std::strtod(token.c_str(), &end);
+  return end != token.c_str() && *end == '\0';
+}
+
+// Read the header cache. Entries that cannot be parsed are ignored, so
+// the corresponding DEMs will be read again.
+void readDemHeaderCache(std::string const& cache_file,
+                        std::map<std::string, std::pair<std::string, DemHeader>> & cache) {
+
+  cache.clear();
+  std::ifstream ifs(cache_file.c_str());
+  if (!ifs.good())
+    return;
+
+  std::string line, file, stamp;
+  DemHeader header;
+  Matrix3x3 transform;
+  int interp = 0;
+  int num_fields = 0; // how many fields were read for the current file
+  while (std::getline(ifs, line)) {
+    std::istringstream is(line);
+    std::string key;
+    if (!(is >> key) || key[0] == '#')
+      continue;
+
+    bool success = true;
+    if (key == "dem:") {
+      file = line.substr(std::min(line.size(), key.size() + 1));
+      num_fields = 1;
+      continue;
+    } else if (key == "stamp:") {
+      std::getline(is >> std::ws, stamp);
+    } else if (key == "size:") {
+      success = bool(is >> header.cols >> header.rows);
+    } else if (key == "nodata:") {
+      success = bool(is >> header.has_nodata) && parseDouble(is, header.nodata);
+    } else if (key == "pixel_interp:") {
+      success = bool(is >> interp);
+    } else if (key == "transform:") {
+      for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+          success = success && parseDouble(is, transform(r, c));
+    } else if (key == "wkt:") {
+      // The last field. Now the georeference can be put together.
+      std::string wkt = line.substr(std::min(line.size(), key.size() + 1));
+      if (num_fields != 6)
+        continue;
+      header.georef = cartography::GeoReference();
+      header.georef.set_wkt(wkt);
+      header.georef.set_pixel_interpretation
+        (interp == 0 ? cartography::GeoReference::PixelAsArea :
+         cartography::GeoReference::PixelAsPoint);
+      header.georef.set_transform(transform);
+      header.georef.ll_box_from_pix_box(BBox2i(0, 0, header.cols, header.rows));
+      cache[file] = std::make_pair(stamp, header);
+      num_fields = 0;
+      continue;
+    } else {
+      success = false;
+    }
+
+    if (success && num_fields > 0)
+      num_fields++;
+    else
+      num_fields = 0;
+  }
+}
+
+// Save the headers, with one field per line
+void writeDemHeaderCache(std::string const& cache_file,
+                         std::vector<std::string> const& dem_files,
+                         std::vector<std::string> const& stamps,
+                         std::vector<DemHeader> const& headers) {
+
+  std::ofstream ofs(cache_file.c_str());
+  if (!ofs.good())
+    vw_throw(ArgumentErr() << "Cannot write: " << cache_file << "\n");
+  ofs.precision(17);
+  ofs << "# dem_mosaic DEM header cache\n";
+  for (size_t it = 0; it < dem_files.size(); it++) {
+    DemHeader const& h = headers[it];
+    Matrix3x3 transform = h.georef.transform();
+    std::string wkt = h.georef.get_wkt();
+    std::replace(wkt.begin(), wkt.end(), '\n', ' ');
+    ofs << "dem: " << fs::absolute(dem_files[it]).string() << "\n";
+    ofs << "stamp: " << stamps[it] << "\n";
+    ofs << "size: " << h.cols << " " << h.rows << "\n";
+    ofs << "nodata: " << h.has_nodata << " " << h.nodata << "\n";
+    ofs << "pixel_interp: "
+        << (h.georef.pixel_interpretation() == cartography::GeoReference::PixelAsArea ? 0 : 1)
+        << "\n";
+    ofs << "transform:";
+    for (int r = 0; r < 3; r++)
+      for (int c = 0; c < 3; c++)
+        ofs << " " << transform(r, c);
+    ofs << "\n";
+    ofs << "wkt: " << wkt << "\n";
+  }
+}
+
+int readDemHeaders(std::vector<std::string> const& dem_files,
+                   std::string const& cache_file,
+                   std::vector<DemHeader> & headers) {
+
+  std::map<std::string, std::pair<std::string, DemHeader>> cache;
+  if (!cache_file.empty())
+    readDemHeaderCache(cache_file, cache);
+
+  headers.resize(dem_files.size());
+  std::vector<std::string> stamps(dem_files.size());
+  int num_cached = 0;
+
+  TerminalProgressCallback tpc("", "\t--> ");
+  tpc.report_progress(0);
+  double inc_amount = 1.0 / std::max(double(dem_files.size()), 1.0);
+  for (size_t it = 0; it < dem_files.size(); it++) {
+
+    if (!cache_file.empty()) {
+      stamps[it] = fileStamp(dem_files[it]);
+      auto pos = cache.find(fs::absolute(dem_files[it]).string());
+      if (pos != cache.end() && pos->second.first == stamps[it]) {
+        headers[it] = pos->second.second;
+        num_cached++;
+        tpc.report_incremental_progress(inc_amount);
+        continue;
+      }
+    }
+
+    // Open the file once, and read all that is needed from it
+    DiskImageResourceGDAL rsrc(dem_files[it]);
+    DemHeader & h = headers[it];
+    h.cols = rsrc.cols();
+    h.rows = rsrc.rows();
+    h.has_nodata = rsrc.has_nodata_read();
+    h.nodata = h.has_nodata ? rsrc.nodata_read() : 0.0;
+    if (!cartography::read_georeference(h.georef, rsrc))
+      vw_throw(ArgumentErr() << "No georeference found in " << dem_files[it] << ".\n");
+
+    tpc.report_incremental_progress(inc_amount);
+  }
+  tpc.report_finished();
+
+  // Save the cache only if something changed
+  if (!cache_file.empty() && num_cached != int(dem_files.size()))
+    writeDemHeaderCache(cache_file, dem_files, stamps, headers);
+
+  return num_cached;
+}
+
+struct DemFootprintIndex::Impl {
+  typedef bg::model::point<double, 2, bg::cs::cartesian> Point;
+  typedef bg::model::box<Point> Box;
+  typedef std::pair<Box, int> Value;
+
+  bgi::rtree<Value, bgi::rstar<16>> tree;
+  std::vector<int> unindexed;
+};
+
+DemFootprintIndex::DemFootprintIndex(std::vector<BBox2> const& footprints):
+  m_impl(new Impl) {
+
+  std::vector<Impl::Value> values;
+  values.reserve(footprints.size());
+  for (size_t it = 0; it < footprints.size(); it++) {
+    BBox2 const& b = footprints[it];
+    bool is_good = !b.empty();
+    for (int c = 0; c < 2; c++) {
+      if (!std::isfinite(b.min()[c]) || !std::isfinite(b.max()[c]))
+        is_good = false;
+    }
+    if (!is_good) {
+      m_impl->unindexed.push_back(it);
+      continue;
+    }
+    values.push_back(Impl::Value(Impl::Box(Impl::Point(b.min().x(), b.min().y()),
+                                           Impl::Point(b.max().x(), b.max().y())), it));
+  }
+
+  // Bulk loading creates a better balanced tree than inserting one by one
+  m_impl->tree = bgi::rtree<Impl::Value, bgi::rstar<16>>(values.begin(), values.end());
+}
+
+void DemFootprintIndex::query(BBox2 const& box, std::vector<int> & indices) const {
+  std::vector<Impl::Value> found;
+  Impl::Box qbox(Impl::Point(box.min().x(), box.min().y()),
+                 Impl::Point(box.max().x(), box.max().y()));
+  m_impl->tree.query(bgi::intersects(qbox), std::back_inserter(found));
+  indices = m_impl->unindexed;
+  for (size_t it = 0; it < found.size(); it++)
+    indices.push_back(found[it].second);
+  std::sort(indices.begin(), indices.end());
+}
+
+DemHandleCache::DemHandleCache(size_t max_open):
+  m_max_open(std::max(max_open, size_t(1))), m_num_opens(0) {}
+
+void DemHandleCache::add(std::string const& dem_file) {
+  m_files.push_back(dem_file);
+  m_handles.push_back(boost::shared_ptr<DiskImageView<float>>());
+  m_lru_pos.push_back(m_lru.end());
+}
+
+DiskImageView<float> DemHandleCache::get_handle(int index) {
+  Mutex::Lock lock(m_mutex);
+
+  if (m_handles[index]) {
+    // Move to the front of the list
+    m_lru.splice(m_lru.begin(), m_lru, m_lru_pos[index]);
+    return *m_handles[index];
+  }
+
+  while (m_lru.size() >= m_max_open) {
+    m_handles[m_lru.back()].reset();
+    m_lru_pos[m_lru.back()] = m_lru.end();
+    m_lru.pop_back();
+  }
+
+  m_handles[index].reset(new DiskImageView<float>(m_files[index]));
+  m_lru.push_front(index);
+  m_lru_pos[index] = m_lru.begin();
+  m_num_opens++;
+  return *m_handles[index];
+}
+
+size_t DemHandleCache::num_opens() {
+  Mutex::Lock lock(m_mutex);
+  return m_num_opens;
+}
+
 } // end namespace asp
@@ -21,17 +21,145 @@
 #ifndef __ASP_CORE_DEM_MOSAIC_H__
 #define __ASP_CORE_DEM_MOSAIC_H__
 
+#include <vw/Core/Thread.h>
 #include <vw/Image/ImageView.h>
+#include <vw/Math/BBox.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Cartography/GeoReference.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace asp {
 
+/// Blur the positive weights with a Gaussian, with zero outside the image.
+/// Pixels with non-positive weights are not changed.
 void blurWeights(vw::ImageView<double> & weights, double sigma);
 
+/// Weights for blending which are zero at the boundary of the valid region,
+/// then grow, and plateau at max_weight_val. The weight of a valid pixel is
+/// the product of such weights along its row and its column. An invalid pixel
+/// gets hole_fill_value if inside the extent of valid pixels in both its row
+/// and its column, and border_fill_value otherwise.
+void centerlineWeights(vw::ImageView<vw::uint8> const& valid,
+                       vw::ImageView<double> & weights,
+                       double max_weight_val, double hole_fill_value = 0,
+                       double border_fill_value = -1);
+
 void applyExternalWeights(std::string const& weight_file,
                           double min_weight, bool invert_weights,
                           vw::BBox2i const& in_box,
                           vw::ImageView<double>& local_wts);
 
+/// Approximate per-pixel median and NMAD of a stack of tiles, with memory not
+/// depending on the number of tiles. Each pixel has a small sketch made of
+/// levels of samples, where a sample at level l stands for 2^l input values
+/// (a simplified KLL sketch). When a level fills up, it is sorted and every
+/// other sample moves to the level above. The last level keeps a weight for
+/// each sample and is compacted in place. The result is exact for pixels with
+/// at most level_size values.
+class QuantileSketchTile {
+public:
+  QuantileSketchTile(int cols, int rows, int level_size, int num_levels = 8);
+
+  /// Add the values of a tile having the same size as this. Values equal
+  /// to nodata are skipped.
+  void add(vw::ImageView<double> const& tile, double nodata);
+
+  /// The approximate median and NMAD at a pixel. Return false if no values
+  /// were added for it.
+  bool median(int col, int row, double & val) const;
+  bool nmad(int col, int row, double & val) const;
+
+  /// An upper bound on how much the rank of the median found at this pixel
+  /// can differ from the rank of the exact median, divided by the number of
+  /// values. This is 0 where the result is exact.
+  double rank_error(int col, int row) const;
+
+private:
+  void push(std::int64_t pix, int level, float val, double wt);
+  void compact(std::int64_t pix, int level);
+  void samples(std::int64_t pix, std::vector<std::pair<float, double>> & out) const;
+
+  int m_cols, m_rows, m_level_size, m_num_levels;
+  // For each level, the samples of all pixels, allocated when first needed
+  std::vector<std::vector<float>> m_samples;
+  std::vector<std::vector<std::uint16_t>> m_counts;
+  std::vector<double> m_top_weights; // the weights of the samples at the last level
+  std::vector<std::int64_t> m_num_values;
+  std::vector<double> m_rank_error; // not normalized
+  std::vector<std::uint8_t> m_parity; // which half of the samples to keep next
+};
+
+/// The information about an input DEM that dem_mosaic needs before
+/// reading any pixels.
+struct DemHeader {
+  int cols, rows;
+  bool has_nodata;
+  double nodata;
+  vw::cartography::GeoReference georef;
+  DemHeader(): cols(0), rows(0), has_nodata(false), nodata(0.0) {}
+};
+
+/// Read the headers of the given DEMs. If cache_file is not empty, reuse the
+/// headers saved in it for the DEMs whose size and modification time did not
+/// change, and save there the updated list. Return the number of headers
+/// that were read from the cache.
+int readDemHeaders(std::vector<std::string> const& dem_files,
+                   std::string const& cache_file,
+                   std::vector<DemHeader> & headers);
+
+/// An R-tree over the footprints of the input DEMs, used to find the DEMs
+/// which may intersect a given box. Empty or non-finite footprints are not
+/// put in the tree and are always returned.
+class DemFootprintIndex {
+public:
+  DemFootprintIndex(std::vector<vw::BBox2> const& footprints);
+
+  /// The indices of the footprints intersecting the given box, in
+  /// increasing order.
+  void query(vw::BBox2 const& box, std::vector<int> & indices) const;
+
+private:
+  struct Impl;
+  boost::shared_ptr<Impl> m_impl;
+};
+
+/// Handles to the input DEMs, with at most a given number of them open at
+/// once. When a DEM which is not open is needed and the limit is reached, the
+/// least recently used one is closed. A returned handle shares the file with
+/// this cache, so it stays valid if the cache closes its copy. All functions
+/// but add() are thread-safe.
+class DemHandleCache {
+public:
+  explicit DemHandleCache(size_t max_open);
+
+  /// Add a DEM. Call this before requesting any handles.
+  void add(std::string const& dem_file);
+
+  size_t size() const { return m_files.size(); }
+  std::string const& get_file_name(int index) const { return m_files[index]; }
+
+  /// A handle to the DEM with this index, opening it if needed
+  vw::DiskImageView<float> get_handle(int index);
+
+  /// How many times the DEMs were opened, for reporting
+  size_t num_opens();
+
+private:
+  vw::Mutex m_mutex;
+  size_t m_max_open, m_num_opens;
+  std::vector<std::string> m_files;
+  std::vector<boost::shared_ptr<vw::DiskImageView<float>>> m_handles;
+  std::list<int> m_lru; // the open DEMs, the most recently used first
+  std::vector<std::list<int>::iterator> m_lru_pos;
+};
+
 } // end namespace asp
 
 #endif //__ASP_CORE_DEM_MOSAIC_H__
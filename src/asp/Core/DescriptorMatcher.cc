@@ -0,0 +1,380 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file DescriptorMatcher.cc
+///
+
+#include <asp/Core/DescriptorMatcher.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/InterestPoint/InterestData.h>
+#include <vw/InterestPoint/Matcher.h> // ip_list_to_matrix()
+
+#include <boost/utility.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace asp {
+
+namespace {
+
+// The number of independent partial sums for the L2 distance. Float rows
+// are padded to a multiple of this.
+const int L2_LANES = 8;
+
+// Compare this many queries with this many references at a time. A block
+// of 512 references with 128 floats each takes 256 KB, so it fits in cache.
+const int QUERY_BLOCK = 32;
+const int REF_BLOCK   = 512;
+
+// Each thread processes this many queries at a time
+const int QUERIES_PER_TASK = 8 * QUERY_BLOCK;
+
+// Squared L2 distance. The partial sums are in separate lanes, and are added
+// in a fixed order at the end, so the result does not depend on whether the
+// compiler vectorizes the loop.
+struct L2Dist {
+  typedef float value_type;
+  typedef float dist_type;
+  dist_type operator()(value_type const* a, value_type const* b, int dim) const {
+    float acc[L2_LANES];
+    for (int l = 0; l < L2_LANES; l++)
+      acc[l] = 0.0f;
+    for (int j = 0; j < dim; j += L2_LANES) {
+      for (int l = 0; l < L2_LANES; l++) {
+        float diff = a[j + l] - b[j + l];
+        acc[l] += diff * diff;
+      }
+    }
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+  }
+};
+
+// Hamming distance, for bits packed in 64-bit words
+struct HammingDist {
+  typedef std::uint64_t value_type;
+  typedef int           dist_type;
+  dist_type operator()(value_type const* a, value_type const* b, int dim) const {
+    int dist = 0;
+    for (int j = 0; j < dim; j++)
+      dist += __builtin_popcountll(a[j] ^ b[j]);
+    return dist;
+  }
+};
+
+// Insert a candidate in the sorted list of k nearest neighbors, if it is
+// closer than the last one. With equal distances, the earlier candidate stays
+// first, and the candidates are visited in increasing order of the index.
+template <class DistT>
+void insertNeighbor(DistT dist, int index, int k, DistT * best_dist, int * best_index) {
+  if (!(dist < best_dist[k - 1]))
+    return;
+  int pos = k - 1;
+  while (pos > 0 && dist < best_dist[pos - 1]) {
+    best_dist[pos]  = best_dist[pos - 1];
+    best_index[pos] = best_index[pos - 1];
+    pos--;
+  }
+  best_dist[pos]  = dist;
+  best_index[pos] = index;
+}
+
+// Find the k nearest references for the queries in [beg, end). The outputs
+// are for all queries, with k values for each.
+template <class DistFunT>
+void knnRange(typename DistFunT::value_type const* ref, int num_ref,
+              typename DistFunT::value_type const* query, int beg, int end,
+              int dim, int k, int * out_index, double * out_dist) {
+
+  typedef typename DistFunT::dist_type dist_type;
+  DistFunT dist_fun;
+  std::vector<dist_type> best_dist(QUERY_BLOCK * k);
+  std::vector<int>       best_index(QUERY_BLOCK * k);
+
+  for (int q0 = beg; q0 < end; q0 += QUERY_BLOCK) {
+    int q1 = std::min(end, q0 + QUERY_BLOCK);
+    std::fill(best_dist.begin(), best_dist.end(), std::numeric_limits<dist_type>::max());
+    std::fill(best_index.begin(), best_index.end(), -1);
+
+    for (int r0 = 0; r0 < num_ref; r0 += REF_BLOCK) {
+      int r1 = std::min(num_ref, r0 + REF_BLOCK);
+      for (int q = q0; q < q1; q++) {
+        auto const* q_ptr = query + size_t(q) * dim;
+        dist_type * bd = &best_dist[(q - q0) * k];
+        int       * bi = &best_index[(q - q0) * k];
+        for (int r = r0; r < r1; r++)
+          insertNeighbor(dist_fun(q_ptr, ref + size_t(r) * dim, dim), r, k, bd, bi);
+      }
+    }
+
+    for (int q = q0; q < q1; q++) {
+      for (int it = 0; it < k; it++) {
+        int i = (q - q0) * k + it;
+        out_index[size_t(q) * k + it] = best_index[i];
+        out_dist [size_t(q) * k + it] = (best_index[i] < 0) ?
+          std::numeric_limits<double>::max() : double(best_dist[i]);
+      }
+    }
+  }
+}
+
+// Find the k nearest among the given references, for a single query
+template <class DistFunT>
+void knnSubset(typename DistFunT::value_type const* ref,
+               typename DistFunT::value_type const* query,
+               std::vector<int> const& candidates, int dim, int k,
+               std::vector<int> & indices, std::vector<double> & distances) {
+
+  typedef typename DistFunT::dist_type dist_type;
+  DistFunT dist_fun;
+  std::vector<dist_type> best_dist(k, std::numeric_limits<dist_type>::max());
+  std::vector<int>       best_index(k, -1);
+  for (size_t it = 0; it < candidates.size(); it++) {
+    int r = candidates[it];
+    insertNeighbor(dist_fun(query, ref + size_t(r) * dim, dim), r, k,
+                   &best_dist[0], &best_index[0]);
+  }
+
+  indices = best_index;
+  distances.resize(k);
+  for (int it = 0; it < k; it++)
+    distances[it] = (best_index[it] < 0) ?
+      std::numeric_limits<double>::max() : double(best_dist[it]);
+}
+
+template <class DistFunT>
+class KnnTask: public vw::Task, private boost::noncopyable {
+  typedef typename DistFunT::value_type value_type;
+  value_type const* m_ref;
+  int m_num_ref;
+  value_type const* m_query;
+  int m_beg, m_end, m_dim, m_k;
+  int * m_out_index;
+  double * m_out_dist;
+public:
+  KnnTask(value_type const* ref, int num_ref, value_type const* query,
+          int beg, int end, int dim, int k, int * out_index, double * out_dist):
+    m_ref(ref), m_num_ref(num_ref), m_query(query), m_beg(beg), m_end(end),
+    m_dim(dim), m_k(k), m_out_index(out_index), m_out_dist(out_dist) {}
+
+  void operator()() {
+    knnRange<DistFunT>(m_ref, m_num_ref, m_query, m_beg, m_end, m_dim, m_k,
+                       m_out_index, m_out_dist);
+  }
+};
+
+// Split the queries among threads. Each query is processed on its own, so
+// the results do not depend on how the work is divided.
+template <class DistFunT>
+void knnSearchImpl(std::vector<typename DistFunT::value_type> const& ref, int num_ref,
+                   std::vector<typename DistFunT::value_type> const& query, int num_query,
+                   int dim, int k, int num_threads,
+                   std::vector<int> & indices, std::vector<double> & distances) {
+
+  indices.resize(size_t(num_query) * k);
+  distances.resize(size_t(num_query) * k);
+  if (num_query == 0)
+    return;
+
+  if (num_threads <= 1 || num_query <= QUERIES_PER_TASK) {
+    knnRange<DistFunT>(&ref[0], num_ref, &query[0], 0, num_query, dim, k,
+                       &indices[0], &distances[0]);
+    return;
+  }
+
+  vw::FifoWorkQueue queue(num_threads);
+  for (int beg = 0; beg < num_query; beg += QUERIES_PER_TASK) {
+    int end = std::min(num_query, beg + QUERIES_PER_TASK);
+    boost::shared_ptr<vw::Task>
+      task(new KnnTask<DistFunT>(&ref[0], num_ref, &query[0], beg, end, dim, k,
+                                 &indices[0], &distances[0]));
+    queue.add_task(task);
+  }
+  queue.join_all();
+}
+
+int paddedFloatDim(int cols) {
+  return L2_LANES * ((cols + L2_LANES - 1) / L2_LANES);
+}
+
+int numBitWords(int cols) {
+  return (cols + 7) / 8;
+}
+
+void packFloat(vw::Matrix<float> const& m, std::vector<float> & packed) {
+  int dim = paddedFloatDim(m.cols());
+  packed.assign(std::max(size_t(1), size_t(m.rows()) * dim), 0.0f);
+  for (size_t r = 0; r < m.rows(); r++) {
+    for (size_t c = 0; c < m.cols(); c++)
+      packed[r * dim + c] = m(r, c);
+  }
+}
+
+void packBits(vw::Matrix<unsigned char> const& m, std::vector<std::uint64_t> & packed) {
+  int dim = numBitWords(m.cols());
+  packed.assign(std::max(size_t(1), size_t(m.rows()) * dim), 0);
+  for (size_t r = 0; r < m.rows(); r++) {
+    for (size_t c = 0; c < m.cols(); c++)
+      packed[r * dim + c / 8] |= std::uint64_t(m(r, c)) << (8 * (c % 8));
+  }
+}
+
+} // end anonymous namespace
+
+void BruteForceMatcher::loadMatchData(vw::Matrix<float> const& ref) {
+  m_binary = false;
+  m_num = ref.rows();
+  m_dim = paddedFloatDim(ref.cols());
+  packFloat(ref, m_ref_float);
+  m_ref_bits.clear();
+}
+
+void BruteForceMatcher::loadMatchData(vw::Matrix<unsigned char> const& ref) {
+  m_binary = true;
+  m_num = ref.rows();
+  m_dim = numBitWords(ref.cols());
+  packBits(ref, m_ref_bits);
+  m_ref_float.clear();
+}
+
+void BruteForceMatcher::knnSearch(vw::Matrix<float> const& queries, int k, int num_threads,
+                                  std::vector<int> & indices,
+                                  std::vector<double> & distances) const {
+  if (m_binary)
+    vw::vw_throw(vw::ArgumentErr() << "Expecting binary descriptors as queries.\n");
+  if (queries.rows() > 0 && paddedFloatDim(queries.cols()) != m_dim)
+    vw::vw_throw(vw::ArgumentErr() << "The query and reference descriptors "
+                 << "have different lengths.\n");
+  if (k <= 0)
+    vw::vw_throw(vw::ArgumentErr() << "Expecting a positive number of neighbors.\n");
+
+  std::vector<float> packed;
+  packFloat(queries, packed);
+  knnSearchImpl<L2Dist>(m_ref_float, m_num, packed, queries.rows(), m_dim, k,
+                        num_threads, indices, distances);
+}
+
+void BruteForceMatcher::knnSearch(vw::Matrix<unsigned char> const& queries, int k,
+                                  int num_threads, std::vector<int> & indices,
+                                  std::vector<double> & distances) const {
+  if (!m_binary)
+    vw::vw_throw(vw::ArgumentErr() << "Expecting float descriptors as queries.\n");
+  if (queries.rows() > 0 && numBitWords(queries.cols()) != m_dim)
+    vw::vw_throw(vw::ArgumentErr() << "The query and reference descriptors "
+                 << "have different lengths.\n");
+  if (k <= 0)
+    vw::vw_throw(vw::ArgumentErr() << "Expecting a positive number of neighbors.\n");
+
+  std::vector<std::uint64_t> packed;
+  packBits(queries, packed);
+  knnSearchImpl<HammingDist>(m_ref_bits, m_num, packed, queries.rows(), m_dim, k,
+                             num_threads, indices, distances);
+}
+
+void BruteForceMatcher::knnSearchSubset(vw::Vector<float> const& query,
+                                        std::vector<int> const& candidates, int k,
+                                        std::vector<int> & indices,
+                                        std::vector<double> & distances) const {
+  if (k <= 0)
+    vw::vw_throw(vw::ArgumentErr() << "Expecting a positive number of neighbors.\n");
+  for (size_t it = 0; it < candidates.size(); it++) {
+    if (candidates[it] < 0 || candidates[it] >= m_num)
+      vw::vw_throw(vw::ArgumentErr() << "Out of range reference index.\n");
+  }
+
+  if (m_binary) {
+    vw::Matrix<unsigned char> m(1, query.size());
+    for (size_t c = 0; c < query.size(); c++)
+      m(0, c) = static_cast<unsigned char>(query[c]);
+    if (numBitWords(m.cols()) != m_dim)
+      vw::vw_throw(vw::ArgumentErr() << "The query and reference descriptors "
+                   << "have different lengths.\n");
+    std::vector<std::uint64_t> packed;
+    packBits(m, packed);
+    knnSubset<HammingDist>(&m_ref_bits[0], &packed[0], candidates, m_dim, k,
+                           indices, distances);
+  } else {
+    vw::Matrix<float> m(1, query.size());
+    for (size_t c = 0; c < query.size(); c++)
+      m(0, c) = query[c];
+    if (paddedFloatDim(m.cols()) != m_dim)
+      vw::vw_throw(vw::ArgumentErr() << "The query and reference descriptors "
+                   << "have different lengths.\n");
+    std::vector<float> packed;
+    packFloat(m, packed);
+    knnSubset<L2Dist>(&m_ref_float[0], &packed[0], candidates, m_dim, k,
+                      indices, distances);
+  }
+}
+
+bool useBruteForceMatcher(std::string const& flann_method) {
+  return flann_method == "brute";
+}
+
+std::string flannMethodForTrees(std::string const& flann_method) {
+  if (useBruteForceMatcher(flann_method))
+    return "kmeans";
+  return flann_method;
+}
+
+void bruteForceMatch(std::vector<vw::ip::InterestPoint> const& ip1,
+                     std::vector<vw::ip::InterestPoint> const& ip2,
+                     bool binary_descriptors, double uniqueness_threshold,
+                     std::vector<vw::ip::InterestPoint> & matched_ip1,
+                     std::vector<vw::ip::InterestPoint> & matched_ip2) {
+
+  matched_ip1.clear();
+  matched_ip2.clear();
+
+  // Two neighbors are needed for the uniqueness test
+  if (ip1.empty() || ip2.size() < 2)
+    return;
+
+  const int k = 2;
+  int num_threads = vw::vw_settings().default_num_threads();
+  BruteForceMatcher matcher;
+  std::vector<int> indices;
+  std::vector<double> distances;
+  if (binary_descriptors) {
+    vw::Matrix<unsigned char> ref, query;
+    ip_list_to_matrix(ip2, ref);
+    ip_list_to_matrix(ip1, query);
+    matcher.loadMatchData(ref);
+    matcher.knnSearch(query, k, num_threads, indices, distances);
+  } else {
+    vw::Matrix<float> ref, query;
+    ip_list_to_matrix(ip2, ref);
+    ip_list_to_matrix(ip1, query);
+    matcher.loadMatchData(ref);
+    matcher.knnSearch(query, k, num_threads, indices, distances);
+  }
+
+  for (size_t it = 0; it < ip1.size(); it++) {
+    int i0 = indices[k * it], i1 = indices[k * it + 1];
+    if (i0 < 0 || i1 < 0)
+      continue;
+    if (distances[k * it] < uniqueness_threshold * distances[k * it + 1]) {
+      matched_ip1.push_back(ip1[it]);
+      matched_ip2.push_back(ip2[i0]);
+    }
+  }
+}
+
+} // end namespace asp
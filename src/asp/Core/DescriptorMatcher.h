@@ -0,0 +1,106 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file DescriptorMatcher.h
+///
+/// Exact nearest-neighbor search for interest point descriptors, by
+/// comparing each query with all reference descriptors. This is used with
+/// --flann-method brute. Unlike the FLANN kdtree method, the results are
+/// always the same, for any number of threads.
+///
+/// The descriptors are stored row after row, padded with zeros to a
+/// multiple of the block length, and compared in blocks of queries and
+/// references that fit in cache. The distance for each pair is accumulated
+/// in a fixed order, with independent partial sums that the compiler can
+/// vectorize. Ties are broken in favor of the smaller reference index.
+
+#ifndef __ASP_CORE_DESCRIPTOR_MATCHER_H__
+#define __ASP_CORE_DESCRIPTOR_MATCHER_H__
+
+#include <vw/Math/Matrix.h>
+#include <vw/Math/Vector.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vw {
+  namespace ip {
+    class InterestPoint;
+  }
+}
+
+namespace asp {
+
+class BruteForceMatcher {
+public:
+  BruteForceMatcher(): m_dim(0), m_num(0), m_binary(false) {}
+
+  // Float descriptors, compared with the squared L2 distance, as in FLANN
+  void loadMatchData(vw::Matrix<float> const& ref);
+
+  // Binary descriptors, such as ORB, with 8 bits per value, compared with
+  // the Hamming distance
+  void loadMatchData(vw::Matrix<unsigned char> const& ref);
+
+  // For each query row, find the k nearest reference rows, sorted by
+  // distance. The outputs have k values per query. Where there are fewer
+  // than k references, the index is -1. The query type must be the same as
+  // for the reference data.
+  void knnSearch(vw::Matrix<float> const& queries, int k, int num_threads,
+                 std::vector<int> & indices, std::vector<double> & distances) const;
+  void knnSearch(vw::Matrix<unsigned char> const& queries, int k, int num_threads,
+                 std::vector<int> & indices, std::vector<double> & distances) const;
+
+  // Same as knnSearch(), for a single query, but compare it only with the
+  // references with given indices. Ties are broken in favor of the candidate
+  // that comes first. The query values are converted to unsigned char for
+  // binary descriptors.
+  void knnSearchSubset(vw::Vector<float> const& query,
+                       std::vector<int> const& candidates, int k,
+                       std::vector<int> & indices, std::vector<double> & distances) const;
+
+  int size() const { return m_num; }
+
+private:
+  int  m_dim; // values per row: floats, or 64-bit words for binary data, with padding
+  int  m_num; // number of references
+  bool m_binary;
+  std::vector<float>         m_ref_float;
+  std::vector<std::uint64_t> m_ref_bits;
+};
+
+// If the given value of --flann-method asks for the brute-force matcher
+bool useBruteForceMatcher(std::string const& flann_method);
+
+// The method to pass to FLANN for searches that do not use the brute-force
+// matcher. The deterministic method is used if brute-force is requested.
+std::string flannMethodForTrees(std::string const& flann_method);
+
+// Match each interest point in ip1 to its nearest neighbor in ip2, if the
+// distance to it is less than uniqueness_threshold times the distance to the
+// second nearest one. Same logic as vw::ip::InterestPointMatcher, with the
+// brute-force search.
+void bruteForceMatch(std::vector<vw::ip::InterestPoint> const& ip1,
+                     std::vector<vw::ip::InterestPoint> const& ip2,
+                     bool binary_descriptors, double uniqueness_threshold,
+                     std::vector<vw::ip::InterestPoint> & matched_ip1,
+                     std::vector<vw::ip::InterestPoint> & matched_ip2);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DESCRIPTOR_MATCHER_H__
@@ -0,0 +1,126 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file DisparityFilter.h
+///
+/// Outlier removal and smoothing of the refined disparity. Used by
+/// stereo_fltr, and by stereo_tri when refinement, filtering, and
+/// triangulation are done in one pass.
+
+#ifndef __ASP_CORE_DISPARITY_FILTER_H__
+#define __ASP_CORE_DISPARITY_FILTER_H__
+
+#include <asp/Core/StereoSettings.h>
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/BlobIndex.h>
+#include <vw/Image/ErodeView.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace asp {
+
+// Erode blobs from given image by iterating through tiles, biasing
+// each tile by a factor of blob size, removing blobs in the tile,
+// then shrinking the tile back. The bias is necessary to help avoid
+// fragmenting (and then unnecessarily removing) blobs.
+template <class ImageT>
+class PerTileErode: public vw::ImageViewBase<PerTileErode<ImageT>> {
+  ImageT m_img;
+public:
+  PerTileErode(vw::ImageViewBase<ImageT> const& img):
+    m_img(img.impl()) {}
+
+  // Image View interface
+  typedef typename ImageT::pixel_type pixel_type;
+  typedef pixel_type                  result_type;
+  typedef vw::ProceduralPixelAccessor<PerTileErode> pixel_accessor;
+
+  inline vw::int32 cols  () const { return m_img.cols(); }
+  inline vw::int32 rows  () const { return m_img.rows(); }
+  inline vw::int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+  inline pixel_type operator()(double /*i*/, double /*j*/, vw::int32 /*p*/ = 0) const {
+    vw::vw_throw(vw::NoImplErr() << "PerTileErode::operator()(...) is not implemented");
+    return pixel_type();
+  }
+
+  typedef vw::CropView<vw::ImageView<pixel_type>> prerasterize_type;
+  inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+
+    int area = stereo_settings().erode_max_size;
+
+    // We look a beyond the current tile, to avoid cutting blobs
+    // if possible. Skinny blobs will be cut though.
+    int bias = 2*int(ceil(sqrt(double(area))));
+
+    vw::BBox2i bbox2 = bbox;
+    bbox2.expand(bias);
+    bbox2.crop(bounding_box(m_img));
+    vw::ImageView<pixel_type> tile_img = crop(m_img, bbox2);
+
+    int tile_size = std::max(bbox2.width(), bbox2.height()); // don't subsplit
+    vw::BlobIndexThreaded smallBlobIndex(tile_img, area, tile_size);
+    vw::ImageView<pixel_type> clean_tile_img = applyErodeView(tile_img,
+                                                              smallBlobIndex);
+    return prerasterize_type(clean_tile_img,
+                             -bbox2.min().x(), -bbox2.min().y(),
+                             cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
+template <class ImageT>
+PerTileErode<ImageT>
+per_tile_erode(vw::ImageViewBase<ImageT> const& img) {
+  typedef PerTileErode<ImageT> return_type;
+  return return_type(img.impl());
+}
+
+/// The number of outlier removal passes. It is zero if --filter-mode is 0,
+/// and then texture-aware smoothing is done instead.
+int numCleanupPasses();
+
+/// Read the masks of the aligned images and shrink them by --mask-buffer-size.
+void disparityEdgeMasks(ASPGlobalOptions const& opt,
+                        vw::ImageViewRef<vw::uint8> & left_edge_mask,
+                        vw::ImageViewRef<vw::uint8> & right_edge_mask);
+
+/// Remove outliers from the disparity, or smooth it, per --filter-mode, then
+/// invalidate it where the left pixel or the matching right pixel is outside
+/// the edge masks.
+vw::ImageViewRef<vw::PixelMask<vw::Vector2f>>
+filteredDisparity(vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> const& disp,
+                  vw::ImageViewRef<vw::PixelGray<float>> const& left_image,
+                  vw::ImageViewRef<vw::uint8> const& left_edge_mask,
+                  vw::ImageViewRef<vw::uint8> const& right_edge_mask);
+
+/// How far beyond a tile filteredDisparity(), followed by per_tile_erode()
+/// if --erode-max-size is positive, reads the input disparity.
+int disparityFilterMargin();
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DISPARITY_FILTER_H__
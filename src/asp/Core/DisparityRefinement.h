@@ -0,0 +1,53 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2025, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file DisparityRefinement.h
+///
+/// Subpixel refinement of the integer disparity produced by correlation. Used
+/// by stereo_rfne, and by stereo_tri when refinement, filtering, and
+/// triangulation are done in one pass.
+
+#ifndef __ASP_CORE_DISPARITY_REFINEMENT_H__
+#define __ASP_CORE_DISPARITY_REFINEMENT_H__
+
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Math/Vector.h>
+
+namespace asp {
+
+class ASPGlobalOptions;
+
+/// Refine the integer disparity with the subpixel mode in stereo_settings().
+vw::ImageViewRef<vw::PixelMask<vw::Vector2f>>
+refine_disparity(vw::ImageViewRef<vw::PixelGray<float>> const& left_image,
+                 vw::ImageViewRef<vw::PixelGray<float>> const& right_image,
+                 vw::ImageViewRef<vw::PixelMask<vw::Vector2f>> const& integer_disp,
+                 ASPGlobalOptions const& opt, bool verbose);
+
+/// Load the aligned images and the disparity from correlation, or from
+/// blending if --subpix-from-blend is set, and return the refined disparity
+/// for the full image. It is computed lazily, per tile. If skip_img_norm is
+/// true, the images are normalized here, as the affine subpixel modes expect.
+vw::ImageViewRef<vw::PixelMask<vw::Vector2f>>
+refinedDisparity(ASPGlobalOptions const& opt, bool skip_img_norm,
+                 bool do_not_exceed_min_max);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_DISPARITY_REFINEMENT_H__
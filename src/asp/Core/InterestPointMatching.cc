@@ -16,6 +16,7 @@
 // __END_LICENSE__
 
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/DescriptorMatcher.h>
 #include <asp/Core/StereoSettings.h>
 
 #include <vw/InterestPoint/IntegralDetector.h>
@@ -697,7 +698,7 @@ bool stddev_ip_filtering(std::vector<vw::ip::InterestPoint> const& ip1,
         Vector2(ip1[index].x,ip1[index].y);
       count++;
     }
-    math::FLANNTree<float> tree1(asp::stereo_settings().flann_method);
+    math::FLANNTree<float> tree1(flannMethodForTrees(asp::stereo_settings().flann_method));
     tree1.load_match_data(locations1, vw::math::FLANN_DistType_L2);
 
     std::pair<double,size_t> worse_index;
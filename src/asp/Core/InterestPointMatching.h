@@ -250,6 +250,46 @@ void detect_match_ip(std::vector<vw::ip::InterestPoint>& matched_ip1,
                      double nodata2 = std::numeric_limits<double>::quiet_NaN(),
                      std::string const& match_file = "");
 
+// Match interest points in both directions with the help of cameras and a
+// datum, keeping the matches close to the epipolar lines and consistent in
+// both directions. If stereo_settings().epipolar_band_matching is set,
+// compare the descriptors only with those of the points near the epipolar
+// line (see EpipolarBandMatchTask).
+void epipolar_ip_matching_task(bool single_threaded_camera,
+                               DetectIpMethod detect_method,
+                               int number_of_jobs,
+                               double epipolar_threshold,
+                               double uniqueness_threshold,
+                               vw::cartography::Datum const& datum,
+                               bool quiet,
+                               vw::camera::CameraModel* cam1,
+                               vw::camera::CameraModel* cam2,
+                               vw::ip::InterestPointList const& ip1,
+                               vw::ip::InterestPointList const& ip2,
+                               // Outputs
+                               std::vector<vw::ip::InterestPoint>& matched_ip1,
+                               std::vector<vw::ip::InterestPoint>& matched_ip2);
+
+// Bucket interest points by pixel location, to quickly find the ones near a
+// line. The cells are squares, and there are not many more than the points.
+class IpLineGrid {
+public:
+  IpLineGrid(vw::ip::InterestPointList const& ip, double cell_size);
+
+  vw::Vector2 const& point(int index) const { return m_points[index]; }
+
+  // Find the points within given distance from the line ax + by + c = 0,
+  // in increasing order of their index.
+  void points_near_line(vw::Vector3 const& line, double max_dist,
+                        std::vector<int> & indices) const;
+
+private:
+  double m_min_x, m_min_y, m_cell_size;
+  int    m_cols, m_rows;
+  std::vector<vw::Vector2> m_points;
+  std::vector<std::vector<int>> m_cells; // indices of the points in each cell
+};
+
 // A debug routine to save images with matches on top of them.
 void write_match_image(std::string const& out_file_name,
                        vw::ImageViewRef<float> const& image1,
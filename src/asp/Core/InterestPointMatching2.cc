@@ -16,6 +16,7 @@
 // __END_LICENSE__
 
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/DescriptorMatcher.h>
 #include <asp/Core/StereoSettings.h>
 
 #include <vw/Math/GaussianClustering.h>
@@ -79,8 +80,26 @@ public:
   static double distance_point_line(vw::Vector3 const& line, vw::Vector2 const& point);
 
   friend class EpipolarLineMatchTask;
+  friend class EpipolarBandMatchTask;
+
+private:
+  /// Same as operator(), but find the epipolar line for each ip first, then
+  /// compare the descriptors only with those of the points near that line.
+  void match_in_band(vw::ip::InterestPointList const& ip1,
+                     vw::ip::InterestPointList const& ip2,
+                     DetectIpMethod  ip_detect_method,
+                     size_t          number_of_jobs,
+                     vw::camera::CameraModel        * cam1,
+                     vw::camera::CameraModel        * cam2,
+                     std::vector<size_t>            & output_indices) const;
 };
 
+// How many nearest descriptors to consider for each interest point
+const size_t NUM_MATCHES_TO_FIND = 10;
+
+// Matches this far beyond the epipolar threshold make the match ambiguous
+const double EPIPOLAR_BAND_EXPANSION = 200;
+
 EpipolarLinePointMatcher::EpipolarLinePointMatcher(bool   single_threaded_camera,
                                                    double uniqueness_threshold,
                                                    double epipolar_threshold,
@@ -160,6 +179,185 @@ double EpipolarLinePointMatcher::distance_point_line(Vector3 const& line,
     norm_2(subvector(line, 0, 2));
 }
 
+// Given the nearest descriptor matches, sorted by distance, with the index set
+// to -1 for those that are not close enough to the epipolar line, return the
+// chosen match, or -1 as a flag for no match.
+size_t select_epipolar_match(std::vector<std::pair<float,int>> const& kept_indices,
+                             double uniqueness_threshold) {
+  // If we only found one match or the first descriptor match is much better than the second
+  if (((kept_indices.size() > 2)     &&
+       (kept_indices[0].second >= 0) &&
+       (kept_indices[0].first < uniqueness_threshold * kept_indices[1].first))
+      || (kept_indices.size() == 1))
+    return kept_indices[0].second; // Return the first of the matches we found
+
+  return (size_t)(-1); // No matches or no clear winner
+}
+
+IpLineGrid::IpLineGrid(ip::InterestPointList const& ip, double cell_size):
+  m_min_x(0), m_min_y(0), m_cell_size(cell_size), m_cols(0), m_rows(0) {
+
+  BBox2 box;
+  for (auto it = ip.begin(); it != ip.end(); it++) {
+    m_points.push_back(Vector2(it->x, it->y));
+    box.grow(m_points.back());
+  }
+  if (m_points.empty())
+    return;
+
+  // Use bigger cells if there would be too many of them
+  double max_num_cells = 4.0 * m_points.size() + 1.0;
+  m_cell_size = std::max(m_cell_size, 1.0);
+  while (((box.width() / m_cell_size) + 1.0) * ((box.height() / m_cell_size) + 1.0)
+         > max_num_cells)
+    m_cell_size *= 2.0;
+
+  m_min_x = box.min().x();
+  m_min_y = box.min().y();
+  m_cols  = int(box.width()  / m_cell_size) + 1;
+  m_rows  = int(box.height() / m_cell_size) + 1;
+  m_cells.resize(m_cols * m_rows);
+  for (size_t it = 0; it < m_points.size(); it++) {
+    int col = std::min(m_cols - 1, int((m_points[it].x() - m_min_x) / m_cell_size));
+    int row = std::min(m_rows - 1, int((m_points[it].y() - m_min_y) / m_cell_size));
+    m_cells[row * m_cols + col].push_back(it);
+  }
+}
+
+void IpLineGrid::points_near_line(Vector3 const& line, double max_dist,
+                                  std::vector<int> & indices) const {
+  indices.clear();
+  double len = norm_2(subvector(line, 0, 2));
+  if (m_points.empty() || len == 0)
+    return;
+
+  // Walk along the coordinate axis closer to the line direction. For
+  // each column (or row) of cells, find the range of cells across it
+  // that are within the band around the line.
+  bool along_x = (std::abs(line.y()) >= std::abs(line.x()));
+  double u = (along_x ? line.x() : line.y()) / len; // coefficient along
+  double v = (along_x ? line.y() : line.x()) / len; // coefficient across
+  double c = line.z() / len;
+  int    num_along   = along_x ? m_cols  : m_rows;
+  int    num_across  = along_x ? m_rows  : m_cols;
+  double min_along   = along_x ? m_min_x : m_min_y;
+  double min_across  = along_x ? m_min_y : m_min_x;
+  double spread      = max_dist / std::abs(v);
+
+  for (int i = 0; i < num_along; i++) {
+    double t0 = min_along + i * m_cell_size, t1 = t0 + m_cell_size;
+    double s0 = -(u * t0 + c) / v, s1 = -(u * t1 + c) / v;
+    double beg = floor((std::min(s0, s1) - spread - min_across) / m_cell_size);
+    double end = floor((std::max(s0, s1) + spread - min_across) / m_cell_size);
+    if (end < 0 || beg > num_across - 1)
+      continue;
+    int beg_j = std::max(0, int(beg)), end_j = std::min(num_across - 1, int(end));
+    for (int j = beg_j; j <= end_j; j++) {
+      int cell = along_x ? (j * m_cols + i) : (i * m_cols + j);
+      for (int index: m_cells[cell]) {
+        if (EpipolarLinePointMatcher::distance_point_line(line, m_points[index]) < max_dist)
+          indices.push_back(index);
+      }
+    }
+  }
+
+  std::sort(indices.begin(), indices.end());
+}
+
+// Find the epipolar lines for a range of interest points
+class EpipolarLineTask: public Task, private boost::noncopyable {
+  std::vector<ip::InterestPoint> const& m_ip;
+  size_t                                m_beg, m_end;
+  vw::cartography::Datum const&         m_datum;
+  camera::CameraModel                  *m_cam1, *m_cam2;
+  std::vector<Vector3>                & m_lines;
+  std::vector<unsigned char>          & m_found;
+public:
+  EpipolarLineTask(std::vector<ip::InterestPoint> const& ip, size_t beg, size_t end,
+                   vw::cartography::Datum const& datum,
+                   camera::CameraModel* cam1, camera::CameraModel* cam2,
+                   std::vector<Vector3> & lines, std::vector<unsigned char> & found):
+    m_ip(ip), m_beg(beg), m_end(end), m_datum(datum), m_cam1(cam1), m_cam2(cam2),
+    m_lines(lines), m_found(found) {}
+
+  void operator()() {
+    for (size_t i = m_beg; i < m_end; i++) {
+      bool success = false;
+      m_lines[i] = EpipolarLinePointMatcher::epipolar_line(Vector2(m_ip[i].x, m_ip[i].y),
+                                                           m_datum, m_cam1, m_cam2,
+                                                           success);
+      m_found[i] = success;
+    }
+  }
+};
+
+// Match a range of interest points, given their epipolar lines, comparing
+// each one only with the points near its line. The decision differs from
+// EpipolarLineMatchTask. That one finds the NUM_MATCHES_TO_FIND nearest
+// descriptors over the whole other image, then drops the ones outside the
+// large band (epipolar threshold plus EPIPOLAR_BAND_EXPANSION). This one finds
+// the nearest descriptors only among the points in the large band. So the
+// uniqueness test compares the best two matches in the band, even if better
+// matches exist elsewhere, and a match is accepted without that test
+// (kept_indices.size() == 1) only when the band holds exactly one point.
+// This can find matches the other approach misses, when the nearest
+// descriptors are all far from the epipolar line.
+class EpipolarBandMatchTask: public Task, private boost::noncopyable {
+  std::vector<ip::InterestPoint> const& m_ip1;
+  size_t                                m_beg, m_end;
+  std::vector<Vector3> const&           m_lines;
+  std::vector<unsigned char> const&     m_found;
+  IpLineGrid const&                     m_grid;
+  BruteForceMatcher const&              m_descriptors2;
+  EpipolarLinePointMatcher const&       m_matcher;
+  std::vector<size_t>                 & m_output;
+public:
+  EpipolarBandMatchTask(std::vector<ip::InterestPoint> const& ip1, size_t beg, size_t end,
+                        std::vector<Vector3> const& lines,
+                        std::vector<unsigned char> const& found,
+                        IpLineGrid const& grid, BruteForceMatcher const& descriptors2,
+                        EpipolarLinePointMatcher const& matcher,
+                        std::vector<size_t> & output):
+    m_ip1(ip1), m_beg(beg), m_end(end), m_lines(lines), m_found(found), m_grid(grid),
+    m_descriptors2(descriptors2), m_matcher(matcher), m_output(output) {}
+
+  void operator()() {
+    double small_epipolar_threshold = m_matcher.m_epipolar_threshold;
+    double large_epipolar_threshold = small_epipolar_threshold + EPIPOLAR_BAND_EXPANSION;
+    std::vector<int> candidates, indices;
+    std::vector<double> distances;
+    std::vector<std::pair<float,int>> kept_indices;
+
+    for (size_t i = m_beg; i < m_end; i++) {
+      m_output[i] = (size_t)(-1); // Failed to find a match, unless changed below
+      if (!m_found[i])
+        continue;
+
+      m_grid.points_near_line(m_lines[i], large_epipolar_threshold, candidates);
+      if (candidates.empty())
+        continue;
+      m_descriptors2.knnSearchSubset(m_ip1[i].descriptor, candidates,
+                                     NUM_MATCHES_TO_FIND, indices, distances);
+
+      // Same logic as in EpipolarLineMatchTask, but all candidates are within
+      // the large threshold (see above).
+      kept_indices.clear();
+      for (size_t j = 0; j < indices.size(); j++) {
+        if (indices[j] < 0)
+          break;
+        Vector2 ip2_coord = m_grid.point(indices[j]);
+        double line_distance = m_matcher.distance_point_line(m_lines[i], ip2_coord);
+        if (line_distance < small_epipolar_threshold)
+          kept_indices.push_back(std::pair<float,int>(distances[j], indices[j]));
+        else // In between thresholds
+          kept_indices.push_back(std::pair<float,int>(distances[j], -1));
+      }
+
+      m_output[i] = select_epipolar_match(kept_indices, m_matcher.m_uniqueness_threshold);
+    }
+  }
+};
+
 // Local class definition
 class EpipolarLineMatchTask: public Task, private boost::noncopyable {
   typedef ip::InterestPointList::const_iterator IPListIter;
@@ -167,6 +365,7 @@ class EpipolarLineMatchTask: public Task, private boost::noncopyable {
   bool                            m_use_uchar_tree;
   math::FLANNTree<float>        & m_tree_float;
   math::FLANNTree<unsigned char>& m_tree_uchar;
+  BruteForceMatcher const*        m_brute; // if not NULL, use this instead of the trees
   IPListIter                      m_start, m_end;
   ip::InterestPointList const&    m_ip_other;
   camera::CameraModel            *m_cam1, *m_cam2;
@@ -178,6 +377,7 @@ public:
                         bool use_uchar_tree,
                         math::FLANNTree<float>        & tree_float,
                         math::FLANNTree<unsigned char>& tree_uchar,
+                        BruteForceMatcher const* brute,
                         ip::InterestPointList::const_iterator start,
                         ip::InterestPointList::const_iterator end,
                         ip::InterestPointList const& ip2,
@@ -188,17 +388,36 @@ public:
                         std::vector<size_t>::iterator output):
     m_single_threaded_camera(single_threaded_camera),
     m_use_uchar_tree(use_uchar_tree), m_tree_float(tree_float), m_tree_uchar(tree_uchar),
-    m_start(start), m_end(end), m_ip_other(ip2),
+    m_brute(brute), m_start(start), m_end(end), m_ip_other(ip2),
     m_cam1(cam1), m_cam2(cam2),
     m_matcher( matcher), m_camera_mutex(camera_mutex), m_output(output) {}
 
   void operator()() {
 
-    const size_t NUM_MATCHES_TO_FIND = 10;
     Vector<int> indices(NUM_MATCHES_TO_FIND);
     Vector<double> distances(NUM_MATCHES_TO_FIND);
 
-    for (IPListIter ip = m_start; ip != m_end; ip++) {
+    // With the brute-force matcher, find the neighbors for all points at once
+    std::vector<int> brute_indices;
+    std::vector<double> brute_distances;
+    if (m_brute != NULL) {
+      std::vector<ip::InterestPoint> queries(m_start, m_end);
+      int num_threads = 1; // this is already run in parallel
+      if (m_use_uchar_tree) {
+        Matrix<unsigned char> query_matrix;
+        ip_list_to_matrix(queries, query_matrix);
+        m_brute->knnSearch(query_matrix, NUM_MATCHES_TO_FIND, num_threads,
+                           brute_indices, brute_distances);
+      } else {
+        Matrix<float> query_matrix;
+        ip_list_to_matrix(queries, query_matrix);
+        m_brute->knnSearch(query_matrix, NUM_MATCHES_TO_FIND, num_threads,
+                           brute_indices, brute_distances);
+      }
+    }
+    size_t query_index = 0;
+
+    for (IPListIter ip = m_start; ip != m_end; ip++, query_index++) {
       Vector2 ip_org_coord = Vector2(ip->x, ip->y);
       Vector3 line_eq;
 
@@ -225,7 +444,17 @@ public:
 
       // Call the correct FLANN tree for the matching type
       size_t num_matches_valid = 0;
-      if (m_use_uchar_tree) {
+      if (m_brute != NULL) {
+        // The neighbors are sorted, and the missing ones are at the end
+        for (size_t i = 0; i < NUM_MATCHES_TO_FIND; i++) {
+          int index = brute_indices[query_index * NUM_MATCHES_TO_FIND + i];
+          if (index < 0)
+            break;
+          indices[num_matches_valid] = index;
+          distances[num_matches_valid] = brute_distances[query_index * NUM_MATCHES_TO_FIND + i];
+          num_matches_valid++;
+        }
+      } else if (m_use_uchar_tree) {
         vw::Vector<unsigned char> uchar_descriptor(ip->descriptor.size());
         for (size_t i=0; i<ip->descriptor.size(); i++)
           uchar_descriptor[i] = static_cast<unsigned char>(ip->descriptor[i]);
@@ -247,7 +476,6 @@ public:
 
       // Loop through the N "nearest" points and keep only the ones within
       //   m_matcher.m_epipolar_threshold pixel distance from the epipolar line
-      const double EPIPOLAR_BAND_EXPANSION = 200;
       double small_epipolar_threshold = m_matcher.m_epipolar_threshold;
       double large_epipolar_threshold = small_epipolar_threshold + EPIPOLAR_BAND_EXPANSION;
       for ( size_t i = 0; i < num_matches_valid; i++ ) {
@@ -273,16 +501,7 @@ public:
         }
       } // End loop for match pruning
 
-        // If we only found one match or the first descriptor match is much better than the second
-      if (((kept_indices.size() > 2)     &&
-            (kept_indices[0].second >= 0) &&
-            (kept_indices[0].first < m_matcher.m_uniqueness_threshold * kept_indices[1].first))
-           || (kept_indices.size() == 1)) {
-        *m_output++ = kept_indices[0].second; // Return the first of the matches we found
-        //vw_out() << "Kept distance: " << kept_indices[0].first << std::endl;
-      } else { // No matches or no clear winner
-        *m_output++ = (size_t)(-1); // Failed to find a match, return a flag!
-      }
+      *m_output++ = select_epipolar_match(kept_indices, m_matcher.m_uniqueness_threshold);
     } // End loop through IP
   } // End function operator()
 
@@ -306,25 +525,41 @@ void EpipolarLinePointMatcher::operator()(ip::InterestPointList const& ip1,
     return;
   }
 
+  if (asp::stereo_settings().epipolar_band_matching) {
+    match_in_band(ip1, ip2, ip_detect_method, number_of_jobs, cam1, cam2, output_indices);
+    return;
+  }
+
   // Build the output indices
   output_indices.resize(ip1_size);
 
   // Set up FLANNTree objects of all the different types we may need.
-  math::FLANNTree<float>         kd_float(asp::stereo_settings().flann_method);
-  math::FLANNTree<unsigned char> kd_uchar(asp::stereo_settings().flann_method);
+  std::string flann_method = asp::stereo_settings().flann_method;
+  math::FLANNTree<float>         kd_float(flannMethodForTrees(flann_method));
+  math::FLANNTree<unsigned char> kd_uchar(flannMethodForTrees(flann_method));
+  BruteForceMatcher brute;
+  bool use_brute = useBruteForceMatcher(flann_method);
 
   Matrix<float>         ip2_matrix_float;
   Matrix<unsigned char> ip2_matrix_uchar;
 
-  // Pack the IP descriptors into a matrix and feed it to the chosen FLANNTree object
+  // Pack the IP descriptors into a matrix and feed it to the chosen FLANNTree
+  // object, or to the brute-force matcher.
   const bool use_uchar_FLANN = (ip_detect_method == DETECT_IP_METHOD_ORB);
   if (use_uchar_FLANN) {
     ip_list_to_matrix(ip2, ip2_matrix_uchar);
-    kd_uchar.load_match_data(ip2_matrix_uchar, vw::math::FLANN_DistType_Hamming);
+    if (use_brute)
+      brute.loadMatchData(ip2_matrix_uchar);
+    else
+      kd_uchar.load_match_data(ip2_matrix_uchar, vw::math::FLANN_DistType_Hamming);
   }else {
     ip_list_to_matrix(ip2, ip2_matrix_float);
-    kd_float.load_match_data(ip2_matrix_float,  vw::math::FLANN_DistType_L2);
+    if (use_brute)
+      brute.loadMatchData(ip2_matrix_float);
+    else
+      kd_float.load_match_data(ip2_matrix_float,  vw::math::FLANN_DistType_L2);
   }
+  BruteForceMatcher const* brute_ptr = use_brute ? &brute : NULL;
 
   vw_out(InfoMessage,"interest_point") << "FLANN-Tree created. Searching...\n";
 
@@ -346,7 +581,7 @@ void EpipolarLinePointMatcher::operator()(ip::InterestPointList const& ip1,
     boost::shared_ptr<Task>
       match_task(new EpipolarLineMatchTask(m_single_threaded_camera,
                                            use_uchar_FLANN, kd_float, kd_uchar,
-                                           start_it, end_it,
+                                           brute_ptr, start_it, end_it,
                                            ip2, cam1, cam2, *this,
                                            camera_mutex, output_it));
     matching_queue.add_task( match_task );
@@ -358,13 +593,67 @@ void EpipolarLinePointMatcher::operator()(ip::InterestPointList const& ip1,
   boost::shared_ptr<Task>
     match_task(new EpipolarLineMatchTask(m_single_threaded_camera,
                                          use_uchar_FLANN, kd_float, kd_uchar,
-                                         start_it, ip1.end(),
+                                         brute_ptr, start_it, ip1.end(),
                                          ip2, cam1, cam2, *this,
                                          camera_mutex, output_it));
   matching_queue.add_task(match_task);
   matching_queue.join_all(); // Wait for all the jobs to finish.
 }
 
+void EpipolarLinePointMatcher::match_in_band(ip::InterestPointList const& ip1,
+                                             ip::InterestPointList const& ip2,
+                                             DetectIpMethod  ip_detect_method,
+                                             size_t          number_of_jobs,
+                                             camera::CameraModel        * cam1,
+                                             camera::CameraModel        * cam2,
+                                             std::vector<size_t>        & output_indices) const {
+
+  std::vector<ip::InterestPoint> ip1_vec(ip1.begin(), ip1.end());
+  size_t ip1_size = ip1_vec.size();
+  output_indices.resize(ip1_size);
+  number_of_jobs = std::max(size_t(1), std::min(number_of_jobs, ip1_size));
+  size_t job_size = (ip1_size + number_of_jobs - 1) / number_of_jobs;
+
+  // Find the epipolar lines first. If the cameras are not thread-safe, do it
+  // in this thread, rather than having all threads wait on a lock.
+  std::vector<Vector3> lines(ip1_size);
+  std::vector<unsigned char> found(ip1_size, 0);
+  {
+    FifoWorkQueue line_queue(m_single_threaded_camera ? 1 : number_of_jobs);
+    for (size_t beg = 0; beg < ip1_size; beg += job_size) {
+      size_t end = std::min(ip1_size, beg + job_size);
+      boost::shared_ptr<Task>
+        line_task(new EpipolarLineTask(ip1_vec, beg, end, m_datum, cam1, cam2,
+                                       lines, found));
+      line_queue.add_task(line_task);
+    }
+    line_queue.join_all();
+  }
+
+  // The descriptors to compare with, and their locations
+  BruteForceMatcher descriptors2;
+  if (ip_detect_method == DETECT_IP_METHOD_ORB) {
+    Matrix<unsigned char> ip2_matrix;
+    ip_list_to_matrix(ip2, ip2_matrix);
+    descriptors2.loadMatchData(ip2_matrix);
+  } else {
+    Matrix<float> ip2_matrix;
+    ip_list_to_matrix(ip2, ip2_matrix);
+    descriptors2.loadMatchData(ip2_matrix);
+  }
+  IpLineGrid grid(ip2, m_epipolar_threshold + EPIPOLAR_BAND_EXPANSION);
+
+  FifoWorkQueue matching_queue(number_of_jobs);
+  for (size_t beg = 0; beg < ip1_size; beg += job_size) {
+    size_t end = std::min(ip1_size, beg + job_size);
+    boost::shared_ptr<Task>
+      match_task(new EpipolarBandMatchTask(ip1_vec, beg, end, lines, found, grid,
+                                           descriptors2, *this, output_indices));
+    matching_queue.add_task(match_task);
+  }
+  matching_queue.join_all();
+}
+
 // End class EpipolarLinePointMatcher
 //---------------------------------------------------------------------------------------
 
@@ -587,7 +876,13 @@ void match_ip_no_datum(std::vector<vw::ip::InterestPoint> const& ip1_copy,
 
   // TODO: Should probably unify the ip::InterestPointMatcher class
   // with the EpipolarLinePointMatcher class!
-  if (detect_method != DETECT_IP_METHOD_ORB) {
+  if (useBruteForceMatcher(asp::stereo_settings().flann_method)) {
+    if (!quiet)
+      vw_out() << "\t   Matching with the brute-force matcher.\n";
+    bool binary_descriptors = (detect_method == DETECT_IP_METHOD_ORB);
+    bruteForceMatch(ip1_copy, ip2_copy, binary_descriptors, uniqueness_threshold,
+                    matched_ip1, matched_ip2);
+  } else if (detect_method != DETECT_IP_METHOD_ORB) {
     // For all L2Norm distance metrics
     vw::ip::InterestPointMatcher<vw::ip::L2NormMetric,ip::NullConstraint> 
       matcher(asp::stereo_settings().flann_method, uniqueness_threshold);
@@ -350,7 +350,8 @@ namespace asp {
   //  - Use the interest points to find the local alignment
   //  - Apply the composition of the global and local alignment to the
   //    original unaligned images to find the locally aligned images
-  //  - Save the locally aligned images to disk
+  //  - Return the locally aligned images, and save them to disk if
+  //    write_tiles is true (otherwise the file names are empty)
   //  - Estimate the search range for the locally aligned images
 
   void local_alignment(// Inputs
@@ -362,6 +363,7 @@ namespace asp {
                        double                          right_extra_factor,
                        vw::BBox2i              const & tile_crop_win,
                        bool                            write_nodata,
+                       bool                            write_tiles,
                        vw::camera::CameraModel const * left_camera_model,
                        vw::camera::CameraModel const * right_camera_model,
                        vw::cartography::Datum  const & datum,
@@ -372,6 +374,8 @@ namespace asp {
                        vw::Matrix<double>            & right_local_mat,
                        std::string                   & left_aligned_file,
                        std::string                   & right_aligned_file,
+                       vw::ImageView<float>          & left_aligned_tile,
+                       vw::ImageView<float>          & right_aligned_tile,
                        int                           & min_disp,
                        int                           & max_disp) {
 
@@ -624,24 +628,32 @@ namespace asp {
       right_trans_clip = apply_mask(create_mask(right_trans_clip, 0), 0);
     }
 
-    // Write the locally aligned images to disk
-    vw::cartography::GeoReference georef;
-    bool has_georef = false, has_aligned_nodata = write_nodata;
-    std::string left_tile = "left-aligned-tile.tif";
-    std::string right_tile = "right-aligned-tile.tif";
-    left_aligned_file = opt.out_prefix + "-" + left_tile;
-    vw_out() << "\t--> Writing: " << left_aligned_file << "\n";
-    block_write_gdal_image(left_aligned_file, left_trans_clip,
-                           has_georef, georef,
-                           has_aligned_nodata, nan_nodata, opt,
-                           TerminalProgressCallback("asp","\t  Left:  "));
-    right_aligned_file = opt.out_prefix + "-" + right_tile;
-    vw_out() << "\t--> Writing: " << right_aligned_file << "\n";
-    block_write_gdal_image(right_aligned_file,
-                           right_trans_clip,
-                           has_georef, georef,
-                           has_aligned_nodata, nan_nodata, opt,
-                           TerminalProgressCallback("asp","\t  Right:  "));
+    left_aligned_tile = left_trans_clip;
+    right_aligned_tile = right_trans_clip;
+
+    // Write the locally aligned images to disk, if the stereo algorithm
+    // cannot take them in memory
+    left_aligned_file = "";
+    right_aligned_file = "";
+    if (write_tiles) {
+      vw::cartography::GeoReference georef;
+      bool has_georef = false, has_aligned_nodata = write_nodata;
+      std::string left_tile = "left-aligned-tile.tif";
+      std::string right_tile = "right-aligned-tile.tif";
+      left_aligned_file = opt.out_prefix + "-" + left_tile;
+      vw_out() << "\t--> Writing: " << left_aligned_file << "\n";
+      block_write_gdal_image(left_aligned_file, left_trans_clip,
+                             has_georef, georef,
+                             has_aligned_nodata, nan_nodata, opt,
+                             TerminalProgressCallback("asp","\t  Left:  "));
+      right_aligned_file = opt.out_prefix + "-" + right_tile;
+      vw_out() << "\t--> Writing: " << right_aligned_file << "\n";
+      block_write_gdal_image(right_aligned_file,
+                             right_trans_clip,
+                             has_georef, georef,
+                             has_aligned_nodata, nan_nodata, opt,
+                             TerminalProgressCallback("asp","\t  Right:  "));
+    }
 
     Vector2 outlier_removal_params = stereo_settings().outlier_removal_params;
 
@@ -24,6 +24,7 @@
 
 #include <vw/Math/BBox.h>
 #include <vw/Math/Matrix.h>
+#include <vw/Image/ImageView.h>
 #include <vw/Image/ImageViewRef.h>
 
 // Forward declarations
@@ -46,7 +47,8 @@ namespace asp {
   //  - Use the interest points to find the local alignment
   //  - Apply the composition of the global and local alignment to the
   //    original unaligned images to find the locally aligned images
-  //  - Save the locally aligned images to disk
+  //  - Return the locally aligned images, and save them to disk if
+  //    write_tiles is true (otherwise the file names are empty)
   //  - Estimate the search range for the locally aligned images
 
   class ASPGlobalOptions; // forward declaration
@@ -60,6 +62,7 @@ namespace asp {
                        double                          right_extra_factor,
                        vw::BBox2i       const & tile_crop_win,
                        bool                     write_nodata,
+                       bool                     write_tiles,
                        vw::camera::CameraModel const * left_camera_model,
                        vw::camera::CameraModel const * right_camera_model,
                        vw::cartography::Datum  const & datum,
@@ -70,6 +73,8 @@ namespace asp {
                        vw::Matrix<double> & right_local_mat,
                        std::string        & left_aligned_file,
                        std::string        & right_aligned_file,
+                       vw::ImageView<float> & left_aligned_tile,
+                       vw::ImageView<float> & right_aligned_tile,
                        int                & min_disp,
                        int                & max_disp); 
   
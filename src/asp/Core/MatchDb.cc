@@ -0,0 +1,372 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file MatchDb.cc
+///
+
+#include <asp/Core/MatchDb.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/InterestPoint/InterestData.h>
+#include <vw/InterestPoint/MatcherIO.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+const char MATCH_DB_MAGIC[] = "ASPMDB01";
+const size_t MATCH_DB_MAGIC_LEN = 8;
+const size_t MATCH_DB_HEADER_LEN = MATCH_DB_MAGIC_LEN + 2 * sizeof(std::uint64_t);
+
+// The fixed-size part of an interest point, as stored on disk
+struct IpRecord {
+  float x, y;
+  std::int32_t ix, iy;
+  float orientation, scale, interest;
+  std::uint32_t polarity, octave, scale_lvl;
+};
+static_assert(sizeof(IpRecord) == 40, "Unexpected padding in IpRecord.");
+
+// Size of the data block for a pair, before padding
+std::uint64_t blockSize(std::uint64_t num_ip, std::uint32_t desc_len) {
+  return 2 * num_ip * (sizeof(IpRecord) + desc_len * sizeof(float));
+}
+
+std::uint64_t padTo8(std::uint64_t pos) {
+  return (pos + 7) / 8 * 8;
+}
+
+// All descriptors of a pair must have the same length
+std::uint32_t descriptorLength(std::vector<vw::ip::InterestPoint> const& ip1,
+                               std::vector<vw::ip::InterestPoint> const& ip2,
+                               std::string const& match_file) {
+  std::uint32_t desc_len = ip1.empty() ? 0 : ip1[0].descriptor.size();
+  for (size_t it = 0; it < ip1.size(); it++) {
+    if (ip1[it].descriptor.size() != desc_len || ip2[it].descriptor.size() != desc_len)
+      vw::vw_throw(vw::ArgumentErr() << "Cannot store matches for " << match_file
+                   << " in a match database, as the descriptor lengths differ.\n");
+  }
+  return desc_len;
+}
+
+void writeRecords(std::ofstream & out, std::vector<vw::ip::InterestPoint> const& ip) {
+  std::vector<IpRecord> records(ip.size());
+  for (size_t it = 0; it < ip.size(); it++) {
+    IpRecord & r = records[it];
+    r.x = ip[it].x;
+    r.y = ip[it].y;
+    r.ix = ip[it].ix;
+    r.iy = ip[it].iy;
+    r.orientation = ip[it].orientation;
+    r.scale = ip[it].scale;
+    r.interest = ip[it].interest;
+    r.polarity = ip[it].polarity;
+    r.octave = ip[it].octave;
+    r.scale_lvl = ip[it].scale_lvl;
+  }
+  if (!records.empty())
+    out.write(reinterpret_cast<const char*>(&records[0]), records.size() * sizeof(IpRecord));
+}
+
+void writeDescriptors(std::ofstream & out, std::vector<vw::ip::InterestPoint> const& ip,
+                      std::uint32_t desc_len) {
+  if (desc_len == 0)
+    return;
+  std::vector<float> desc(ip.size() * desc_len);
+  for (size_t it = 0; it < ip.size(); it++) {
+    for (std::uint32_t d = 0; d < desc_len; d++)
+      desc[it * desc_len + d] = ip[it].descriptor[d];
+  }
+  out.write(reinterpret_cast<const char*>(&desc[0]), desc.size() * sizeof(float));
+}
+
+// Read the interest points starting at the given location in the map.
+// Use memcpy, as the data need not be aligned for the records.
+void readRecords(const char * data, std::uint64_t num_ip,
+                 std::vector<vw::ip::InterestPoint> & ip) {
+  ip.resize(num_ip);
+  IpRecord r;
+  for (std::uint64_t it = 0; it < num_ip; it++) {
+    std::memcpy(&r, data + it * sizeof(IpRecord), sizeof(IpRecord));
+    vw::ip::InterestPoint & p = ip[it];
+    p.x = r.x;
+    p.y = r.y;
+    p.ix = r.ix;
+    p.iy = r.iy;
+    p.orientation = r.orientation;
+    p.scale = r.scale;
+    p.interest = r.interest;
+    p.polarity = (r.polarity != 0);
+    p.octave = r.octave;
+    p.scale_lvl = r.scale_lvl;
+  }
+}
+
+void readDescriptors(const char * data, std::uint32_t desc_len,
+                     std::vector<vw::ip::InterestPoint> & ip) {
+  for (size_t it = 0; it < ip.size(); it++) {
+    ip[it].descriptor.set_size(desc_len);
+    if (desc_len > 0)
+      std::memcpy(&ip[it].descriptor[0], data + it * desc_len * sizeof(float),
+                  desc_len * sizeof(float));
+  }
+}
+
+// Read a value from the map, checking the bounds
+template<class T>
+T readValue(const char * data, std::uint64_t size, std::uint64_t & pos,
+            std::string const& db_file) {
+  if (pos + sizeof(T) > size)
+    vw::vw_throw(vw::IOErr() << "Truncated match database: " << db_file << "\n");
+  T val;
+  std::memcpy(&val, data + pos, sizeof(T));
+  pos += sizeof(T);
+  return val;
+}
+
+} // end anonymous namespace
+
+MatchDb::MatchDb(std::string const& db_file) {
+  open(db_file);
+}
+
+void MatchDb::open(std::string const& db_file) {
+
+  m_file = db_file;
+  m_index.clear();
+  if (m_map.is_open())
+    m_map.close();
+
+  try {
+    m_map.open(db_file);
+  } catch (std::exception const& e) {
+    vw::vw_throw(vw::IOErr() << "Cannot open match database: " << db_file << ". "
+                 << e.what() << "\n");
+  }
+
+  const char * data = m_map.data();
+  std::uint64_t size = m_map.size();
+  if (size < MATCH_DB_HEADER_LEN ||
+      std::memcmp(data, MATCH_DB_MAGIC, MATCH_DB_MAGIC_LEN) != 0)
+    vw::vw_throw(vw::IOErr() << "Not a match database: " << db_file << "\n");
+
+  std::uint64_t pos = MATCH_DB_MAGIC_LEN;
+  std::uint64_t num_pairs = readValue<std::uint64_t>(data, size, pos, db_file);
+  pos = readValue<std::uint64_t>(data, size, pos, db_file); // the index offset
+
+  for (std::uint64_t it = 0; it < num_pairs; it++) {
+    std::uint32_t name_len = readValue<std::uint32_t>(data, size, pos, db_file);
+    if (pos + name_len > size)
+      vw::vw_throw(vw::IOErr() << "Truncated match database: " << db_file << "\n");
+    std::string name(data + pos, name_len);
+    pos += name_len;
+    Entry e;
+    e.name     = name;
+    e.offset   = readValue<std::uint64_t>(data, size, pos, db_file);
+    e.num_ip   = readValue<std::uint64_t>(data, size, pos, db_file);
+    e.desc_len = readValue<std::uint32_t>(data, size, pos, db_file);
+    if (e.offset + blockSize(e.num_ip, e.desc_len) > size)
+      vw::vw_throw(vw::IOErr() << "Truncated match database: " << db_file << "\n");
+    if (!m_index.empty() && !(m_index.back().name < name))
+      vw::vw_throw(vw::IOErr() << "The index of the match database is not sorted: "
+                   << db_file << "\n");
+    m_index.push_back(e);
+  }
+}
+
+MatchDb::Entry const* MatchDb::lookup(std::string const& match_file) const {
+  std::string name = matchDbName(match_file);
+  auto it = std::lower_bound(m_index.begin(), m_index.end(), name,
+                             [](Entry const& e, std::string const& val) {
+                               return e.name < val;
+                             });
+  if (it == m_index.end() || it->name != name)
+    return NULL;
+  return &(*it);
+}
+
+MatchDb::Entry const& MatchDb::find(std::string const& match_file) const {
+  Entry const* e = lookup(match_file);
+  if (e == NULL)
+    vw::vw_throw(vw::ArgumentErr() << "Match file " << match_file
+                 << " is not in the match database: " << m_file << "\n");
+  return *e;
+}
+
+bool MatchDb::has(std::string const& match_file) const {
+  return lookup(match_file) != NULL;
+}
+
+std::uint64_t MatchDb::numMatches(std::string const& match_file) const {
+  return find(match_file).num_ip;
+}
+
+void MatchDb::read(std::string const& match_file,
+                   std::vector<vw::ip::InterestPoint> & ip1,
+                   std::vector<vw::ip::InterestPoint> & ip2) const {
+
+  Entry const& e = find(match_file);
+  const char * data = m_map.data() + e.offset;
+  std::uint64_t rec_len = e.num_ip * sizeof(IpRecord);
+  std::uint64_t desc_len = e.num_ip * e.desc_len * sizeof(float);
+  readRecords(data, e.num_ip, ip1);
+  readRecords(data + rec_len, e.num_ip, ip2);
+  readDescriptors(data + 2 * rec_len, e.desc_len, ip1);
+  readDescriptors(data + 2 * rec_len + desc_len, e.desc_len, ip2);
+}
+
+std::vector<std::string> MatchDb::names() const {
+  std::vector<std::string> names;
+  for (auto const& e: m_index)
+    names.push_back(e.name);
+  return names;
+}
+
+MatchDbWriter::MatchDbWriter(std::string const& db_file):
+  m_file(db_file), m_tmp_file(db_file + ".tmp"), m_pos(0) {
+
+  fs::path dir = fs::path(db_file).parent_path();
+  if (!dir.empty())
+    fs::create_directories(dir);
+
+  m_out.open(m_tmp_file.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+  if (!m_out.good())
+    vw::vw_throw(vw::IOErr() << "Cannot write: " << m_tmp_file << "\n");
+
+  // Placeholder for the header, which is filled in by close()
+  std::vector<char> header(MATCH_DB_HEADER_LEN, 0);
+  m_out.write(&header[0], header.size());
+  m_pos = header.size();
+}
+
+// If close() was not called, such as on an exception, discard the data
+MatchDbWriter::~MatchDbWriter() {
+  if (m_out.is_open()) {
+    m_out.close();
+    boost::system::error_code ec;
+    fs::remove(m_tmp_file, ec);
+  }
+}
+
+void MatchDbWriter::write(std::string const& match_file,
+                          std::vector<vw::ip::InterestPoint> const& ip1,
+                          std::vector<vw::ip::InterestPoint> const& ip2) {
+
+  if (!m_out.is_open())
+    vw::vw_throw(vw::ArgumentErr() << "The match database was already closed: "
+                 << m_file << "\n");
+  if (ip1.size() != ip2.size())
+    vw::vw_throw(vw::ArgumentErr() << "The number of left and right interest points "
+                 << "must agree for: " << match_file << "\n");
+
+  Entry e;
+  e.name = matchDbName(match_file);
+  e.offset = m_pos;
+  e.num_ip = ip1.size();
+  e.desc_len = descriptorLength(ip1, ip2, match_file);
+
+  writeRecords(m_out, ip1);
+  writeRecords(m_out, ip2);
+  writeDescriptors(m_out, ip1, e.desc_len);
+  writeDescriptors(m_out, ip2, e.desc_len);
+
+  // Pad to a multiple of 8 bytes
+  std::uint64_t end = e.offset + blockSize(e.num_ip, e.desc_len);
+  std::vector<char> pad(padTo8(end) - end, 0);
+  if (!pad.empty())
+    m_out.write(&pad[0], pad.size());
+  m_pos = padTo8(end);
+
+  if (!m_out.good())
+    vw::vw_throw(vw::IOErr() << "Failed writing: " << m_tmp_file << "\n");
+
+  m_entries.push_back(e);
+}
+
+void MatchDbWriter::close() {
+
+  if (!m_out.is_open())
+    return;
+
+  // Sort the index by name, for lookup with binary search. If a name was
+  // written more than once, keep the last copy. The sort is stable, so that
+  // one comes last among equal names.
+  std::stable_sort(m_entries.begin(), m_entries.end(),
+                   [](Entry const& a, Entry const& b) { return a.name < b.name; });
+  std::vector<Entry> index;
+  for (size_t it = 0; it < m_entries.size(); it++) {
+    if (it + 1 < m_entries.size() && m_entries[it + 1].name == m_entries[it].name)
+      continue;
+    index.push_back(m_entries[it]);
+  }
+
+  // The index
+  std::uint64_t index_offset = m_pos;
+  for (auto const& e: index) {
+    std::uint32_t name_len = e.name.size();
+    m_out.write(reinterpret_cast<const char*>(&name_len), sizeof(name_len));
+    m_out.write(e.name.data(), name_len);
+    m_out.write(reinterpret_cast<const char*>(&e.offset),   sizeof(e.offset));
+    m_out.write(reinterpret_cast<const char*>(&e.num_ip),   sizeof(e.num_ip));
+    m_out.write(reinterpret_cast<const char*>(&e.desc_len), sizeof(e.desc_len));
+  }
+
+  // The header
+  std::uint64_t num_pairs = index.size();
+  m_out.seekp(0);
+  m_out.write(MATCH_DB_MAGIC, MATCH_DB_MAGIC_LEN);
+  m_out.write(reinterpret_cast<const char*>(&num_pairs), sizeof(num_pairs));
+  m_out.write(reinterpret_cast<const char*>(&index_offset), sizeof(index_offset));
+
+  // On failure do not leave the temporary file behind
+  bool good = m_out.good();
+  m_out.close();
+  boost::system::error_code ec;
+  if (good)
+    fs::rename(m_tmp_file, m_file, ec);
+  if (!good || ec) {
+    fs::remove(m_tmp_file, ec);
+    vw::vw_throw(vw::IOErr() << "Failed writing: " << m_file << "\n");
+  }
+}
+
+std::string matchDbName(std::string const& match_file) {
+  return fs::path(match_file).filename().string();
+}
+
+void readMatchFile(MatchDb const* db, std::string const& match_file,
+                   std::vector<vw::ip::InterestPoint> & ip1,
+                   std::vector<vw::ip::InterestPoint> & ip2) {
+  if (db != NULL && db->has(match_file))
+    db->read(match_file, ip1, ip2);
+  else
+    vw::ip::read_binary_match_file(match_file, ip1, ip2);
+}
+
+bool matchFileExists(MatchDb const* db, std::string const& match_file) {
+  return (db != NULL && db->has(match_file)) || fs::exists(match_file);
+}
+
+} // end namespace asp
@@ -0,0 +1,146 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file MatchDb.h
+///
+/// A single-file store for many pairwise interest point match files. With
+/// thousands of images, bundle adjustment can produce hundreds of thousands
+/// of small .match files, which are slow to list and open on network file
+/// systems. The database keeps all of them in one memory-mapped file.
+///
+/// Each pair of match files is stored under the file name (without the
+/// directory) it would have on disk, such as run-img1__img2.match, so the
+/// same naming conventions as for individual match files apply.
+///
+/// File layout, in host byte order. Each data block and the index start at a
+/// multiple of 8 bytes.
+///   header: magic "ASPMDB01", number of pairs, offset of the index (uint64)
+///   per pair: left and right interest points, as fixed-size records,
+///             followed by the left and right descriptors
+///   index:    per pair, sorted by name, the name length (uint32), name, offset
+///             of the data block, number of matches (uint64), and descriptor
+///             length (uint32)
+
+#ifndef __ASP_CORE_MATCH_DB_H__
+#define __ASP_CORE_MATCH_DB_H__
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace vw {
+  namespace ip {
+    class InterestPoint;
+  }
+}
+
+namespace asp {
+
+// Read-only access to a match database. The file is memory-mapped, so
+// opening it only reads the index, and the matches for a pair are read on
+// demand. A pair is looked up with a binary search in the sorted index.
+// The const methods can be called from multiple threads.
+class MatchDb {
+public:
+  MatchDb() {}
+  explicit MatchDb(std::string const& db_file);
+
+  void open(std::string const& db_file);
+
+  // Check if matches for this match file are present. Only the file name
+  // is used, not the directory.
+  bool has(std::string const& match_file) const;
+
+  // Read the matches for this match file. Throws if not present.
+  void read(std::string const& match_file,
+            std::vector<vw::ip::InterestPoint> & ip1,
+            std::vector<vw::ip::InterestPoint> & ip2) const;
+
+  // The number of matches for this match file, without reading them
+  std::uint64_t numMatches(std::string const& match_file) const;
+
+  // The names of all stored match files, in sorted order
+  std::vector<std::string> names() const;
+
+  std::string const& file() const { return m_file; }
+  size_t size() const { return m_index.size(); }
+
+private:
+  struct Entry {
+    std::string name;
+    std::uint64_t offset, num_ip;
+    std::uint32_t desc_len;
+  };
+
+  // Return null if not found
+  Entry const* lookup(std::string const& match_file) const;
+  Entry const& find(std::string const& match_file) const;
+
+  std::string m_file;
+  boost::iostreams::mapped_file_source m_map;
+  std::vector<Entry> m_index; // sorted by name
+};
+
+// Write a match database. The pairs are appended one at a time, and the
+// index is written by close(). The data goes to a temporary file which is
+// renamed at the end, so an interrupted run will not leave behind a
+// truncated database. If close() is not called, nothing is saved. If the
+// same name is written more than once, the last copy is kept. The index is
+// sorted by name when written.
+class MatchDbWriter {
+public:
+  explicit MatchDbWriter(std::string const& db_file);
+  ~MatchDbWriter();
+
+  void write(std::string const& match_file,
+             std::vector<vw::ip::InterestPoint> const& ip1,
+             std::vector<vw::ip::InterestPoint> const& ip2);
+
+  void close();
+
+private:
+  struct Entry {
+    std::string name;
+    std::uint64_t offset, num_ip;
+    std::uint32_t desc_len;
+  };
+
+  std::string m_file, m_tmp_file;
+  std::ofstream m_out;
+  std::uint64_t m_pos;
+  std::vector<Entry> m_entries;
+};
+
+// The name under which a match file is stored in the database
+std::string matchDbName(std::string const& match_file);
+
+// Read matches from the database, if it is not null and has them, and
+// otherwise from the match file on disk. The database takes priority, so
+// the file system need not be queried.
+void readMatchFile(MatchDb const* db, std::string const& match_file,
+                   std::vector<vw::ip::InterestPoint> & ip1,
+                   std::vector<vw::ip::InterestPoint> & ip2);
+
+// Check if matches exist either in the database or on disk
+bool matchFileExists(MatchDb const* db, std::string const& match_file);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_MATCH_DB_H__
@@ -21,6 +21,10 @@
 #include <vw/BundleAdjustment/ControlNetworkLoader.h>
 #include <vw/InterestPoint/MatcherIO.h>
 #include <asp/Core/MatchList.h>
+#include <asp/Core/MatchDb.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
 
 using namespace vw;
 
@@ -271,6 +275,7 @@ void MatchList::setIpValid(size_t image) {
 void populateMatchFiles(std::vector<std::string> const& image_files,
                         std::string const& output_prefix,
                         std::string const& first_match_file,
+                        std::string const& match_db,
                         // Outputs
                         std::vector<std::string> & matchFiles,
                         std::vector<size_t> & leftIndices,
@@ -278,6 +283,10 @@ void populateMatchFiles(std::vector<std::string> const& image_files,
 
   int num_images = image_files.size();
 
+  boost::shared_ptr<MatchDb> db;
+  if (!match_db.empty() && boost::filesystem::exists(match_db))
+    db.reset(new MatchDb(match_db));
+
   // Populate the outputs
   matchFiles.resize(num_images-1);
   leftIndices.resize(num_images-1);
@@ -303,7 +312,7 @@ void populateMatchFiles(std::vector<std::string> const& image_files,
       trial_match = vw::ip::match_filename(output_prefix, image_files[i-1],
              image_files[i]);
       leftIndex = i - 1;
-      vw::ip::read_binary_match_file(trial_match, left, right);
+      asp::readMatchFile(db.get(), trial_match, left, right);
       vw::vw_out() << "Read " << left.size() << " matches from " << trial_match << "\n";
 
     } catch(...) {
@@ -312,7 +321,7 @@ void populateMatchFiles(std::vector<std::string> const& image_files,
         trial_match = vw::ip::match_filename(output_prefix, image_files[0],
                image_files[i]);
         leftIndex = 0;
-        vw::ip::read_binary_match_file(trial_match, left, right);
+        asp::readMatchFile(db.get(), trial_match, left, right);
         vw::vw_out() << "Read " << left.size() << " matches from " << trial_match << "\n";
 
       } catch(...) {
@@ -346,7 +355,8 @@ void MatchList::populateFromIpPair(std::vector<vw::ip::InterestPoint> const& ip1
 }
 
 bool MatchList::loadPointsFromMatchFiles(std::vector<std::string> const& matchFiles,
-                                         std::vector<size_t> const& leftIndices) {
+                                         std::vector<size_t> const& leftIndices,
+                                         std::string const& match_db) {
 
   // Count IP as in the same location if x and y are at least this close.
   const float ALLOWED_POS_DIFF = 0.5;
@@ -363,6 +373,10 @@ bool MatchList::loadPointsFromMatchFiles(std::vector<std::string> const& matchFi
   resize(0); // wipe first
   resize(num_images);
 
+  boost::shared_ptr<MatchDb> db;
+  if (!match_db.empty() && boost::filesystem::exists(match_db))
+    db.reset(new MatchDb(match_db));
+
   // Loop through all of the matches
   size_t num_ip = 0;
   for (size_t i = 1; i < num_images; i++) {
@@ -381,7 +395,7 @@ bool MatchList::loadPointsFromMatchFiles(std::vector<std::string> const& matchFi
     std::vector<vw::ip::InterestPoint> left, right;
     try {
       vw_out() << "Reading binary match file: " << match_file << "\n";
-      ip::read_binary_match_file(match_file, left, right);
+      asp::readMatchFile(db.get(), match_file, left, right);
       vw::vw_out() << "Read " << left.size() << " matches.\n";
     } catch(...) {
       vw_out() << "IP load failed, leaving default invalid IP\n";
@@ -429,13 +443,25 @@ bool MatchList::loadPointsFromMatchFiles(std::vector<std::string> const& matchFi
 
 bool MatchList::savePointsToDisk(std::string const& prefix,
                                  std::vector<std::string> const& imageNames,
-                                 std::string const& match_file) const {
+                                 std::string const& match_file,
+                                 std::string const& match_db) const {
   if (!allPointsValid() || (imageNames.size() != m_matches.size()))
     vw::vw_throw(vw::ArgumentErr()
                  << "Cannot write match files, not all points are valid.\n");
 
   const size_t num_image_files = imageNames.size();
 
+  // When saving to a match database, rewrite it, keeping the prior matches
+  // for other images. The new copy replaces the old one only at the end.
+  boost::shared_ptr<MatchDb> prev_db;
+  boost::shared_ptr<MatchDbWriter> db_writer;
+  if (!match_db.empty()) {
+    if (boost::filesystem::exists(match_db))
+      prev_db.reset(new MatchDb(match_db));
+    db_writer.reset(new MatchDbWriter(match_db));
+  }
+  std::set<std::string> saved_names;
+
   bool success = true;
   for (size_t i = 0; i < num_image_files; i++) {
 
@@ -455,6 +481,12 @@ bool MatchList::savePointsToDisk(std::string const& prefix,
       if ((num_image_files == 2) && (match_file != ""))
         output_path = match_file;
       try {
+        if (db_writer) {
+          vw_out() << "Writing: " << output_path << " to " << match_db << std::endl;
+          db_writer->write(output_path, m_matches[i], m_matches[j]);
+          saved_names.insert(matchDbName(output_path));
+          continue;
+        }
         vw_out() << "Writing: " << output_path << std::endl;
         ip::write_binary_match_file(output_path, m_matches[i], m_matches[j]);
       }catch(...) {
@@ -463,6 +495,20 @@ bool MatchList::savePointsToDisk(std::string const& prefix,
       }
     }
   }
+
+  if (db_writer) {
+    if (prev_db) {
+      std::vector<vw::ip::InterestPoint> left, right;
+      for (auto const& name: prev_db->names()) {
+        if (saved_names.find(name) != saved_names.end())
+          continue;
+        prev_db->read(name, left, right);
+        db_writer->write(name, left, right);
+      }
+    }
+    db_writer->close();
+  }
+
   return success;
 }
 
@@ -39,10 +39,12 @@ namespace asp {
   /// - Each image must have the same number of interest points
   ///   but in some situations some of the points can be flagged as invalid.
   
-  // Populate the match files and leftIndices vectors
+  // Populate the match files and leftIndices vectors. If a match database is
+  // given, the matches are looked up there first.
   void populateMatchFiles(std::vector<std::string> const& image_files,
                           std::string const& output_prefix,
                           std::string const& first_match_file,
+                          std::string const& match_db,
                           // Outputs
                           std::vector<std::string> & matchFiles,
                           std::vector<size_t> & leftIndices,
@@ -101,8 +103,10 @@ namespace asp {
     ///   contains the index of the other file they match to (0 or i-1).
     /// - Any points that cannot be loaded will be flagged as invalid.
     /// - Return the number of points loaded, or -1 for failure.
+    /// - If a match database is given, the matches are read from there if present.
     bool loadPointsFromMatchFiles(std::vector<std::string> const& matchFiles,
-                                  std::vector<size_t>      const& leftIndices);
+                                  std::vector<size_t>      const& leftIndices,
+                                  std::string              const& match_db = "");
 
     /// Try to load the interest points from a GCP file.
     bool loadPointsFromGCPs(std::string const gcpPath,
@@ -116,10 +120,13 @@ namespace asp {
     void populateFromIpPair(std::vector<vw::ip::InterestPoint> const& ip1,
                             std::vector<vw::ip::InterestPoint> const& ip2);
     
-    /// Write all points out using a given prefix.
+    /// Write all points out using a given prefix. If a match database is
+    /// given, the matches are saved there, replacing any prior ones for
+    /// the same images, rather than to individual files.
     bool savePointsToDisk(std::string const& prefix,
                           std::vector<std::string> const& imageNames,
-                          std::string const& match_file="") const;
+                          std::string const& match_file="",
+                          std::string const& match_db="") const;
 
   private:
 
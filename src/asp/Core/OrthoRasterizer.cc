@@ -28,6 +28,7 @@
 #include <vw/Image/Algorithms.h>
 #include <vw/Image/BlockRasterize.h>
 #include <vw/Core/ThreadPool.h>
+#include <vw/Core/Stopwatch.h>
 #include <vw/Math/Vector.h>
 #include <vw/Math/BBox.h>
 #include <vw/Math/Statistics.h>
@@ -37,13 +38,80 @@
 #include <asp/Core/PointUtils.h>
 #include <boost/foreach.hpp>
 #include <boost/math/special_functions/next.hpp>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
 #include <asp/Core/OrthoRasterizer.h>
 #include <valarray>
+#include <fstream>
+#include <atomic>
+#include <chrono>
 
 namespace asp{
 
   using namespace vw;
 
+  namespace bg  = boost::geometry;
+  namespace bgi = boost::geometry::index;
+
+  // An R-tree over the horizontal extent of the point cloud block
+  // boundaries, built once, and used to find the blocks contributing
+  // to a given output tile. Boxes with non-finite coordinates are not
+  // put in the tree and are always checked.
+  class BoundaryIndex {
+  public:
+    typedef bg::model::point<double, 2, bg::cs::cartesian> Point;
+    typedef bg::model::box<Point> Box;
+    typedef std::pair<Box, size_t> Value;
+
+    BoundaryIndex(std::vector<BBoxPair> const& boundaries):
+      m_num_queries(0), m_query_nanoseconds(0) {
+      std::vector<Value> values;
+      values.reserve(boundaries.size());
+      for (size_t it = 0; it < boundaries.size(); it++) {
+        BBox3 const& b = boundaries[it].first;
+        bool is_finite = true;
+        for (int c = 0; c < 2; c++) {
+          if (!std::isfinite(b.min()[c]) || !std::isfinite(b.max()[c]))
+            is_finite = false;
+        }
+        if (!is_finite) {
+          m_unindexed.push_back(it);
+          continue;
+        }
+        values.push_back(Value(Box(Point(b.min().x(), b.min().y()),
+                                   Point(b.max().x(), b.max().y())), it));
+      }
+      // Bulk loading creates a better balanced tree than inserting one by one
+      m_tree = bgi::rtree<Value, bgi::rstar<16>>(values.begin(), values.end());
+    }
+
+    // Find the indices of the boundaries whose horizontal extent
+    // intersects the given box. Sort them to process them in the
+    // same order as before indexing.
+    void query(BBox3 const& box, std::vector<size_t> & indices) {
+      auto beg = std::chrono::steady_clock::now();
+      std::vector<Value> found;
+      Box qbox(Point(box.min().x(), box.min().y()), Point(box.max().x(), box.max().y()));
+      m_tree.query(bgi::intersects(qbox), std::back_inserter(found));
+      indices = m_unindexed;
+      for (size_t it = 0; it < found.size(); it++)
+        indices.push_back(found[it].second);
+      std::sort(indices.begin(), indices.end());
+      auto end = std::chrono::steady_clock::now();
+      m_num_queries++;
+      m_query_nanoseconds +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - beg).count();
+    }
+
+    std::int64_t num_queries() const { return m_num_queries; }
+    double query_time() const { return 1.0e-9 * m_query_nanoseconds; }
+
+  private:
+    bgi::rtree<Value, bgi::rstar<16>> m_tree;
+    std::vector<size_t> m_unindexed;
+    std::atomic<std::int64_t> m_num_queries, m_query_nanoseconds;
+  };
+
   class compare_bboxes { // simple comparison function
   public:
     bool operator()(const BBox2i A, const BBox2i B) const {
@@ -236,6 +304,103 @@ namespace asp{
     }
   }; // End function operator()
 
+  namespace {
+    const std::string BOUNDARY_CACHE_MAGIC = "ASP_POINT_CLOUD_BOUNDARY_CACHE_V1";
+
+    template <class T>
+    void write_val(std::ofstream & ofs, T const& val) {
+      ofs.write(reinterpret_cast<const char*>(&val), sizeof(T));
+    }
+    template <class T>
+    bool read_val(std::ifstream & ifs, T & val) {
+      ifs.read(reinterpret_cast<char*>(&val), sizeof(T));
+      return ifs.good();
+    }
+    void write_box(std::ofstream & ofs, BBox3 const& box) {
+      for (int c = 0; c < 3; c++) write_val(ofs, box.min()[c]);
+      for (int c = 0; c < 3; c++) write_val(ofs, box.max()[c]);
+    }
+    bool read_box(std::ifstream & ifs, BBox3 & box) {
+      for (int c = 0; c < 3; c++) if (!read_val(ifs, box.min()[c])) return false;
+      for (int c = 0; c < 3; c++) if (!read_val(ifs, box.max()[c])) return false;
+      return true;
+    }
+  }
+
+  bool PointCloudBoundaryCache::read(std::string const& file,
+                                     std::string const& expected_key) {
+    loaded = false;
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs.good())
+      return false;
+
+    std::string magic;
+    if (!std::getline(ifs, magic) || magic != BOUNDARY_CACHE_MAGIC)
+      return false;
+
+    std::uint64_t len = 0;
+    if (!read_val(ifs, len) || len != expected_key.size())
+      return false;
+    std::string file_key(len, ' ');
+    ifs.read(&file_key[0], len);
+    if (!ifs.good() || file_key != expected_key)
+      return false;
+
+    if (!read_val(ifs, estim_max_error) || !read_box(ifs, estim_proj_box) ||
+        !read_box(ifs, bbox) || !read_val(ifs, len))
+      return false;
+    errors_hist.resize(len);
+    for (size_t it = 0; it < errors_hist.size(); it++)
+      if (!read_val(ifs, errors_hist[it]))
+        return false;
+
+    if (!read_val(ifs, len))
+      return false;
+    boundaries.resize(len);
+    for (size_t it = 0; it < boundaries.size(); it++) {
+      if (!read_box(ifs, boundaries[it].first))
+        return false;
+      std::int32_t v[4];
+      for (int c = 0; c < 4; c++)
+        if (!read_val(ifs, v[c]))
+          return false;
+      boundaries[it].second = BBox2i(Vector2i(v[0], v[1]), Vector2i(v[2], v[3]));
+    }
+
+    key = expected_key;
+    loaded = true;
+    return true;
+  }
+
+  void PointCloudBoundaryCache::write(std::string const& file) const {
+    std::ofstream ofs(file.c_str(), std::ios::binary);
+    if (!ofs.good()) {
+      vw_out(WarningMessage) << "Cannot write: " << file << ".\n";
+      return;
+    }
+
+    ofs << BOUNDARY_CACHE_MAGIC << "\n";
+    write_val(ofs, std::uint64_t(key.size()));
+    ofs.write(key.c_str(), key.size());
+    write_val(ofs, estim_max_error);
+    write_box(ofs, estim_proj_box);
+    write_box(ofs, bbox);
+    write_val(ofs, std::uint64_t(errors_hist.size()));
+    for (size_t it = 0; it < errors_hist.size(); it++)
+      write_val(ofs, errors_hist[it]);
+    write_val(ofs, std::uint64_t(boundaries.size()));
+    for (size_t it = 0; it < boundaries.size(); it++) {
+      write_box(ofs, boundaries[it].first);
+      BBox2i const& b = boundaries[it].second;
+      std::int32_t v[4] = {b.min().x(), b.min().y(), b.max().x(), b.max().y()};
+      for (int c = 0; c < 4; c++)
+        write_val(ofs, v[c]);
+    }
+
+    if (!ofs.good())
+      vw_out(WarningMessage) << "Failed writing: " << file << ".\n";
+  }
+
   void remove_outliers(ImageView<Vector3> & image, ImageViewRef<double> const& errors,
                        double error_cutoff, BBox2i const& box) {
 
@@ -400,6 +565,7 @@ namespace asp{
    std::string const& filter,
    double default_grid_size_multiplier,
    std::int64_t * num_invalid_pixels, vw::Mutex *count_mutex,
+   PointCloudBoundaryCache * boundary_cache,
    const ProgressCallback& progress):
     // Ensure all members are initiated, even if to temporary values
     m_point_image(point_image), m_texture(ImageView<float>(1,1)),
@@ -449,6 +615,15 @@ namespace asp{
       errors_hist = std::vector<double>(num_bins, 0.0);
     }
 
+    bool use_cache = (boundary_cache != NULL && boundary_cache->loaded &&
+                      boundary_cache->errors_hist.size() == errors_hist.size());
+    if (use_cache) {
+      vw_out() << "Using the cached point cloud extent.\n";
+      m_bbox                   = boundary_cache->bbox;
+      m_point_image_boundaries = boundary_cache->boundaries;
+      errors_hist              = boundary_cache->errors_hist;
+    }
+
     // Subdivide each block into smaller chunks. Note: small chunks
     // greatly increase the memory usage and run-time for very large
     // images (because they are very many). As such, make the chunks
@@ -464,7 +639,9 @@ namespace asp{
     sub_block_size = int(round(pow(2.0, floor(log(sub_block_size)/log(2.0)))));
     sub_block_size = std::max(16, sub_block_size);
     sub_block_size = std::min(ASP_MAX_SUBBLOCK_SIZE, sub_block_size);
-    std::vector<BBox2i> blocks = subdivide_bbox(m_point_image, m_block_size, m_block_size);
+    std::vector<BBox2i> blocks;
+    if (!use_cache)
+      blocks = subdivide_bbox(m_point_image, m_block_size, m_block_size);
 
     // Find the bounding box of each subblock, stored in
     // m_point_image_boundaries, together with other info by
@@ -485,6 +662,13 @@ namespace asp{
     queue.join_all();
     progress.report_finished();
 
+    // Keep the results for future runs
+    if (boundary_cache != NULL && !use_cache) {
+      boundary_cache->bbox        = m_bbox;
+      boundary_cache->boundaries  = m_point_image_boundaries;
+      boundary_cache->errors_hist = errors_hist;
+    }
+
     if (m_bbox.empty())
       vw_throw(ArgumentErr() << "OrthoRasterize: Input point cloud is empty!\n");
 
@@ -496,6 +680,15 @@ namespace asp{
 
     VW_OUT(DebugMessage,"asp") << "Point cloud boundary is " << m_bbox << "\n";
 
+    // Index the boundaries to quickly find the ones needed for each output tile
+    Stopwatch sw;
+    sw.start();
+    m_boundary_index.reset(new BoundaryIndex(m_point_image_boundaries));
+    sw.stop();
+    VW_OUT(DebugMessage,"asp") << "Indexed " << m_point_image_boundaries.size()
+                               << " point cloud block boundaries in "
+                               << sw.elapsed_seconds() << " seconds.\n";
+
     if (outlier_removal_method != NO_OUTLIER_REMOVAL_METHOD) {
 
       // Per user request, find some error percentiles to print.
@@ -656,7 +849,11 @@ namespace asp{
     // Used to find which polygons are actually in the draw space.
     BBox3 local_3d_bbox = pixel_to_point_bbox(bbox_1);
 
-    ImageView<double> d_buffer, weights;
+    // One output layer for the main texture, and one for each extra texture.
+    // The weights depend only on the point locations, so they are shared.
+    int num_layers = planes();
+    std::vector<ImageView<double>> d_buffers(num_layers);
+    ImageView<double> weights;
 
     // Given a DEM grid point, search for cloud points within the
     // circular region of radius equal to grid size. As such, a
@@ -669,14 +866,15 @@ namespace asp{
       search_radius = std::max(m_spacing, m_default_spacing);
     else
       search_radius = m_spacing*m_search_radius_factor;
-    asp::Point2Grid point2grid(bbox_1.width(),
-                               bbox_1.height(),
-                               d_buffer, weights,
-                               local_3d_bbox.min().x(),
-                               local_3d_bbox.min().y(),
-                               m_spacing, m_default_spacing,
-                               search_radius, m_sigma_factor,
-                               m_filter, m_percentile);
+    // A single engine grids all layers, so the points are binned only once
+    asp::Point2GridBinned point2grid(bbox_1.width(),
+                                     bbox_1.height(),
+                                     d_buffers, weights,
+                                     local_3d_bbox.min().x(),
+                                     local_3d_bbox.min().y(),
+                                     m_spacing, m_default_spacing,
+                                     search_radius, m_sigma_factor,
+                                     m_filter, m_percentile);
 
     // Set up the default color value
     double min_val = 0.0;
@@ -700,7 +898,10 @@ namespace asp{
     typedef std::map<BBox2i, BBox2i, compare_bboxes> BlockMapType;
     typedef BlockMapType::iterator MapIterType;
     BlockMapType blocks_map;
-    BOOST_FOREACH(BBoxPair const& boundary, m_point_image_boundaries) {
+    std::vector<size_t> indices;
+    m_boundary_index->query(local_3d_bbox, indices);
+    for (size_t ind = 0; ind < indices.size(); ind++) {
+      BBoxPair const& boundary = m_point_image_boundaries[indices[ind]];
       if (! local_3d_bbox.intersects(boundary.first))
         continue;
 
@@ -727,8 +928,10 @@ namespace asp{
         (*m_num_invalid_pixels) += std::int64_t(bbox.width())*std::int64_t(bbox.height());
       }
 
-      return prerasterize_type(d_buffer, BBox2i(-bbox_1.min().x(),
-                                                -bbox_1.min().y(), cols(), rows()));
+      ImageView<PixelGray<float>> result(bbox_1.width(), bbox_1.height(), num_layers);
+      fill(result, PixelGray<float>(min_val));
+      return prerasterize_type(result, BBox2i(-bbox_1.min().x(),
+                                              -bbox_1.min().y(), cols(), rows()));
     }
 
     for (MapIterType it = blocks_map.begin(); it != blocks_map.end(); it++) {
@@ -752,8 +955,12 @@ namespace asp{
       // Crop back to the area of interest
       point_copy = crop(point_copy, block - biased_block.min());
 
-      ImageView<float> texture_copy = crop(m_texture, block);
+      std::vector<ImageView<float>> texture_copies(num_layers);
+      texture_copies[0] = crop(m_texture, block);
+      for (int layer = 1; layer < num_layers; layer++)
+        texture_copies[layer] = crop(m_extra_textures[layer - 1], block);
 
+      std::vector<double> vals(num_layers); // the texture values at a point
       typedef ImageView<Vector3>::pixel_accessor PointAcc;
       PointAcc row_acc = point_copy.origin();
       for (int32 row = 0; row < point_copy.rows(); row++) {
@@ -767,9 +974,10 @@ namespace asp{
 
           if (!boost::math::isnan(point_copy(col, row).z()) &&
                 local_3d_bbox.contains(point_copy(col, row))) {
-            point2grid.AddPoint(point_copy(col, row).x(),
-                                point_copy(col, row).y(),
-                                texture_copy(col,  row));
+            for (int layer = 0; layer < num_layers; layer++)
+              vals[layer] = texture_copies[layer](col, row);
+            point2grid.AddPoint(point_copy(col, row).x(), point_copy(col, row).y(),
+                                &vals[0]);
           }
           point_ul.next_col();
         } // End column loop
@@ -783,9 +991,16 @@ namespace asp{
     // The software renderer returns an image which will render
     // upside down in most image formats, so we correct that here.
     // We also introduce transparent pixels into the result where necessary.
-    // TODO: Here can do flipping in place.
-    ImageView<PixelGray<float>> result;
-    result = flip_vertical(d_buffer);
+    // Each layer becomes a plane of the result.
+    ImageView<PixelGray<float>> result(bbox_1.width(), bbox_1.height(), num_layers);
+    for (int layer = 0; layer < num_layers; layer++) {
+      ImageView<double> const& d_buffer = d_buffers[layer];
+      int last_row = d_buffer.rows() - 1;
+      for (int r = 0; r < d_buffer.rows(); r++) {
+        for (int c = 0; c < d_buffer.cols(); c++)
+          result(c, r, layer) = d_buffer(c, last_row - r);
+      }
+    }
 
     // Loop through result here and count up how many pixels have been
     // changed from the default value.
@@ -810,6 +1025,24 @@ namespace asp{
                              BBox2i(-bbox_1.min().x(), -bbox_1.min().y(), cols(), rows()));
   }
 
+  void OrthoRasterizerView::set_extra_textures
+  (std::vector<vw::ImageViewRef<double>> const& textures) {
+    m_extra_textures.clear();
+    for (size_t it = 0; it < textures.size(); it++) {
+      VW_ASSERT(textures[it].cols() == m_point_image.cols() &&
+                textures[it].rows() == m_point_image.rows(),
+                vw::ArgumentErr() << "Orthorasterizer: set_extra_textures() failed."
+                << " Texture dimensions must match point image dimensions.");
+      m_extra_textures.push_back(vw::channel_cast<float>(textures[it]));
+    }
+  }
+
+  void OrthoRasterizerView::boundary_query_stats(std::int64_t & num_queries,
+                                                 double & query_time) const {
+    num_queries = m_boundary_index->num_queries();
+    query_time  = m_boundary_index->query_time();
+  }
+
   // Return the affine georeferencing transform.
   vw::Matrix<double,3,3> OrthoRasterizerView::geo_transform() {
     vw::Matrix<double,3,3> geo_transform;
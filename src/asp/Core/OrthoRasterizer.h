@@ -32,13 +32,40 @@
 #include <vw/Math/BBox.h>
 #include <asp/Core/Point2Grid.h>
 
+#include <boost/shared_ptr.hpp>
+
 namespace asp{
 
+  class BoundaryIndex;
+
   enum OutlierRemovalMethod {NO_OUTLIER_REMOVAL_METHOD, PERCENTILE_OUTLIER_METHOD,
                              TUKEY_OUTLIER_METHOD};
 
   typedef std::pair<vw::BBox3, vw::BBox2i> BBoxPair;
 
+  /// The results of the passes over the point cloud done before rasterizing
+  /// it. These can be saved to disk and reused by a later run with the same
+  /// input clouds and the same options affecting these passes, such as when
+  /// only the grid size or filter changes.
+  struct PointCloudBoundaryCache {
+    std::string key;              // identifies the input clouds and options
+    bool        loaded;           // true if read from disk rather than computed
+    double      estim_max_error;  // see estim_max_tri_error_and_proj_box()
+    vw::BBox3   estim_proj_box;
+    vw::BBox3   bbox;             // bounding box of the cloud, before --t_projwin
+    std::vector<double>   errors_hist;
+    std::vector<BBoxPair> boundaries;
+
+    PointCloudBoundaryCache(): loaded(false), estim_max_error(0.0) {}
+
+    /// Read from disk. Return false if the file is missing, cannot be parsed,
+    /// or was made for a different key.
+    bool read(std::string const& file, std::string const& expected_key);
+
+    /// Write to disk. Failure to write is not fatal, as this is only a cache.
+    void write(std::string const& file) const;
+  };
+
   /// Given a point image and corresponding texture, this class
   /// bins and averages the point cloud on a regular grid over the [x,y]
   /// plane of the point image; producing an evenly sampled ortho-image
@@ -47,6 +74,7 @@ namespace asp{
     public vw::ImageViewBase<OrthoRasterizerView> {
     vw::ImageViewRef<vw::Vector3> m_point_image;
     vw::ImageViewRef<float>   m_texture;
+    std::vector<vw::ImageViewRef<float>> m_extra_textures;
     vw::BBox3  m_bbox, m_snapped_bbox; // bounding box of point cloud
     double  m_spacing;         // point cloud units (usually m or deg) per pixel
     double  m_default_spacing; // if user did not specify spacing
@@ -69,14 +97,17 @@ namespace asp{
     std::int64_t * m_num_invalid_pixels; ///< Keep a count of nodata output pixels, needs to be pointer due to VW weirdness.
     vw::Mutex  *m_count_mutex;        ///< A lock for m_num_invalid_pixels, needs to be pointer due to C++ weirdness.
 
-    // We could actually use a quadtree here .. but this should be a
-    // good enough improvement.
     std::vector<BBoxPair> m_point_image_boundaries;
     // These boundaries describe a point cloud 3D boundaries and then
     // their location in the the point cloud image. These boxes are
     // overlapping in the pc image X/Y domain to insure that
     // everything is triangulated.
 
+    // An R-tree over the boundaries above, to quickly find the ones
+    // intersecting a given output tile. It also keeps the query timing.
+    // A pointer as this view gets copied.
+    boost::shared_ptr<BoundaryIndex> m_boundary_index;
+
     // Function to convert pixel coordinates to the point domain
     vw::BBox3 pixel_to_point_bbox(vw::BBox2 const& px) const;
 
@@ -86,6 +117,9 @@ namespace asp{
     typedef vw::ProceduralPixelAccessor<OrthoRasterizerView> pixel_accessor;
 
     /// Constructor. Must call initialize_spacing before using the object!!!
+    /// If boundary_cache is not NULL and was loaded from disk, its contents
+    /// are used instead of going over the cloud. Otherwise, if not NULL, it
+    /// is filled in, so that it can be saved.
     OrthoRasterizerView(vw::ImageViewRef<vw::Vector3> point_image,
                         vw::ImageViewRef<double > texture,
                         double  search_radius_factor,
@@ -105,6 +139,7 @@ namespace asp{
                         double  default_grid_size_multiplier,
                         std::int64_t * num_invalid_pixels,
                         vw::Mutex *count_mutex,
+                        PointCloudBoundaryCache * boundary_cache,
                         const vw::ProgressCallback& progress);
 
     /// This must be called before the object can be used!
@@ -123,6 +158,12 @@ namespace asp{
       m_texture = vw::channel_cast<float>(vw::channels_to_planes(texture.impl()));
     }
 
+    /// Extra textures to rasterize in the same pass over the point cloud as
+    /// the texture, each resulting in an additional plane of the output.
+    /// These must satisfy the same requirements as for set_texture().
+    void set_extra_textures(std::vector<vw::ImageViewRef<double>> const& textures);
+    void clear_extra_textures() { m_extra_textures.clear(); }
+
     inline int cols() const {
       return (int)round((fabs(m_snapped_bbox.max().x() - m_snapped_bbox.min().x()) / m_spacing)) + 1;
       }
@@ -130,8 +171,9 @@ namespace asp{
       return (int)round((fabs(m_snapped_bbox.max().y() - m_snapped_bbox.min().y()) / m_spacing)) + 1;
     }
 
+    // One plane for the texture, and one for each extra texture
     inline int planes() const {
-       return 1; 
+       return 1 + m_extra_textures.size(); 
     }
 
     inline pixel_accessor origin() const { 
@@ -191,6 +233,11 @@ namespace asp{
 
     vw::BBox3 bounding_box() const { return m_snapped_bbox; }
 
+    /// The number of output tiles so far looked up in the index of point
+    /// cloud block boundaries, and the total time spent in these lookups,
+    /// in seconds.
+    void boundary_query_stats(std::int64_t & num_queries, double & query_time) const;
+
     // Return the affine georeferencing transform.
     vw::Matrix<double,3,3> geo_transform();
 
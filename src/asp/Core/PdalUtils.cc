@@ -658,12 +658,13 @@ private:
   
 };
 
-// Set up a reader for a LAS or COPC file 
-void setupLasOrCopcReader(std::string const& in_file,
-                          vw::BBox2 const& copc_win, bool copc_read_all,
-                          boost::shared_ptr<pdal::Reader>& pdal_reader,
-                          pdal::Options& read_options,
-                          std::int64_t & num_total_points) {
+// Create a reader for a LAS or COPC file. For COPC, only the points in
+// copc_win will be fetched, unless copc_read_all is set. No data is read here,
+// so the reader can be used in streaming mode.
+void createLasOrCopcReader(std::string const& in_file,
+                           vw::BBox2 const& copc_win, bool copc_read_all,
+                           boost::shared_ptr<pdal::Reader>& pdal_reader,
+                           pdal::Options& read_options) {
 
   read_options.add("filename", in_file);
 
@@ -687,6 +688,16 @@ void setupLasOrCopcReader(std::string const& in_file,
     pdal_reader.reset(new pdal::LasReader());
   }
   pdal_reader->setOptions(read_options);
+}
+
+// Set up a reader for a LAS or COPC file 
+void setupLasOrCopcReader(std::string const& in_file,
+                          vw::BBox2 const& copc_win, bool copc_read_all,
+                          boost::shared_ptr<pdal::Reader>& pdal_reader,
+                          pdal::Options& read_options,
+                          std::int64_t & num_total_points) {
+
+  createLasOrCopcReader(in_file, copc_win, copc_read_all, pdal_reader, read_options);
   
   // Note: For COPC files, the number of total points in the desired region
   // is a very rough estimate, and can be off by up to a factor of 10.
@@ -86,6 +86,14 @@ void apply_transform_to_las(std::string const& input_file,
                             vw::BBox2 const& copc_win, bool copc_read_all,
                             Eigen::MatrixXd const& T);
 
+// Create a reader for a LAS or COPC file. For COPC, only the points in
+// copc_win will be fetched, unless copc_read_all is set. No data is read here,
+// so the reader can be used in streaming mode.
+void createLasOrCopcReader(std::string const& in_file,
+                           vw::BBox2 const& copc_win, bool copc_read_all,
+                           boost::shared_ptr<pdal::Reader>& pdal_reader,
+                           pdal::Options& read_options);
+
 // Set up a reader for a LAS or COPC file 
 void setupLasOrCopcReader(std::string const& in_file,
                           vw::BBox2 const& copc_win, bool copc_read_all,
@@ -23,11 +23,42 @@
 #include <vw/Math/Functors.h>
 
 #include <iostream>
+#include <algorithm>
+#include <limits>
 
 using namespace std;
 using namespace vw;
 
 namespace asp {
+
+// Validate the inputs shared by the gridding engines
+void checkPoint2GridArgs(double grid_size, double radius, FilterType filter,
+                         double percentile) {
+  if (grid_size <= 0)
+    vw_throw( ArgumentErr() << "Point2Grid: Grid size must be > 0.\n" );
+  if (radius <= 0)
+    vw_throw( ArgumentErr() << "Point2Grid: Search radius must be > 0.\n" );
+
+  if (filter == f_percentile && (percentile < 0 || percentile > 100.0) )  
+    vw_throw( ArgumentErr() << "Point2Grid: Expecting the percentile in the range 0.0 to 100.0.\n" );
+}
+
+// By the time we reached the distance 'spacing' from the origin, we
+// want the Gaussian exp(-sigma*x^2) to decay to given value.  Note
+// that the user may choose to make the grid size very small, but we
+// put a limit to how small 'spacing' gets, that is, how large sigma
+// gets, to ensure that the DEM stays smooth.
+double gaussianSigma(double grid_size, double min_spacing, double sigma_factor) {
+  double spacing = std::max(grid_size, min_spacing);
+  double val = 0.25;
+  double sigma = -log(val)/spacing/spacing;
+
+  // Override this if passed from outside
+  if (sigma_factor > 0)
+    sigma = sigma_factor/spacing/spacing;
+
+  return sigma;
+}
   
 // ===========================================================================
 // Class Member Functions
@@ -43,31 +74,14 @@ Point2Grid::Point2Grid(int width, int height,
   m_x0(x0), m_y0(y0), m_grid_size(grid_size),
   m_radius(radius), m_filter(filter), m_percentile(percentile){
   
-  if (m_grid_size <= 0)
-    vw_throw( ArgumentErr() << "Point2Grid: Grid size must be > 0.\n" );
-  if (m_radius <= 0)
-    vw_throw( ArgumentErr() << "Point2Grid: Search radius must be > 0.\n" );
-
-  if (m_filter == f_percentile && (m_percentile < 0 || m_percentile > 100.0) )  
-    vw_throw( ArgumentErr() << "Point2Grid: Expecting the percentile in the range 0.0 to 100.0.\n" );
+  checkPoint2GridArgs(m_grid_size, m_radius, m_filter, m_percentile);
 
   // Stop here if we don't need to create gaussian weights
   if (m_filter != f_weighted_average) 
     return; 
 
-  // By the time we reached the distance 'spacing' from the origin, we
-  // want the Gaussian exp(-sigma*x^2) to decay to given value.  Note
-  // that the user may choose to make the grid size very small, but we
-  // put a limit to how small 'spacing' gets, that is, how large sigma
-  // gets, to ensure that the DEM stays smooth.
-  double spacing = std::max(grid_size, min_spacing);
-  double val = 0.25;
-  double sigma = -log(val)/spacing/spacing;
+  double sigma = gaussianSigma(grid_size, min_spacing, sigma_factor);
 
-  // Override this if passed from outside
-  if (sigma_factor > 0)
-    sigma = sigma_factor/spacing/spacing;
-  
   // Sample the gaussian for speed
   int num_samples = 1000;
   m_dx = m_radius/(num_samples - 1.0);
@@ -204,5 +218,285 @@ void Point2Grid::normalize(){
     }
   }
 }
+
+// ===========================================================================
+// Point2GridBinned
+// ===========================================================================
+
+Point2GridBinned::Point2GridBinned(int width, int height,
+                                   ImageView<double> & buffer, ImageView<double> & weights,
+                                   double x0, double y0, double grid_size, double min_spacing,
+                                   double radius, double sigma_factor,
+                                   FilterType filter, double percentile):
+  m_width(width), m_height(height),
+  m_buffers(1, &buffer), m_weights(weights),
+  m_x0(x0), m_y0(y0), m_grid_size(grid_size),
+  m_radius(radius), m_dx2(0.0), m_filter(filter), m_percentile(percentile) {
+  init(min_spacing, sigma_factor);
+}
+
+Point2GridBinned::Point2GridBinned(int width, int height,
+                                   std::vector<ImageView<double>> & buffers,
+                                   ImageView<double> & weights,
+                                   double x0, double y0, double grid_size, double min_spacing,
+                                   double radius, double sigma_factor,
+                                   FilterType filter, double percentile):
+  m_width(width), m_height(height),
+  m_weights(weights),
+  m_x0(x0), m_y0(y0), m_grid_size(grid_size),
+  m_radius(radius), m_dx2(0.0), m_filter(filter), m_percentile(percentile) {
+
+  if (buffers.empty())
+    vw_throw(ArgumentErr() << "Point2GridBinned: Expecting at least one buffer.\n");
+  for (size_t ch = 0; ch < buffers.size(); ch++)
+    m_buffers.push_back(&buffers[ch]);
+
+  init(min_spacing, sigma_factor);
+}
+
+void Point2GridBinned::init(double min_spacing, double sigma_factor) {
+
+  checkPoint2GridArgs(m_grid_size, m_radius, m_filter, m_percentile);
+
+  // Stop here if we don't need to create gaussian weights
+  if (m_filter != f_weighted_average) 
+    return; 
+
+  double sigma = gaussianSigma(m_grid_size, min_spacing, sigma_factor);
+
+  // Sample the gaussian at uniformly spaced squared distances, so that
+  // no square root is needed when looking up a weight. Use more samples
+  // than Point2Grid as these are denser near the radius than near the origin.
+  int num_samples = 4000;
+  m_dx2 = m_radius*m_radius/(num_samples - 1.0);
+  m_sampled_gauss_sq.resize(num_samples);
+  for (int k = 0; k < num_samples; k++)
+    m_sampled_gauss_sq[k] = exp(-sigma*k*m_dx2);
+}
+
+void Point2GridBinned::Clear(const float value) {
+  for (size_t ch = 0; ch < m_buffers.size(); ch++) {
+    ImageView<double> & buffer = *m_buffers[ch];
+    buffer.set_size(m_width, m_height);
+    for (int c = 0; c < buffer.cols(); c++){
+      for (int r = 0; r < buffer.rows(); r++)
+        buffer(c, r) = value; // usually this is the no-data value
+    }
+  }
+  m_weights.set_size(m_width, m_height);
+  for (int c = 0; c < m_weights.cols(); c++){
+    for (int r = 0; r < m_weights.rows(); r++)
+      m_weights(c, r) = 0.0;
+  }
+  m_xy.clear();
+  m_vals.clear();
+}
+
+void Point2GridBinned::AddPoint(double x, double y, double z) {
+  AddPoint(x, y, &z);
+}
+
+void Point2GridBinned::AddPoint(double x, double y, double const* vals) {
+  m_xy.push_back(Vector2(x, y));
+  m_vals.insert(m_vals.end(), vals, vals + m_buffers.size());
+}
+
+// For the filters which can be accumulated one point at a time, add each
+// point to the grid nodes within the search radius. Rows are traversed in
+// storage order, and the squared distance is compared against the squared
+// radius, so no square root is needed. The values of all buffers for a
+// node are stored together, and share the distance and weight computation.
+template <FilterType F>
+void Point2GridBinned::scatter() {
+
+  // Initialize the accumulators. Nodes which receive no points are set to
+  // the no-data value at the end.
+  double init = 0.0;
+  if (F == f_min)
+    init = std::numeric_limits<double>::max();
+  else if (F == f_max)
+    init = -std::numeric_limits<double>::max();
+  int nch = m_buffers.size();
+  std::vector<double> acc(size_t(m_width)*size_t(m_height)*nch, init);
+  std::vector<double> wts(size_t(m_width)*size_t(m_height), 0.0);
+
+  double r2 = m_radius*m_radius;
+  for (size_t it = 0; it < m_xy.size(); it++) {
+
+    double x = m_xy[it].x(), y = m_xy[it].y();
+    double const* z = &m_vals[it*nch];
+    int minx = std::max( (int)ceil( (x - m_radius - m_x0)/m_grid_size ), 0 );
+    int miny = std::max( (int)ceil( (y - m_radius - m_y0)/m_grid_size ), 0 );
+    int maxx = std::min( (int)floor( (x + m_radius - m_x0)/m_grid_size ), m_width  - 1 );
+    int maxy = std::min( (int)floor( (y + m_radius - m_y0)/m_grid_size ), m_height - 1 );
+
+    for (int iy = miny; iy <= maxy; iy++) {
+      double dy = y - (m_y0 + iy*m_grid_size);
+      double dy2 = dy*dy;
+      double * acc_row = &acc[size_t(iy)*m_width*nch];
+      double * wts_row = &wts[size_t(iy)*m_width];
+      for (int ix = minx; ix <= maxx; ix++) {
+        double dx = x - (m_x0 + ix*m_grid_size);
+        double d2 = dx*dx + dy2;
+        if (d2 > r2)
+          continue;
+        double * a = acc_row + size_t(ix)*nch;
+        if constexpr (F == f_weighted_average) {
+          double wt = m_sampled_gauss_sq[(int)round(d2/m_dx2)];
+          for (int ch = 0; ch < nch; ch++)
+            a[ch] += z[ch]*wt;
+          wts_row[ix] += wt;
+        } else if constexpr (F == f_mean || F == f_count) {
+          for (int ch = 0; ch < nch; ch++)
+            a[ch] += z[ch];
+          wts_row[ix] += 1;
+        } else if constexpr (F == f_min) {
+          for (int ch = 0; ch < nch; ch++)
+            a[ch] = std::min(a[ch], z[ch]);
+          wts_row[ix] = 1;
+        } else if constexpr (F == f_max) {
+          for (int ch = 0; ch < nch; ch++)
+            a[ch] = std::max(a[ch], z[ch]);
+          wts_row[ix] = 1;
+        }
+      }
+    }
+  }
+
+  for (int iy = 0; iy < m_height; iy++) {
+    for (int ix = 0; ix < m_width; ix++) {
+      size_t k = size_t(iy)*m_width + ix;
+      m_weights(ix, iy) = wts[k];
+      for (int ch = 0; ch < nch; ch++) {
+        ImageView<double> & buffer = *m_buffers[ch];
+        if constexpr (F == f_count) {
+          buffer(ix, iy) = wts[k]; // hence instead of no-data we will have always 0
+        } else {
+          if (wts[k] <= 0)
+            continue; // keep the no-data value
+          if constexpr (F == f_weighted_average || F == f_mean)
+            buffer(ix, iy) = acc[k*nch + ch]/wts[k];
+          else
+            buffer(ix, iy) = acc[k*nch + ch];
+        }
+      }
+    }
+  }
+}
+
+// For the filters which need all values at a node, sort the points into
+// cells of the same size as the grid spacing, then for each grid node
+// find the points from the cells within the search radius, and for each
+// buffer collect their values into a single reusable buffer. The cells are
+// padded on each side by the number of cells the radius spans, so that
+// points outside the grid can still contribute to the nodes at the edges.
+template <FilterType F>
+void Point2GridBinned::gather() {
+
+  int nch = m_buffers.size();
+  int pad = (int)ceil(m_radius/m_grid_size);
+  int nc = m_width  + 2*pad;
+  int nr = m_height + 2*pad;
+
+  // Count the points in each cell. Cell k occupies [start[k], start[k+1]).
+  std::vector<int> cell_of(m_xy.size(), -1);
+  std::vector<size_t> start(size_t(nc)*size_t(nr) + 1, 0);
+  for (size_t it = 0; it < m_xy.size(); it++) {
+    double cx = floor((m_xy[it].x() - m_x0)/m_grid_size) + pad;
+    double cy = floor((m_xy[it].y() - m_y0)/m_grid_size) + pad;
+    if (cx < 0 || cx >= nc || cy < 0 || cy >= nr)
+      continue; // too far from any grid node
+    cell_of[it] = int(cy)*nc + int(cx);
+    start[cell_of[it] + 1]++;
+  }
+  for (size_t k = 1; k < start.size(); k++)
+    start[k] += start[k-1];
+
+  // Counting sort into flat arrays, for cache-friendly access
+  size_t num_kept = start.back();
+  std::vector<double> px(num_kept), py(num_kept), pv(num_kept*nch);
+  std::vector<size_t> pos(start.begin(), start.end() - 1);
+  for (size_t it = 0; it < m_xy.size(); it++) {
+    if (cell_of[it] < 0)
+      continue;
+    size_t k = pos[cell_of[it]]++;
+    px[k] = m_xy[it].x();
+    py[k] = m_xy[it].y();
+    for (int ch = 0; ch < nch; ch++)
+      pv[k*nch + ch] = m_vals[it*nch + ch];
+  }
+  // Free memory early as for large tiles these can be big
+  std::vector<int>().swap(cell_of);
+  std::vector<Vector2>().swap(m_xy);
+  std::vector<double>().swap(m_vals);
+
+  double r2 = m_radius*m_radius;
+  for (int iy = 0; iy < m_height; iy++) {
+    double gy = m_y0 + iy*m_grid_size;
+    for (int ix = 0; ix < m_width; ix++) {
+      double gx = m_x0 + ix*m_grid_size;
+
+      // Node (ix, iy) sees the padded cell rows iy, ..., iy + 2*pad, and
+      // in each such row the cells ix, ..., ix + 2*pad, which are stored
+      // consecutively, so they form a single range of points.
+      m_near.clear();
+      for (int cy = iy; cy <= iy + 2*pad; cy++) {
+        size_t beg = start[size_t(cy)*nc + ix];
+        size_t end = start[size_t(cy)*nc + ix + 2*pad + 1];
+        for (size_t k = beg; k < end; k++) {
+          double dx = px[k] - gx, dy = py[k] - gy;
+          if (dx*dx + dy*dy <= r2)
+            m_near.push_back(k);
+        }
+      }
+
+      m_weights(ix, iy) = m_near.size();
+      if (m_near.empty())
+        continue; // keep the no-data value
+
+      for (int ch = 0; ch < nch; ch++) {
+        m_arena.clear();
+        for (size_t it = 0; it < m_near.size(); it++)
+          m_arena.push_back(pv[m_near[it]*nch + ch]);
+
+        ImageView<double> & buffer = *m_buffers[ch];
+        if constexpr (F == f_stddev) {
+          vw::math::StdDevAccumulator<double> V;
+          for (size_t it = 0; it < m_arena.size(); it++) 
+            V(m_arena[it]);
+          buffer(ix, iy) = V.value();
+        } else if constexpr (F == f_median) {
+          vw::math::MedianAccumulator<double> V;
+          for (size_t it = 0; it < m_arena.size(); it++) 
+            V(m_arena[it]);
+          buffer(ix, iy) = V.value();
+        } else if constexpr (F == f_nmad) {
+          buffer(ix, iy) = vw::math::destructive_nmad(m_arena);
+        } else if constexpr (F == f_percentile) {
+          buffer(ix, iy) = vw::math::destructive_percentile(m_arena, m_percentile);
+        }
+      }
+    }
+  }
+}
+
+void Point2GridBinned::normalize() {
+  // Resolve the filter once per tile, rather than once per point
+  switch (m_filter) {
+    case f_weighted_average: scatter<f_weighted_average>(); break;
+    case f_min:              scatter<f_min>();              break;
+    case f_max:              scatter<f_max>();              break;
+    case f_mean:             scatter<f_mean>();             break;
+    case f_count:            scatter<f_count>();            break;
+    case f_median:           gather<f_median>();            break;
+    case f_stddev:           gather<f_stddev>();            break;
+    case f_nmad:             gather<f_nmad>();              break;
+    case f_percentile:       gather<f_percentile>();        break;
+    default:
+      vw_throw(ArgumentErr() << "Point2GridBinned: Unknown filter.\n");
+  }
+  m_xy.clear();
+  m_vals.clear();
+}
   
 } // end namespace asp
@@ -23,6 +23,9 @@
 #define __VW_POINT2GRID_H__
 
 #include <vw/Image/ImageView.h>
+#include <vw/Math/Vector.h>
+
+#include <vector>
 
 namespace asp {
 
@@ -62,6 +65,61 @@ namespace asp {
 
   };
 
+  /// An alternative to Point2Grid producing the same result, but faster for
+  /// dense clouds. AddPoint() only records the point, and the work is done
+  /// in normalize(), where the filter is resolved once per tile via a
+  /// template. Filters which accumulate are applied point by point, with
+  /// Gaussian weights looked up by squared distance. For order statistics
+  /// the points are sorted once into grid cells, and each grid node gathers
+  /// the values from the nearby cells into a single reusable buffer, rather
+  /// than each node keeping its own vector.
+  class Point2GridBinned {
+
+  public:
+    Point2GridBinned(int width, int height,
+                     vw::ImageView<double> & buffer, vw::ImageView<double> & weights,
+                     double x0, double y0,
+                     double grid_size, double min_spacing, double radius,
+                     double sigma_factor,
+                     FilterType filter, double percentile);
+
+    /// Grid several values per point, such as several textures of the same
+    /// cloud, with one output buffer per value. The points are binned and the
+    /// distances found only once. The weights are the same for all values.
+    Point2GridBinned(int width, int height,
+                     std::vector<vw::ImageView<double>> & buffers,
+                     vw::ImageView<double> & weights,
+                     double x0, double y0,
+                     double grid_size, double min_spacing, double radius,
+                     double sigma_factor,
+                     FilterType filter, double percentile);
+    ~Point2GridBinned(){}
+    void Clear    (const float val);
+    void AddPoint (double x, double y, double z);
+    void AddPoint (double x, double y, double const* vals); // one value per buffer
+    void normalize();
+
+  private:
+    void init(double min_spacing, double sigma_factor);
+    template <FilterType F> void scatter();
+    template <FilterType F> void gather();
+
+    int m_width, m_height; // DEM dimensions
+    std::vector<vw::ImageView<double>*> m_buffers;
+    vw::ImageView<double> & m_weights;
+    std::vector<vw::Vector2> m_xy;     // points accumulated until normalize()
+    std::vector<double> m_vals;        // their values, one per buffer for each point
+    std::vector<size_t> m_near;        // scratch indices of points near a node
+    std::vector<double> m_arena;       // scratch values for order statistics
+    double     m_x0, m_y0;   // lower-left corner
+    double     m_grid_size;  // spacing between output DEM pixels
+    double     m_radius;     // how far to search for cloud points
+    double     m_dx2;        // spacing between squared distance samples
+    std::vector<double> m_sampled_gauss_sq; // Gaussian sampled at squared distances
+    FilterType m_filter;
+    double     m_percentile; // The actual value of the percentile to use if in that mode
+  };
+
 }
 
 #endif  // __VW_POINT2GRID_H__
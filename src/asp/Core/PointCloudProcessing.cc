@@ -23,6 +23,7 @@
 #include <asp/Core/PdalUtils.h>
 
 #include <vw/Cartography/Chipper.h>
+#include <vw/Core/Stopwatch.h>
 
 #include <pdal/PointView.hpp>
 #include <pdal/PointTable.hpp>
@@ -37,6 +38,11 @@
 #include <pdal/SpatialReference.hpp>
 #include <pdal/SrsBounds.hpp>
 
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+
 // Read through las points in streaming fashion. When a given amount is collected,
 // write a chip to disk.
 namespace asp {
@@ -657,6 +663,483 @@ void las_or_csv_to_tif(std::string const& in_file,
   return;
 }
 
+// Pass each point read from a LAS or COPC file to a function, in streaming
+// fashion, without keeping the points in memory.
+class PDAL_DLL PointVisitor: public pdal::Writer, public pdal::Streamable {
+
+public:
+
+  std::string getName() const { return "point visitor"; }
+
+  PointVisitor(std::function<void(vw::Vector3 const&)> const& visit):
+    m_visit(visit) {}
+
+  ~PointVisitor() {}
+
+private:
+
+  std::function<void(vw::Vector3 const&)> m_visit;
+
+  // This will be called for each point in the cloud.
+  virtual bool processOne(pdal::PointRef& point) {
+    m_visit(vw::Vector3(point.getFieldAs<double>(pdal::Dimension::Id::X),
+                        point.getFieldAs<double>(pdal::Dimension::Id::Y),
+                        point.getFieldAs<double>(pdal::Dimension::Id::Z)));
+    return true;
+  }
+
+  // Part of the API, not used here.
+  virtual void writeView(const pdal::PointViewPtr view) {
+    throw pdal::pdal_error("The writeView() function must not be called in streaming mode.");
+  }
+  virtual void addArgs(pdal::ProgramArgs& args) {}
+  virtual void initialize() {}
+  PointVisitor& operator=(const PointVisitor&) = delete;
+  PointVisitor(const PointVisitor&) = delete;
+  PointVisitor(const PointVisitor&&) = delete;
+};
+
+// Pass each point of a COPC file in the given window to a function. Only the
+// octree nodes of the file intersecting the window are read. If set, the
+// start function is first passed the information in the file header, so the
+// caller can prepare for the points without opening the file one more time.
+void visit_copc_points(std::string const& in_file,
+                       vw::BBox2 const& copc_win, bool copc_read_all,
+                       std::function<void(vw::Vector3 const&)> const& visit,
+                       std::function<void(pdal::QuickInfo const&)> const& start
+                       = nullptr) {
+
+  boost::shared_ptr<pdal::Reader> pdal_reader;
+  pdal::Options read_options;
+  asp::createLasOrCopcReader(in_file, copc_win, copc_read_all,
+                             pdal_reader, read_options);
+  if (start)
+    start(pdal_reader->preview());
+
+  // buf_size is the number of points that will be processed and kept in this
+  // table at the same time.
+  int buf_size = 100;
+  pdal::FixedPointTable t(buf_size);
+  pdal_reader->prepare(t);
+
+  PointVisitor visitor(visit);
+  pdal::Options write_options;
+  visitor.setOptions(write_options);
+  visitor.setInput(*pdal_reader);
+  visitor.prepare(t);
+  visitor.execute(t);
+}
+
+// A grid over the xy extent of a COPC file. The number of points in each cell
+// is used to split the cloud into windows having a bounded number of points.
+struct CopcGrid {
+
+  vw::Vector2 origin, cell_size;
+  int nx, ny;
+  std::vector<std::int64_t> sums; // cumulative counts, of size (nx+1)*(ny+1)
+
+  CopcGrid(): nx(0), ny(0) {}
+
+  // Use max_cells along the longer side, and square cells
+  CopcGrid(vw::BBox2 const& domain, int max_cells) {
+    origin = domain.min();
+    double len = std::max(domain.width(), domain.height());
+    if (len <= 0.0)
+      len = 1.0; // a single point, or all points on a line
+    double d = len / max_cells;
+    cell_size = vw::Vector2(d, d);
+    nx = std::max(1, std::min(max_cells, int(ceil(domain.width() / d))));
+    ny = std::max(1, std::min(max_cells, int(ceil(domain.height() / d))));
+    sums.assign(std::int64_t(nx + 1) * (ny + 1), 0);
+  }
+
+  // The coordinate along the given axis where cell k starts. Both cell() and
+  // region() use this, so that the region of a range of cells contains
+  // exactly the points in these cells, with no roundoff issues.
+  double edge(int axis, int k) const {
+    return origin[axis] + k * cell_size[axis];
+  }
+
+  // The cell index along an axis, with cell k being [edge(k), edge(k + 1)).
+  // Values before the first cell or past the last one are clamped.
+  int cell_index(int axis, double val, int num) const {
+    int k = int(floor((val - origin[axis]) / cell_size[axis]));
+    k = std::max(0, std::min(k, num - 1));
+    while (k > 0 && val < edge(axis, k))
+      k--;
+    while (k < num - 1 && val >= edge(axis, k + 1))
+      k++;
+    return k;
+  }
+
+  // The cell having the given point. Points on or past the domain boundary
+  // go to the nearest cell.
+  vw::Vector2i cell(vw::Vector3 const& p) const {
+    return vw::Vector2i(cell_index(0, p.x(), nx), cell_index(1, p.y(), ny));
+  }
+
+  // The region covered by a range of cells
+  vw::BBox2 region(vw::BBox2i const& cells) const {
+    return vw::BBox2(vw::Vector2(edge(0, cells.min().x()), edge(1, cells.min().y())),
+                     vw::Vector2(edge(0, cells.max().x()), edge(1, cells.max().y())));
+  }
+
+  std::int64_t & sum(int cx, int cy) { return sums[std::int64_t(cy) * (nx + 1) + cx]; }
+  std::int64_t sum(int cx, int cy) const { return sums[std::int64_t(cy) * (nx + 1) + cx]; }
+
+  // Turn the per-cell counts, stored at sum(cx + 1, cy + 1), into cumulative
+  // counts, so the number of points in a range of cells is found in constant time.
+  void accumulate() {
+    for (int cy = 1; cy <= ny; cy++) {
+      for (int cx = 1; cx <= nx; cx++)
+        sum(cx, cy) += sum(cx - 1, cy) + sum(cx, cy - 1) - sum(cx - 1, cy - 1);
+    }
+  }
+
+  // The number of points in a range of cells. The max corner is exclusive.
+  std::int64_t count(vw::BBox2i const& cells) const {
+    return sum(cells.max().x(), cells.max().y()) - sum(cells.min().x(), cells.max().y())
+      - sum(cells.max().x(), cells.min().y()) + sum(cells.min().x(), cells.min().y());
+  }
+};
+
+// A window of a COPC file and where its points are placed in the cloud image
+struct CopcWindow {
+  vw::BBox2i   cells;      // range of grid cells, the max corner is exclusive
+  std::int64_t num_points;
+  std::int64_t start_col;  // the first column in the cloud image
+  std::int64_t num_cols;
+};
+
+// Recursively split a range of cells into two pieces with about the same
+// number of points, until each piece has no more than max_num_points, or it is
+// a single cell. Empty pieces are skipped.
+void split_copc_cells(CopcGrid const& grid, vw::BBox2i const& cells,
+                      std::int64_t max_num_points,
+                      std::vector<CopcWindow> & windows) {
+
+  std::int64_t num = grid.count(cells);
+  if (num == 0)
+    return;
+
+  if (num <= max_num_points || (cells.width() == 1 && cells.height() == 1)) {
+    CopcWindow win;
+    win.cells = cells;
+    win.num_points = num;
+    win.start_col = 0; // will be set later
+    win.num_cols = 0;
+    windows.push_back(win);
+    return;
+  }
+
+  // Split along the longer side, at the first position past the median
+  bool along_x = (cells.width() >= cells.height());
+  int beg = along_x ? cells.min().x() : cells.min().y();
+  int end = along_x ? cells.max().x() : cells.max().y();
+  vw::BBox2i left = cells, right = cells;
+  for (int pos = beg + 1; pos < end; pos++) {
+    if (along_x)
+      left.max().x() = pos;
+    else
+      left.max().y() = pos;
+    if (grid.count(left) >= num / 2)
+      break;
+  }
+  if (along_x)
+    right.min().x() = left.max().x();
+  else
+    right.min().y() = left.max().y();
+
+  split_copc_cells(grid, left,  max_num_points, windows);
+  split_copc_cells(grid, right, max_num_points, windows);
+}
+
+/// A point cloud image whose points are fetched on demand from a COPC file,
+/// rather than from a temporary tif file. The file is split into windows with
+/// a bounded number of points each, and each window is placed as a strip of
+/// the image. When a window is needed, its points are read with a spatial
+/// query, and organized in chips as done by las_or_csv_to_tif(). The most
+/// recently used windows are kept in memory.
+class CopcCloudView: public vw::ImageViewBase<CopcCloudView> {
+
+  typedef vw::Vector3 PixelT;
+  typedef boost::shared_ptr<vw::ImageView<PixelT>> WindowPtr;
+
+  // The windows in memory, shared among copies of this view
+  struct WindowCache {
+    vw::Mutex mutex;
+    std::list<int> recent; // most recently used first
+    std::map<int, WindowPtr> windows;
+    // Serialize reading a given window, so it is read only once
+    std::vector<boost::shared_ptr<vw::Mutex>> window_mutexes;
+  };
+
+  std::string m_file;
+  vw::BBox2 m_copc_win;
+  bool m_copc_read_all;
+  bool m_has_georef;
+  vw::cartography::GeoReference m_georef;
+  vw::BBox2 m_domain; // the file extent, within the COPC window
+  CopcGrid m_grid;
+  std::vector<CopcWindow> m_windows;
+  std::int64_t m_cols;
+  int m_rows, m_block_size, m_cache_size;
+  boost::shared_ptr<WindowCache> m_cache;
+
+  // The COPC reader returns the points in the window, including its boundary
+  bool in_copc_win(PixelT const& p) const {
+    return m_copc_read_all ||
+      (p.x() >= m_copc_win.min().x() && p.x() <= m_copc_win.max().x() &&
+       p.y() >= m_copc_win.min().y() && p.y() <= m_copc_win.max().y());
+  }
+
+  // The window having the given image column
+  int window_index(std::int64_t col) const {
+    int beg = 0, end = m_windows.size();
+    while (end - beg > 1) {
+      int mid = (beg + end) / 2;
+      if (m_windows[mid].start_col <= col)
+        beg = mid;
+      else
+        end = mid;
+    }
+    return beg;
+  }
+
+  // Read the points in a window and organize them in chips
+  WindowPtr read_window(int w) const {
+
+    CopcWindow const& win = m_windows[w];
+
+    // Query exactly the region of the window cells. Points on a boundary
+    // shared with another window are returned for both, so keep only those
+    // in the window cells. The windows on the sides of the domain also get
+    // the points clamped to their cells, so extend the region there, with a
+    // margin in case the extent in the header is rounded.
+    vw::BBox2 region = m_grid.region(win.cells);
+    vw::BBox2 domain = m_domain;
+    domain.expand(std::max(m_grid.cell_size.x(), m_grid.cell_size.y()));
+    if (win.cells.min().x() == 0)
+      region.min().x() = domain.min().x();
+    if (win.cells.min().y() == 0)
+      region.min().y() = domain.min().y();
+    if (win.cells.max().x() == m_grid.nx)
+      region.max().x() = domain.max().x();
+    if (win.cells.max().y() == m_grid.ny)
+      region.max().y() = domain.max().y();
+
+    vw::PointBuffer buf;
+    buf.reserve(win.num_points);
+    bool copc_read_all = false;
+    visit_copc_points(m_file, region, copc_read_all,
+                      [&](PixelT const& p) {
+                        if (!in_copc_win(p))
+                          return;
+                        vw::Vector2i c = m_grid.cell(p);
+                        if (c.x() >= win.cells.min().x() && c.x() < win.cells.max().x() &&
+                            c.y() >= win.cells.min().y() && c.y() < win.cells.max().y())
+                          buf.push_back(p);
+                      });
+
+    // This can happen only if the file changed since the points were counted
+    std::int64_t max_num_points = win.num_cols * m_rows;
+    if (std::int64_t(buf.size()) > max_num_points) {
+      vw::vw_out(vw::WarningMessage) << "Found more points than expected in "
+                                     << m_file << ". Ignoring the extra points.\n";
+      buf.resize(max_num_points);
+    }
+
+    WindowPtr img(new vw::ImageView<PixelT>);
+    vw::Chipper(buf, m_block_size, m_has_georef, m_georef, win.num_cols, m_rows, *img);
+
+    VW_ASSERT(win.num_cols == img->cols() && m_rows == img->rows(),
+              vw::ArgumentErr() << "CopcCloudView: Size mis-match.\n");
+
+    return img;
+  }
+
+  // Fetch a window from the cache, or read it
+  WindowPtr window(int w) const {
+
+    vw::Mutex::Lock window_lock(*m_cache->window_mutexes[w]);
+    {
+      vw::Mutex::Lock lock(m_cache->mutex);
+      auto it = m_cache->windows.find(w);
+      if (it != m_cache->windows.end()) {
+        m_cache->recent.remove(w);
+        m_cache->recent.push_front(w);
+        return it->second;
+      }
+    }
+
+    WindowPtr img = read_window(w);
+
+    vw::Mutex::Lock lock(m_cache->mutex);
+    m_cache->windows[w] = img;
+    m_cache->recent.push_front(w);
+    while (int(m_cache->recent.size()) > m_cache_size) {
+      m_cache->windows.erase(m_cache->recent.back());
+      m_cache->recent.pop_back();
+    }
+
+    return img;
+  }
+
+public:
+
+  typedef PixelT pixel_type;
+  typedef PixelT result_type;
+  typedef vw::ProceduralPixelAccessor<CopcCloudView> pixel_accessor;
+
+  // Each window will have at most max_num_points, and each image strip will
+  // have the given number of rows. This will count the points in the file.
+  CopcCloudView(std::string const& file,
+                vw::BBox2 const& copc_win, bool copc_read_all,
+                std::int64_t max_num_points, int rows, int block_size,
+                int cache_size):
+    m_file(file), m_copc_win(copc_win), m_copc_read_all(copc_read_all),
+    m_cols(0), m_rows(rows), m_block_size(block_size),
+    m_cache_size(std::max(cache_size, 1)), m_cache(new WindowCache) {
+
+    VW_ASSERT(rows % block_size == 0,
+              vw::ArgumentErr() << "CopcCloudView: Expecting the number of rows "
+              << "to be a multiple of the block size.\n");
+
+    if (!m_copc_read_all && m_copc_win.empty())
+      vw::vw_throw(vw::ArgumentErr() << "Detected COPC file: " << m_file << ".\n"
+                   << "Set either the copc-win or copc-read-all option.\n");
+
+    // Count the points in each cell of a grid over the file extent. The
+    // georeference and extent are read from the header by the same reader
+    // that then reads the points. Nothing is written to disk.
+    vw::vw_out() << "Counting the points in: " << m_file << "\n";
+    vw::Stopwatch sw;
+    sw.start();
+    int max_cells = 1024;
+    auto start = [&](pdal::QuickInfo const& qi) {
+      std::string wkt = qi.m_srs.getWKT();
+      m_has_georef = !wkt.empty();
+      if (m_has_georef)
+        m_georef.set_wkt(wkt);
+      pdal::BOX3D const& b = qi.m_bounds;
+      m_domain = vw::BBox2(vw::Vector2(b.minx, b.miny), vw::Vector2(b.maxx, b.maxy));
+      if (!m_copc_read_all)
+        m_domain.crop(m_copc_win);
+      if (m_domain.empty())
+        vw::vw_throw(vw::ArgumentErr() << "The COPC window " << m_copc_win
+                     << " does not intersect the extent of " << m_file << ".\n");
+      m_grid = CopcGrid(m_domain, max_cells);
+    };
+    visit_copc_points(m_file, m_copc_win, m_copc_read_all,
+                      [&](PixelT const& p) {
+                        if (!in_copc_win(p))
+                          return;
+                        vw::Vector2i c = m_grid.cell(p);
+                        m_grid.sum(c.x() + 1, c.y() + 1)++;
+                      }, start);
+    m_grid.accumulate();
+    sw.stop();
+    vw::vw_out(vw::DebugMessage, "asp") << "Counting time: " << sw.elapsed_seconds()
+                                        << " seconds.\n";
+
+    split_copc_cells(m_grid, vw::BBox2i(0, 0, m_grid.nx, m_grid.ny),
+                     max_num_points, m_windows);
+    if (m_windows.empty())
+      vw::vw_throw(vw::ArgumentErr() << "No points were found in: " << m_file << ".\n");
+
+    // Lay out the windows side by side. A single cell with too many points
+    // gets several strips.
+    std::int64_t strip_cols = max_num_points / m_rows;
+    strip_cols = std::max(std::int64_t(1), strip_cols / m_block_size) * m_block_size;
+    for (size_t w = 0; w < m_windows.size(); w++) {
+      std::int64_t num_strips = (m_windows[w].num_points + strip_cols * m_rows - 1)
+        / (strip_cols * m_rows);
+      m_windows[w].start_col = m_cols;
+      m_windows[w].num_cols  = num_strips * strip_cols;
+      m_cols += m_windows[w].num_cols;
+    }
+    if (m_cols > std::numeric_limits<vw::int32>::max())
+      vw::vw_throw(vw::ArgumentErr() << "The COPC file " << m_file
+                   << " has too many points to process at once. Use --copc-win.\n");
+
+    for (size_t w = 0; w < m_windows.size(); w++)
+      m_cache->window_mutexes.push_back(boost::shared_ptr<vw::Mutex>(new vw::Mutex));
+
+    vw::vw_out() << "Split the cloud into " << m_windows.size() << " regions.\n";
+  }
+
+  inline vw::int32 cols  () const { return m_cols; }
+  inline vw::int32 rows  () const { return m_rows; }
+  inline vw::int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this); }
+
+  inline result_type operator()(size_t i, size_t j, size_t p=0) const {
+    int w = window_index(i);
+    WindowPtr img = window(w);
+    return (*img)(i - m_windows[w].start_col, j);
+  }
+
+  typedef vw::CropView<vw::ImageView<PixelT>> prerasterize_type;
+  inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+
+    vw::ImageView<PixelT> out(bbox.width(), bbox.height());
+    for (int w = window_index(bbox.min().x());
+         w < int(m_windows.size()) && m_windows[w].start_col < bbox.max().x(); w++) {
+
+      vw::BBox2i win_box(m_windows[w].start_col, 0, m_windows[w].num_cols, m_rows);
+      win_box.crop(bbox);
+      if (win_box.empty())
+        continue;
+
+      WindowPtr img = window(w);
+      int start_col = m_windows[w].start_col;
+      for (int col = win_box.min().x(); col < win_box.max().x(); col++) {
+        for (int row = win_box.min().y(); row < win_box.max().y(); row++)
+          out(col - bbox.min().x(), row - bbox.min().y()) = (*img)(col - start_col, row);
+      }
+    }
+
+    return crop(out, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+
+}; // End class CopcCloudView
+
+// Form a point cloud image from COPC files, with the points fetched on demand
+// with spatial queries. No temporary files are written.
+vw::ImageViewRef<vw::Vector3>
+copc_stream_cloud(std::vector<std::string> const& copc_files,
+                  vw::BBox2 const& copc_win, bool copc_read_all,
+                  int rows, int block_size, int cache_size) {
+
+  VW_ASSERT(copc_files.size() >= 1, vw::ArgumentErr() << "Expecting at least one file.\n");
+
+  // Each window will have about as many points as a tile of a temporary tif
+  // file, but less memory is used as only a few windows are kept at a time.
+  std::int64_t max_num_points
+    = std::int64_t(ASP_POINT_CLOUD_TILE_LEN) * ASP_POINT_CLOUD_TILE_LEN / 4;
+
+  vw::mosaic::ImageComposite<vw::Vector3> composite_image;
+  composite_image.set_draft_mode(true); // images will be disjoint
+
+  for (size_t i = 0; i < copc_files.size(); i++) {
+    vw::ImageViewRef<vw::Vector3> I
+      = CopcCloudView(copc_files[i], copc_win, copc_read_all, max_num_points,
+                      rows, block_size, cache_size);
+    int start = composite_image.cols();
+    if (i > 0) // Insert the spacing
+      start = block_size*(int)ceil(double(start)/block_size) + block_size;
+    composite_image.insert(I, start, 0);
+  }
+
+  return composite_image;
+}
+
 /// Builds a GeoReference from the first cloud having a georeference in the list
 bool georef_from_pc_files(std::vector<std::string> const& files,
                           vw::cartography::GeoReference & georef) {
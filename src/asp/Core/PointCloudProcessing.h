@@ -23,7 +23,9 @@
 #ifndef __ASP_CORE_POINT_CLOUD_PROCESSING_H__
 #define __ASP_CORE_POINT_CLOUD_PROCESSING_H__
 
+#include <vw/Image/ImageViewRef.h>
 #include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
 
 #include <string>
 #include <vector>
@@ -55,6 +57,16 @@ namespace asp {
                          asp::CsvConv const& csv_conv,
                          std::vector<std::string> & out_files);
   
+  /// Form a point cloud image from COPC files without writing temporary tif
+  /// files. Each file is split into windows with a bounded number of points.
+  /// The points in a window are read with a spatial query when needed and
+  /// organized in chips, and the most recently used windows are kept in memory.
+  /// The image will have the given number of rows.
+  vw::ImageViewRef<vw::Vector3>
+  copc_stream_cloud(std::vector<std::string> const& copc_files,
+                    vw::BBox2 const& copc_win, bool copc_read_all,
+                    int rows, int block_size, int cache_size);
+
 } // End namespace asp
 
 #endif // __ASP_CORE_POINT_CLOUD_PROCESSING_H__
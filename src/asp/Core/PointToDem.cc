@@ -20,6 +20,7 @@
 #include <asp/Core/PointCloudProcessing.h>
 #include <asp/Core/PdalUtils.h>
 #include <asp/Core/CartographyUtils.h>
+#include <asp/Core/StereoSettings.h>
 
 #include <vw/Image/AntiAliasing.h>
 #include <vw/Image/Filter.h>
@@ -42,7 +43,8 @@ DemOptions::DemOptions():
   erode_len(0), search_radius_factor(0), sigma_factor(0),
   default_grid_size_multiplier(1.0),
   has_las_or_csv_or_pcd(false), max_output_size(9999999, 9999999),
-  auto_proj_center(false), input_is_projected(false) {}
+  auto_proj_center(false), input_is_projected(false), use_bbox_cache(false),
+  single_pass(false), copc_stream(false) {}
 
 // The files will be input point clouds, and if opt.do_ortho is
 // true, also texture files. If texture files are present, there
@@ -230,6 +232,19 @@ void chip_convert_to_tif(DemOptions const& opt,
 
 }
 
+// The COPC files read directly have only the points
+int cloud_num_channels(DemOptions const& opt) {
+  if (opt.copc_stream)
+    return 3;
+  return asp::num_channels(opt.pointcloud_files);
+}
+
+bool cloud_has_stddev(DemOptions const& opt) {
+  if (opt.copc_stream)
+    return false;
+  return asp::has_stddev(opt.pointcloud_files);
+}
+
 // Set the projection based on options. By now opt.proj_lon and opt.proj_lat
 // should have been set. 
 void setProjection(DemOptions const& opt, cartography::GeoReference & output_georef) {
@@ -285,4 +300,37 @@ void setProjection(DemOptions const& opt, cartography::GeoReference & output_geo
   return;
 } 
 
+// The file in which to cache the point cloud extent and block boundaries,
+// next to the first input cloud.
+std::string bbox_cache_file(DemOptions const& opt) {
+  if (opt.pointcloud_files.empty())
+    vw::vw_throw(ArgumentErr() << "No input point clouds were specified.\n");
+  return opt.pointcloud_files[0] + ".bbox_cache";
+}
+
+// A string identifying the input clouds (via their size and modification
+// time) and the options which affect the point cloud extent and block
+// boundaries. A cached extent is used only if it was made with the same key.
+std::string bbox_cache_key(DemOptions const& opt,
+                           vw::cartography::GeoReference const& georef) {
+  std::ostringstream os;
+  os.precision(17);
+  for (size_t it = 0; it < opt.pointcloud_files.size(); it++) {
+    std::string const& file = opt.pointcloud_files[it];
+    os << "file: " << fs::absolute(file).string() << " " << fs::file_size(file) << " "
+       << fs::last_write_time(file) << "\n";
+  }
+  os << "srs: " << georef.get_wkt() << "\n";
+  os << "input_is_projected: " << opt.input_is_projected << "\n";
+  os << "rotation: " << opt.rot_order << " " << opt.phi_rot << " " << opt.omega_rot
+     << " " << opt.kappa_rot << "\n";
+  os << "offset: " << opt.lon_offset << " " << opt.lat_offset << " "
+     << opt.height_offset << "\n";
+  os << "outliers: " << opt.remove_outliers_with_pct << " " << opt.use_tukey_outlier_removal
+     << " " << opt.remove_outliers_params << " " << opt.max_valid_triangulation_error << "\n";
+  os << "tile_size: " << asp::ASPGlobalOptions::tri_tile_size() << " "
+     << ASP_MAX_SUBBLOCK_SIZE << "\n";
+  return os.str();
+}
+
 } // end namespace asp
@@ -82,7 +82,7 @@ struct DemOptions: vw::GdalWriteOptions {
   double      search_radius_factor, sigma_factor, default_grid_size_multiplier;
   bool        has_las_or_csv_or_pcd, auto_proj_center, copc_read_all;
   vw::Vector2i max_output_size;
-  bool        input_is_projected;
+  bool        input_is_projected, use_bbox_cache, single_pass, copc_stream;
   
   // Output
   std::string out_prefix, output_file_type;
@@ -103,6 +103,11 @@ void chip_convert_to_tif(DemOptions const& opt,
                          std::vector<std::string> & pc_files, 
                          std::vector<std::string> & conv_files);
 
+// The number of channels of the input clouds, and if they have the stddev
+// channels. COPC files read directly with --copc-stream have only the points.
+int cloud_num_channels(DemOptions const& opt);
+bool cloud_has_stddev(DemOptions const& opt);
+
 // Rasterize a DEM
 void rasterize_cloud(asp::OrthoRasterizerView& rasterizer,
                      DemOptions& opt,
@@ -113,6 +118,16 @@ void rasterize_cloud(asp::OrthoRasterizerView& rasterizer,
 // should have been set. 
 void setProjection(DemOptions const& opt, vw::cartography::GeoReference & output_georef);
 
+// The file in which to cache the point cloud extent and block boundaries,
+// next to the first input cloud.
+std::string bbox_cache_file(DemOptions const& opt);
+
+// A string identifying the input clouds (via their size and modification
+// time) and the options which affect the point cloud extent and block
+// boundaries. A cached extent is used only if it was made with the same key.
+std::string bbox_cache_key(DemOptions const& opt,
+                           vw::cartography::GeoReference const& georef);
+
 } // end namespace asp
 
 #endif//__ASP_CORE_POINT_TO_DEM_H__
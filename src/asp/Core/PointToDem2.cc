@@ -22,6 +22,7 @@
 #include <vw/Image/AntiAliasing.h>
 #include <vw/Image/Filter.h>
 #include <vw/Image/InpaintView.h>
+#include <vw/Image/Manipulation.h>
 
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
@@ -232,6 +233,35 @@ CombinedAbsView combine_abs_channels(double nodata_value,
   return CombinedAbsView(nodata_value, image1, image2, image3);
 }
 
+// Stop the program if it is going to create too large a DEM, this will
+// cause a crash.
+void check_dem_size(DemOptions const& opt, Vector2i const& dem_size) {
+  vw_out()<< "Creating output file that is " << dem_size << " px.\n";
+  if ((dem_size[0] > opt.max_output_size[0]) || (dem_size[1] > opt.max_output_size[1]))
+    vw_throw(ArgumentErr()
+              << "Requested DEM size is too large, max allowed output size is "
+              << opt.max_output_size << " pixels.\n");
+}
+
+// Print the percentage of valid DEM pixels, given the number of invalid
+// ones counted by OrthoRasterizerView as the DEM was written, then reset
+// that count.
+void report_valid_pixels(Vector2i const& dem_size, std::int64_t * num_invalid_pixels) {
+
+  double num_invalid_pixelsD = *num_invalid_pixels;
+
+  // Below we convert to double first and multiply later, to avoid
+  // 32-bit integer overflow.
+  double num_total_pixels = double(dem_size[0]) * double(dem_size[1]);
+
+  double invalid_ratio = num_invalid_pixelsD / num_total_pixels;
+  vw_out() << "Percentage of valid pixels: "
+            << 100.0*(1.0 - invalid_ratio) << "%\n";
+
+  // Wipe after use. This will reset the counter in OrthoRasterizerView.
+  *num_invalid_pixels = 0;
+}
+
 // Save the DEM
 void save_dem(DemOptions & opt,
               vw::cartography::GeoReference const& georef,
@@ -265,32 +295,24 @@ void save_dem(DemOptions & opt,
         opt.nodata_value);
   }
 
-  // Stop the program if it is going to create too large a DEM, this will
-  // cause a crash.
   Vector2i dem_size = bounding_box(dem).size();
-  vw_out()<< "Creating output file that is " << dem_size << " px.\n";
-  if ((dem_size[0] > opt.max_output_size[0]) || (dem_size[1] > opt.max_output_size[1]))
-    vw_throw(ArgumentErr()
-              << "Requested DEM size is too large, max allowed output size is "
-              << opt.max_output_size << " pixels.\n");
+  check_dem_size(opt, dem_size);
 
   asp::save_image(opt, dem, georef, hole_fill_len, "DEM");
   sw2.stop();
   vw_out(DebugMessage,"asp") << "DEM render time: " << sw2.elapsed_seconds() << ".\n";
 
-  // num_invalid_pixels was updated as the DEM was written.
-  double num_invalid_pixelsD = *num_invalid_pixels;
-
-  // Below we convert to double first and multiply later, to avoid
-  // 32-bit integer overflow.
-  double num_total_pixels = double(dem_size[0]) * double(dem_size[1]);
-
-  double invalid_ratio = num_invalid_pixelsD / num_total_pixels;
-  vw_out() << "Percentage of valid pixels: "
-            << 100.0*(1.0 - invalid_ratio) << "%\n";
+  // Report the cost of finding the point cloud blocks for each tile
+  std::int64_t num_queries = 0;
+  double query_time = 0.0;
+  rasterizer.boundary_query_stats(num_queries, query_time);
+  if (num_queries > 0)
+    vw_out(DebugMessage,"asp") << "Block boundary lookups: " << num_queries
+                               << ", total time: " << query_time << " s, per tile: "
+                               << query_time/num_queries << " s.\n";
 
-  // Wipe after use. This will reset the counter in OrthoRasterizerView.
-  *num_invalid_pixels = 0;
+  // num_invalid_pixels was updated as the DEM was written.
+  report_valid_pixels(dem_size, num_invalid_pixels);
 }
 
 // Save the intersection error
@@ -301,7 +323,7 @@ void save_intersection_error(DemOptions & opt,
                              asp::OrthoRasterizerView& rasterizer) {
 
   int hole_fill_len = 0;
-  int num_channels = asp::num_channels(opt.pointcloud_files);
+  int num_channels = asp::cloud_num_channels(opt);
 
   if (num_channels == 4 || (num_channels == 6 && has_stddev) || opt.scalar_error) {
     // The error is a scalar (4 channels or 6 channels but last two are stddev),
@@ -343,7 +365,7 @@ void save_stddev(DemOptions & opt,
                  vw::cartography::GeoReference const& georef,
                  asp::OrthoRasterizerView& rasterizer) {
 
-  int num_channels = asp::num_channels(opt.pointcloud_files);
+  int num_channels = asp::cloud_num_channels(opt);
 
   double rounding_error = 0.0;
   vw_out() << "Not rounding propagated errors (option: --rounding-error) to avoid "
@@ -458,6 +480,138 @@ void save_ortho(DemOptions & opt,
   vw_out(DebugMessage,"asp") << "DRG render time: " << sw3.elapsed_seconds() << "\n";
 }
 
+// Remove a file when going out of scope, also if an exception is thrown
+struct RemoveFileGuard {
+  std::string m_file;
+  RemoveFileGuard(std::string const& file): m_file(file) {}
+  ~RemoveFileGuard() {
+    boost::system::error_code ec;
+    fs::remove(m_file, ec); // a destructor must not throw
+  }
+};
+
+// Rasterize the DEM, and the requested intersection error, stddev, and
+// orthoimage, in a single pass over the point cloud. Each of these is a
+// plane in a temporary multi-band file, which is then split into the
+// usual output files. The orthoimage is produced separately if its holes
+// are to be filled, as that modifies the cloud. Return true if the
+// orthoimage was written.
+bool save_layers_one_pass(DemOptions & opt,
+                          bool has_stddev,
+                          vw::cartography::GeoReference const& georef,
+                          Vector2 const& tile_size,
+                          asp::OrthoRasterizerView& rasterizer,
+                          std::int64_t * num_invalid_pixels) {
+
+  // Collect the textures beyond the height. Layer 0 is the DEM.
+  std::vector<ImageViewRef<double>> extra;
+  int err_layer = -1, num_err_layers = 0, stddev_layer = -1, ortho_layer = -1;
+  int num_channels = asp::cloud_num_channels(opt);
+
+  if (opt.do_error) {
+    if (num_channels == 4 || (num_channels == 6 && has_stddev) || opt.scalar_error) {
+      err_layer = 1 + extra.size();
+      num_err_layers = 1;
+      extra.push_back(asp::point_cloud_error_image(opt.pointcloud_files));
+    } else if (num_channels == 6) {
+      // The error is a 3D vector. Rasterize it in the NED coordinate system.
+      ImageViewRef<Vector6> point_disk_image = asp::form_point_cloud_composite<Vector6>
+        (opt.pointcloud_files, ASP_MAX_SUBBLOCK_SIZE);
+      ImageViewRef<Vector3> ned_err = asp::error_to_NED(point_disk_image, georef);
+      err_layer = 1 + extra.size();
+      num_err_layers = 3;
+      for (int ch_index = 0; ch_index < 3; ch_index++)
+        extra.push_back(select_channel(ned_err, ch_index));
+    } else {
+      vw_out() << "The point cloud files must have an equal number of channels which "
+               << "must be 4 or 6 to be able to process the intersection error.\n";
+    }
+  }
+
+  if (opt.propagate_errors) {
+    ImageViewRef<Vector6> point_disk_image = asp::form_point_cloud_composite<Vector6>
+      (opt.pointcloud_files, ASP_MAX_SUBBLOCK_SIZE);
+    stddev_layer = 1 + extra.size();
+    extra.push_back(select_channel(point_disk_image, 4));
+    extra.push_back(select_channel(point_disk_image, 5));
+  }
+
+  if (opt.do_ortho && opt.ortho_hole_fill_len == 0) {
+    ImageViewRef<PixelGray<float>> texture
+      = asp::form_point_cloud_composite<PixelGray<float>>
+      (opt.texture_files, ASP_MAX_SUBBLOCK_SIZE);
+    ortho_layer = 1 + extra.size();
+    extra.push_back(channel_cast<double>(select_channel(texture, 0)));
+  }
+
+  // Rasterize all layers in one pass
+  Stopwatch sw;
+  sw.start();
+  *num_invalid_pixels = 0;
+  rasterizer.set_extra_textures(extra);
+  Vector2i dem_size = bounding_box(rasterizer.impl()).size();
+  check_dem_size(opt, dem_size);
+  std::string layers_file = opt.out_prefix + "-layers-tmp.tif";
+  RemoveFileGuard layers_guard(layers_file); // also if an exception is thrown
+  vw_out() << "Writing: " << layers_file << "\n";
+  bool has_georef = true, has_nodata = true;
+  vw::cartography::block_write_gdal_image(layers_file, rasterizer.impl(),
+                                          has_georef, georef,
+                                          has_nodata, opt.nodata_value, opt,
+                                          TerminalProgressCallback("asp", "All layers: "));
+  rasterizer.clear_extra_textures();
+  sw.stop();
+  vw_out(DebugMessage,"asp") << "Single-pass render time: " << sw.elapsed_seconds() << ".\n";
+  report_valid_pixels(dem_size, num_invalid_pixels);
+
+  // Split into the individual outputs
+  DiskImageView<float> layers(layers_file);
+  ImageViewRef<PixelGray<float>> dem
+    = asp::round_image_pixels_skip_nodata(pixel_cast<PixelGray<float>>
+                                          (select_plane(layers, 0)),
+                                          opt.rounding_error, opt.nodata_value);
+  int hole_fill_len = opt.dem_hole_fill_len;
+  if (hole_fill_len > 0)
+    dem = apply_mask(vw::fill_holes_grass(create_mask(block_cache(dem, tile_size,
+                                                                  opt.num_threads),
+                                                      opt.nodata_value),
+                                          hole_fill_len),
+                     opt.nodata_value);
+  asp::save_image(opt, dem, georef, hole_fill_len, "DEM");
+
+  if (err_layer > 0 && num_err_layers == 1) {
+    save_image(opt, asp::round_image_pixels_skip_nodata
+               (pixel_cast<PixelGray<float>>(select_plane(layers, err_layer)),
+                opt.rounding_error, opt.nodata_value),
+               georef, 0, "IntersectionErr");
+  } else if (err_layer > 0 && num_err_layers == 3) {
+    std::vector<ImageViewRef<PixelGray<float>>> rasterized(3);
+    for (int ch_index = 0; ch_index < 3; ch_index++)
+      rasterized[ch_index]
+        = pixel_cast<PixelGray<float>>(select_plane(layers, err_layer + ch_index));
+    auto err_vec = asp::combine_abs_channels(opt.nodata_value, rasterized[0],
+                                             rasterized[1], rasterized[2]);
+    save_image(opt, asp::round_image_pixels_skip_nodata(err_vec,
+                              opt.rounding_error, opt.nodata_value),
+                georef, 0, "IntersectionErr");
+  }
+
+  if (stddev_layer > 0) {
+    vw_out() << "Not rounding propagated errors (option: --rounding-error) to avoid "
+              << "introducing step artifacts.\n";
+    save_image(opt, pixel_cast<PixelGray<float>>(select_plane(layers, stddev_layer)),
+               georef, 0, "HorizontalStdDev");
+    save_image(opt, pixel_cast<PixelGray<float>>(select_plane(layers, stddev_layer + 1)),
+               georef, 0, "VerticalStdDev");
+  }
+
+  if (ortho_layer > 0)
+    save_image(opt, pixel_cast<PixelGray<float>>(select_plane(layers, ortho_layer)),
+               georef, 0, "DRG");
+
+  return (ortho_layer > 0);
+}
+
 // Rasterize a DEM, and perhaps the error image, orthoimage, stddev, etc.
 // This may be called several times, with different grid sizes.
 void rasterize_cloud(asp::OrthoRasterizerView& rasterizer,
@@ -494,17 +648,8 @@ void rasterize_cloud(asp::OrthoRasterizerView& rasterizer,
   Vector2 tile_size(vw_settings().default_tile_size(),
                     vw_settings().default_tile_size());
 
-  // Write out the DEM. We've set the texture to be the height.
-  // This must happen before we set the texture to something else.
-  if (!opt.no_dem)
-     save_dem(opt, georef, rasterizer, tile_size, num_invalid_pixels);
-
   // If the point cloud has propagated stddev affects how we write the error image.
-  bool has_stddev = asp::has_stddev(opt.pointcloud_files);
-
-  // Write triangulation error image if requested
-  if (opt.do_error)
-    save_intersection_error(opt, has_stddev, georef, tile_size, rasterizer);
+  bool has_stddev = asp::cloud_has_stddev(opt);
 
   if (opt.propagate_errors && !has_stddev) {
     // Do not throw an error. Go on and save at least the intersection
@@ -514,8 +659,24 @@ void rasterize_cloud(asp::OrthoRasterizerView& rasterizer,
     opt.propagate_errors = false;
   }
 
-  if (opt.propagate_errors)
-    save_stddev(opt, georef, rasterizer);
+  bool ortho_done = false;
+  if (opt.single_pass && !opt.no_dem) {
+    // Write the DEM and the other layers with one pass over the cloud
+    ortho_done = save_layers_one_pass(opt, has_stddev, georef, tile_size, rasterizer,
+                                      num_invalid_pixels);
+  } else {
+    // Write out the DEM. We've set the texture to be the height.
+    // This must happen before we set the texture to something else.
+    if (!opt.no_dem)
+       save_dem(opt, georef, rasterizer, tile_size, num_invalid_pixels);
+
+    // Write triangulation error image if requested
+    if (opt.do_error)
+      save_intersection_error(opt, has_stddev, georef, tile_size, rasterizer);
+
+    if (opt.propagate_errors)
+      save_stddev(opt, georef, rasterizer);
+  }
 
   // Write out a normalized version of the DEM, if requested (for debugging).
   // Here the DEM is read back and written normalized to a new file.
@@ -533,7 +694,7 @@ void rasterize_cloud(asp::OrthoRasterizerView& rasterizer,
   // Write DRG if the user requested and provided a texture file.
   // This must be at the end, as we may be messing with the point
   // image in irreversible ways.
-  if (opt.do_ortho)
+  if (opt.do_ortho && !ortho_done)
    save_ortho(opt, georef, rasterizer);
 
 } // End rasterize_cloud
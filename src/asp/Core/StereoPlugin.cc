@@ -0,0 +1,127 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file StereoPlugin.cc
+///
+
+#include <asp/Core/StereoPlugin.h>
+#include <asp/Core/EnvUtils.h>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <limits>
+#include <mutex>
+
+namespace asp {
+
+bool isLibraryStereoPlugin(std::string const& plugin_path) {
+  return boost::ends_with(plugin_path, ".so") ||
+    boost::ends_with(plugin_path, ".dylib");
+}
+
+StereoPlugin::StereoPlugin(std::string const& lib_path):
+  m_lib_path(lib_path), m_run(NULL) {
+
+  vw::vw_out() << "Loading stereo plugin: " << lib_path << std::endl;
+  try {
+    m_lib.load(lib_path);
+  } catch (std::exception const& e) {
+    vw::vw_throw(vw::ArgumentErr() << "Cannot load the stereo plugin: " << lib_path
+                 << ". " << e.what() << "\n");
+  }
+
+  if (!m_lib.has(ASP_STEREO_PLUGIN_API_VERSION_FUNC) ||
+      !m_lib.has(ASP_STEREO_PLUGIN_RUN_FUNC))
+    vw::vw_throw(vw::ArgumentErr() << "The stereo plugin " << lib_path
+                 << " must export the functions " << ASP_STEREO_PLUGIN_API_VERSION_FUNC
+                 << " and " << ASP_STEREO_PLUGIN_RUN_FUNC << ".\n");
+
+  int version = m_lib.get<int()>(ASP_STEREO_PLUGIN_API_VERSION_FUNC)();
+  if (version != ASP_STEREO_PLUGIN_API_VERSION)
+    vw::vw_throw(vw::ArgumentErr() << "The stereo plugin " << lib_path
+                 << " was built for interface version " << version
+                 << ", but version " << ASP_STEREO_PLUGIN_API_VERSION
+                 << " is expected.\n");
+
+  m_run = m_lib.get<int(int, char const* const*, int, int, float const*, float const*,
+                        int, int, float*, char*, int)>(ASP_STEREO_PLUGIN_RUN_FUNC);
+}
+
+void StereoPlugin::run(std::vector<std::string> const& options,
+                       vw::ImageView<float> const& left,
+                       vw::ImageView<float> const& right,
+                       int min_disp, int max_disp,
+                       vw::ImageView<float> & disparity) const {
+
+  if (left.cols() != right.cols() || left.rows() != right.rows())
+    vw::vw_throw(vw::ArgumentErr() << "Expecting the left and right aligned images "
+                 << "to have the same dimensions.\n");
+  if (left.cols() <= 0 || left.rows() <= 0)
+    vw::vw_throw(vw::ArgumentErr() << "Empty images passed to the stereo plugin.\n");
+
+  std::vector<char const*> argv;
+  for (size_t it = 0; it < options.size(); it++)
+    argv.push_back(options[it].c_str());
+  argv.push_back(NULL);
+
+  // Start with no valid disparity, in case the plugin does not set all pixels
+  disparity.set_size(left.cols(), left.rows());
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  for (int row = 0; row < disparity.rows(); row++) {
+    for (int col = 0; col < disparity.cols(); col++)
+      disparity(col, row) = nan;
+  }
+
+  // The image views store the data row after row
+  std::vector<char> err_msg(1024, '\0');
+  int ans = m_run(int(options.size()), &argv[0], left.cols(), left.rows(),
+                  &left(0, 0), &right(0, 0), min_disp, max_disp,
+                  &disparity(0, 0), &err_msg[0], int(err_msg.size()));
+  err_msg.back() = '\0'; // in case the plugin did not terminate the string
+
+  if (ans != 0)
+    vw::vw_throw(vw::ArgumentErr() << "The stereo plugin " << m_lib_path
+                 << " failed with code " << ans << ". " << &err_msg[0] << "\n");
+}
+
+StereoPlugin const& loadStereoPlugin(std::string const& lib_path,
+                                     std::map<std::string, std::string> const& env_vars) {
+
+  static std::mutex plugin_mutex;
+  static std::map<std::string, boost::shared_ptr<StereoPlugin>> loaded_plugins;
+  std::lock_guard<std::mutex> lock(plugin_mutex);
+
+  // The variables must be set before the library is opened, as its
+  // initialization code may read them
+  for (auto it = env_vars.begin(); it != env_vars.end(); it++)
+    asp::setEnvVar(it->first, it->second);
+
+  auto it = loaded_plugins.find(lib_path);
+  if (it != loaded_plugins.end())
+    return *it->second;
+
+  // Cache the plugin only if loading succeeded
+  boost::shared_ptr<StereoPlugin> plugin(new StereoPlugin(lib_path));
+  loaded_plugins[lib_path] = plugin;
+  return *plugin;
+}
+
+} // end namespace asp
@@ -0,0 +1,70 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file StereoPlugin.h
+///
+/// Load and run a stereo algorithm built as a shared library, with the
+/// interface in StereoPluginApi.h. This avoids launching a process for
+/// each tile and saving the disparity to disk and reading it back.
+
+#ifndef __ASP_CORE_STEREO_PLUGIN_H__
+#define __ASP_CORE_STEREO_PLUGIN_H__
+
+#include <asp/Core/StereoPluginApi.h>
+
+#include <vw/Image/ImageView.h>
+
+#include <boost/dll/shared_library.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+// If the plugin path from plugin_list.txt is a shared library, rather than
+// a program to invoke.
+bool isLibraryStereoPlugin(std::string const& plugin_path);
+
+class StereoPlugin {
+public:
+  // Load the library and look up its functions. Throws on failure.
+  explicit StereoPlugin(std::string const& lib_path);
+
+  // Find the 1D disparity for given aligned images, having NaN as nodata.
+  // The disparity will have NaN where not found. Throws on failure.
+  void run(std::vector<std::string> const& options,
+           vw::ImageView<float> const& left, vw::ImageView<float> const& right,
+           int min_disp, int max_disp,
+           vw::ImageView<float> & disparity) const;
+
+private:
+  std::string m_lib_path;
+  boost::dll::shared_library m_lib;
+  asp_stereo_plugin_run_t m_run;
+};
+
+// Set the given environmental variables, then load the plugin, if not loaded
+// already. The plugin is loaded only once per process and kept loaded until
+// the process exits, so its own initialization, which may depend on these
+// variables, happens only once. Throws on failure.
+StereoPlugin const& loadStereoPlugin(std::string const& lib_path,
+                                     std::map<std::string, std::string> const& env_vars);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_STEREO_PLUGIN_H__
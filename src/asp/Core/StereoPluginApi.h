@@ -0,0 +1,67 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file StereoPluginApi.h
+///
+/// The C interface for a stereo algorithm built as a shared library, which
+/// stereo_corr loads and calls in-process for each pair of locally aligned
+/// tiles. This header has no dependencies, so it can be copied to the
+/// source tree of the plugin. See the documentation for how to register
+/// such a plugin in plugins/stereo/plugin_list.txt.
+///
+/// The images are stored row after row, so the pixel at column col and row
+/// row is at index row * cols + col. No-data pixels are NaN, both in the
+/// inputs and the output. The images are epipolar-aligned, so the
+/// disparity is only along rows, with the pixel (col, row) in the left
+/// image corresponding to (col + disparity, row) in the right image.
+
+#ifndef __ASP_CORE_STEREO_PLUGIN_API_H__
+#define __ASP_CORE_STEREO_PLUGIN_API_H__
+
+/// Increment when the signature of any function below changes
+#define ASP_STEREO_PLUGIN_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Must return ASP_STEREO_PLUGIN_API_VERSION as defined when the plugin
+/// was compiled.
+typedef int (*asp_stereo_plugin_api_version_t)(void);
+
+/// Find the disparity from the left to the right image. The options are as
+/// passed on the command line to an external stereo program, such as
+/// "-opt1", "val1", "-opt2", "val2", without the program name. The
+/// disparity buffer is allocated by the caller, with cols * rows values.
+/// Return 0 on success. Otherwise, write a null-terminated error message,
+/// of at most err_msg_len bytes including the terminator, to err_msg.
+typedef int (*asp_stereo_plugin_run_t)(int argc, char const* const* argv,
+                                       int cols, int rows,
+                                       float const* left, float const* right,
+                                       int min_disp, int max_disp,
+                                       float * disparity,
+                                       char * err_msg, int err_msg_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/// The names under which the plugin must export the functions above
+#define ASP_STEREO_PLUGIN_API_VERSION_FUNC "asp_stereo_plugin_api_version"
+#define ASP_STEREO_PLUGIN_RUN_FUNC         "asp_stereo_plugin_run"
+
+#endif // __ASP_CORE_STEREO_PLUGIN_API_H__
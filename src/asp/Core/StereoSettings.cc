@@ -128,6 +128,11 @@ PreProcessingDescription::PreProcessingDescription():
       "Interest point detection algorithm (0: Integral OBALoG (default), 1: OpenCV SIFT, 2: OpenCV ORB.")
     ("epipolar-threshold", po::value(&global.epipolar_threshold)->default_value(-1),
       "Maximum distance from the epipolar line to search for IP matches. Default: automatic calculation.")
+    ("epipolar-band-matching", po::bool_switch(&global.epipolar_band_matching)->default_value(false)->implicit_value(true),
+      "When matching interest points with the help of cameras and a datum, find the "
+      "epipolar line for each point first, then compare its descriptor only with those of "
+      "the points near that line, rather than with all of them. Much faster for many "
+      "features.")
     ("ip-edge-buffer", po::value(&global.ip_edge_buffer_percent)->default_value(0),
       "Remove IP within this percentage from the outer edges of an image pair (integer percent).")
     ("normalize-ip-tiles", po::bool_switch(&global.ip_normalize_tiles)->default_value(false)->implicit_value(true),
@@ -202,7 +207,9 @@ PreProcessingDescription::PreProcessingDescription():
       "Choose the FLANN method for matching interest points. Options: 'kmeans': slower but "
       "deterministic, 'kdtree': faster (up to 6x) but not deterministic (starting with "
       "FLANN 1.9.2). The default ('auto') is to use 'kmeans' for 25,000 features or less "
-      "and 'kdtree' otherwise. This does not apply to ORB feature matching.")
+      "and 'kdtree' otherwise. This does not apply to ORB feature matching. The option "
+      "'brute' compares all descriptors. It is exact and deterministic, fast enough for "
+      "up to about 100,000 features, and applies also to ORB.")
     ("left-image-clip", po::value(&global.left_image_clip)->default_value(""),
       "If --left-image-crop-win is used, replaced the left image cropped to that window with this clip.")
     ("right-image-clip", po::value(&global.right_image_clip)->default_value(""),
@@ -486,6 +493,10 @@ TriangulationDescription::TriangulationDescription():
       "Skip the computation of the point cloud center. This option is invoked from parallel_stereo.")
     ("compute-error-vector", po::bool_switch(&global.compute_error_vector)->default_value(false)->implicit_value(true),
       "Compute the triangulation error vector, not just its length.")
+    ("fuse-rfne-fltr-tri", po::bool_switch(&global.fuse_rfne_fltr_tri)->default_value(false)->implicit_value(true),
+      "Do the refinement and filtering of the disparity as part of triangulation, for each "
+      "tile in memory, without writing the RD.tif and F.tif files. The refinement and "
+      "filtering steps are then skipped.")
     ("enable-atmospheric-refraction-correction",
       po::bool_switch(&global.enable_atmospheric_refraction_correction)->default_value(false)->implicit_value(true),
       "Enable atmospheric refraction correction for Pleiades linescan cameras. By default, "
@@ -526,6 +537,8 @@ GUIDescription::GUIDescription(): po::options_description("GUI options") {
       "Locate and display the interest point matches for a stereo pair.")
     ("match-file", po::value(&global.match_file)->default_value(""),
       "Display this match file instead of looking one up based on existing conventions (implies --view-matches).")
+    ("match-db", po::value(&global.match_db)->default_value(""),
+      "Read and save interest point matches in this single-file match database, created with match_db, rather than as individual match files. The usual naming conventions for match files apply.")
     ("gcp-file", po::value(&global.gcp_file)->default_value(""),
       "Display the GCP pixel coordinates for this GCP file (implies --view-matches).")
     ("gcp-sigma", po::value(&global.gcp_sigma)->default_value(1.0),
@@ -613,6 +626,10 @@ ParallelDescription::ParallelDescription(): po::options_description("parallel_st
       "Pixel width of input image tile for a single process.")
     ("job-size-h", po::value(&global.job_size_h)->default_value(2048),
       "Pixel height of input image tile for a single process.")
+    ("max-tile-cost-ratio", po::value(&global.parallel_max_tile_cost_ratio)->default_value(0.0),
+      "Split into four, recursively, the tiles whose estimated correlation cost is more "
+      "than this multiple of the median tile cost. Not done with padded tiles, or without "
+      "D_sub. Set to 0 to not split.")
     ("sparse-disp-options", po::value(&global.sparse_disp_options)->default_value(""),
       "Options to pass directly to sparse_disp. Use quotes around this string.")
     ("prev-run-prefix", po::value(&global.prev_run_prefix)->default_value(""),
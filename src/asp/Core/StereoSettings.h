@@ -164,6 +164,7 @@ namespace asp {
     vw::Vector2 ortho_heights;
     std::string output_prefix_override; // override the output prefix with this 
     std::string flann_method; // The method to use for FLANN matching
+    bool epipolar_band_matching; // Compare descriptors only near the epipolar line
 
     // This option will be the default in the future and then it will go away
     bool aster_use_csm; // Use the CSM camera model with ASTER images
@@ -288,6 +289,7 @@ namespace asp {
     bool   compute_point_cloud_center_only;   // Only compute the center of triangulated point cloud and exit.
     bool   skip_point_cloud_center_comp;
     bool   unalign_disparity;                 // Compute disparity between unaligned images
+    bool   fuse_rfne_fltr_tri;                // Refine and filter the disparity during triangulation
     bool enable_atmospheric_refraction_correction;
     bool enable_velocity_aberration_correction;
 
@@ -300,7 +302,8 @@ namespace asp {
     int lowest_resolution_subimage_num_pixels;
     double hillshade_azimuth, hillshade_elevation, gcp_sigma;
     bool view_matches, view_several_side_by_side, colorize, preview;
-    std::string match_file, gcp_file, dem_file, csv_datum, csv_format_str, csv_srs, nvm, isis_cnet;
+    std::string match_file, match_db, gcp_file, dem_file, csv_datum, csv_format_str, csv_srs, nvm,
+      isis_cnet;
     bool delete_temporary_files_on_exit;
     bool create_image_pyramids_only, hide_all, nvm_no_shift;
     bool pairwise_matches, pairwise_clean_matches, no_georef;
@@ -318,6 +321,7 @@ namespace asp {
     // with a parallel_stereo command it would not fail.
     std::string nodes_list, ssh, sparse_disp_options, parallel_options, prev_run_prefix;
     int threads_multi, threads_single, processes, entry_point, stop_point, job_size_h, job_size_w;
+    double parallel_max_tile_cost_ratio; // also used by stereo_parse
 
     // Undocumented options. We don't want these exposed to the user.
     vw::BBox2i trans_crop_win;        // Left image crop window in respect to L.tif.
@@ -0,0 +1,277 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DemMosaic.h>
+#include <vw/Math/Functors.h>
+#include <vw/Image/Filter.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+using namespace vw;
+
+// Feed a stack of tiles to the quantile sketch and compare with the exact
+// median and NMAD. Small stacks must give exact results. For bigger ones, the
+// rank of the approximate median among the input values must be within the
+// reported bound, which must be within the KLL bound.
+TEST(DemMosaic, QuantileSketch) {
+
+  // Enough levels that the last one is not compacted for these stacks
+  int cols = 6, rows = 5, level_size = 16, num_levels = 12;
+  double nodata = -32768.0;
+  std::srand(7);
+
+  int stack_sizes[] = {1, 2, 15, 16, 17, 500, 3000};
+  for (int num_tiles: stack_sizes) {
+
+    asp::QuantileSketchTile sketch(cols, rows, level_size, num_levels);
+    std::vector<std::vector<double>> vals(cols * rows);
+    for (int t = 0; t < num_tiles; t++) {
+      ImageView<double> tile(cols, rows);
+      for (int col = 0; col < cols; col++) {
+        for (int row = 0; row < rows; row++) {
+          // Clustered values with some outliers and some no-data
+          double r = double(std::rand())/RAND_MAX;
+          double val = 100.0 + 5.0 * double(std::rand())/RAND_MAX;
+          if (r < 0.1)
+            val += 1000.0;
+          if (r > 0.95)
+            val = nodata;
+          tile(col, row) = val;
+          if (val != nodata)
+            vals[row * cols + col].push_back(val);
+        }
+      }
+      sketch.add(tile, nodata);
+    }
+
+    for (int col = 0; col < cols; col++) {
+      for (int row = 0; row < rows; row++) {
+        std::vector<double> v = vals[row * cols + col];
+        double med = 0.0, nmad = 0.0;
+        ASSERT_EQ(sketch.median(col, row, med), !v.empty());
+        ASSERT_EQ(sketch.nmad(col, row, nmad), !v.empty());
+        if (v.empty())
+          continue;
+
+        double err = sketch.rank_error(col, row);
+        if ((int)v.size() <= level_size) {
+          EXPECT_EQ(err, 0.0);
+          std::vector<double> w = v;
+          EXPECT_NEAR(med, math::destructive_median(w), 1e-4);
+          w = v;
+          EXPECT_NEAR(nmad, math::destructive_nmad(w), 1e-4);
+          continue;
+        }
+
+        // Fraction of values below the approximate median
+        std::sort(v.begin(), v.end());
+        double below = std::lower_bound(v.begin(), v.end(), med - 1e-4) - v.begin();
+        double above = v.end() - std::upper_bound(v.begin(), v.end(), med + 1e-4);
+        double n = v.size();
+        EXPECT_LE(below/n, 0.5 + err + 1.0/n);
+        EXPECT_LE(above/n, 0.5 + err + 1.0/n);
+
+        // Level l gets at most n / 2^l values, so it is compacted at most
+        // n / (2^l k) times, each adding 2^l to the rank error. Only the
+        // levels getting more than k values are compacted.
+        double bound = 0.0;
+        for (double n_l = n; n_l > level_size; n_l /= 2.0)
+          bound += 1.0 / level_size;
+        EXPECT_LE(err, bound + 1e-12);
+      }
+    }
+  }
+}
+
+// The footprint index must return the same DEMs as checking each footprint,
+// in increasing order, and always return the footprints it cannot index.
+TEST(DemMosaic, FootprintIndex) {
+
+  std::srand(11);
+  std::vector<BBox2> footprints;
+  for (int it = 0; it < 500; it++) {
+    double x = 1000.0 * double(std::rand())/RAND_MAX;
+    double y = 1000.0 * double(std::rand())/RAND_MAX;
+    double w = 1.0 + 50.0 * double(std::rand())/RAND_MAX;
+    double h = 1.0 + 50.0 * double(std::rand())/RAND_MAX;
+    footprints.push_back(BBox2(x, y, w, h));
+  }
+  footprints.push_back(BBox2()); // empty
+  footprints.push_back(BBox2(0, 0, std::numeric_limits<double>::infinity(), 1.0));
+  int num = footprints.size();
+
+  asp::DemFootprintIndex index(footprints);
+  for (int it = 0; it < 100; it++) {
+    double x = 1000.0 * double(std::rand())/RAND_MAX;
+    double y = 1000.0 * double(std::rand())/RAND_MAX;
+    BBox2 box(x, y, 64.0, 64.0);
+
+    std::vector<int> indices;
+    index.query(box, indices);
+    ASSERT_TRUE(std::is_sorted(indices.begin(), indices.end()));
+    ASSERT_TRUE(std::binary_search(indices.begin(), indices.end(), num - 2));
+    ASSERT_TRUE(std::binary_search(indices.begin(), indices.end(), num - 1));
+    for (int dem_iter = 0; dem_iter < num - 2; dem_iter++) {
+      bool found = std::binary_search(indices.begin(), indices.end(), dem_iter);
+      EXPECT_EQ(found, box.intersects(footprints[dem_iter]));
+    }
+  }
+}
+
+// Compare the centerline weights with a direct evaluation of the product of
+// the row and column weights, for a disk with a hole in it.
+TEST(DemMosaic, CenterlineWeights) {
+
+  int cols = 60, rows = 45;
+  double max_weight = 12.0, hole_fill = 0.0, border_fill = -1.0;
+  ImageView<uint8> valid(cols, rows);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      double r = std::hypot(col - 30.0, row - 20.0);
+      valid(col, row) = (r < 18.0 && r > 4.0);
+    }
+  }
+
+  ImageView<double> weights;
+  asp::centerlineWeights(valid, weights, max_weight, hole_fill, border_fill);
+  ASSERT_EQ(weights.cols(), cols);
+  ASSERT_EQ(weights.rows(), rows);
+
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+
+      // Extent of valid pixels in this row and column
+      int min_col = cols, max_col = -1, min_row = rows, max_row = -1;
+      for (int c = 0; c < cols; c++) {
+        if (valid(c, row)) {
+          min_col = std::min(min_col, c);
+          max_col = std::max(max_col, c);
+        }
+      }
+      for (int r = 0; r < rows; r++) {
+        if (valid(col, r)) {
+          min_row = std::min(min_row, r);
+          max_row = std::max(max_row, r);
+        }
+      }
+
+      if (!valid(col, row)) {
+        bool inner = (col >= min_col && col <= max_col && row >= min_row && row <= max_row);
+        EXPECT_EQ(weights(col, row), inner ? hole_fill : border_fill);
+        continue;
+      }
+
+      double half_h = (max_col - min_col)/2.0, half_v = (max_row - min_row)/2.0;
+      double dist_h = std::abs(col - (min_col + max_col)/2.0);
+      double dist_v = std::abs(row - (min_row + max_row)/2.0);
+      double wt_h = half_h > 0 ? std::max(0.0, half_h - dist_h + 1e-8*half_h) : 0.0;
+      double wt_v = half_v > 0 ? std::max(0.0, half_v - dist_v + 1e-8*half_v) : 0.0;
+      EXPECT_EQ(weights(col, row), std::min(wt_h, max_weight) * std::min(wt_v, max_weight));
+    }
+  }
+}
+
+// The separable blur of the weights must agree with a direct 2D convolution,
+// with zero outside the image, and must not change non-positive weights.
+TEST(DemMosaic, BlurWeights) {
+
+  int cols = 40, rows = 30;
+  double sigma = 2.5;
+  std::srand(5);
+  ImageView<double> weights(cols, rows);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      double val = double(std::rand())/RAND_MAX;
+      // A band of zero rows, and some negative values
+      if (row >= 10 && row < 15)
+        val = 0.0;
+      else if (val < 0.1)
+        val = -1.0;
+      weights(col, row) = val;
+    }
+  }
+
+  ImageView<double> blurred = copy(weights);
+  asp::blurWeights(blurred, sigma);
+
+  std::vector<double> kernel;
+  vw::generate_gaussian_kernel(kernel, sigma, vw::compute_kernel_size(sigma));
+  int half = kernel.size()/2;
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      if (weights(col, row) <= 0) {
+        EXPECT_EQ(blurred(col, row), weights(col, row));
+        continue;
+      }
+      double sum = 0.0;
+      for (int i = 0; i < (int)kernel.size(); i++) {
+        for (int j = 0; j < (int)kernel.size(); j++) {
+          int c = col + i - half, r = row + j - half;
+          if (c < 0 || c >= cols || r < 0 || r >= rows || weights(c, r) <= 0)
+            continue;
+          sum += kernel[i] * kernel[j] * weights(c, r);
+        }
+      }
+      EXPECT_NEAR(blurred(col, row), sum, 1e-12);
+    }
+  }
+}
+
+// At most the given number of DEMs are open, the least recently used one is
+// closed first, and a handle stays valid after the cache closes its copy.
+TEST(DemMosaic, HandleCache) {
+
+  cartography::GeoReference georef;
+  georef.set_well_known_geogcs("WGS84");
+  std::vector<UnlinkName> files;
+  files.reserve(3); // no copies, as each copy removes the file when destroyed
+  for (int it = 0; it < 3; it++) {
+    files.push_back(UnlinkName("dem_handle_" + std::to_string(it) + ".tif"));
+    ImageView<float> dem(4, 3);
+    fill(dem, float(it));
+    cartography::write_georeferenced_image(files.back(), dem, georef);
+  }
+
+  asp::DemHandleCache cache(2);
+  for (int it = 0; it < 3; it++)
+    cache.add(files[it]);
+  EXPECT_EQ(cache.size(), 3u);
+  EXPECT_EQ(cache.get_file_name(1), std::string(files[1]));
+
+  DiskImageView<float> dem0 = cache.get_handle(0);
+  cache.get_handle(1);
+  cache.get_handle(0); // already open
+  EXPECT_EQ(cache.num_opens(), 2u);
+  cache.get_handle(2); // closes DEM 1, the least recently used
+  cache.get_handle(0);
+  EXPECT_EQ(cache.num_opens(), 3u);
+  cache.get_handle(1); // closes DEM 2
+  EXPECT_EQ(cache.num_opens(), 4u);
+  cache.get_handle(2); // closes DEM 0
+  EXPECT_EQ(cache.num_opens(), 5u);
+
+  // The handle from before DEM 0 was closed still reads it
+  EXPECT_EQ(dem0(3, 2), 0.0);
+  EXPECT_EQ(cache.get_handle(2)(1, 1), 2.0);
+}
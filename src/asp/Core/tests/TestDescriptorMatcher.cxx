@@ -0,0 +1,156 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DescriptorMatcher.h>
+
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+// Descriptors with values in [0, 1), as for SIFT-like features
+void randomFloatDescriptors(int num, int len, Matrix<float> & m) {
+  m.set_size(num, len);
+  for (int r = 0; r < num; r++)
+    for (int c = 0; c < len; c++)
+      m(r, c) = float(std::rand()) / RAND_MAX;
+}
+
+void randomBinaryDescriptors(int num, int len, Matrix<unsigned char> & m) {
+  m.set_size(num, len);
+  for (int r = 0; r < num; r++)
+    for (int c = 0; c < len; c++)
+      m(r, c) = std::rand() % 256;
+}
+
+// Find the nearest reference with a plain loop
+template <class DistFunT, class T>
+void naiveNearest(Matrix<T> const& ref, Matrix<T> const& query, int q,
+                  DistFunT dist_fun, int & best_index, double & best_dist) {
+  best_index = -1;
+  best_dist = 0;
+  for (size_t r = 0; r < ref.rows(); r++) {
+    double dist = 0;
+    for (size_t c = 0; c < ref.cols(); c++)
+      dist += dist_fun(ref(r, c), query(q, c));
+    if (best_index < 0 || dist < best_dist) {
+      best_index = r;
+      best_dist = dist;
+    }
+  }
+}
+
+double sqDiff(float a, float b) {
+  return double(a - b) * double(a - b);
+}
+
+double bitDiff(unsigned char a, unsigned char b) {
+  return __builtin_popcount(a ^ b);
+}
+
+} // end anonymous namespace
+
+TEST(DescriptorMatcher, FloatMatchesNaive) {
+
+  std::srand(42);
+  Matrix<float> ref, query;
+  randomFloatDescriptors(700, 128, ref);
+  randomFloatDescriptors(300, 128, query);
+
+  BruteForceMatcher matcher;
+  matcher.loadMatchData(ref);
+  EXPECT_EQ(matcher.size(), 700);
+
+  int k = 3;
+  std::vector<int> indices1, indices4;
+  std::vector<double> distances1, distances4;
+  matcher.knnSearch(query, k, 1, indices1, distances1);
+  matcher.knnSearch(query, k, 4, indices4, distances4);
+  ASSERT_EQ(indices1.size(), query.rows() * k);
+
+  for (size_t q = 0; q < query.rows(); q++) {
+    int best_index = -1;
+    double best_dist = 0;
+    naiveNearest(ref, query, q, sqDiff, best_index, best_dist);
+    EXPECT_EQ(indices1[q * k], best_index);
+    EXPECT_NEAR(distances1[q * k], best_dist, 1e-4);
+
+    // Sorted by distance
+    for (int it = 1; it < k; it++)
+      EXPECT_LE(distances1[q * k + it - 1], distances1[q * k + it]);
+  }
+
+  // The results must not depend on the number of threads
+  EXPECT_TRUE(indices1 == indices4);
+  EXPECT_TRUE(distances1 == distances4);
+
+  // Binary queries do not go with float references
+  Matrix<unsigned char> binary_query;
+  randomBinaryDescriptors(2, 32, binary_query);
+  EXPECT_THROW(matcher.knnSearch(binary_query, k, 1, indices1, distances1),
+               vw::ArgumentErr);
+}
+
+TEST(DescriptorMatcher, BinaryMatchesNaive) {
+
+  std::srand(7);
+  Matrix<unsigned char> ref, query;
+  randomBinaryDescriptors(500, 32, ref);
+  randomBinaryDescriptors(200, 32, query);
+
+  BruteForceMatcher matcher;
+  matcher.loadMatchData(ref);
+
+  int k = 2;
+  std::vector<int> indices;
+  std::vector<double> distances;
+  matcher.knnSearch(query, k, 1, indices, distances);
+
+  for (size_t q = 0; q < query.rows(); q++) {
+    int best_index = -1;
+    double best_dist = 0;
+    naiveNearest(ref, query, q, bitDiff, best_index, best_dist);
+    // With integer distances there can be ties, and then the smaller index wins
+    EXPECT_EQ(indices[q * k], best_index);
+    EXPECT_EQ(distances[q * k], best_dist);
+  }
+}
+
+TEST(DescriptorMatcher, FewerReferencesThanNeighbors) {
+
+  Matrix<float> ref, query;
+  randomFloatDescriptors(2, 64, ref);
+  randomFloatDescriptors(5, 64, query);
+
+  BruteForceMatcher matcher;
+  matcher.loadMatchData(ref);
+
+  int k = 4;
+  std::vector<int> indices;
+  std::vector<double> distances;
+  matcher.knnSearch(query, k, 2, indices, distances);
+  for (size_t q = 0; q < query.rows(); q++) {
+    EXPECT_GE(indices[q * k], 0);
+    EXPECT_GE(indices[q * k + 1], 0);
+    EXPECT_EQ(indices[q * k + 2], -1);
+    EXPECT_EQ(indices[q * k + 3], -1);
+  }
+}
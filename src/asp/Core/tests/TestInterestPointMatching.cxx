@@ -18,10 +18,13 @@
 
 #include <test/Helpers.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/StereoSettings.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/LensDistortion.h>
 #include <vw/Cartography/CameraBBox.h>
 
+#include <cstdlib>
+
 using namespace vw;
 using namespace asp;
 
@@ -68,3 +71,166 @@ TEST( InterestPointMatching, DatumIntersection ) {
   }
 
 }
+
+// An interest point at the given pixel, with the given descriptor
+ip::InterestPoint makeIp(Vector2 const& pix, Vector<float> const& desc) {
+  ip::InterestPoint p;
+  p.x  = pix.x();
+  p.y  = pix.y();
+  p.ix = int(round(pix.x()));
+  p.iy = int(round(pix.y()));
+  p.descriptor = desc;
+  return p;
+}
+
+// A random descriptor, with values in [0, 1]
+Vector<float> randomDescriptor(int len) {
+  Vector<float> desc(len);
+  for (int it = 0; it < len; it++)
+    desc[it] = double(std::rand()) / RAND_MAX;
+  return desc;
+}
+
+// Match with and without --epipolar-band-matching
+void matchBothModes(camera::PinholeModel & cam1, camera::PinholeModel & cam2,
+                    cartography::Datum const& datum,
+                    ip::InterestPointList const& ip1, ip::InterestPointList const& ip2,
+                    std::vector<ip::InterestPoint> & legacy1,
+                    std::vector<ip::InterestPoint> & legacy2,
+                    std::vector<ip::InterestPoint> & band1,
+                    std::vector<ip::InterestPoint> & band2) {
+
+  bool single_threaded_camera = false, quiet = true;
+  int num_jobs = 2;
+  double epipolar_threshold = 100.0, uniqueness_threshold = 0.8;
+
+  legacy1.clear(); legacy2.clear(); band1.clear(); band2.clear();
+  stereo_settings().epipolar_band_matching = false;
+  epipolar_ip_matching_task(single_threaded_camera, DETECT_IP_METHOD_SIFT, num_jobs,
+                            epipolar_threshold, uniqueness_threshold, datum, quiet,
+                            &cam1, &cam2, ip1, ip2, legacy1, legacy2);
+  stereo_settings().epipolar_band_matching = true;
+  epipolar_ip_matching_task(single_threaded_camera, DETECT_IP_METHOD_SIFT, num_jobs,
+                            epipolar_threshold, uniqueness_threshold, datum, quiet,
+                            &cam1, &cam2, ip1, ip2, band1, band2);
+}
+
+TEST(InterestPointMatching, EpipolarBandMatching) {
+
+  std::string orig_flann_method = stereo_settings().flann_method;
+  bool orig_band_matching = stereo_settings().epipolar_band_matching;
+  stereo_settings().flann_method = "brute"; // exact, so the modes can be compared
+
+  // Two cameras with 200 x 200 pixel images, with the second one moved
+  // by 3 km along the image x axis
+  cartography::Datum datum("WGS84");
+  Vector3 ctr(-414653.934175,-2305310.05912,-6759174.5439);
+  Matrix3x3 rot = Quat(-0.0794638597818,-0.0396316037899,
+                       -0.40945443655,-0.907998840691).rotation_matrix();
+  double f = 1.0e+4, c = 100.0, side = 2.0 * c;
+  camera::PinholeModel cam1(ctr, rot, f, f, c, c,
+                            Vector3(1,0,0), Vector3(0,1,0), Vector3(0,0,1));
+  camera::PinholeModel cam2(ctr + 3000.0 * select_col(rot, 0), rot, f, f, c, c,
+                            Vector3(1,0,0), Vector3(0,1,0), Vector3(0,0,1));
+
+  // Points on the datum seen by both cameras, with nearby descriptors, and
+  // points seen only by the second camera
+  std::srand(1);
+  int desc_len = 16, num_common = 100, num_other = 50;
+  ip::InterestPointList ip1, ip2;
+  while (int(ip1.size()) < num_common) {
+    Vector2 pix1(side * std::rand() / RAND_MAX, side * std::rand() / RAND_MAX);
+    Vector2 pix2 = cam2.point_to_pixel(cartography::datum_intersection(datum, &cam1, pix1));
+    if (pix2.x() < 0 || pix2.y() < 0 || pix2.x() > side || pix2.y() > side)
+      continue;
+    Vector<float> desc1 = randomDescriptor(desc_len), desc2 = desc1;
+    for (int it = 0; it < desc_len; it++)
+      desc2[it] += 0.02 * (double(std::rand()) / RAND_MAX - 0.5);
+    ip1.push_back(makeIp(pix1, desc1));
+    ip2.push_back(makeIp(pix2, desc2));
+  }
+  for (int it = 0; it < num_other; it++) {
+    Vector2 pix2(side * std::rand() / RAND_MAX, side * std::rand() / RAND_MAX);
+    ip2.push_back(makeIp(pix2, randomDescriptor(desc_len)));
+  }
+
+  // The epipolar band covers the whole image, so both modes compare
+  // the same descriptors, and must find all matches.
+  std::vector<ip::InterestPoint> legacy1, legacy2, band1, band2;
+  matchBothModes(cam1, cam2, datum, ip1, ip2, legacy1, legacy2, band1, band2);
+  ASSERT_EQ(int(legacy1.size()), num_common);
+  ASSERT_EQ(legacy1.size(), band1.size());
+  auto it1 = ip1.begin(), it2 = ip2.begin();
+  for (int it = 0; it < num_common; it++) {
+    EXPECT_EQ(legacy1[it].x, it1->x);
+    EXPECT_EQ(legacy2[it].x, it2->x);
+    EXPECT_EQ(band1[it].x,   it1->x);
+    EXPECT_EQ(band2[it].x,   it2->x);
+    EXPECT_EQ(band2[it].y,   it2->y);
+    it1++; it2++;
+  }
+
+  // Add points with descriptors closer to the first point than its match,
+  // but far from its epipolar line. These take all the nearest descriptor
+  // slots without the band, so that point is not matched then.
+  ip::InterestPoint const& first = ip1.front();
+  Vector3 p0 = cartography::datum_intersection(datum, &cam1, Vector2(first.x, first.y));
+  Vector3 p1 = p0 + 10.0 * cam1.pixel_to_vector(Vector2(first.x, first.y));
+  Vector2 e0 = cam2.point_to_pixel(p0), e1 = cam2.point_to_pixel(p1);
+  Vector2 along = normalize(e1 - e0), across(-along.y(), along.x());
+  for (int it = 0; it < 12; it++) {
+    Vector<float> desc = first.descriptor;
+    desc[0] += 1e-4 * (it + 1);
+    ip2.push_back(makeIp(e0 + 1000.0 * across + 5.0 * it * along, desc));
+  }
+
+  matchBothModes(cam1, cam2, datum, ip1, ip2, legacy1, legacy2, band1, band2);
+  ASSERT_EQ(int(legacy1.size()), num_common - 1);
+  ASSERT_EQ(int(band1.size()), num_common);
+  EXPECT_EQ(band1[0].x, first.x);
+  EXPECT_EQ(band2[0].x, ip2.front().x);
+  EXPECT_NE(legacy1[0].x, first.x);
+
+  stereo_settings().flann_method = orig_flann_method;
+  stereo_settings().epipolar_band_matching = orig_band_matching;
+}
+
+TEST(InterestPointMatching, IpLineGrid) {
+
+  std::srand(2);
+  ip::InterestPointList ip;
+  for (int it = 0; it < 1000; it++)
+    ip.push_back(makeIp(Vector2(500.0 * std::rand() / RAND_MAX,
+                                300.0 * std::rand() / RAND_MAX), Vector<float>()));
+  std::vector<Vector2> points;
+  for (auto it = ip.begin(); it != ip.end(); it++)
+    points.push_back(Vector2(it->x, it->y));
+
+  // Random lines through the points, and ones along the axes
+  std::vector<Vector3> lines;
+  for (int it = 0; it < 50; it++) {
+    double a = 2.0 * std::rand() / RAND_MAX - 1.0, b = 2.0 * std::rand() / RAND_MAX - 1.0;
+    Vector2 const& p = points[std::rand() % points.size()];
+    lines.push_back(Vector3(a, b, -a * p.x() - b * p.y()));
+  }
+  lines.push_back(Vector3(0, 1, -150));
+  lines.push_back(Vector3(1, 0, -250));
+  lines.push_back(Vector3(1, 0, 1000)); // no points near it
+
+  double max_dist = 15.0;
+  IpLineGrid grid(ip, max_dist);
+  for (size_t i = 0; i < lines.size(); i++) {
+    Vector3 const& l = lines[i];
+    std::vector<int> indices, expected;
+    grid.points_near_line(l, max_dist, indices);
+    for (size_t j = 0; j < points.size(); j++) {
+      double dist = fabs(l.x() * points[j].x() + l.y() * points[j].y() + l.z()) /
+        norm_2(subvector(l, 0, 2));
+      if (dist < max_dist)
+        expected.push_back(j);
+    }
+    EXPECT_EQ(indices, expected);
+    for (size_t j = 0; j < indices.size(); j++)
+      EXPECT_EQ(grid.point(indices[j]), points[indices[j]]);
+  }
+}
@@ -0,0 +1,165 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/MatchDb.h>
+#include <vw/InterestPoint/InterestData.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdlib>
+#include <fstream>
+
+using namespace asp;
+
+// Make some matches with varying fields and descriptors
+void makeMatches(int num_ip, int desc_len,
+                 std::vector<vw::ip::InterestPoint> & ip1,
+                 std::vector<vw::ip::InterestPoint> & ip2) {
+  ip1.resize(num_ip);
+  ip2.resize(num_ip);
+  for (int it = 0; it < num_ip; it++) {
+    for (int side = 0; side < 2; side++) {
+      vw::ip::InterestPoint & p = (side == 0) ? ip1[it] : ip2[it];
+      p.x = 1000.0 * std::rand() / RAND_MAX;
+      p.y = 1000.0 * std::rand() / RAND_MAX;
+      p.ix = int(p.x);
+      p.iy = int(p.y);
+      p.orientation = float(std::rand()) / RAND_MAX;
+      p.scale = 1.0 + it;
+      p.interest = -1.0 * it;
+      p.polarity = (it % 2 == 0);
+      p.octave = it % 3;
+      p.scale_lvl = it % 5;
+      p.descriptor.set_size(desc_len);
+      for (int d = 0; d < desc_len; d++)
+        p.descriptor[d] = float(std::rand()) / RAND_MAX;
+    }
+  }
+}
+
+void expectSame(std::vector<vw::ip::InterestPoint> const& a,
+                std::vector<vw::ip::InterestPoint> const& b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t it = 0; it < a.size(); it++) {
+    EXPECT_EQ(a[it].x, b[it].x);
+    EXPECT_EQ(a[it].y, b[it].y);
+    EXPECT_EQ(a[it].ix, b[it].ix);
+    EXPECT_EQ(a[it].iy, b[it].iy);
+    EXPECT_EQ(a[it].orientation, b[it].orientation);
+    EXPECT_EQ(a[it].scale, b[it].scale);
+    EXPECT_EQ(a[it].interest, b[it].interest);
+    EXPECT_EQ(a[it].polarity, b[it].polarity);
+    EXPECT_EQ(a[it].octave, b[it].octave);
+    EXPECT_EQ(a[it].scale_lvl, b[it].scale_lvl);
+    ASSERT_EQ(a[it].descriptor.size(), b[it].descriptor.size());
+    for (size_t d = 0; d < a[it].descriptor.size(); d++)
+      EXPECT_EQ(a[it].descriptor[d], b[it].descriptor[d]);
+  }
+}
+
+TEST(MatchDb, RoundTrip) {
+
+  std::string db_file = "TestMatchDb.mdb";
+  std::srand(7);
+
+  // Pairs with different sizes and descriptor lengths, including no matches
+  std::vector<std::string> match_files = {"run/run-a__b.match",
+                                          "run/run-a__c.match",
+                                          "run/run-b__c-clean.match"};
+  int num_ip[] = {17, 0, 5}, desc_len[] = {0, 3, 64};
+  std::vector<std::vector<vw::ip::InterestPoint>> left(3), right(3);
+  {
+    MatchDbWriter writer(db_file);
+    for (size_t it = 0; it < match_files.size(); it++) {
+      makeMatches(num_ip[it], desc_len[it], left[it], right[it]);
+      writer.write(match_files[it], left[it], right[it]);
+    }
+    writer.close();
+  }
+
+  MatchDb db(db_file);
+  EXPECT_EQ(db.size(), match_files.size());
+  EXPECT_FALSE(db.has("run/run-c__a.match"));
+  for (size_t it = 0; it < match_files.size(); it++) {
+    // Only the file name matters, not the directory
+    std::string match_file = "other/" + matchDbName(match_files[it]);
+    EXPECT_TRUE(db.has(match_file));
+    EXPECT_EQ(db.numMatches(match_file), std::uint64_t(num_ip[it]));
+    std::vector<vw::ip::InterestPoint> ip1, ip2;
+    readMatchFile(&db, match_file, ip1, ip2);
+    expectSame(left[it], ip1);
+    expectSame(right[it], ip2);
+  }
+
+  boost::filesystem::remove(db_file);
+}
+
+TEST(MatchDb, SortedIndex) {
+
+  std::string db_file = "TestMatchDbSorted.mdb";
+  std::srand(11);
+
+  // Write out of order, and one name twice. The last copy must win.
+  std::vector<std::string> match_files = {"run-c__d.match", "run-a__b.match",
+                                          "run-b__c.match", "run-a__b.match"};
+  std::vector<std::vector<vw::ip::InterestPoint>> left(4), right(4);
+  {
+    MatchDbWriter writer(db_file);
+    for (size_t it = 0; it < match_files.size(); it++) {
+      makeMatches(3 + it, 2, left[it], right[it]);
+      writer.write(match_files[it], left[it], right[it]);
+    }
+    writer.close();
+  }
+
+  MatchDb db(db_file);
+  std::vector<std::string> names = db.names();
+  ASSERT_EQ(names.size(), 3u);
+  EXPECT_EQ(names[0], "run-a__b.match");
+  EXPECT_EQ(names[1], "run-b__c.match");
+  EXPECT_EQ(names[2], "run-c__d.match");
+  EXPECT_FALSE(db.has("run-a__a.match"));
+  EXPECT_FALSE(db.has("run-d__e.match"));
+
+  std::vector<vw::ip::InterestPoint> ip1, ip2;
+  db.read("run-a__b.match", ip1, ip2);
+  expectSame(left[3], ip1);
+  expectSame(right[3], ip2);
+  db.read("run-c__d.match", ip1, ip2);
+  expectSame(left[0], ip1);
+  expectSame(right[0], ip2);
+
+  boost::filesystem::remove(db_file);
+}
+
+TEST(MatchDb, FailedCloseRemovesTmp) {
+
+  // The output name is a non-empty directory, so the final rename fails
+  std::string db_file = "TestMatchDbFail.mdb";
+  boost::filesystem::create_directory(db_file);
+  std::ofstream(db_file + "/file.txt") << "data\n";
+
+  std::vector<vw::ip::InterestPoint> ip1, ip2;
+  makeMatches(3, 2, ip1, ip2);
+  MatchDbWriter writer(db_file);
+  writer.write("run-a__b.match", ip1, ip2);
+  EXPECT_THROW(writer.close(), vw::IOErr);
+  EXPECT_FALSE(boost::filesystem::exists(db_file + ".tmp"));
+
+  boost::filesystem::remove_all(db_file);
+}
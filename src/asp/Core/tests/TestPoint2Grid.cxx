@@ -0,0 +1,128 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/Point2Grid.h>
+
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+// Grid the same tile with Point2Grid and Point2GridBinned, and check that the
+// results agree. The timings are compared with asp_benchmark.
+TEST(Point2Grid, BinnedMatchesScatter) {
+
+  int width = 200, height = 150;
+  double x0 = 1000.0, y0 = -500.0, grid_size = 2.0, min_spacing = 2.0;
+  double radius = 2.5*grid_size, sigma_factor = 0.0, percentile = 25.0, nodata = -1e+6;
+  int num_points = 30000;
+
+  // Points cover the grid and some margin around it
+  std::srand(42);
+  std::vector<Vector3> points(num_points);
+  for (int it = 0; it < num_points; it++) {
+    double u = double(std::rand())/RAND_MAX, v = double(std::rand())/RAND_MAX;
+    points[it] = Vector3(x0 - 10.0 + u*(width*grid_size + 20.0),
+                         y0 - 10.0 + v*(height*grid_size + 20.0),
+                         100.0*double(std::rand())/RAND_MAX);
+  }
+
+  FilterType filters[] = {f_weighted_average, f_min, f_max, f_mean, f_median,
+                          f_stddev, f_count, f_nmad, f_percentile};
+  for (FilterType filter: filters) {
+
+    ImageView<double> buf1, wts1, buf2, wts2;
+    Point2Grid p2g(width, height, buf1, wts1, x0, y0, grid_size, min_spacing,
+                   radius, sigma_factor, filter, percentile);
+    Point2GridBinned p2gb(width, height, buf2, wts2, x0, y0, grid_size, min_spacing,
+                          radius, sigma_factor, filter, percentile);
+
+    p2g.Clear(nodata);
+    for (int it = 0; it < num_points; it++)
+      p2g.AddPoint(points[it].x(), points[it].y(), points[it].z());
+    p2g.normalize();
+
+    p2gb.Clear(nodata);
+    for (int it = 0; it < num_points; it++)
+      p2gb.AddPoint(points[it].x(), points[it].y(), points[it].z());
+    p2gb.normalize();
+
+    // The Gaussian weights are sampled differently, so allow for some slack
+    double tol = (filter == f_weighted_average) ? 5e-2 : 1e-8;
+    ASSERT_EQ(buf1.cols(), buf2.cols());
+    ASSERT_EQ(buf1.rows(), buf2.rows());
+    for (int c = 0; c < buf1.cols(); c++) {
+      for (int r = 0; r < buf1.rows(); r++) {
+        EXPECT_NEAR(buf1(c, r), buf2(c, r), tol);
+      }
+    }
+  }
+}
+
+// Gridding several values per point at once is the same as gridding each
+// value on its own
+TEST(Point2Grid, BinnedMultipleChannels) {
+
+  int width = 50, height = 40, num_points = 5000, num_channels = 3;
+  double x0 = 0.0, y0 = 0.0, grid_size = 1.0, min_spacing = 1.0;
+  double radius = 2.0, sigma_factor = 0.0, percentile = 75.0, nodata = -1e+6;
+
+  std::srand(3);
+  std::vector<Vector2> xy(num_points);
+  std::vector<double> vals(num_points * num_channels);
+  for (int it = 0; it < num_points; it++) {
+    xy[it] = Vector2(width * double(std::rand())/RAND_MAX,
+                     height * double(std::rand())/RAND_MAX);
+    for (int ch = 0; ch < num_channels; ch++)
+      vals[it * num_channels + ch] = 10.0 * double(std::rand())/RAND_MAX;
+  }
+
+  FilterType filters[] = {f_weighted_average, f_min, f_max, f_mean, f_median,
+                          f_stddev, f_count, f_nmad, f_percentile};
+  for (FilterType filter: filters) {
+
+    std::vector<ImageView<double>> bufs(num_channels);
+    ImageView<double> wts;
+    Point2GridBinned multi(width, height, bufs, wts, x0, y0, grid_size, min_spacing,
+                           radius, sigma_factor, filter, percentile);
+    multi.Clear(nodata);
+    for (int it = 0; it < num_points; it++)
+      multi.AddPoint(xy[it].x(), xy[it].y(), &vals[it * num_channels]);
+    multi.normalize();
+
+    for (int ch = 0; ch < num_channels; ch++) {
+      ImageView<double> buf1, wts1;
+      Point2GridBinned single(width, height, buf1, wts1, x0, y0, grid_size,
+                              min_spacing, radius, sigma_factor, filter, percentile);
+      single.Clear(nodata);
+      for (int it = 0; it < num_points; it++)
+        single.AddPoint(xy[it].x(), xy[it].y(), vals[it * num_channels + ch]);
+      single.normalize();
+
+      ASSERT_EQ(bufs[ch].cols(), buf1.cols());
+      ASSERT_EQ(bufs[ch].rows(), buf1.rows());
+      for (int c = 0; c < buf1.cols(); c++) {
+        for (int r = 0; r < buf1.rows(); r++) {
+          EXPECT_NEAR(bufs[ch](c, r), buf1(c, r), 1e-10);
+          EXPECT_EQ(wts(c, r), wts1(c, r));
+        }
+      }
+    }
+  }
+}
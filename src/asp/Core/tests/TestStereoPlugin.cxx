@@ -0,0 +1,46 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/Core/StereoPlugin.h>
+
+#include <cstdlib>
+
+using namespace asp;
+
+TEST(StereoPlugin, IsLibrary) {
+  EXPECT_TRUE(isLibraryStereoPlugin("plugins/stereo/elas_lib/lib/libasp_elas_plugin.so"));
+  EXPECT_TRUE(isLibraryStereoPlugin("plugins/stereo/mylib/lib/libmylib.dylib"));
+  EXPECT_FALSE(isLibraryStereoPlugin("plugins/stereo/elas/bin/elas"));
+  EXPECT_FALSE(isLibraryStereoPlugin("plugins/stereo/mgm/bin/mgm.so.txt"));
+}
+
+TEST(StereoPlugin, LoadFailure) {
+
+  std::string lib_path = "no_such_dir/libno_such_plugin.so";
+  std::map<std::string, std::string> env_vars;
+  env_vars["ASP_TEST_STEREO_PLUGIN_VAR"] = "5";
+  unsetenv("ASP_TEST_STEREO_PLUGIN_VAR");
+
+  // The variables are set before the library is opened, even if that fails
+  EXPECT_THROW(loadStereoPlugin(lib_path, env_vars), vw::ArgumentErr);
+  ASSERT_TRUE(getenv("ASP_TEST_STEREO_PLUGIN_VAR") != NULL);
+  EXPECT_EQ(std::string(getenv("ASP_TEST_STEREO_PLUGIN_VAR")), "5");
+
+  // A failed load is not cached, so it fails again
+  EXPECT_THROW(loadStereoPlugin(lib_path, env_vars), vw::ArgumentErr);
+}
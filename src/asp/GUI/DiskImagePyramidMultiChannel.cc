@@ -20,6 +20,7 @@
 #include <vw/Core/Stopwatch.h>
 #include <QtWidgets>
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -39,6 +40,12 @@ TemporaryFiles& temporary_files() {
   return *temporary_files_ptr;
 }
 
+// A new id for each pyramid that is created
+int nextPyramidId() {
+  static std::atomic<int> id(0);
+  return id++;
+}
+
 // Form a QImage to show on screen. For scalar images, we scale them
 // and handle the nodata val. For two channel images, interpret the
 // second channel as mask. If there are 3 or more channels,
@@ -136,7 +143,8 @@ DiskImagePyramidMultiChannel::
 DiskImagePyramidMultiChannel(std::string const& image_file,
                              vw::GdalWriteOptions const& opt,
                              int top_image_max_pix, int subsample):
-  m_opt(opt), m_num_channels(0), m_rows(0), m_cols(0), m_type(UNINIT) {
+  m_opt(opt), m_num_channels(0), m_rows(0), m_cols(0), m_type(UNINIT),
+  m_id(nextPyramidId()) {
 
   if (image_file == "")
     return;
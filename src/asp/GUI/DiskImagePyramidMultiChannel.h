@@ -79,6 +79,7 @@ namespace vw { namespace gui {
     int m_num_channels;
     int m_rows, m_cols;
     ImgType m_type; // keeps track of which of the above images we use
+    int m_id; // unique for each pyramid that is created, to cache its tiles
 
     // Constructor
     DiskImagePyramidMultiChannel(std::string const& image_file = "",
@@ -103,6 +103,12 @@ MainWidget::MainWidget(QWidget *parent,
   this->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
   this->setFocusPolicy(Qt::ClickFocus);
 
+  // Tiles are loaded on other threads, so the signal is queued to this one
+  m_tileTimer.setSingleShot(true);
+  m_tileTimer.setInterval(100); // milliseconds
+  connect(&m_tileLoader, SIGNAL(tileLoaded()), this, SLOT(tileLoaded()));
+  connect(&m_tileTimer, SIGNAL(timeout()), this, SLOT(refreshPixmap()));
+
   // Read the images. Find the box that will contain all of them.
   // If we use georef, that box is in projected point units
   // of the first image.
@@ -276,6 +282,11 @@ MainWidget::MainWidget(QWidget *parent,
 
 MainWidget::~MainWidget() {}
 
+void MainWidget::tileLoaded() {
+  if (!m_tileTimer.isActive())
+    m_tileTimer.start();
+}
+
 bool MainWidget::eventFilter(QObject *obj, QEvent *E) {
   return QWidget::eventFilter(obj, E);
 }
@@ -972,6 +983,9 @@ void MainWidget::drawImage(QPainter* paint) {
   full_screen_box.grow(floor(world2screen(m_current_view.min())));
   full_screen_box.grow(ceil(world2screen(m_current_view.max())));
 
+  // Tiles queued for the previous view which are not needed now will be skipped
+  m_tileLoader.startFrame();
+
   // Keep track of which pixels were drawn. Initialize with zeros.
   ImageView<int> drawn_already;
   if (m_use_georef) {
@@ -1096,29 +1110,30 @@ void MainWidget::drawImage(QPainter* paint) {
       highlight_nodata = false;
     }
 
+    DiskImagePyramidMultiChannel const* img = &m_images[i].img; // original image
+    if (m_images[i].m_display_mode == THRESHOLDED_VIEW)
+      img = &m_images[i].thresholded_img;
+    else if (m_images[i].m_display_mode == HILLSHADED_VIEW)
+      img = &m_images[i].hillshaded_img;
+
+    // Use the tiles loaded so far. When more get loaded, this will be redrawn.
     QImage qimg;
-    if (m_images[i].m_display_mode == THRESHOLDED_VIEW) {
-      m_images[i].thresholded_img.get_image_clip(scale, image_box,
-                                                  highlight_nodata,
-                                                  qimg, scale_out, region_out);
-    } else if (m_images[i].m_display_mode == HILLSHADED_VIEW) {
-      m_images[i].hillshaded_img.get_image_clip(scale, image_box,
-                                                highlight_nodata,
-                                                qimg, scale_out, region_out);
-    } else {
-      // Original images
-      m_images[i].img.get_image_clip(scale, image_box, highlight_nodata,
-                                     qimg, scale_out, region_out);
-    }
+    if (!m_tileLoader.getImageClip(*img, scale, image_box, highlight_nodata,
+                                   qimg, scale_out, region_out))
+      continue;
 
     // Draw on image screen
     Stopwatch sw4;
     sw4.start();
     if (!m_use_georef) {
-      // This is a regular image, no georeference, just pass it to the Qt painter
-      QRect rect(screen_box.min().x(), screen_box.min().y(),
+      // This is a regular image, no georeference, just pass it to the Qt
+      // painter. The clip can extend beyond the image box, or be coarser.
+      QRectF rect(screen_box.min().x(), screen_box.min().y(),
                   screen_box.width(), screen_box.height());
-      paint->drawImage(rect, qimg);
+      QRectF source(image_box.min().x() / scale_out - region_out.min().x(),
+                    image_box.min().y() / scale_out - region_out.min().y(),
+                    image_box.width() / scale_out, image_box.height() / scale_out);
+      paint->drawImage(rect, qimg, source);
     } else {
       MainWidget::renderGeoreferencedImage(scale_out, i, paint, has_csv, qimg,
                                            screen_box, region_out, drawn_already);
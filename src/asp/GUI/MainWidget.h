@@ -36,6 +36,7 @@
 // Qt
 #include <QWidget>
 #include <QPoint>
+#include <QTimer>
 
 // Qwt
 #include <qwt_plot.h>
@@ -63,6 +64,7 @@
 // ASP
 #include <asp/Core/MatchList.h>
 #include <asp/GUI/GuiUtilities.h>
+#include <asp/GUI/TileLoader.h>
 #include <asp/GUI/WidgetBase.h>
 
 class QMouseEvent;
@@ -177,6 +179,8 @@ public slots:
     void viewUnthreshImages();
     void viewThreshImages  (bool refresh_pixmap);
     void viewHillshadedImages(bool hillshade_mode);
+    void tileLoaded(); ///< Redraw soon, as an image tile got loaded in the background
+    void refreshPixmap(); /// Draw the image   
 
     void addMatchPoint          (); ///< Add a new interest point (from right click menu)
     void deleteMatchPoint       (); ///< Delete an interest point (from right click menu)
@@ -203,8 +207,6 @@ public slots:
     void mergePolys             (); ///< Merge existing polygons
     void saveScreenshot         (); ///< Save a screenshot of the current imagery
 
-    void refreshPixmap(); /// Draw the image   
-
   protected:
 
     // Setup
@@ -280,6 +282,11 @@ public slots:
     // if really necessary, and display it when paintEvent is called.
     QPixmap m_pixmap;
 
+    // Load image tiles in the background. Redraw when the timer fires,
+    // rather than for each tile.
+    TileLoader m_tileLoader;
+    QTimer     m_tileTimer;
+
     // Default color when polys are created from scratch
     std::string m_polyColor;
 
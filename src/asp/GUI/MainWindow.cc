@@ -29,6 +29,7 @@
 #include <asp/Core/GCP.h>
 #include <asp/Rig/nvm.h>
 #include <asp/Core/IpMatchingAlgs.h>
+#include <asp/Core/MatchDb.h>
 #include <asp/Camera/BundleAdjustIsis.h>
 
 #include <vw/config.h>
@@ -1369,9 +1370,11 @@ void MainWindow::viewMatches() {
       std::vector<size_t> leftIndices;
       bool matchfiles_found = false;
       asp::populateMatchFiles(m_image_files, m_output_prefix, stereo_settings().match_file,
+                              stereo_settings().match_db,
                               matchFiles, leftIndices, matchfiles_found);      
       if (matchfiles_found) 
-        m_matchlist.loadPointsFromMatchFiles(matchFiles, leftIndices);
+        m_matchlist.loadPointsFromMatchFiles(matchFiles, leftIndices,
+                                             stereo_settings().match_db);
     }
 
   } // End case where we tried to load the matches
@@ -1533,7 +1536,10 @@ void MainWindow::viewPairwiseMatchesOrCleanMatches() {
     try {
       // Load it
       vw_out() << "Loading match file: " << match_file << std::endl;
-      ip::read_binary_match_file(match_file, left_ip, right_ip);
+      boost::shared_ptr<asp::MatchDb> match_db;
+      if (!stereo_settings().match_db.empty() && fs::exists(stereo_settings().match_db))
+        match_db.reset(new asp::MatchDb(stereo_settings().match_db));
+      asp::readMatchFile(match_db.get(), match_file, left_ip, right_ip);
       vw_out() << "Read: " << left_ip.size() << " matches.\n";
     } catch(...) {
       // Having this pop-up for a large number of images is annoying
@@ -1564,7 +1570,8 @@ void MainWindow::saveMatches() {
 
   try {
     m_matchlist.savePointsToDisk(m_output_prefix, m_image_files,
-                                 stereo_settings().match_file);
+                                 stereo_settings().match_file,
+                                 stereo_settings().match_db);
   } catch (std::exception const& e) {
     popUp(e.what());
     return;
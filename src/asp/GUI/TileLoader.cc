@@ -0,0 +1,282 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2006-2024, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/GUI/TileLoader.h>
+
+#include <vw/Core/Settings.h>
+#include <vw/Core/Log.h>
+
+#include <QPainter>
+
+#include <boost/utility.hpp>
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+namespace vw { namespace gui {
+
+// The size of a tile, in pixels at the pyramid level it is read from
+const int TILE_SIZE = 256;
+
+// Drop the least recently used tiles when the cache gets larger than this
+const size_t MAX_CACHE_BYTES = size_t(512) * 1024 * 1024;
+
+// Reading the tiles is mostly limited by disk access, so use few threads
+const int MAX_LOADER_THREADS = 4;
+
+bool TileKey::operator<(TileKey const& other) const {
+  return std::tie(pyramid_id, scale, highlight_nodata, col, row) <
+    std::tie(other.pyramid_id, other.scale, other.highlight_nodata, other.col, other.row);
+}
+
+size_t tileBytes(QImage const& qimg) {
+  return size_t(qimg.bytesPerLine()) * qimg.height();
+}
+
+// Load a tile on a thread of the work queue. Keep a copy of the pyramid,
+// which is cheap, in case the original one is replaced in the meantime.
+class TileTask: public vw::Task, private boost::noncopyable {
+  TileLoader                 & m_loader;
+  TileKey                      m_key;
+  DiskImagePyramidMultiChannel m_img;
+  vw::BBox2i                   m_region;
+public:
+  TileTask(TileLoader & loader, TileKey const& key,
+           DiskImagePyramidMultiChannel const& img, vw::BBox2i const& region):
+    m_loader(loader), m_key(key), m_img(img), m_region(region) {}
+
+  void operator()() {
+    m_loader.loadTile(m_key, m_img, m_region);
+  }
+};
+
+TileLoader::TileLoader():
+  m_cache_bytes(0), m_counter(0), m_stopping(false),
+  m_queue(std::max(1, std::min(MAX_LOADER_THREADS,
+                               int(vw::vw_settings().default_num_threads())))) {}
+
+TileLoader::~TileLoader() {
+  {
+    vw::Mutex::Lock lock(m_mutex);
+    m_stopping = true;
+    m_wanted.clear();
+  }
+  m_queue.join_all();
+}
+
+void TileLoader::startFrame() {
+  vw::Mutex::Lock lock(m_mutex);
+  m_wanted.clear();
+}
+
+bool TileLoader::findTile(TileKey const& key, TileData & tile) {
+  vw::Mutex::Lock lock(m_mutex);
+  auto it = m_cache.find(key);
+  if (it == m_cache.end())
+    return false;
+  it->second.last_used = ++m_counter;
+  tile = it->second;
+  return true;
+}
+
+void TileLoader::requestTile(TileKey const& key, DiskImagePyramidMultiChannel const& img,
+                             vw::BBox2i const& region) {
+  {
+    vw::Mutex::Lock lock(m_mutex);
+    m_wanted.insert(key);
+    if (m_cache.find(key) != m_cache.end() || m_queued.find(key) != m_queued.end())
+      return;
+    m_queued.insert(key);
+  }
+
+  boost::shared_ptr<vw::Task> task(new TileTask(*this, key, img, region));
+  m_queue.add_task(task);
+}
+
+void TileLoader::loadTile(TileKey const& key, DiskImagePyramidMultiChannel const& img,
+                          vw::BBox2i const& region) {
+
+  // Skip the tiles that are no longer in view
+  {
+    vw::Mutex::Lock lock(m_mutex);
+    if (m_stopping || m_wanted.find(key) == m_wanted.end()) {
+      m_queued.erase(key);
+      return;
+    }
+  }
+
+  // For the coarsest level, use a scale larger than that of any level
+  double scale_in = key.scale;
+  if (key.scale == 0)
+    scale_in = std::max(img.cols(), img.rows());
+
+  // If reading fails, keep an empty tile, so it is not read again
+  TileData tile;
+  try {
+    img.get_image_clip(scale_in, region, key.highlight_nodata,
+                       tile.qimg, tile.scale_out, tile.region_out);
+  } catch (std::exception const& e) {
+    vw::vw_out() << "Failed to read an image tile: " << e.what() << "\n";
+    tile = TileData();
+  }
+
+  {
+    vw::Mutex::Lock lock(m_mutex);
+    m_queued.erase(key);
+    auto it = m_cache.find(key);
+    if (it != m_cache.end())
+      m_cache_bytes -= tileBytes(it->second.qimg);
+    tile.last_used = ++m_counter;
+    m_cache[key] = tile;
+    m_cache_bytes += tileBytes(tile.qimg);
+    evictTiles();
+  }
+
+  // This will be delivered to the GUI thread
+  emit tileLoaded();
+}
+
+void TileLoader::evictTiles() {
+
+  while (m_cache_bytes > MAX_CACHE_BYTES) {
+    // Never drop the tiles in the current view
+    auto oldest = m_cache.end();
+    for (auto it = m_cache.begin(); it != m_cache.end(); it++) {
+      if (m_wanted.find(it->first) != m_wanted.end())
+        continue;
+      if (oldest == m_cache.end() || it->second.last_used < oldest->second.last_used)
+        oldest = it;
+    }
+    if (oldest == m_cache.end())
+      break;
+
+    m_cache_bytes -= tileBytes(oldest->second.qimg);
+    m_cache.erase(oldest);
+  }
+}
+
+bool TileLoader::getImageClip(DiskImagePyramidMultiChannel const& img,
+                              double scale_in, vw::BBox2i region_in,
+                              bool highlight_nodata,
+                              QImage & qimg, double & scale_out,
+                              vw::BBox2i & region_out) {
+
+  vw::BBox2i full_box(0, 0, img.cols(), img.rows());
+  region_in.crop(full_box);
+  if (region_in.empty())
+    return false;
+
+  // The whole image at the coarsest level, to show until the tiles are loaded
+  TileKey coarse_key = {img.m_id, 0, highlight_nodata, 0, 0};
+  requestTile(coarse_key, img, full_box);
+  TileData coarse;
+  bool have_coarse = findTile(coarse_key, coarse) && !coarse.qimg.isNull();
+
+  // If the coarsest level is fine enough, that is all that is needed
+  if (have_coarse && coarse.scale_out <= scale_in) {
+    qimg       = coarse.qimg;
+    scale_out  = coarse.scale_out;
+    region_out = coarse.region_out;
+    return true;
+  }
+
+  // Round down the scale to a power of 2, so that the tiles can be reused
+  // when the view changes slightly. Then the same pyramid level is used.
+  int scale = 1;
+  while (2.0 * scale <= scale_in)
+    scale *= 2;
+
+  // The range of tiles seen in the view, in full-resolution pixels
+  int len = TILE_SIZE * scale;
+  int beg_col = region_in.min().x() / len, end_col = (region_in.max().x() - 1) / len;
+  int beg_row = region_in.min().y() / len, end_row = (region_in.max().y() - 1) / len;
+  int max_col = (img.cols() - 1) / len, max_row = (img.rows() - 1) / len;
+
+  // Request the tiles in view, then the ones around them, to be loaded in
+  // this order.
+  std::vector<TileData> tiles;
+  int num_in_view = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    int extra = pass; // prefetch one tile around the view
+    for (int row = std::max(0, beg_row - extra);
+         row <= std::min(max_row, end_row + extra); row++) {
+      for (int col = std::max(0, beg_col - extra);
+           col <= std::min(max_col, end_col + extra); col++) {
+
+        bool in_view = (col >= beg_col && col <= end_col &&
+                        row >= beg_row && row <= end_row);
+        if ((pass == 0) != in_view)
+          continue;
+
+        TileKey key = {img.m_id, scale, highlight_nodata, col, row};
+        vw::BBox2i region(col * len, row * len, len, len);
+        region.crop(full_box);
+        requestTile(key, img, region);
+
+        if (!in_view)
+          continue;
+        num_in_view++;
+        TileData tile;
+        if (findTile(key, tile) && !tile.qimg.isNull())
+          tiles.push_back(tile);
+      }
+    }
+  }
+
+  if (tiles.empty()) {
+    if (!have_coarse)
+      return false;
+    qimg       = coarse.qimg;
+    scale_out  = coarse.scale_out;
+    region_out = coarse.region_out;
+    return true;
+  }
+
+  // Put together the tiles in view. The region is at the scale of the tiles.
+  scale_out = tiles[0].scale_out;
+  region_out.min() = vw::Vector2i(floor(region_in.min().x() / scale_out),
+                                  floor(region_in.min().y() / scale_out));
+  region_out.max() = vw::Vector2i(ceil(region_in.max().x() / scale_out),
+                                  ceil(region_in.max().y() / scale_out));
+  qimg = QImage(region_out.width(), region_out.height(),
+                QImage::Format_ARGB32_Premultiplied);
+  qimg.fill(Qt::transparent);
+
+  QPainter paint(&qimg);
+
+  // Fill in from the coarsest level where the tiles are not loaded yet
+  if (int(tiles.size()) < num_in_view && have_coarse) {
+    double ratio = coarse.scale_out / scale_out;
+    QRectF target(coarse.region_out.min().x() * ratio - region_out.min().x(),
+                  coarse.region_out.min().y() * ratio - region_out.min().y(),
+                  coarse.region_out.width() * ratio,
+                  coarse.region_out.height() * ratio);
+    paint.drawImage(target, coarse.qimg);
+  }
+
+  for (size_t it = 0; it < tiles.size(); it++)
+    paint.drawImage(QPoint(tiles[it].region_out.min().x() - region_out.min().x(),
+                           tiles[it].region_out.min().y() - region_out.min().y()),
+                    tiles[it].qimg);
+
+  paint.end();
+
+  return true;
+}
+
+}} // namespace vw::gui
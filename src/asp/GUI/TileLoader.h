@@ -0,0 +1,114 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2006-2024, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileLoader.h
+///
+/// Read tiles of image pyramids on background threads, convert them to
+/// QImage, and keep them in a cache of bounded size. Until the tiles
+/// needed for the current view are loaded, the coarsest pyramid level is
+/// shown in their place.
+///
+#ifndef __STEREO_GUI_TILE_LOADER_H__
+#define __STEREO_GUI_TILE_LOADER_H__
+
+#include <asp/GUI/DiskImagePyramidMultiChannel.h>
+
+#include <QObject>
+#include <QImage>
+
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/BBox.h>
+
+#include <cstdint>
+#include <map>
+#include <set>
+
+namespace vw { namespace gui {
+
+  // A tile of a given image pyramid, at a given scale. The scale is a power
+  // of 2, or 0 for the whole image at the coarsest level.
+  struct TileKey {
+    int  pyramid_id;
+    int  scale;
+    bool highlight_nodata;
+    int  col, row; // position in the grid of tiles at this scale
+
+    bool operator<(TileKey const& other) const;
+  };
+
+  // A loaded tile, with the same meaning for the fields as for the outputs
+  // of DiskImagePyramidMultiChannel::get_image_clip().
+  struct TileData {
+    QImage        qimg;
+    double        scale_out;
+    vw::BBox2i    region_out;
+    std::uint64_t last_used; // for evicting the least recently used tiles
+  };
+
+  class TileLoader: public QObject {
+    Q_OBJECT
+
+  public:
+    TileLoader();
+    ~TileLoader(); // waits for the tiles being loaded
+
+    // Must be called before redrawing all images. Tiles queued earlier that
+    // are not requested again are not loaded.
+    void startFrame();
+
+    // Same interface as DiskImagePyramidMultiChannel::get_image_clip(), but
+    // form the output from the tiles loaded so far. Tiles that are missing
+    // are queued for loading, together with the ones around the region, and
+    // their place is filled from the coarsest level. Return false if not even
+    // that one is loaded yet. The tileLoaded() signal is emitted when there
+    // is something new to draw.
+    bool getImageClip(DiskImagePyramidMultiChannel const& img,
+                      double scale_in, vw::BBox2i region_in, bool highlight_nodata,
+                      QImage & qimg, double & scale_out, vw::BBox2i & region_out);
+
+    // Invoked by the loading threads
+    void loadTile(TileKey const& key, DiskImagePyramidMultiChannel const& img,
+                  vw::BBox2i const& region);
+
+  signals:
+    void tileLoaded();
+
+  private:
+    // Return true if the tile is in the cache, and then copy it
+    bool findTile(TileKey const& key, TileData & tile);
+
+    // Queue the tile for loading, unless loaded or queued already
+    void requestTile(TileKey const& key, DiskImagePyramidMultiChannel const& img,
+                     vw::BBox2i const& region);
+
+    // Remove the least recently used tiles until the cache fits in memory
+    void evictTiles();
+
+    vw::Mutex                   m_mutex;
+    std::map<TileKey, TileData> m_cache;
+    std::set<TileKey>           m_queued, m_wanted;
+    size_t                      m_cache_bytes;
+    std::uint64_t               m_counter;
+    bool                        m_stopping;
+    vw::FifoWorkQueue           m_queue;
+  };
+
+}} // namespace vw::gui
+
+#endif  // __STEREO_GUI_TILE_LOADER_H__
@@ -240,4 +240,100 @@ void binnedStatistics(vw::ImageView<vw::PixelMask<float>> const& x,
    }
 }
 
+UniformHistogram::UniformHistogram(double min_val, double max_val, int num_bins):
+  m_min_val(min_val), m_max_val(max_val), m_count(0) {
+  
+  if (num_bins <= 0 || !(max_val > min_val))
+    vw::vw_throw(vw::ArgumentErr() << "Invalid histogram range or number of bins.\n");
+  
+  m_counts.resize(num_bins, 0);
+  m_bin_width = (max_val - min_val) / num_bins;
+}
+
+void UniformHistogram::add(double val) {
+  
+  if (!(val >= m_min_val && val <= m_max_val))
+    return; // this also skips NaN
+  
+  int num_bins = m_counts.size();
+  int bin_index = (int)std::floor((val - m_min_val) / m_bin_width);
+  if (bin_index >= num_bins) // This can happen due to numerical errors
+    bin_index = num_bins - 1;
+  if (bin_index < 0)
+    bin_index = 0;
+  
+  m_counts[bin_index]++;
+  m_count++;
+}
+
+void UniformHistogram::merge(UniformHistogram const& other) {
+  
+  if (other.m_counts.size() != m_counts.size() || other.m_min_val != m_min_val ||
+      other.m_max_val != m_max_val)
+    vw::vw_throw(vw::ArgumentErr() << "Cannot merge histograms with different bins.\n");
+  
+  for (size_t i = 0; i < m_counts.size(); i++)
+    m_counts[i] += other.m_counts[i];
+  m_count += other.m_count;
+}
+
+double UniformHistogram::cdf(double val) const {
+  
+  if (val <= m_min_val)
+    return 0.0;
+  if (val >= m_max_val)
+    return m_count;
+  
+  int bin_index = std::min((int)std::floor((val - m_min_val) / m_bin_width),
+                           (int)m_counts.size() - 1);
+  double sum = 0.0;
+  for (int i = 0; i < bin_index; i++)
+    sum += m_counts[i];
+  
+  double frac = (val - m_min_val - bin_index * m_bin_width) / m_bin_width;
+  return sum + frac * m_counts[bin_index];
+}
+
+double UniformHistogram::quantile(double fraction) const {
+  
+  if (m_count == 0)
+    vw::vw_throw(vw::ArgumentErr() << "No values found in quantile calculation.\n");
+  
+  double target = fraction * m_count;
+  double sum = 0.0;
+  for (size_t i = 0; i < m_counts.size(); i++) {
+    if (m_counts[i] > 0 && sum + m_counts[i] >= target) {
+      double frac = std::max(0.0, target - sum) / m_counts[i];
+      return m_min_val + (i + frac) * m_bin_width;
+    }
+    sum += m_counts[i];
+  }
+  
+  return m_max_val;
+}
+
+// Find the radius around the median that has half of the values, by bisection
+double normalizedMad(UniformHistogram const& hist, double median) {
+  
+  if (hist.count() == 0)
+    vw::vw_throw(vw::ArgumentErr() << "No values found in MAD calculation.\n");
+  
+  double half = hist.count() / 2.0;
+  double low = 0.0, high = 1.0;
+  // This ends once the radius covers the histogram range
+  while (hist.cdf(median + high) - hist.cdf(median - high) < half)
+    high *= 2.0;
+  
+  for (int it = 0; it < 60; it++) {
+    double mid = (low + high) / 2.0;
+    if (hist.cdf(median + mid) - hist.cdf(median - mid) < half)
+      low = mid;
+    else
+      high = mid;
+  }
+  
+  // The normalization factor is to make this equivalent to the standard deviation  
+  return 1.4826 * high;
+}
+
 } // end namespace vw
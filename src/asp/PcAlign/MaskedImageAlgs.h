@@ -25,6 +25,8 @@
 
 #include <vw/Image/ImageView.h>
 
+#include <vector>
+
 namespace vw {
   
 // Find the valid pixels. Use long long, to avoid integer overflow.
@@ -67,6 +69,37 @@ void binnedStatistics(vw::ImageView<vw::PixelMask<float>> const& x,
                       std::vector<double> & bin_edges,
                       std::vector<double> & bin_centers);
   
+// A histogram with bins of equal width over a given range, to find
+// approximate quantiles of more values than can be kept in memory. Values
+// outside the range are ignored.
+class UniformHistogram {
+public:
+  UniformHistogram(double min_val, double max_val, int num_bins);
+  
+  void add(double val);
+  
+  // Add the counts of a histogram with the same range and bins
+  void merge(UniformHistogram const& other);
+  
+  long long count() const { return m_count; }
+  
+  // The number of values no larger than given one. Values are assumed to be
+  // uniformly distributed within each bin.
+  double cdf(double val) const;
+  
+  // The value below which the given fraction of values lies. The error is
+  // at most the bin width.
+  double quantile(double fraction) const;
+  
+private:
+  double m_min_val, m_max_val, m_bin_width;
+  std::vector<long long> m_counts;
+  long long m_count;
+};
+  
+// Approximate normalized median absolute deviation of the values in a histogram
+double normalizedMad(UniformHistogram const& hist, double median);
+  
 } // end namespace vw
 
 #endif // __ASP_PC_ALIGN_MASKEDIMAGEALGS_H__
@@ -37,6 +37,7 @@
 #include <asp/PcAlign/MaskedImageAlgs.h>
 #include <asp/PcAlign/SlopeAspect.h>
 #include <vw/Core/Settings.h>
+#include <vw/Image/Algorithms.h>
 #include <vw/Math/RandomSet.h>
 #include <vw/Math/Geometry.h>
 
@@ -55,8 +56,8 @@ namespace asp {
   
 struct Options: vw::GdalWriteOptions {
   std::string ref, src, out_prefix, res;
-  int poly_order, max_iter, inner_iter;
-  double tol, max_horiz_offset, max_vert_offset, max_displacement;
+  int poly_order, max_iter, inner_iter, tile_size;
+  double tol, tile_cache_mb, max_horiz_offset, max_vert_offset, max_displacement;
   bool tiltcorr, compute_translation_only;
   vw::Vector2 slope_lim;
   Options() {}
@@ -81,6 +82,15 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("num-inner-iter", po::value(&opt.inner_iter)->default_value(10),
       "Maximum number of iterations for the inner loop, when finding the best "
       "fit parameters for the current translation.")
+    ("tile-size", po::value(&opt.tile_size)->default_value(0),
+     "If positive, do not load the DEMs fully in memory, but process them in tiles "
+     "of this size, in pixels, in parallel. The medians are then approximated with "
+     "histograms. This is for DEMs that do not fit in memory.")
+    ("tile-cache-mb", po::value(&opt.tile_cache_mb)->default_value(2048),
+     "With --tile-size, keep the tiles of the difference, slope, and aspect in "
+     "memory between the three passes of each iteration if they take no more than "
+     "this many megabytes, so the DEMs are read once per iteration rather than "
+     "three times. Set to 0 to not keep them.")
     // The options below are not yet supported
     ("tiltcorr", po::bool_switch(&opt.tiltcorr)->default_value(false),
      "After a preliminary translation, fit a polynomial to residual elevation offsets "
@@ -119,6 +129,11 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   if (opt.tol <= 0.0)
     vw::vw_throw(vw::ArgumentErr() << "The tolerance must be positive.\n");
 
+  if (opt.tile_size < 0)
+    vw::vw_throw(vw::ArgumentErr() << "The tile size must be non-negative.\n");
+  if (opt.tile_cache_mb < 0)
+    vw::vw_throw(vw::ArgumentErr() << "The tile cache size must be non-negative.\n");
+
   // If horizontal and vertical offset are NaN (so, not set), use max_displacement
   if (std::isnan(opt.max_horiz_offset))
      opt.max_horiz_offset = opt.max_displacement;
@@ -160,10 +175,11 @@ inline double DegToRad(double deg) {
   return deg * M_PI / 180.0;
 }
 
-// Put the above logic in a function that prepares the data.
+// Check the georeferences and read the no-data values. The DEMs are not read
+// from disk yet.
 void prepareData(Options const& opt, 
-                  vw::ImageView<vw::PixelMask<float>> & ref,
-                  vw::ImageView<vw::PixelMask<float>> & src,
+                  vw::ImageViewRef<vw::PixelMask<float>> & ref,
+                  vw::ImageViewRef<vw::PixelMask<float>> & src,
                   double & ref_nodata, double & src_nodata,
                   vw::cartography::GeoReference & ref_georef,
                   vw::cartography::GeoReference & src_georef) {
@@ -229,12 +245,9 @@ void prepareData(Options const& opt,
   if (src_rsrc.has_nodata_read())
     src_nodata = src_rsrc.nodata_read(); 
   
-  // Read the ref and source images fully in memory, for speed
-  ref = copy(create_mask(vw::DiskImageView<float>(opt.ref), ref_nodata));
-
-  // Get a handle to the source image on disk. We will warp it and read it in memory
-  // as needed, when it is being shifted.
-  src = copy(create_mask(vw::DiskImageView<float>(opt.src), src_nodata));
+  // Get handles to the images on disk
+  ref = create_mask(vw::DiskImageView<float>(opt.ref), ref_nodata);
+  src = create_mask(vw::DiskImageView<float>(opt.src), src_nodata);
   
   // TODO(oalexan1): Crop the reference given the extent of the source
   // and estimated max movement.
@@ -304,52 +317,60 @@ void shiftWarp(int ref_cols, int ref_rows,
   return;
 }
 
+// The images can be huge. A sample of pixels is enough for finding the ECEF
+// transform. Use a grid with about this many pixels along each dimension.
+const int ECEF_SAMPLE_GRID = 1000;
+
+// Find the pixels on the sample grid having a valid reference height and
+// difference. Store the pixel and the height.
+void ecefSamplePixels(vw::ImageView<vw::PixelMask<float>> const& ref,
+                      vw::ImageView<vw::PixelMask<float>> const& diff,
+                      std::vector<vw::Vector3> & samples) {
+  
+  samples.clear();
+  int col_rate = std::max(ref.cols() / ECEF_SAMPLE_GRID, 1);
+  int row_rate = std::max(ref.rows() / ECEF_SAMPLE_GRID, 1);
+  #pragma omp parallel for
+  for (int col = 0; col < ref.cols(); col += col_rate) {
+    for (int row = 0; row < ref.rows(); row += row_rate) {
+      vw::PixelMask<float> ht = ref(col, row);
+      if (!is_valid(ht) || !is_valid(diff(col, row))) 
+        continue;
+      #pragma omp critical
+      samples.push_back(vw::Vector3(col, row, ht.child()));
+    }
+  }
+}
+
 // Convert a translation in projected coordinates that aligns the source to the
 // reference to a rotation + translation transform in ECEF. Make use of the
-// filtered differences we employed to find the translation.
-void calcEcefTransform(vw::ImageView<vw::PixelMask<float>> const& ref,
-                       vw::ImageView<vw::PixelMask<float>> const& diff,
+// pixels with filtered differences we employed to find the translation.
+void calcEcefTransform(std::vector<vw::Vector3> const& samples,
                        vw::cartography::GeoReference const& ref_georef,
                        double dx_total, double dy_total, double dz_total,
                        bool compute_translation_only,
                        // Outputs
                        Eigen::MatrixXd & ecef_transform) {
   
-  std::vector<vw::Vector3> ref_pts, src_pts;
+  std::vector<vw::Vector3> ref_pts(samples.size()), src_pts(samples.size());
   
-  // The images can be huge. A sample is enough here.
-  int col_rate = std::max(ref.cols() / 1000, 1);
-  int row_rate = std::max(ref.rows() / 1000, 1);
   #pragma omp parallel for
-  for (int col = 0; col < ref.cols(); col += col_rate) {
-    for (int row = 0; row < ref.rows(); row += row_rate) {
-      
-      vw::Vector2 ref_pix(col, row);
-      vw::PixelMask<float> ht = ref(col, row);
-      if (!is_valid(ht)) 
-        continue;
-      if (!is_valid(diff(col, row))) 
-        continue;
-      
-      // Convert to projected coordinates, then to ECEF
-      vw::Vector2 ref_pt = ref_georef.pixel_to_point(ref_pix);
-      vw::Vector2 ref_lon_lat = ref_georef.point_to_lonlat(ref_pt);
-      vw::Vector3 ref_ecef = ref_georef.datum().geodetic_to_cartesian
-        (vw::Vector3(ref_lon_lat[0], ref_lon_lat[1], ht.child()));
-
-      // Same for the source. Must go back to the source domain, in x, y, z.
-      vw::Vector2 src_pt = ref_pt - vw::Vector2(dx_total, dy_total);
-      vw::Vector2 src_lon_lat = ref_georef.point_to_lonlat(src_pt);
-      vw::Vector3 src_ecef = ref_georef.datum().geodetic_to_cartesian
-        (vw::Vector3(src_lon_lat[0], src_lon_lat[1], ht.child() - dz_total));
-  
-      #pragma omp critical
-      {
-        ref_pts.push_back(ref_ecef);
-        src_pts.push_back(src_ecef);
-      }
-      
-    }
+  for (int i = 0; i < (int)samples.size(); i++) {
+    
+    vw::Vector2 ref_pix(samples[i][0], samples[i][1]);
+    double ht = samples[i][2];
+    
+    // Convert to projected coordinates, then to ECEF
+    vw::Vector2 ref_pt = ref_georef.pixel_to_point(ref_pix);
+    vw::Vector2 ref_lon_lat = ref_georef.point_to_lonlat(ref_pt);
+    ref_pts[i] = ref_georef.datum().geodetic_to_cartesian
+      (vw::Vector3(ref_lon_lat[0], ref_lon_lat[1], ht));
+
+    // Same for the source. Must go back to the source domain, in x, y, z.
+    vw::Vector2 src_pt = ref_pt - vw::Vector2(dx_total, dy_total);
+    vw::Vector2 src_lon_lat = ref_georef.point_to_lonlat(src_pt);
+    src_pts[i] = ref_georef.datum().geodetic_to_cartesian
+      (vw::Vector3(src_lon_lat[0], src_lon_lat[1], ht - dz_total));
   }
   
   // This will not be robust unless we have a lot of samples
@@ -520,6 +541,353 @@ void computeNuthOffset(Options const& opt,
                fit_params);
 } // End function computeNuthOffset
 
+// Warp the source DEM to a region of the reference DEM's grid, while applying
+// a translation, as in shiftWarp(). Read from disk only the part of the source
+// that is needed.
+void shiftWarpRegion(vw::BBox2i const& ref_box,
+                     vw::ImageViewRef<vw::PixelMask<float>> const& src,
+                     vw::cartography::GeoReference const& ref_georef,
+                     vw::cartography::GeoReference const& src_georef,
+                     double dx_total, double dy_total, double dz_total,
+                     // Outputs
+                     vw::ImageView<vw::PixelMask<float>> & src_warp) {
+  
+  vw::PixelMask<float> nodata_val;
+  nodata_val.invalidate();
+  src_warp.set_size(ref_box.width(), ref_box.height());
+  vw::fill(src_warp, nodata_val);
+  
+  // Find the source pixels to interpolate at, and their extent
+  vw::cartography::GeoTransform gt(ref_georef, src_georef);
+  vw::ImageView<vw::Vector2> src_pix(ref_box.width(), ref_box.height());
+  double inf = std::numeric_limits<double>::max();
+  vw::Vector2 min_pix(inf, inf), max_pix(-inf, -inf);
+  for (int col = 0; col < ref_box.width(); col++) {
+    for (int row = 0; row < ref_box.height(); row++) {
+      vw::Vector2 ref_pix(col + ref_box.min().x(), row + ref_box.min().y());
+      vw::Vector2 proj_pt = ref_georef.pixel_to_point(ref_pix);
+      proj_pt -= vw::Vector2(dx_total, dy_total);
+      ref_pix = ref_georef.point_to_pixel(proj_pt);
+      src_pix(col, row) = gt.forward(ref_pix);
+      if (std::isnan(src_pix(col, row)[0]) || std::isnan(src_pix(col, row)[1]))
+        continue;
+      for (int c = 0; c < 2; c++) {
+        min_pix[c] = std::min(min_pix[c], src_pix(col, row)[c]);
+        max_pix[c] = std::max(max_pix[c], src_pix(col, row)[c]);
+      }
+    }
+  }
+  
+  if (min_pix[0] > max_pix[0] || min_pix[1] > max_pix[1])
+    return; // no valid pixels
+
+  // Read the source in that extent, with a margin for bicubic interpolation.
+  // Clamp before converting to int, to avoid overflow.
+  double margin = 3.0, cols = src.cols(), rows = src.rows();
+  int beg_col = std::min(cols, std::max(0.0, floor(min_pix[0]) - margin));
+  int beg_row = std::min(rows, std::max(0.0, floor(min_pix[1]) - margin));
+  int end_col = std::max(0.0, std::min(cols, ceil(max_pix[0]) + margin + 1.0));
+  int end_row = std::max(0.0, std::min(rows, ceil(max_pix[1]) + margin + 1.0));
+  if (beg_col >= end_col || beg_row >= end_row)
+    return; // no overlap
+  vw::BBox2i src_box(beg_col, beg_row, end_col - beg_col, end_row - beg_row);
+  vw::ImageView<vw::PixelMask<float>> src_crop = crop(src, src_box);
+  
+  auto nodata_ext = vw::ValueEdgeExtension<vw::PixelMask<float>>(nodata_val);
+  vw::ImageViewRef<vw::PixelMask<float>> src_interp 
+    = vw::interpolate(src_crop, vw::BicubicInterpolation(), nodata_ext);
+  for (int col = 0; col < ref_box.width(); col++) {
+    for (int row = 0; row < ref_box.height(); row++) {
+      vw::Vector2 pix = src_pix(col, row);
+      if (std::isnan(pix[0]) || std::isnan(pix[1]))
+        continue;
+      pix -= vw::Vector2(src_box.min().x(), src_box.min().y());
+      src_warp(col, row) = src_interp(pix[0], pix[1]);
+      src_warp(col, row) += dz_total;
+    }
+  }
+}
+
+// For a tile of the reference DEM, find the reference heights, the difference
+// of the warped source and the reference, and the slope and aspect of the
+// warped source, with the range filters applied. The source is warped with a
+// margin of one pixel, so that the slope at the tile boundary is the same as
+// when the whole DEM is in memory.
+void nuthTile(vw::ImageViewRef<vw::PixelMask<float>> const& ref,
+              vw::ImageViewRef<vw::PixelMask<float>> const& src,
+              vw::cartography::GeoReference const& ref_georef,
+              vw::cartography::GeoReference const& src_georef,
+              vw::BBox2i const& tile,
+              double dx_total, double dy_total, double dz_total,
+              double max_vert_offset, vw::Vector2 const& slope_lim,
+              // Outputs
+              vw::ImageView<vw::PixelMask<float>> & ref_tile,
+              vw::ImageView<vw::PixelMask<float>> & diff,
+              vw::ImageView<vw::PixelMask<float>> & slope,
+              vw::ImageView<vw::PixelMask<float>> & aspect) {
+  
+  vw::BBox2i ext_tile = tile;
+  ext_tile.expand(1);
+  ext_tile.crop(vw::bounding_box(ref));
+  
+  vw::ImageView<vw::PixelMask<float>> src_warp, ext_slope, ext_aspect;
+  shiftWarpRegion(ext_tile, src, ref_georef, src_georef,
+                  dx_total, dy_total, dz_total, 
+                  src_warp); // output
+  vw::cartography::GeoReference ext_georef 
+    = vw::cartography::crop(ref_georef, ext_tile.min().x(), ext_tile.min().y());
+  vw::cartography::calcSlopeAspect(src_warp, ext_georef, ext_slope, ext_aspect);
+  
+  ref_tile = crop(ref, tile);
+  diff.set_size(tile.width(), tile.height());
+  slope.set_size(tile.width(), tile.height());
+  aspect.set_size(tile.width(), tile.height());
+  vw::Vector2i off = tile.min() - ext_tile.min();
+  for (int col = 0; col < tile.width(); col++) {
+    for (int row = 0; row < tile.height(); row++) {
+      diff(col, row)   = src_warp(col + off.x(), row + off.y()) - ref_tile(col, row);
+      slope(col, row)  = ext_slope(col + off.x(), row + off.y());
+      aspect(col, row) = ext_aspect(col + off.x(), row + off.y());
+    }
+  }
+  
+  vw::rangeFilter(diff, -max_vert_offset, max_vert_offset);
+  vw::rangeFilter(slope, slope_lim[0], slope_lim[1]);
+}
+
+// The outputs of nuthTile() for one tile
+struct NuthTileData {
+  vw::ImageView<vw::PixelMask<float>> ref_tile, diff, slope, aspect;
+};
+
+// Same as computeNuthOffset(), but without loading the DEMs fully in memory.
+// The tiles are processed in parallel, and the statistics are accumulated
+// over them. This needs three passes over the tiles, as the filters in each
+// pass depend on the statistics of the previous one. The tiles are kept in
+// memory after the first pass if they fit within --tile-cache-mb, else they are
+// read and warped again in each pass. The medians are found with histograms.
+// Return the pixels for finding the ECEF transform.
+void computeNuthOffsetTiled(Options const& opt,
+                            vw::ImageViewRef<vw::PixelMask<float>> const& ref,
+                            vw::ImageViewRef<vw::PixelMask<float>> const& src,
+                            vw::cartography::GeoReference const& ref_georef,
+                            vw::cartography::GeoReference const& src_georef,
+                            double max_horiz_offset, double max_vert_offset, 
+                            vw::Vector2 const& slope_lim,
+                            double dx_total, double dy_total, double dz_total,
+                            // Outputs
+                            std::vector<vw::Vector3> & ecef_samples,
+                            vw::Vector3 & fit_params,
+                            double & median_diff) {
+
+  std::vector<vw::BBox2i> tiles = vw::subdivide_bbox(ref, opt.tile_size, opt.tile_size);
+  int num_tiles = tiles.size();
+  
+  // Histogram bins for finding the medians of the differences and slopes, and
+  // of the values in each aspect bin. There are 360 of the latter per thread,
+  // so they are kept small. Their range is within 3 standard deviations of the
+  // mean, so the median is still found to within 0.006 standard deviations.
+  int numHistBins = 100000, numBinHistBins = 1000;
+  double outlierFactor = 3.0;
+  
+  // Each tile has 4 images with 8 bytes per pixel
+  double tiles_mb = 32.0 * double(ref.cols()) * double(ref.rows()) / (1024.0 * 1024.0);
+  bool use_cache = (tiles_mb <= opt.tile_cache_mb);
+  std::vector<NuthTileData> cache(use_cache ? num_tiles : 0);
+  
+  // First pass: the median and MAD of the differences, for filtering them.
+  // Each thread accumulates its own histogram, and these are merged at the end.
+  vw::UniformHistogram diff_hist(-max_vert_offset, max_vert_offset, numHistBins);
+  #pragma omp parallel
+  {
+    vw::UniformHistogram thread_diff_hist(-max_vert_offset, max_vert_offset, numHistBins);
+    #pragma omp for schedule(dynamic)
+    for (int it = 0; it < num_tiles; it++) {
+      NuthTileData local;
+      NuthTileData & t = use_cache ? cache[it] : local;
+      nuthTile(ref, src, ref_georef, src_georef, tiles[it], 
+               dx_total, dy_total, dz_total, max_vert_offset, slope_lim,
+               t.ref_tile, t.diff, t.slope, t.aspect); // outputs
+      for (int col = 0; col < t.diff.cols(); col++) {
+        for (int row = 0; row < t.diff.rows(); row++) {
+          if (is_valid(t.diff(col, row)))
+            thread_diff_hist.add(t.diff(col, row).child());
+        }
+      }
+    }
+    #pragma omp critical
+    diff_hist.merge(thread_diff_hist);
+  }
+  if (diff_hist.count() == 0)
+    vw::vw_throw(vw::ArgumentErr() << "No valid pixels found in median calculation.\n");
+  double median = diff_hist.quantile(0.5);
+  double mad = vw::normalizedMad(diff_hist, median);
+  double mad_min = median - outlierFactor * mad;
+  double mad_max = median + outlierFactor * mad;
+  
+  // Second pass: the median difference and slope, and the mean and standard
+  // deviation of the values to fit. The latter are merged across threads with
+  // the formula of Chan et al., for accuracy. The values to fit are not defined
+  // where the slope is zero, as for computeNuthOffset().
+  int col_rate = std::max(ref.cols() / ECEF_SAMPLE_GRID, 1);
+  int row_rate = std::max(ref.rows() / ECEF_SAMPLE_GRID, 1);
+  ecef_samples.clear();
+  vw::UniformHistogram filtered_diff_hist(-max_vert_offset, max_vert_offset, numHistBins);
+  vw::UniformHistogram slope_hist(slope_lim[0], slope_lim[1], numHistBins);
+  long long count_y = 0;
+  double mean_y = 0.0, sum_sq_y = 0.0;
+  #pragma omp parallel
+  {
+    vw::UniformHistogram thread_diff_hist(-max_vert_offset, max_vert_offset, numHistBins);
+    vw::UniformHistogram thread_slope_hist(slope_lim[0], slope_lim[1], numHistBins);
+    std::vector<vw::Vector3> thread_samples;
+    long long thread_count = 0;
+    double thread_mean = 0.0, thread_sum_sq = 0.0;
+    #pragma omp for schedule(dynamic)
+    for (int it = 0; it < num_tiles; it++) {
+      vw::BBox2i const& tile = tiles[it];
+      NuthTileData local;
+      NuthTileData & t = use_cache ? cache[it] : local;
+      if (!use_cache)
+        nuthTile(ref, src, ref_georef, src_georef, tile, 
+                 dx_total, dy_total, dz_total, max_vert_offset, slope_lim,
+                 t.ref_tile, t.diff, t.slope, t.aspect); // outputs
+      // These filters change the cached tile. That is fine, as the third pass
+      // applies the same ones.
+      vw::ImageView<vw::PixelMask<float>> & ref_tile = t.ref_tile, & diff = t.diff,
+        & slope = t.slope, & aspect = t.aspect;
+      vw::rangeFilter(diff, mad_min, mad_max);
+      vw::intersectValid(diff, slope);
+      vw::intersectValid(diff, aspect);
+      
+      for (int col = 0; col < tile.width(); col++) {
+        for (int row = 0; row < tile.height(); row++) {
+          if (is_valid(slope(col, row)))
+            thread_slope_hist.add(slope(col, row).child());
+          if (!is_valid(diff(col, row)))
+            continue;
+          thread_diff_hist.add(diff(col, row).child());
+          
+          int global_col = col + tile.min().x(), global_row = row + tile.min().y();
+          if (global_col % col_rate == 0 && global_row % row_rate == 0 &&
+              is_valid(ref_tile(col, row)))
+            thread_samples.push_back(vw::Vector3(global_col, global_row, 
+                                                 ref_tile(col, row).child()));
+          
+          if (slope(col, row).child() == 0)
+            continue;
+          
+          // Update the mean and sum of squared deviations (Welford)
+          double y = diff(col, row).child() / tan(DegToRad(slope(col, row).child()));
+          thread_count++;
+          double delta = y - thread_mean;
+          thread_mean += delta / thread_count;
+          thread_sum_sq += delta * (y - thread_mean);
+        }
+      }
+    }
+    
+    #pragma omp critical
+    {
+      filtered_diff_hist.merge(thread_diff_hist);
+      slope_hist.merge(thread_slope_hist);
+      ecef_samples.insert(ecef_samples.end(), thread_samples.begin(), 
+                          thread_samples.end());
+      if (thread_count > 0) {
+        long long total = count_y + thread_count;
+        double delta = thread_mean - mean_y;
+        mean_y += delta * thread_count / total;
+        sum_sq_y += thread_sum_sq + delta * delta * count_y * thread_count / total;
+        count_y = total;
+      }
+    }
+  }
+  
+  // Important sanity check
+  int minCount = 100;
+  if (filtered_diff_hist.count() < minCount)
+    vw::vw_throw(vw::ArgumentErr() 
+                 << "Too little valid data left after filtering.\n");
+  
+  // Find the initial guess to fit_params
+  median_diff = filtered_diff_hist.quantile(0.5); // will return
+  double median_slope = slope_hist.quantile(0.5);
+  double c_seed = (median_diff/tan(DegToRad(median_slope)));
+  fit_params = vw::Vector3(0, 0, c_seed); // will update later and return
+  
+  // Filter outliers in y by mean and std dev
+  double std_dev_y = sqrt(sum_sq_y / count_y);
+  double rmin = mean_y - outlierFactor * std_dev_y;
+  double rmax = mean_y + outlierFactor * std_dev_y;
+  if (rmin >= rmax) {
+    // All values are the same. The histograms need a non-empty range.
+    rmin -= 1.0;
+    rmax += 1.0;
+  }
+  
+  // Third pass: bin the values to fit by aspect, and find the count and
+  // median for each bin
+  int numBins = 360;
+  vw::Vector2 binRange(0.0, numBins);
+  double bin_width = (binRange[1] - binRange[0]) / numBins;
+  std::vector<double> bin_count(numBins, 0.0), bin_median(numBins, 0.0);
+  std::vector<double> bin_centers(numBins);
+  for (int i = 0; i < numBins; i++)
+    bin_centers[i] = binRange[0] + (i + 0.5) * bin_width;
+  std::vector<vw::UniformHistogram> bin_hists(numBins, 
+                                             vw::UniformHistogram(rmin, rmax,
+                                                                  numBinHistBins));
+  #pragma omp parallel
+  {
+    std::vector<vw::UniformHistogram> 
+      thread_bin_hists(numBins, vw::UniformHistogram(rmin, rmax, numBinHistBins));
+    #pragma omp for schedule(dynamic)
+    for (int it = 0; it < num_tiles; it++) {
+      NuthTileData local;
+      NuthTileData & t = use_cache ? cache[it] : local;
+      if (!use_cache)
+        nuthTile(ref, src, ref_georef, src_georef, tiles[it], 
+                 dx_total, dy_total, dz_total, max_vert_offset, slope_lim,
+                 t.ref_tile, t.diff, t.slope, t.aspect); // outputs
+      vw::ImageView<vw::PixelMask<float>> & diff = t.diff, & slope = t.slope,
+        & aspect = t.aspect;
+      vw::rangeFilter(diff, mad_min, mad_max);
+      vw::intersectValid(diff, slope);
+      vw::intersectValid(diff, aspect);
+      
+      for (int col = 0; col < diff.cols(); col++) {
+        for (int row = 0; row < diff.rows(); row++) {
+          if (!is_valid(diff(col, row)) || slope(col, row).child() == 0)
+            continue;
+          double y = diff(col, row).child() / tan(DegToRad(slope(col, row).child()));
+          double x = aspect(col, row).child();
+          if (y < rmin || y > rmax || x < binRange[0] || x > binRange[1])
+            continue;
+          int bin_index = (int)std::floor((x - binRange[0]) / bin_width);
+          bin_index = std::max(0, std::min(bin_index, numBins - 1));
+          thread_bin_hists[bin_index].add(y);
+        }
+      }
+    }
+    
+    #pragma omp critical
+    {
+      for (int i = 0; i < numBins; i++)
+        bin_hists[i].merge(thread_bin_hists[i]);
+    }
+  }
+  
+  for (int i = 0; i < numBins; i++) {
+    bin_count[i] = bin_hists[i].count();
+    if (bin_count[i] > 0)
+      bin_median[i] = bin_hists[i].quantile(0.5);
+  }
+  
+  // Find the best fit. This refines fit_params.
+  asp::nuthFit(bin_count, bin_centers, bin_median, opt.inner_iter, opt.num_threads,
+               fit_params);
+} // End function computeNuthOffsetTiled
+
 // Given a command-line string, form argc and argv. In addition to pointers,
 // will also store the strings in argv_str, to ensure permanence.
 void formArgcArgv(std::string const& cmd,
@@ -576,13 +944,22 @@ Eigen::MatrixXd nuthAlignment(std::string const& ref_file,
   if (opt.max_iter == 0)
     return ecef_transform;
   
-  // Load and prepare the data
-  vw::ImageView<vw::PixelMask<float>> ref, src;
+  // Prepare the data
+  vw::ImageViewRef<vw::PixelMask<float>> ref_disk, src_disk;
   double ref_nodata = -std::numeric_limits<double>::max();
   double src_nodata = ref_nodata;
   vw::cartography::GeoReference ref_georef, src_georef;
-  // start stopwatch
-  prepareData(opt, ref, src, ref_nodata, src_nodata, ref_georef, src_georef);
+  prepareData(opt, ref_disk, src_disk, ref_nodata, src_nodata, ref_georef, src_georef);
+
+  // Read the ref and source images fully in memory, for speed, unless
+  // processing them in tiles
+  vw::ImageView<vw::PixelMask<float>> ref, src;
+  if (opt.tile_size == 0) {
+    ref = copy(ref_disk);
+    src = copy(src_disk);
+  } else {
+    vw::vw_out() << "Processing the DEMs in tiles of size " << opt.tile_size << ".\n";
+  }
   
   // Initialize
   double dx_total = 0, dy_total = 0, dz_total = 0;
@@ -591,15 +968,22 @@ Eigen::MatrixXd nuthAlignment(std::string const& ref_file,
   int iter = 1;
   double change_len = -1.0;
   vw::ImageView<vw::PixelMask<float>> diff;
+  std::vector<vw::Vector3> ecef_samples;
   
   vw::vw_out() << "Iteration and change in transform (meters)\n";
   while (1) {
     
     // Compute the Nuth offset
-    computeNuthOffset(opt, ref, src, ref_georef, src_georef, ref_nodata, src_nodata,
-                      opt.max_horiz_offset, opt.max_vert_offset, opt.slope_lim,
-                      dx_total, dy_total, dz_total, 
-                      diff, fit_params, median_diff); // outputs
+    if (opt.tile_size == 0)
+      computeNuthOffset(opt, ref, src, ref_georef, src_georef, ref_nodata, src_nodata,
+                        opt.max_horiz_offset, opt.max_vert_offset, opt.slope_lim,
+                        dx_total, dy_total, dz_total, 
+                        diff, fit_params, median_diff); // outputs
+    else
+      computeNuthOffsetTiled(opt, ref_disk, src_disk, ref_georef, src_georef,
+                             opt.max_horiz_offset, opt.max_vert_offset, opt.slope_lim,
+                             dx_total, dy_total, dz_total, 
+                             ecef_samples, fit_params, median_diff); // outputs
     
     // Note: minus signs here since we are computing dz = src-ref, but adjusting src
     double dx = -fit_params[0] * sin(DegToRad(fit_params[1]));
@@ -631,8 +1015,10 @@ Eigen::MatrixXd nuthAlignment(std::string const& ref_file,
       << "Total horizontal offset is: " << horiz_total << " meters. It exceeds the "
       << "specified max horizontal offset: " << opt.max_horiz_offset << " meters. Consider increasing the --max-horizontal-offset value.\n";
     
-  // Compute the ECEF transform
-  calcEcefTransform(ref, diff, ref_georef, dx_total, dy_total, dz_total, 
+  // Compute the ECEF transform. With tiles, the samples are found above.
+  if (opt.tile_size == 0)
+    ecefSamplePixels(ref, diff, ecef_samples);
+  calcEcefTransform(ecef_samples, ref_georef, dx_total, dy_total, dz_total, 
                     opt.compute_translation_only,
                     ecef_transform); // output 
      
@@ -25,6 +25,17 @@
 #include <pdal/PDALUtils.hpp>
 #include <pointmatcher/PointMatcher.h>
 
+#include <boost/filesystem.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
 namespace asp {
 
 using namespace vw;
@@ -781,4 +792,164 @@ void filterPointsByError(DP & point_cloud, Eigen::MatrixXd &errors, double cutof
 
 }
 
+// Layout of the reference cloud cache, in host byte order:
+//   magic "ASPRCC01", key length (uint64), key, padded to a multiple of 8
+//   rows, cols, is_lola_rdr_format (uint64), shift (3 doubles),
+//   median longitude (double), features (rows * cols doubles, column-major)
+const char REF_CACHE_MAGIC[] = "ASPRCC01";
+const size_t REF_CACHE_MAGIC_LEN = 8;
+
+std::string ref_cloud_cache_key(std::string const& file_name,
+                                std::int64_t num_points_to_load,
+                                vw::BBox2 const& copc_win, bool copc_read_all,
+                                vw::cartography::GeoReference const& geo,
+                                std::string const& csv_format_str,
+                                std::string const& csv_srs) {
+  std::ostringstream os;
+  os.precision(17);
+  os << "file: " << fs::absolute(file_name).string() << " " << fs::file_size(file_name)
+     << " " << fs::last_write_time(file_name) << "\n";
+  os << "num_points: " << num_points_to_load << "\n";
+  os << "copc_win: " << copc_win << " " << copc_read_all << "\n";
+  os << "datum: " << geo.datum() << "\n";
+  os << "csv: " << csv_format_str << " " << csv_srs << "\n";
+  return os.str();
+}
+
+std::string ref_cloud_cache_file(std::string const& cache_prefix,
+                                 std::string const& key) {
+
+  // FNV-1a hash of the key
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (size_t it = 0; it < key.size(); it++) {
+    hash ^= static_cast<unsigned char>(key[it]);
+    hash *= 1099511628211ULL;
+  }
+  std::ostringstream os;
+  os << std::hex << std::setw(16) << std::setfill('0') << hash;
+
+  fs::path path(cache_prefix);
+  return (path.parent_path() /
+          (path.stem().string() + "-" + os.str() + path.extension().string())).string();
+}
+
+bool read_ref_cloud_cache(std::string const& cache_file, std::string const& key,
+                          vw::Vector3 & shift, bool & is_lola_rdr_format,
+                          double & median_longitude, DP & data) {
+
+  std::ifstream in(cache_file.c_str(), std::ios::binary);
+  if (!in.good())
+    return false;
+  in.seekg(0, std::ios::end);
+  std::uint64_t size = in.tellg(), pos = 0;
+  in.seekg(0, std::ios::beg);
+  auto read = [&](void * val, std::uint64_t len) {
+    if (pos + len > size)
+      return false;
+    in.read(reinterpret_cast<char*>(val), len);
+    pos += len;
+    return bool(in);
+  };
+
+  char magic[REF_CACHE_MAGIC_LEN];
+  std::uint64_t key_len = 0;
+  if (!read(magic, REF_CACHE_MAGIC_LEN) ||
+      std::memcmp(magic, REF_CACHE_MAGIC, REF_CACHE_MAGIC_LEN) != 0 ||
+      !read(&key_len, sizeof(key_len)) || key_len != key.size())
+    return false;
+  std::string file_key(key_len, '\0');
+  if (!read(&file_key[0], key_len) || file_key != key)
+    return false;
+  pos = (pos + 7) / 8 * 8;
+  in.seekg(pos, std::ios::beg);
+
+  std::uint64_t rows = 0, cols = 0, lola = 0;
+  double vals[4];
+  if (!read(&rows, sizeof(rows)) || !read(&cols, sizeof(cols)) ||
+      !read(&lola, sizeof(lola)) || !read(vals, sizeof(vals)) ||
+      rows != std::uint64_t(DIM + 1) || pos + rows * cols * sizeof(double) != size)
+    return false;
+
+  // Read the points directly into the output
+  data.featureLabels = form_labels(DIM);
+  data.features.resize(rows, cols);
+  if (!read(data.features.data(), rows * cols * sizeof(double)))
+    return false;
+  is_lola_rdr_format = (lola != 0);
+  shift = vw::Vector3(vals[0], vals[1], vals[2]);
+  median_longitude = vals[3];
+
+  return true;
+}
+
+void write_ref_cloud_cache(std::string const& cache_file, std::string const& key,
+                           vw::Vector3 const& shift, bool is_lola_rdr_format,
+                           double median_longitude, DP const& data) {
+
+  // Make the temporary file name unique, as several runs may write the same
+  // cache at the same time.
+  std::ostringstream os;
+  os << cache_file << ".tmp" << getpid();
+  std::string tmp_file = os.str();
+  {
+    std::ofstream out(tmp_file.c_str(), std::ios::binary);
+    if (!out.good())
+      vw::vw_throw(vw::ArgumentErr() << "Cannot write: " << tmp_file << "\n");
+
+    std::uint64_t key_len = key.size();
+    out.write(REF_CACHE_MAGIC, REF_CACHE_MAGIC_LEN);
+    out.write(reinterpret_cast<const char*>(&key_len), sizeof(key_len));
+    out.write(key.data(), key_len);
+    std::uint64_t pos = REF_CACHE_MAGIC_LEN + sizeof(key_len) + key_len;
+    const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    out.write(zeros, (8 - pos % 8) % 8);
+
+    std::uint64_t rows = data.features.rows(), cols = data.features.cols();
+    std::uint64_t lola = is_lola_rdr_format;
+    double vals[4] = {shift[0], shift[1], shift[2], median_longitude};
+    out.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+    out.write(reinterpret_cast<const char*>(&cols), sizeof(cols));
+    out.write(reinterpret_cast<const char*>(&lola), sizeof(lola));
+    out.write(reinterpret_cast<const char*>(vals), sizeof(vals));
+    out.write(reinterpret_cast<const char*>(data.features.data()),
+              rows * cols * sizeof(double));
+    bool good = out.good();
+    out.close();
+    if (!good) {
+      std::remove(tmp_file.c_str());
+      vw::vw_throw(vw::ArgumentErr() << "Failed writing: " << tmp_file << "\n");
+    }
+  }
+
+  if (std::rename(tmp_file.c_str(), cache_file.c_str()) != 0) {
+    std::remove(tmp_file.c_str());
+    vw::vw_throw(vw::ArgumentErr() << "Cannot write: " << cache_file << "\n");
+  }
+}
+
+void crop_to_lonlat_box(vw::BBox2 const& lonlat_box, vw::Vector3 const& shift,
+                        vw::cartography::Datum const& datum, DP & data) {
+
+  if (lonlat_box.empty())
+    return;
+
+  // Keep the points in the box, moving them towards the front. The box may
+  // differ by 360 degrees in longitude from the points.
+  std::int64_t count = 0;
+  for (std::int64_t col = 0; col < data.features.cols(); col++) {
+    vw::Vector3 xyz;
+    for (int row = 0; row < DIM; row++)
+      xyz[row] = data.features(row, col) + shift[row];
+    vw::Vector2 lonlat = subvector(datum.cartesian_to_geodetic(xyz), 0, 2);
+    if (!lonlat_box.contains(lonlat) &&
+        !lonlat_box.contains(lonlat + vw::Vector2(360, 0)) &&
+        !lonlat_box.contains(lonlat - vw::Vector2(360, 0)))
+      continue;
+    if (count != col)
+      data.features.col(count) = data.features.col(col);
+    count++;
+  }
+  data.features.conservativeResize(Eigen::NoChange, count);
+}
+
 } // end namespace asp
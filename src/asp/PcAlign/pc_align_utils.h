@@ -207,6 +207,43 @@ void read_georef(std::vector<std::string> const& clouds,
 void filterPointsByError(DP & point_cloud, Eigen::MatrixXd &errors,
                          double cutoff);
 
+/// A string identifying the reference cloud (via its size and modification
+/// time) and the options with which it is loaded. A cached reference cloud
+/// is used only if it was saved with the same key. The crop to the region
+/// shared with the source is not part of the key, as it is done after the
+/// cache is read, with crop_to_lonlat_box().
+std::string ref_cloud_cache_key(std::string const& file_name,
+                                std::int64_t num_points_to_load,
+                                vw::BBox2 const& copc_win, bool copc_read_all,
+                                vw::cartography::GeoReference const& geo,
+                                std::string const& csv_format_str,
+                                std::string const& csv_srs);
+
+/// The cache file for the given key. A hash of the key is inserted before the
+/// extension of the given name, so each set of options for loading the
+/// reference cloud has its own file.
+std::string ref_cloud_cache_file(std::string const& cache_prefix,
+                                 std::string const& key);
+
+/// Read the reference cloud, as returned by load_cloud(), from a cache file
+/// made by write_ref_cloud_cache(). Return false if the file does not exist,
+/// is not valid, or has a different key.
+bool read_ref_cloud_cache(std::string const& cache_file, std::string const& key,
+                          vw::Vector3 & shift, bool & is_lola_rdr_format,
+                          double & median_longitude, DP & data);
+
+/// Save the reference cloud as returned by load_cloud(). The data is written
+/// to a temporary file which is renamed at the end, so that concurrent runs
+/// never see a partially written cache.
+void write_ref_cloud_cache(std::string const& cache_file, std::string const& key,
+                           vw::Vector3 const& shift, bool is_lola_rdr_format,
+                           double median_longitude, DP const& data);
+
+/// Keep only the points in the given lon-lat box. The points are shifted by
+/// the given amount, as done by load_cloud(). Do nothing if the box is empty.
+void crop_to_lonlat_box(vw::BBox2 const& lonlat_box, vw::Vector3 const& shift,
+                        vw::cartography::Datum const& datum, DP & data);
+
 }
 
 #endif // #define __PC_ALIGN_UTILS_H__
@@ -0,0 +1,84 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/PcAlign/MaskedImageAlgs.h>
+
+#include <cstdlib>
+#include <limits>
+
+using namespace vw;
+
+TEST(MaskedImageAlgs, UniformHistogram) {
+
+  // One value in the middle of each bin, and some outside the range
+  UniformHistogram hist(0.0, 1000.0, 1000);
+  for (int it = 0; it < 1000; it++)
+    hist.add(it + 0.5);
+  hist.add(-1.0);
+  hist.add(1001.0);
+  hist.add(std::numeric_limits<double>::quiet_NaN());
+  EXPECT_EQ(hist.count(), 1000);
+
+  EXPECT_NEAR(hist.cdf(250.0), 250.0, 1e-8);
+  EXPECT_NEAR(hist.cdf(-5.0), 0.0, 1e-8);
+  EXPECT_NEAR(hist.cdf(5000.0), 1000.0, 1e-8);
+  for (double fraction = 0.1; fraction < 1.0; fraction += 0.1)
+    EXPECT_NEAR(hist.quantile(fraction), 1000.0 * fraction, 1.0);
+
+  // Merging the histograms of two halves gives the same result
+  UniformHistogram hist1(0.0, 1000.0, 1000), hist2(0.0, 1000.0, 1000);
+  for (int it = 0; it < 1000; it++)
+    (it % 2 == 0 ? hist1 : hist2).add(it + 0.5);
+  hist1.merge(hist2);
+  EXPECT_EQ(hist1.count(), hist.count());
+  for (double fraction = 0.1; fraction < 1.0; fraction += 0.1)
+    EXPECT_EQ(hist1.quantile(fraction), hist.quantile(fraction));
+
+  UniformHistogram other(0.0, 1000.0, 500), empty(0.0, 1.0, 10);
+  EXPECT_THROW(hist.merge(other), vw::ArgumentErr);
+  EXPECT_THROW(empty.quantile(0.5), vw::ArgumentErr);
+  EXPECT_THROW(UniformHistogram(1.0, 1.0, 10), vw::ArgumentErr);
+}
+
+TEST(MaskedImageAlgs, NormalizedMad) {
+
+  // Values roughly normally distributed, with some invalid ones
+  std::srand(1);
+  ImageView<PixelMask<float>> img(100, 100);
+  UniformHistogram hist(-50.0, 50.0, 100000);
+  for (int col = 0; col < img.cols(); col++) {
+    for (int row = 0; row < img.rows(); row++) {
+      double val = 0.0;
+      for (int it = 0; it < 12; it++)
+        val += double(std::rand()) / RAND_MAX;
+      img(col, row) = PixelMask<float>(5.0 * (val - 6.0) + 3.0);
+      if ((col + row) % 7 == 0)
+        img(col, row).invalidate();
+      else
+        hist.add(img(col, row).child());
+    }
+  }
+
+  // The histogram results agree with the exact ones within a few bin widths
+  double median = maskedMedian(img);
+  double hist_median = hist.quantile(0.5);
+  EXPECT_NEAR(hist_median, median, 0.01);
+  double mad = normalizedMad(img, median);
+  EXPECT_NEAR(normalizedMad(hist, hist_median), mad, 0.05);
+  EXPECT_NEAR(mad, 5.0, 0.5);
+}
@@ -0,0 +1,87 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/PcAlign/NuthAlignment.h>
+
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <vw/Image/ImageView.h>
+
+#include <cmath>
+
+using namespace vw;
+using namespace vw::test;
+
+// A hilly terrain, with slopes of various magnitudes and directions
+double terrainHeight(double x, double y) {
+  return 1000.0 + 100.0 * sin(x / 300.0) * cos(y / 250.0) + 50.0 * sin((x + 2.0 * y) / 170.0);
+}
+
+TEST(NuthAlignment, TiledAgreesWithInMemory) {
+
+  // A DEM with a 10 m grid in UTM
+  cartography::GeoReference georef;
+  georef.set_well_known_geogcs("WGS84");
+  georef.set_UTM(13, true);
+  Matrix3x3 tx = math::identity_matrix<3>();
+  tx(0, 0) = 10.0;
+  tx(1, 1) = -10.0;
+  tx(0, 2) = 500000.0;
+  tx(1, 2) = 4000000.0;
+  georef.set_transform(tx);
+
+  // The source DEM is the reference one shifted by a known amount
+  double sx = 7.0, sy = -4.0, sz = 3.0;
+  int cols = 200, rows = 150;
+  ImageView<float> ref(cols, rows), src(cols, rows);
+  for (int col = 0; col < cols; col++) {
+    for (int row = 0; row < rows; row++) {
+      double x = 10.0 * col, y = -10.0 * row;
+      ref(col, row) = terrainHeight(x, y);
+      src(col, row) = terrainHeight(x - sx, y - sy) + sz;
+    }
+  }
+  UnlinkName ref_file("nuth_ref.tif"), src_file("nuth_src.tif");
+  write_georeferenced_image(ref_file, ref, georef);
+  write_georeferenced_image(src_file, src, georef);
+
+  double max_displacement = 50.0;
+  int num_iter = 10, num_threads = 2;
+  bool translation_only = true;
+  Eigen::MatrixXd mem_trans
+    = asp::nuthAlignment(ref_file, src_file, "nuth", max_displacement, num_iter,
+                         num_threads, translation_only, "");
+  Eigen::MatrixXd tiled_trans
+    = asp::nuthAlignment(ref_file, src_file, "nuth", max_displacement, num_iter,
+                         num_threads, translation_only, "--tile-size 64");
+  // Without keeping the tiles in memory between the passes
+  Eigen::MatrixXd reread_trans
+    = asp::nuthAlignment(ref_file, src_file, "nuth", max_displacement, num_iter,
+                         num_threads, translation_only,
+                         "--tile-size 64 --tile-cache-mb 0");
+
+  // With tiles the medians are found with histograms, so the results agree
+  // only approximately
+  Eigen::Vector3d mem_shift = mem_trans.block(0, 3, 3, 1);
+  Eigen::Vector3d tiled_shift = tiled_trans.block(0, 3, 3, 1);
+  EXPECT_NEAR(mem_shift.norm(), sqrt(sx * sx + sy * sy + sz * sz), 1.0);
+  EXPECT_LT((mem_shift - tiled_shift).norm(), 0.2);
+  
+  // Keeping the tiles or reading them again gives the same result
+  EXPECT_LT((tiled_trans - reread_trans).norm(), 1e-8);
+}
@@ -0,0 +1,108 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <asp/PcAlign/pc_align_utils.h>
+
+#include <boost/filesystem.hpp>
+
+#include <sstream>
+#include <unistd.h>
+
+using namespace vw;
+
+TEST(PcAlignUtils, RefCloudCacheRoundTrip) {
+
+  asp::DP data;
+  data.featureLabels = asp::form_labels(asp::DIM);
+  int num = 5;
+  data.features.resize(asp::DIM + 1, num);
+  for (int col = 0; col < num; col++) {
+    for (int row = 0; row < asp::DIM; row++)
+      data.features(row, col) = 1.5 * col - 0.25 * row;
+    data.features(asp::DIM, col) = 1.0;
+  }
+  Vector3 shift(-1e6, 2e6, 3.5e6);
+  double median_longitude = -122.5;
+
+  // A key of length not a multiple of 8, to exercise the padding
+  std::string key = "file: ref.tif 12345\nnum_points: 1000\n";
+  std::string cache_file = "TestRefCloudCache.bin";
+  asp::write_ref_cloud_cache(cache_file, key, shift, true, median_longitude, data);
+
+  std::ostringstream os;
+  os << cache_file << ".tmp" << getpid();
+  EXPECT_FALSE(boost::filesystem::exists(os.str()));
+
+  asp::DP out_data;
+  Vector3 out_shift;
+  bool out_lola = false;
+  double out_lon = 0.0;
+  ASSERT_TRUE(asp::read_ref_cloud_cache(cache_file, key, out_shift, out_lola,
+                                        out_lon, out_data));
+  EXPECT_EQ(out_shift, shift);
+  EXPECT_TRUE(out_lola);
+  EXPECT_EQ(out_lon, median_longitude);
+  ASSERT_EQ(out_data.features.rows(), data.features.rows());
+  ASSERT_EQ(out_data.features.cols(), data.features.cols());
+  EXPECT_EQ((out_data.features - data.features).norm(), 0.0);
+
+  // A different key, or no file, is not a match
+  EXPECT_FALSE(asp::read_ref_cloud_cache(cache_file, key + "x", out_shift, out_lola,
+                                         out_lon, out_data));
+  EXPECT_FALSE(asp::read_ref_cloud_cache("TestNoSuchCache.bin", key, out_shift,
+                                         out_lola, out_lon, out_data));
+
+  boost::filesystem::remove(cache_file);
+}
+
+TEST(PcAlignUtils, CropToLonLatBox) {
+
+  cartography::Datum datum("WGS84");
+  Vector3 shift = datum.geodetic_to_cartesian(Vector3(179.0, 10.0, 0.0));
+
+  // Points on both sides of the antimeridian, shifted as when loaded
+  std::vector<Vector2> lonlat = {Vector2(178.5, 10.0), Vector2(179.5, 10.5),
+                                 Vector2(-179.5, 10.2), Vector2(179.5, 12.0),
+                                 Vector2(170.0, 10.0)};
+  asp::DP data;
+  data.featureLabels = asp::form_labels(asp::DIM);
+  data.features.resize(asp::DIM + 1, lonlat.size());
+  for (size_t col = 0; col < lonlat.size(); col++) {
+    Vector3 xyz = datum.geodetic_to_cartesian(Vector3(lonlat[col][0], lonlat[col][1],
+                                                      100.0)) - shift;
+    for (int row = 0; row < asp::DIM; row++)
+      data.features(row, col) = xyz[row];
+    data.features(asp::DIM, col) = 1.0;
+  }
+
+  // The box crosses 180 degrees, so the point at -179.5 is in it
+  BBox2 box(Vector2(178.0, 9.0), Vector2(181.0, 11.0));
+  asp::crop_to_lonlat_box(box, shift, datum, data);
+  ASSERT_EQ(data.features.cols(), 3);
+  for (int col = 0; col < 3; col++) {
+    Vector3 xyz;
+    for (int row = 0; row < asp::DIM; row++)
+      xyz[row] = data.features(row, col) + shift[row];
+    Vector3 llh = datum.cartesian_to_geodetic(xyz);
+    EXPECT_NEAR(llh[1], lonlat[col][1], 1e-8);
+  }
+
+  // An empty box keeps all points
+  asp::crop_to_lonlat_box(BBox2(), shift, datum, data);
+  EXPECT_EQ(data.features.cols(), 3);
+}
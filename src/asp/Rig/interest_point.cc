@@ -1049,6 +1049,7 @@ void detectMatchFeatures(// Inputs
          cams[it].image, verbose, &cid_to_descriptor_map[it], &cid_to_keypoint_map[it]);
     }
     thread_pool.Join();
+    thread_pool.PrintStats("Feature detection");
   }
 
   // Find which image pairs to match
@@ -1087,6 +1088,7 @@ void detectMatchFeatures(// Inputs
          &matches[pair]);
     }
     thread_pool.Join();
+    thread_pool.PrintStats("Feature matching");
   }
   cid_to_keypoint_map = std::vector<Eigen::Matrix2Xd>(); // wipe, no longer needed
   cid_to_descriptor_map = std::vector<cv::Mat>();  // Wipe, no longer needed
@@ -0,0 +1,98 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <Rig/thread.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+DECLARE_int32(num_threads);
+
+namespace {
+
+void squareTask(int val, int sleep_us, std::atomic<int> * num_running,
+                std::atomic<int> * max_running, int * out) {
+  int running = ++(*num_running);
+  int prev = max_running->load();
+  while (running > prev && !max_running->compare_exchange_weak(prev, running)) {}
+  std::this_thread::sleep_for(std::chrono::microseconds(sleep_us));
+  *out = val * val;
+  --(*num_running);
+}
+
+}
+
+// All tasks run, on no more threads than requested, also when more tasks are
+// added after a join, and when tasks of very different length are mixed.
+TEST(ThreadPool, RunsAllTasks) {
+
+  int num_threads = FLAGS_num_threads;
+  FLAGS_num_threads = 3;
+
+  {
+    rig::ThreadPool pool;
+    std::atomic<int> num_running(0), max_running(0);
+    int num = 200;
+    std::vector<int> out(2 * num, -1);
+    for (int it = 0; it < num; it++) {
+      int sleep_us = (it % 7 == 0) ? 2000 : 10;
+      pool.AddTask(&squareTask, it, sleep_us, &num_running, &max_running, &out[it]);
+    }
+    pool.Join();
+    for (int it = 0; it < num; it++)
+      EXPECT_EQ(out[it], it * it);
+    EXPECT_EQ(num_running.load(), 0);
+
+    for (int it = num; it < 2 * num; it++)
+      pool.AddTask(&squareTask, it, 10, &num_running, &max_running, &out[it]);
+    pool.Join();
+    for (int it = num; it < 2 * num; it++)
+      EXPECT_EQ(out[it], it * it);
+
+    EXPECT_GE(max_running.load(), 1);
+    EXPECT_LE(max_running.load(), 3);
+  }
+
+  FLAGS_num_threads = num_threads;
+}
+
+// The pending tasks finish before the pool is destroyed, with one thread
+// and with several.
+TEST(ThreadPool, DestructorJoins) {
+
+  int num_threads = FLAGS_num_threads;
+  int thread_counts[] = {1, 4};
+  for (int count: thread_counts) {
+    FLAGS_num_threads = count;
+    std::atomic<int> num_running(0), max_running(0);
+    int num = 50;
+    std::vector<int> out(num, -1);
+    {
+      rig::ThreadPool pool;
+      for (int it = 0; it < num; it++)
+        pool.AddTask(&squareTask, it, 100, &num_running, &max_running, &out[it]);
+    }
+    for (int it = 0; it < num; it++)
+      EXPECT_EQ(out[it], it * it);
+    EXPECT_LE(max_running.load(), count);
+  }
+
+  FLAGS_num_threads = num_threads;
+}
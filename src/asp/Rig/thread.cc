@@ -18,84 +18,126 @@
 
 #include <Rig/thread.h>
 
+#include <vw/Core/Log.h>
+
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
-#include <sys/time.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 #include <thread>
 
 DEFINE_int32(num_threads, (std::thread::hardware_concurrency() == 0 ?
                            8 : std::thread::hardware_concurrency()),
              "Number of threads to use.");
 
-void* rig::HolderFunction(void* ptr) {
-  rig::ThreadPool::VarsTuple* vars = reinterpret_cast<rig::ThreadPool::VarsTuple*>(ptr);
-
-  // Run the function
-  std::get<0>(*vars)();
-
-  // Set out boolean so someone can know they can delete this
-  std::get<3>(*vars) = true;
-
-  // Signal that we are finished
-  pthread_mutex_lock(std::get<1>(*vars));
-  pthread_cond_signal(std::get<2>(*vars));
-  pthread_mutex_unlock(std::get<1>(*vars));
-
-  return NULL;
+namespace {
+  double seconds(std::chrono::steady_clock::duration const& d) {
+    return std::chrono::duration<double>(d).count();
+  }
 }
 
 rig::ThreadPool::ThreadPool()
-  : max_concurrent_jobs_(FLAGS_num_threads) {
-  pthread_mutex_init(&cond_mutex_, NULL);
-  pthread_cond_init(&cond_, NULL);
-  if (max_concurrent_jobs_ <= 0) {
+  : num_threads_(std::max(FLAGS_num_threads, 0)), num_running_(0), stop_(false),
+    num_added_(0), num_done_(0), max_queue_depth_(0),
+    queue_depth_sum_(0.0), wait_seconds_(0.0), run_seconds_(0.0), max_run_seconds_(0.0) {
+
+  if (num_threads_ <= 0) {
     LOG(ERROR) << "Thread pool without threads created...";
+    num_threads_ = 1;
   }
+
+  // Keep a few tasks ready for each thread, but not so many that the
+  // copies of their arguments use up a lot of memory.
+  max_queued_tasks_ = 2 * num_threads_;
+
+  for (size_t it = 0; it < num_threads_; it++)
+    threads_.emplace_back(&rig::ThreadPool::WorkerLoop, this);
 }
 
 rig::ThreadPool::~ThreadPool() {
   Join();
-  pthread_cond_destroy(&cond_);
-  pthread_mutex_destroy(&cond_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cond_.notify_all();
+  for (size_t it = 0; it < threads_.size(); it++)
+    threads_[it].join();
 }
 
-void rig::ThreadPool::Join() {
-  while (threads_.size()) {
-    pthread_join(threads_.front(), NULL);
-    threads_.pop_front();
-    var_bindings_.pop_front();
+void rig::ThreadPool::Enqueue(std::function<void(void)> const& func) {
+  {
+    // Wait until there is room for one more task
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cond_.wait(lock, [this] { return tasks_.size() < max_queued_tasks_; });
+    if (num_added_ == 0)
+      first_add_time_ = Clock::now();
+    tasks_.push_back(Task{func, Clock::now()});
+    num_added_++;
+    max_queue_depth_ = std::max(max_queue_depth_, tasks_.size());
+    queue_depth_sum_ += tasks_.size();
   }
+  work_cond_.notify_one();
 }
 
-void rig::ThreadPool::WaitTillJobOpening() {
-  while (threads_.size() >= max_concurrent_jobs_) {
-    // Wait for a condition event to signal a free job or time out
-    // after one second. I do a time out because somehow I still have
-    // a deadlock. I think it occurs if a task just finishes faster
-    // than we can get back into a state to wait for condition.
-    pthread_mutex_lock(&cond_mutex_);
-    struct timeval tv;
-    struct timespec ts;
-    gettimeofday(&tv, NULL);
-    ts.tv_sec = tv.tv_sec + 1;
-    ts.tv_nsec = 0;
-    pthread_cond_timedwait(&cond_, &cond_mutex_, &ts);
-    pthread_mutex_unlock(&cond_mutex_);
-
-    // Iterate through and clean out all the finished jobs
-    std::list<pthread_t>::iterator thread_it = threads_.begin();
-    std::list<VarsTuple>::iterator vars_it = var_bindings_.begin();
-    while (thread_it != threads_.end()) {
-      if (std::get<3>(*vars_it)) {
-        // Thread says it has finished. Join.
-        pthread_join(*thread_it, NULL);
-        thread_it = threads_.erase(thread_it);
-        vars_it = var_bindings_.erase(vars_it);
-      } else {
-        thread_it++;
-        vars_it++;
-      }
+void rig::ThreadPool::WorkerLoop() {
+
+  while (1) {
+
+    // Wait for a task, and take it
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cond_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty())
+        return; // stopping and no work left
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+      num_running_++;
+    }
+    // There is room for one more task
+    done_cond_.notify_all();
+
+    Clock::time_point beg = Clock::now();
+    task.func();
+    Clock::time_point end = Clock::now();
+
+    // Free the arguments before announcing the task is done
+    task.func = std::function<void(void)>();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      num_running_--;
+      num_done_++;
+      wait_seconds_ += seconds(beg - task.add_time);
+      double run_seconds = seconds(end - beg);
+      run_seconds_ += run_seconds;
+      max_run_seconds_ = std::max(max_run_seconds_, run_seconds);
+      last_done_time_ = end;
     }
+    done_cond_.notify_all();
   }
 }
+
+void rig::ThreadPool::Join() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cond_.wait(lock, [this] { return tasks_.empty() && num_running_ == 0; });
+}
+
+void rig::ThreadPool::PrintStats(std::string const& name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  double n = std::max(num_done_, size_t(1));
+  double elapsed = (num_done_ > 0) ? seconds(last_done_time_ - first_add_time_) : 0.0;
+  std::ostringstream oss;
+  oss << std::setprecision(4) << name << ": " << num_done_ << " tasks on "
+     << num_threads_ << " threads. "
+     << "Mean wait: " << wait_seconds_ / n << " s. "
+     << "Mean run time: " << run_seconds_ / n << " s. "
+     << "Max run time: " << max_run_seconds_ << " s. "
+     << "Mean queue depth: " << queue_depth_sum_ / std::max(num_added_, size_t(1)) << ". "
+     << "Max queue depth: " << max_queue_depth_ << ". "
+     << "Elapsed time: " << elapsed << " s.\n";
+  vw::vw_out(vw::DebugMessage, "asp") << oss.str();
+}
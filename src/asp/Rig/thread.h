@@ -20,10 +20,15 @@
 #define RIG_CALIBRATOR_THREAD_H
 
 #include <gflags/gflags.h>
-#include <pthread.h>
 
-#include <list>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define GOOGLE_ALLOW_RVALUE_REFERENCES_PUSH
 #define GOOGLE_ALLOW_RVALUE_REFERENCES_POP
@@ -32,12 +37,11 @@ GOOGLE_ALLOW_RVALUE_REFERENCES_PUSH
 
 namespace rig {
 
-  void* HolderFunction(void* ptr);
-
+  // A pool of --num_threads worker threads, which are created once and
+  // live as long as the pool. The workers take the tasks from a shared
+  // queue, in the order in which they were added.
   class ThreadPool {
    public:
-    typedef std::tuple<std::function<void(void)>, pthread_mutex_t*, pthread_cond_t*, bool> VarsTuple;
-
     ThreadPool();
     ~ThreadPool();
     // The following identifies this thread as non copyable and non
@@ -47,8 +51,9 @@ namespace rig {
     ThreadPool& operator=(const ThreadPool&) = delete;
 
     // This pushes back a function and it's arguments to be
-    // executed. This method will block if the number of threads is
-    // already maxed. You can also push back mixed types of functions.
+    // executed. This method will block if many tasks are already
+    // waiting to be executed, to limit the memory used by their
+    // arguments. You can also push back mixed types of functions.
     //
     // Example:
     // void Monkey(std::vector const& input, int val, std::vector * output);
@@ -59,28 +64,43 @@ namespace rig {
     // will be copied. Other alternatives are to use a pointer.
     template <typename Function, typename... Args>
     void AddTask(Function&& f, Args&&... args) {
-      WaitTillJobOpening();
-
       // Bind up the function the user has given us
-      var_bindings_.emplace_back(std::bind(f, args...),
-                                 &cond_mutex_,
-                                 &cond_, false);
-
-      // Create the thread and start doing work
-      threads_.push_back(pthread_t());
-      pthread_create(&threads_.back(), NULL, HolderFunction, &var_bindings_.back());
+      Enqueue(std::bind(f, args...));
     }
 
+    // Wait until all the tasks added so far are done. More tasks can
+    // be added after this.
     void Join();
 
-   private:
-    void WaitTillJobOpening();
+    // Log the number of tasks, how long they waited in the queues and
+    // ran, the queue depth, and the elapsed time, as debug messages.
+    void PrintStats(std::string const& name) const;
 
-    size_t max_concurrent_jobs_;
-    std::list<pthread_t> threads_;
-    std::list<VarsTuple> var_bindings_;
-    pthread_mutex_t cond_mutex_;
-    pthread_cond_t cond_;
+   private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Task {
+      std::function<void(void)> func;
+      Clock::time_point add_time;
+    };
+
+    void Enqueue(std::function<void(void)> const& func);
+    void WorkerLoop();
+
+    size_t num_threads_, max_queued_tasks_;
+    std::vector<std::thread> threads_;
+
+    // Protects the queue and the counters below
+    mutable std::mutex mutex_;
+    std::condition_variable work_cond_, done_cond_;
+    std::deque<Task> tasks_;
+    size_t num_running_;
+    bool stop_;
+
+    // Statistics
+    size_t num_added_, num_done_, max_queue_depth_;
+    double queue_depth_sum_, wait_seconds_, run_seconds_, max_run_seconds_;
+    Clock::time_point first_add_time_, last_done_time_;
   };
 
 }  // namespace rig
@@ -22,27 +22,52 @@
 #include <asp/SfS/SfsCamera.h>
 #include <vw/Image/Interpolation.h>
 
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include <unistd.h>
+
 namespace asp {
 
 using namespace vw;
 
+// FNV-1a hash of some bytes, continuing from a given hash
+std::uint64_t fnv1aHash(void const* data, size_t len,
+                        std::uint64_t hash = 14695981039346656037ULL) {
+  unsigned char const* bytes = static_cast<unsigned char const*>(data);
+  for (size_t b = 0; b < len; b++) {
+    hash ^= bytes[b];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
 ApproxCameraModel::ApproxCameraModel(vw::camera::AdjustedCameraModel const& exact_camera,
                                      BBox2i img_bbox, 
                                      ImageView<double> const& dem,
                                      vw::cartography::GeoReference const& geo,
                                      double nodata_val,
-                                     vw::Mutex & camera_mutex):
+                                     vw::Mutex & camera_mutex,
+                                     std::string const& cache_prefix,
+                                     std::string const& cache_id):
     m_geo(geo), 
     m_camera_mutex(camera_mutex),
     m_exact_camera(exact_camera),
     m_img_bbox(img_bbox), 
-    m_model_is_valid(true) {
+    m_model_is_valid(true),
+    m_table_error(0.0), m_dem_error(0.0), m_loaded(false) {
 
   int big = 1e+8;
   m_uncompValue = Vector2(-big, -big);
   
-  // Compute the mean DEM height. We expect all DEM entries to be valid.
+  // Compute the mean and range of DEM heights. We expect all DEM entries
+  // to be valid.
   m_mean_ht = 0;
+  m_min_ht = std::numeric_limits<double>::max();
+  m_max_ht = -m_min_ht;
   double num = 0.0;
   for (int col = 0; col < dem.cols(); col++) {
     for (int row = 0; row < dem.rows(); row++) {
@@ -50,10 +75,13 @@ ApproxCameraModel::ApproxCameraModel(vw::camera::AdjustedCameraModel const& exac
         vw_throw( ArgumentErr()
                   << "ApproxCameraModel: Expecting a DEM without nodata values.\n");
       m_mean_ht += dem(col, row);
+      m_min_ht = std::min(m_min_ht, dem(col, row));
+      m_max_ht = std::max(m_max_ht, dem(col, row));
       num += 1.0;
     }
   }
   if (num > 0) m_mean_ht /= num;
+  else m_min_ht = m_max_ht = 0.0;
 
   // The area we're supposed to work around
   m_point_box = m_geo.pixel_to_point_bbox(bounding_box(dem));
@@ -88,6 +116,20 @@ ApproxCameraModel::ApproxCameraModel(vw::camera::AdjustedCameraModel const& exac
 
   m_begX = 0; m_endX = numx-1;
   m_begY = 0; m_endY = numy-1;
+
+  // See if this table was made before
+  if (!cache_prefix.empty()) {
+    m_key = cache_key(dem, nodata_val, cache_id);
+    std::ostringstream os;
+    os << cache_prefix << "-" << std::hex << fnv1aHash(m_key.data(), m_key.size())
+       << ".bin";
+    m_cache_file = os.str();
+    if (read_table(m_cache_file, m_key)) {
+      vw_out() << "Read approximate camera model: " << m_cache_file << std::endl;
+      m_loaded = true;
+      return;
+    }
+  }
   
   // Mark all values as uncomputed and invalid
   m_pixel_to_vec_mat.set_size(numx, numy);
@@ -109,8 +151,47 @@ ApproxCameraModel::ApproxCameraModel(vw::camera::AdjustedCameraModel const& exac
   
   m_crop_box.crop(m_img_bbox);
 
+  comp_table_error();
+  vw_out() << "Approximate model error at the centers of the table cells, "
+           << "for heights from " << m_min_ht << " to " << m_max_ht << ": "
+           << m_table_error << " pixels." << std::endl;
+
   return;
 } // End constructor
+
+// Call the exact camera. Only one thread can do that at a time.
+Vector2 ApproxCameraModel::exact_point_to_pixel(Vector3 const& xyz) const {
+  vw::Mutex::Lock lock(m_camera_mutex);
+  return m_exact_camera.point_to_pixel(xyz);
+}
+
+// Compare with the exact model at the centers of every other table cell,
+// in each direction, which is where interpolation is least accurate. The
+// table is for the mean DEM height, so also compare at the lowest and
+// highest DEM heights, where finding the ray to the table is least accurate.
+void ApproxCameraModel::comp_table_error() {
+
+  m_table_error = 0.0;
+  double heights[] = {m_min_ht, m_mean_ht, m_max_ht};
+  for (double ht: heights) {
+    for (int x = m_begX; x < m_endX; x += 2) {
+      for (int y = m_begY; y < m_endY; y += 2) {
+        Vector2 pt(m_point_box.min().x() + (x + 0.5)*m_approx_table_gridx,
+                   m_point_box.min().y() + (y + 0.5)*m_approx_table_gridy);
+        Vector2 lonlat = m_geo.point_to_lonlat(pt);
+        Vector3 xyz = m_geo.datum().geodetic_to_cartesian
+          (Vector3(lonlat[0], lonlat[1], ht));
+        try {
+          Vector2 exact_pix = exact_point_to_pixel(xyz);
+          Vector2 approx_pix = point_to_pixel(xyz);
+          m_table_error = std::max(m_table_error, norm_2(exact_pix - approx_pix));
+        } catch(...) {
+          // Points which do not project into the camera are not used
+        }
+      }
+    }
+  }
+}
       
 void ApproxCameraModel::comp_entries_in_table() const {    
   for (int x = m_begX; x <= m_endX; x++) {
@@ -130,6 +211,7 @@ void ApproxCameraModel::comp_entries_in_table() const {
       Vector2 pix;
       Vector3 vec;
       try {
+        vw::Mutex::Lock lock(m_camera_mutex);
         pix = m_exact_camera.point_to_pixel(xyz);
         //if (true || m_img_bbox.contains(pix))  // Need to think more here
         vec = m_exact_camera.pixel_to_vector(pix);
@@ -165,13 +247,14 @@ void ApproxCameraModel::comp_entries_in_table() const {
 // so we iterate to find it.
 vw::Vector2 ApproxCameraModel::point_to_pixel(Vector3 const& xyz) const {
 
-  // TODO: What happens if we use bicubic interpolation?
-  InterpolationView<EdgeExtensionView<ImageView<PixelMask<Vector3>>, ConstantEdgeExtension>, BilinearInterpolation> pixel_to_vec_interp
-    = interpolate(m_pixel_to_vec_mat, BilinearInterpolation(),
+  // Bicubic interpolation is more accurate than bilinear for the same
+  // table size, as the tabulated functions are smooth.
+  InterpolationView<EdgeExtensionView<ImageView<PixelMask<Vector3>>, ConstantEdgeExtension>, BicubicInterpolation> pixel_to_vec_interp
+    = interpolate(m_pixel_to_vec_mat, BicubicInterpolation(),
                   ConstantEdgeExtension());
 
-  InterpolationView<EdgeExtensionView<ImageView<PixelMask<Vector2>>, ConstantEdgeExtension>, BilinearInterpolation> point_to_pix_interp
-    = interpolate(m_point_to_pix_mat, BilinearInterpolation(),
+  InterpolationView<EdgeExtensionView<ImageView<PixelMask<Vector2>>, ConstantEdgeExtension>, BicubicInterpolation> point_to_pix_interp
+    = interpolate(m_point_to_pix_mat, BicubicInterpolation(),
                   ConstantEdgeExtension());
 
   Vector3 dir = m_mean_dir;
@@ -182,7 +265,7 @@ vw::Vector2 ApproxCameraModel::point_to_pixel(Vector3 const& xyz) const {
 
     Vector3 S = xyz - 1.1*major_radius*dir; // push the point outside the sphere
     if (norm_2(S) <= major_radius) // point is inside the sphere
-      return m_exact_camera.point_to_pixel(xyz);
+      return exact_point_to_pixel(xyz);
 
     Vector3 datum_pt 
       = vw::cartography::datum_intersection(major_radius, minor_radius, S, dir);
@@ -193,13 +276,14 @@ vw::Vector2 ApproxCameraModel::point_to_pixel(Vector3 const& xyz) const {
     double x = (pt.x() - m_point_box.min().x())/m_approx_table_gridx;
     double y = (pt.y() - m_point_box.min().y())/m_approx_table_gridy;
 
-    bool out_of_range = (x < m_begX || x >= m_endX-1 ||
-                         y < m_begY || y >= m_endY-1);
+    // Bicubic interpolation needs one more table entry on each side
+    bool out_of_range = (x < m_begX+1 || x >= m_endX-1 ||
+                         y < m_begY+1 || y >= m_endY-1);
 
     // If out of range, return the exact result. This should be very slow.
     // The hope is that it will be very rare.
     if (out_of_range)
-      return m_exact_camera.point_to_pixel(xyz);
+      return exact_point_to_pixel(xyz);
     
     PixelMask<Vector3> masked_dir = pixel_to_vec_interp(x, y);
     PixelMask<Vector2> masked_pix = point_to_pix_interp(x, y);
@@ -207,7 +291,7 @@ vw::Vector2 ApproxCameraModel::point_to_pixel(Vector3 const& xyz) const {
       dir = masked_dir.child();
       pix = masked_pix.child();
     } else {
-      return m_exact_camera.point_to_pixel(xyz);
+      return exact_point_to_pixel(xyz);
     }
   }
 
@@ -252,4 +336,187 @@ vw::camera::AdjustedCameraModel ApproxCameraModel::exact_camera() const {
   return m_exact_camera;
 }
 
+double ApproxCameraModel::table_error() const {
+  return m_table_error;
+}
+
+double & ApproxCameraModel::dem_error() {
+  return m_dem_error;
+}
+
+bool ApproxCameraModel::loaded() const {
+  return m_loaded;
+}
+
+// A string identifying all inputs that the table depends on. The DEM
+// values enter via a hash.
+std::string ApproxCameraModel::cache_key(ImageView<double> const& dem, double nodata_val,
+                                         std::string const& cache_id) const {
+
+  // Hash of the DEM values
+  std::uint64_t hash = fnv1aHash(NULL, 0);
+  for (int row = 0; row < dem.rows(); row++) {
+    for (int col = 0; col < dem.cols(); col++) {
+      double val = dem(col, row);
+      hash = fnv1aHash(&val, sizeof(val), hash);
+    }
+  }
+
+  std::ostringstream os;
+  os.precision(17);
+  os << "id: " << cache_id << "\n";
+  os << "image_box: " << m_img_bbox << "\n";
+  os << "dem: " << dem.cols() << " " << dem.rows() << " " << nodata_val << " "
+     << hash << "\n";
+  os << "georef: " << m_geo.get_wkt() << " " << m_geo.transform() << "\n";
+  os << "adjustment: " << m_exact_camera.translation() << " "
+     << m_exact_camera.rotation() << " " << m_exact_camera.pixel_offset() << " "
+     << m_exact_camera.scale() << "\n";
+  return os.str();
+}
+
+// Binary I/O of the table. The values are only for use on the same
+// machine, so no care is taken for portability.
+template<class T>
+void writeBinary(std::ofstream & ofs, T const& val) {
+  ofs.write(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+template<class T>
+bool readBinary(std::ifstream & ifs, T & val) {
+  ifs.read(reinterpret_cast<char*>(&val), sizeof(T));
+  return bool(ifs);
+}
+
+template<class PixelT>
+void writeMaskedTable(std::ofstream & ofs, ImageView<PixelMask<PixelT>> const& table) {
+  for (int x = 0; x < table.cols(); x++) {
+    for (int y = 0; y < table.rows(); y++) {
+      writeBinary(ofs, std::uint8_t(is_valid(table(x, y))));
+      for (size_t c = 0; c < table(x, y).child().size(); c++)
+        writeBinary(ofs, table(x, y).child()[c]);
+    }
+  }
+}
+
+template<class PixelT>
+bool readMaskedTable(std::ifstream & ifs, ImageView<PixelMask<PixelT>> & table) {
+  for (int x = 0; x < table.cols(); x++) {
+    for (int y = 0; y < table.rows(); y++) {
+      std::uint8_t valid = 0;
+      if (!readBinary(ifs, valid))
+        return false;
+      PixelT val;
+      for (size_t c = 0; c < val.size(); c++) {
+        if (!readBinary(ifs, val[c]))
+          return false;
+      }
+      table(x, y) = val;
+      if (!valid)
+        table(x, y).invalidate();
+    }
+  }
+  return true;
+}
+
+std::string const& ApproxCameraModel::cache_file() const {
+  return m_cache_file;
+}
+
+void ApproxCameraModel::write_table() const {
+
+  if (m_cache_file.empty())
+    vw_throw(ArgumentErr() << "No file was set for the approximate camera model.\n");
+
+  // Write to a temporary file first, and rename it at the end, so that another
+  // process never reads a partially written table
+  std::ostringstream os;
+  os << m_cache_file << ".tmp" << getpid();
+  std::string tmp_file = os.str();
+  {
+    std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+    if (!ofs.good())
+      vw_throw(ArgumentErr() << "Cannot write: " << tmp_file << "\n");
+
+    writeBinary(ofs, std::uint64_t(m_key.size()));
+    ofs.write(m_key.data(), m_key.size());
+    writeBinary(ofs, std::int32_t(m_pixel_to_vec_mat.cols()));
+    writeBinary(ofs, std::int32_t(m_pixel_to_vec_mat.rows()));
+    writeBinary(ofs, m_mean_dir[0]);
+    writeBinary(ofs, m_mean_dir[1]);
+    writeBinary(ofs, m_mean_dir[2]);
+    writeBinary(ofs, std::int32_t(m_count));
+    writeBinary(ofs, std::uint8_t(m_model_is_valid));
+    writeBinary(ofs, m_table_error);
+    writeBinary(ofs, m_dem_error);
+    writeBinary(ofs, std::uint8_t(m_crop_box.empty()));
+    for (int c = 0; c < 2; c++) {
+      writeBinary(ofs, m_crop_box.min()[c]);
+      writeBinary(ofs, m_crop_box.max()[c]);
+    }
+    writeMaskedTable(ofs, m_pixel_to_vec_mat);
+    writeMaskedTable(ofs, m_point_to_pix_mat);
+
+    if (!ofs.good())
+      vw_throw(ArgumentErr() << "Failed writing: " << tmp_file << "\n");
+  }
+
+  if (std::rename(tmp_file.c_str(), m_cache_file.c_str()) != 0) {
+    std::remove(tmp_file.c_str());
+    vw_throw(ArgumentErr() << "Cannot write: " << m_cache_file << "\n");
+  }
+  vw_out() << "Wrote approximate camera model: " << m_cache_file << std::endl;
+}
+
+// Read the table if made with the same key. The grid was set up already,
+// from the same inputs.
+bool ApproxCameraModel::read_table(std::string const& file, std::string const& key) {
+
+  std::ifstream ifs(file.c_str(), std::ios::binary);
+  if (!ifs.good())
+    return false;
+
+  std::uint64_t key_len = 0;
+  if (!readBinary(ifs, key_len) || key_len != key.size())
+    return false;
+  std::string file_key(key_len, '\0');
+  ifs.read(&file_key[0], key_len);
+  if (!ifs || file_key != key)
+    return false;
+
+  std::int32_t numx = 0, numy = 0, count = 0;
+  std::uint8_t is_valid = 0, empty_crop_box = 0;
+  Vector3 mean_dir;
+  double table_error = 0.0, dem_error = 0.0;
+  if (!readBinary(ifs, numx) || !readBinary(ifs, numy) ||
+      numx != m_endX - m_begX + 1 || numy != m_endY - m_begY + 1)
+    return false;
+  if (!readBinary(ifs, mean_dir[0]) || !readBinary(ifs, mean_dir[1]) ||
+      !readBinary(ifs, mean_dir[2]) || !readBinary(ifs, count) ||
+      !readBinary(ifs, is_valid) || !readBinary(ifs, table_error) ||
+      !readBinary(ifs, dem_error) || !readBinary(ifs, empty_crop_box))
+    return false;
+  Vector2 crop_min, crop_max;
+  for (int c = 0; c < 2; c++) {
+    if (!readBinary(ifs, crop_min[c]) || !readBinary(ifs, crop_max[c]))
+      return false;
+  }
+
+  m_pixel_to_vec_mat.set_size(numx, numy);
+  m_point_to_pix_mat.set_size(numx, numy);
+  if (!readMaskedTable(ifs, m_pixel_to_vec_mat) ||
+      !readMaskedTable(ifs, m_point_to_pix_mat))
+    return false;
+
+  m_mean_dir = mean_dir;
+  m_count = count;
+  m_model_is_valid = is_valid;
+  m_table_error = table_error;
+  m_dem_error = dem_error;
+  m_crop_box = BBox2();
+  if (!empty_crop_box)
+    m_crop_box = BBox2(crop_min, crop_max);
+
+  return true;
+}
+
 } // end namespace asp
@@ -27,13 +27,20 @@
 #include <vw/Core/Thread.h>
 #include <vw/Cartography/GeoReference.h>
 
+#include <string>
+
 namespace asp {
 
+// Tabulates the exact camera at the mean DEM height, on a grid somewhat
+// bigger than the DEM, and interpolates in that table with bicubic
+// interpolation. Calls to the exact camera are protected by a lock, so
+// this model can be used from multiple threads even if the exact camera
+// cannot. The table can be saved to disk and loaded on a later run.
 class ApproxCameraModel: public vw::camera::CameraModel {
 private:
   mutable vw::Vector3 m_mean_dir;  // mean vector from camera to ground
   vw::cartography::GeoReference m_geo;
-  double m_mean_ht;
+  double m_mean_ht, m_min_ht, m_max_ht;
   mutable vw::ImageView<vw::PixelMask<vw::Vector3>> m_pixel_to_vec_mat;
   mutable vw::ImageView<vw::PixelMask<vw::Vector2>> m_point_to_pix_mat;
   double m_approx_table_gridx, m_approx_table_gridy;
@@ -45,8 +52,17 @@ private:
   mutable vw::BBox2 m_point_box, m_crop_box;
   bool m_model_is_valid;
   vw::camera::AdjustedCameraModel m_exact_camera;
+  double m_table_error, m_dem_error;
+  bool m_loaded;
+  std::string m_key; // identifies the inputs, for saving and loading the table
+  std::string m_cache_file; // where the table is saved, with a hash of the key
 
   void comp_entries_in_table() const;
+  void comp_table_error();
+  vw::Vector2 exact_point_to_pixel(vw::Vector3 const& xyz) const;
+  std::string cache_key(vw::ImageView<double> const& dem, double nodata_val,
+                        std::string const& cache_id) const;
+  bool read_table(std::string const& file, std::string const& key);
 
 public:
 
@@ -55,7 +71,9 @@ public:
                     vw::ImageView<double> const& dem,
                     vw::cartography::GeoReference const& geo,
                     double nodata_val,
-                    vw::Mutex& camera_mutex);
+                    vw::Mutex& camera_mutex,
+                    std::string const& cache_prefix = "",
+                    std::string const& cache_id = "");
 
   virtual ~ApproxCameraModel() {}
 
@@ -68,6 +86,26 @@ public:
   vw::BBox2& crop_box();
   bool model_is_valid();
   vw::camera::AdjustedCameraModel exact_camera() const;
+
+  // The largest difference, in pixels, between this and the exact model,
+  // at the centers of the table cells, at the min, mean, and max DEM heights.
+  double table_error() const;
+
+  // The largest difference with the exact model at the DEM grid points.
+  // This is found by the caller, and kept here to be saved with the table.
+  double& dem_error();
+
+  // If the table, crop box, and DEM error were loaded from disk
+  bool loaded() const;
+
+  // The file for saving the table. It is the cache prefix passed in, followed
+  // by a hash of the key, so tables for different inputs do not overwrite
+  // each other. Empty if there is no cache prefix.
+  std::string const& cache_file() const;
+
+  // Save the table, crop box, and DEM error to cache_file(), with the key
+  // with which they will be looked up.
+  void write_table() const;
 };
 
 } // end namespace asp
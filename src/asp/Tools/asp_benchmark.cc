@@ -0,0 +1,275 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file asp_benchmark.cc
+///
+/// Time some functions against the ones they replace, such as batch versions
+/// against those processing one item at a time. This is a developer tool. The
+/// unit tests check only that the results agree.
+
+#include <asp/Core/Common.h>
+#include <asp/Core/Macros.h>
+#include <asp/Core/DescriptorMatcher.h>
+#include <asp/Core/Point2Grid.h>
+#include <asp/Camera/RPC_XML.h>
+#include <asp/Camera/RPCModel.h>
+
+#include <vw/Core/Settings.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Math/FLANNTree.h>
+
+#include <xercesc/util/PlatformUtils.hpp>
+
+#include <cstdlib>
+
+namespace po = boost::program_options;
+
+using namespace vw;
+
+struct Options: vw::GdalWriteOptions {
+  std::string benchmark, rpc_camera;
+  int num_points;
+  Options(): num_points(0) {}
+};
+
+void handle_arguments(int argc, char *argv[], Options& opt) {
+  po::options_description general_options("");
+  general_options.add_options()
+    ("rpc-camera", po::value(&opt.rpc_camera)->default_value(""),
+     "The RPC camera in XML format, for the rpc benchmark.")
+    ("num-points", po::value(&opt.num_points)->default_value(0),
+     "The number of points, pixels, or features to process. If not positive, use "
+     "1000000 for the rpc and point2grid benchmarks, and 10000 for "
+     "descriptor_matcher.");
+  general_options.add(vw::GdalWriteOptionsDescription(opt));
+
+  po::options_description positional("");
+  positional.add_options()
+    ("benchmark", po::value(&opt.benchmark));
+
+  po::positional_options_description positional_desc;
+  positional_desc.add("benchmark", 1);
+
+  std::string usage("[options] <benchmark>\n"
+                    "The benchmarks are: rpc, descriptor_matcher, point2grid.");
+  bool allow_unregistered = false;
+  std::vector<std::string> unregistered;
+  po::variables_map vm =
+    asp::check_command_line(argc, argv, opt, general_options, general_options,
+                            positional, positional_desc, usage,
+                            allow_unregistered, unregistered);
+
+  if (opt.benchmark == "")
+    vw_throw(ArgumentErr() << "No benchmark was specified.\n" << usage << general_options);
+  if (opt.num_points <= 0)
+    opt.num_points = (opt.benchmark == "descriptor_matcher") ? 10000 : 1000000;
+}
+
+// Time RPCModel::geodetic_to_pixels() and RPCModel::pixels_to_rays()
+// against geodetic_to_pixel() and point_and_dir() for each point.
+void rpc_benchmark(Options const& opt) {
+
+  if (opt.rpc_camera == "")
+    vw_throw(ArgumentErr() << "The rpc benchmark needs --rpc-camera.\n");
+
+  xercesc::XMLPlatformUtils::Initialize();
+  asp::RPCXML xml;
+  xml.read_from_file(opt.rpc_camera);
+  asp::RPCModel model(*xml.rpc_ptr());
+  xercesc::XMLPlatformUtils::Terminate();
+
+  // A grid of pixels over the image, and the ground points projecting
+  // into them at the height offset of the model
+  int side = std::max(1, int(round(sqrt(double(opt.num_points)))));
+  Vector2 xy_off = model.xy_offset(), xy_scale = model.xy_scale();
+  double h = model.lonlatheight_offset()[2];
+  std::vector<Vector2> pixels;
+  std::vector<Vector3> geodetic;
+  for (int r = 0; r < side; r++) {
+    for (int c = 0; c < side; c++) {
+      Vector2 pix(xy_off[0] + xy_scale[0] * (2.0 * c / side - 1.0),
+                  xy_off[1] + xy_scale[1] * (2.0 * r / side - 1.0));
+      Vector2 lonlat = model.image_to_ground(pix, h);
+      pixels.push_back(pix);
+      geodetic.push_back(Vector3(lonlat[0], lonlat[1], h));
+    }
+  }
+  int num = pixels.size();
+  vw_out() << "Number of points: " << num << "\n";
+
+  Stopwatch sw1;
+  sw1.start();
+  std::vector<Vector2> pixels1(num);
+  for (int it = 0; it < num; it++)
+    pixels1[it] = model.geodetic_to_pixel(geodetic[it]);
+  sw1.stop();
+
+  Stopwatch sw2;
+  sw2.start();
+  std::vector<Vector2> pixels2;
+  model.geodetic_to_pixels(geodetic, pixels2);
+  sw2.stop();
+
+  vw_out() << "geodetic_to_pixel: single time " << sw1.elapsed_seconds()
+           << " s, batch time " << sw2.elapsed_seconds() << " s.\n";
+
+  Stopwatch sw3;
+  sw3.start();
+  std::vector<Vector3> ctrs1(num), dirs1(num);
+  for (int it = 0; it < num; it++)
+    model.point_and_dir(pixels[it], ctrs1[it], dirs1[it]);
+  sw3.stop();
+
+  Stopwatch sw4;
+  sw4.start();
+  std::vector<Vector3> ctrs2, dirs2;
+  model.pixels_to_rays(pixels, ctrs2, dirs2);
+  sw4.stop();
+
+  vw_out() << "point_and_dir: single time " << sw3.elapsed_seconds()
+           << " s, batch time " << sw4.elapsed_seconds() << " s.\n";
+}
+
+// Time the brute-force descriptor matcher against FLANN, for the given
+// number of random float descriptors and fewer, to see where each one is
+// preferable.
+void descriptor_matcher_benchmark(Options const& opt) {
+
+  std::srand(1);
+  int k = 2, len = 128, num_threads = opt.num_threads;
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+
+  std::vector<int> counts;
+  for (int num = opt.num_points; num >= 1000 && counts.size() < 3; num /= 4)
+    counts.insert(counts.begin(), num);
+  if (counts.empty())
+    counts.push_back(opt.num_points);
+
+  for (int num: counts) {
+    Matrix<float> ref(num, len), query(num, len);
+    for (int r = 0; r < num; r++) {
+      for (int c = 0; c < len; c++) {
+        ref(r, c)   = float(std::rand()) / RAND_MAX;
+        query(r, c) = float(std::rand()) / RAND_MAX;
+      }
+    }
+
+    Stopwatch sw1;
+    sw1.start();
+    asp::BruteForceMatcher matcher;
+    matcher.loadMatchData(ref);
+    std::vector<int> indices;
+    std::vector<double> distances;
+    matcher.knnSearch(query, k, num_threads, indices, distances);
+    sw1.stop();
+
+    vw_out() << "Features: " << num << ", brute-force time with " << num_threads
+             << " threads: " << sw1.elapsed_seconds() << " s";
+
+    std::string methods[] = {"kdtree", "kmeans"};
+    for (std::string const& method: methods) {
+      Stopwatch sw2;
+      sw2.start();
+      math::FLANNTree<float> tree(method);
+      tree.load_match_data(ref, math::FLANN_DistType_L2);
+      Vector<int> tree_indices(k);
+      Vector<double> tree_distances(k);
+      Vector<float> descriptor(len);
+      for (int q = 0; q < num; q++) {
+        for (int c = 0; c < len; c++)
+          descriptor[c] = query(q, c);
+        tree.knn_search(descriptor, tree_indices, tree_distances, k);
+      }
+      sw2.stop();
+      vw_out() << ", FLANN " << method << " time: " << sw2.elapsed_seconds() << " s";
+    }
+    vw_out() << ".\n";
+  }
+}
+
+// Time Point2Grid against Point2GridBinned for each filter, gridding random
+// points over a tile.
+void point2grid_benchmark(Options const& opt) {
+
+  int width = 200, height = 150;
+  double x0 = 1000.0, y0 = -500.0, grid_size = 2.0, min_spacing = 2.0;
+  double radius = 2.5 * grid_size, sigma_factor = 0.0, percentile = 25.0;
+  double nodata = -1e+6;
+
+  // Points cover the grid and some margin around it
+  std::srand(42);
+  std::vector<Vector3> points(opt.num_points);
+  for (int it = 0; it < opt.num_points; it++) {
+    double u = double(std::rand()) / RAND_MAX, v = double(std::rand()) / RAND_MAX;
+    points[it] = Vector3(x0 - 10.0 + u * (width * grid_size + 20.0),
+                         y0 - 10.0 + v * (height * grid_size + 20.0),
+                         100.0 * double(std::rand()) / RAND_MAX);
+  }
+  vw_out() << "Number of points: " << opt.num_points << "\n";
+
+  asp::FilterType filters[] = {asp::f_weighted_average, asp::f_min, asp::f_max,
+                               asp::f_mean, asp::f_median, asp::f_stddev,
+                               asp::f_count, asp::f_nmad, asp::f_percentile};
+  for (asp::FilterType filter: filters) {
+
+    ImageView<double> buf1, wts1, buf2, wts2;
+    asp::Point2Grid p2g(width, height, buf1, wts1, x0, y0, grid_size, min_spacing,
+                        radius, sigma_factor, filter, percentile);
+    asp::Point2GridBinned p2gb(width, height, buf2, wts2, x0, y0, grid_size,
+                               min_spacing, radius, sigma_factor, filter, percentile);
+
+    Stopwatch sw1;
+    sw1.start();
+    p2g.Clear(nodata);
+    for (size_t it = 0; it < points.size(); it++)
+      p2g.AddPoint(points[it].x(), points[it].y(), points[it].z());
+    p2g.normalize();
+    sw1.stop();
+
+    Stopwatch sw2;
+    sw2.start();
+    p2gb.Clear(nodata);
+    for (size_t it = 0; it < points.size(); it++)
+      p2gb.AddPoint(points[it].x(), points[it].y(), points[it].z());
+    p2gb.normalize();
+    sw2.stop();
+
+    vw_out() << "Filter " << int(filter) << ": scatter time " << sw1.elapsed_seconds()
+             << " s, binned time " << sw2.elapsed_seconds() << " s.\n";
+  }
+}
+
+int main(int argc, char *argv[]) {
+
+  Options opt;
+  try {
+    handle_arguments(argc, argv, opt);
+
+    if (opt.benchmark == "rpc")
+      rpc_benchmark(opt);
+    else if (opt.benchmark == "descriptor_matcher")
+      descriptor_matcher_benchmark(opt);
+    else if (opt.benchmark == "point2grid")
+      point2grid_benchmark(opt);
+    else
+      vw_throw(ArgumentErr() << "Unknown benchmark: " << opt.benchmark << ".\n");
+
+  } ASP_STANDARD_CATCHES;
+
+  return 0;
+}
@@ -35,6 +35,7 @@
 #include <asp/Core/Macros.h>
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/IpMatchingAlgs.h>
+#include <asp/Core/MatchDb.h>
 #include <asp/Core/ImageUtils.h>
 #include <asp/Core/ImageNormalization.h>
 #include <asp/Core/OutlierProcessing.h>
@@ -43,6 +44,7 @@
 
 #include <vw/Camera/CameraUtilities.h>
 #include <vw/Core/CmdUtils.h>
+#include <vw/Core/Stopwatch.h>
 #include <vw/FileIO/MatrixIO.h>
 #include <vw/InterestPoint/MatcherIO.h>
 #include <vw/Cartography/GeoTransform.h>
@@ -108,7 +110,8 @@ int add_to_outliers(vw::ba::ControlNetwork & cnet,
                     size_t num_tri_residuals,
                     size_t num_cam_pos_residuals,
                     std::vector<vw::Vector3> const& reference_vec,
-                    ceres::Problem &problem) {
+                    ceres::Problem &problem,
+                    std::vector<ceres::ResidualBlockId> const* residual_blocks = NULL) {
 
   vw_out() << "Removing outliers.\n";
 
@@ -123,7 +126,7 @@ int add_to_outliers(vw::ba::ControlNetwork & cnet,
                     num_tri_residuals, num_cam_pos_residuals,
                     reference_vec, problem,
                     // output
-                    residuals);
+                    residuals, residual_blocks);
 
   // Compute the mean residual at each xyz, and how many times that residual is seen
   std::vector<double> mean_residuals;
@@ -302,28 +305,112 @@ int add_to_outliers(vw::ba::ControlNetwork & cnet,
 
 // End outlier functions
 
-// One pass of bundle adjustment
-int do_ba_ceres_one_pass(asp::BaOptions      & opt,
-                         asp::CRNJ      const& crn,
-                         bool                  first_pass,
-                         bool                  remove_outliers,
-                         asp::BAParams       & param_storage,
-                         asp::BAParams const & orig_parameters,
-                         bool                & convergence_reached,
-                         double              & final_cost) {
+// The optimization problem and its book-keeping. With --warm-start-passes
+// this is created on the first pass and reused in later passes, with the
+// residuals for outliers removed. Otherwise it is created anew for each pass.
+struct BaProblem {
+  boost::shared_ptr<ceres::Problem> problem;
+
+  // Needed for computing the residuals
+  std::vector<size_t> cam_residual_counts;
+  std::vector<std::map<int, vw::Vector2>> pixel_sigmas;
+  int num_gcp, num_gcp_or_dem_residuals, num_uncertainty_residuals,
+    num_cam_pos_residuals, num_tri_residuals;
+  std::vector<vw::Vector3> reference_vec; // must be persistent
+  std::vector<ImageViewRef<DispPixelT>> interp_disp; // must be persistent
+
+  // Used only with --warm-start-passes. The residual blocks in the order they
+  // were added, which Ceres does not preserve on removal, the blocks for the
+  // ground and triangulation constraints, the outliers the problem accounts
+  // for, and the trust region radius at the end of the previous pass.
+  std::vector<ceres::ResidualBlockId> residual_blocks;
+  std::set<ceres::ResidualBlockId> gcp_or_dem_blocks, tri_blocks;
+  std::vector<bool> outliers;
+  double trust_region_radius;
+
+  BaProblem(): num_gcp(0), num_gcp_or_dem_residuals(0), num_uncertainty_residuals(0),
+               num_cam_pos_residuals(0), num_tri_residuals(0),
+               trust_region_radius(0.0) {}
+};
+
+// Remove from the problem the residuals for the points that were flagged as
+// outliers since the last time this was called, and update the book-keeping.
+// Removing a point removes all residuals that depend on it. The camera
+// position constraints depend only on cameras, so they are kept as they are.
+void removeOutliersFromProblem(asp::BaOptions const& opt,
+                               asp::BAParams & param_storage,
+                               BaProblem & bp) {
+
+  ControlNetwork const& cnet = *opt.cnet;
+  int num_points = param_storage.num_points();
+
+  std::set<ceres::ResidualBlockId> removed_blocks;
+  int num_removed_points = 0;
+  for (int ipt = 0; ipt < num_points; ipt++) {
+    if (!param_storage.get_point_outlier(ipt) || bp.outliers[ipt])
+      continue;
+    bp.outliers[ipt] = true;
+
+    double * point = param_storage.get_point_ptr(ipt);
+    if (!bp.problem->HasParameterBlock(point))
+      continue; // Was never added
+
+    std::vector<ceres::ResidualBlockId> blocks;
+    bp.problem->GetResidualBlocksForParameterBlock(point, &blocks);
+    for (size_t it = 0; it < blocks.size(); it++) {
+      if (bp.gcp_or_dem_blocks.erase(blocks[it]) > 0)
+        bp.num_gcp_or_dem_residuals--;
+      else if (bp.tri_blocks.erase(blocks[it]) > 0)
+        bp.num_tri_residuals--;
+      removed_blocks.insert(blocks[it]);
+    }
+
+    // The remaining blocks are the reprojection errors
+    for (auto m = cnet[ipt].begin(); m != cnet[ipt].end(); m++) {
+      int icam = m->image_id();
+      if (bp.pixel_sigmas[icam].erase(ipt) > 0)
+        bp.cam_residual_counts[icam]--;
+    }
+
+    bp.problem->RemoveParameterBlock(point);
+    num_removed_points++;
+  }
+
+  if (num_removed_points == 0)
+    return;
+
+  std::vector<ceres::ResidualBlockId> residual_blocks;
+  for (size_t it = 0; it < bp.residual_blocks.size(); it++) {
+    if (removed_blocks.find(bp.residual_blocks[it]) == removed_blocks.end())
+      residual_blocks.push_back(bp.residual_blocks[it]);
+  }
+  bp.residual_blocks.swap(residual_blocks);
+
+  vw_out() << "Removed from the problem " << num_removed_points << " outlier points and "
+           << removed_blocks.size() << " residual blocks.\n";
+}
+
+// Add the various cost functions the solver will optimize over.
+void setupBaProblem(asp::BaOptions      & opt,
+                    asp::CRNJ      const& crn,
+                    asp::BAParams       & param_storage,
+                    asp::BAParams const & orig_parameters,
+                    BaProblem           & bp) {
 
   ControlNetwork & cnet = *opt.cnet;
   int num_cameras = param_storage.num_cameras();
   int num_points  = param_storage.num_points();
 
-  if ((int)crn.size() != num_cameras)
-    vw_throw(ArgumentErr() << "Book-keeping error, the size of CameraRelationNetwork "
-             << "must equal the number of images.\n");
-
-  convergence_reached = true;
-
-  if (opt.proj_win != BBox2(0, 0, 0, 0) && (!opt.proj_str.empty()))
-    initial_filter_by_proj_win(opt, param_storage, cnet);
+  bp = BaProblem();
+  ceres::Problem::Options problem_options;
+  if (opt.warm_start_passes) {
+    problem_options.enable_fast_removal = true; // for removing outliers
+    bp.outliers.resize(num_points);
+    for (int ipt = 0; ipt < num_points; ipt++)
+      bp.outliers[ipt] = param_storage.get_point_outlier(ipt);
+  }
+  bp.problem.reset(new ceres::Problem(problem_options));
+  ceres::Problem & problem = *bp.problem;
 
   // How many times an xyz point shows up in the problem
   std::vector<int> count_map(num_points);
@@ -371,27 +458,24 @@ int do_ba_ceres_one_pass(asp::BaOptions      & opt,
     vw::cartography::readGeorefImage(opt.weight_image,
       weight_image_nodata, weight_image_georef, weight_image);
 
-  // Add the various cost functions the solver will optimize over.
-  ceres::Problem problem;
-
   // Pixel reprojection error
-  std::vector<size_t> cam_residual_counts, num_pixels_per_cam;
+  std::vector<size_t> num_pixels_per_cam;
   std::vector<std::vector<vw::Vector2>> pixels_per_cam;
   std::vector<std::vector<vw::Vector3>> tri_points_per_cam;
-  std::vector<std::map<int, vw::Vector2>> pixel_sigmas;
   asp::addPixelReprojCostFun(opt, crn, count_map, weight_image, weight_image_georef,
                              dem_xyz_vec, have_weight_image, have_dem,
                              // Outputs
-                             cnet, param_storage, problem, cam_residual_counts,
+                             cnet, param_storage, problem, bp.cam_residual_counts,
                              num_pixels_per_cam, pixels_per_cam, tri_points_per_cam,
-                             pixel_sigmas);
+                             bp.pixel_sigmas);
 
   // Add ground control points or points based on a DEM constraint
-  int num_gcp = 0, num_gcp_or_dem_residuals = 0;
+  int beg_gcp_or_dem = problem.NumResidualBlocks();
   asp::addGcpOrDemConstraint(opt, opt.cost_function, opt.use_llh_error, opt.fix_gcp_xyz,
                              // Outputs
-                             cnet, num_gcp, num_gcp_or_dem_residuals,
+                             cnet, bp.num_gcp, bp.num_gcp_or_dem_residuals,
                              param_storage, problem);
+  int end_gcp_or_dem = problem.NumResidualBlocks();
 
   // Add camera constraints
   if (opt.camera_weight > 0) {
@@ -431,7 +515,6 @@ int do_ba_ceres_one_pass(asp::BaOptions      & opt,
   asp::calcOptimizedCameras(opt, orig_parameters, orig_cams); // orig cameras
   std::vector<vw::Vector3> orig_cam_positions;
   asp::calcCameraCenters(orig_cams, orig_cam_positions);
-  int num_uncertainty_residuals = 0;
   if (opt.camera_position_uncertainty.size() > 0) {
     for (int icam = 0; icam < num_cameras; icam++) {
       // orig_ctr has the actual camera center, but orig_cam_ptr may have an adjustment
@@ -447,33 +530,85 @@ int do_ba_ceres_one_pass(asp::BaOptions      & opt,
                                       opt.camera_position_uncertainty_power);
       ceres::LossFunction* loss_function = new ceres::TrivialLoss();
       problem.AddResidualBlock(cost_function, loss_function, cam_ptr);
-      num_uncertainty_residuals++;
+      bp.num_uncertainty_residuals++;
     }
   }
 
   // Add a soft constraint to keep the cameras near the original position. Add one
   // constraint per reprojection error.
-  int num_cam_pos_residuals = 0;
   if (opt.camera_position_weight > 0)
     asp::addCamPosCostFun(opt, orig_parameters, pixels_per_cam,
-                          tri_points_per_cam, pixel_sigmas, orig_cams,
-                          param_storage, problem, num_cam_pos_residuals);
+                          tri_points_per_cam, bp.pixel_sigmas, orig_cams,
+                          param_storage, problem, bp.num_cam_pos_residuals);
 
   // Add a cost function meant to tie up to known disparity
   // (option --reference-terrain).
-  std::vector<vw::Vector3> reference_vec; // must be persistent
-  std::vector<ImageViewRef<DispPixelT>> interp_disp; // must be persistent
   if (opt.reference_terrain != "")
     asp::addReferenceTerrainCostFunction(opt, param_storage, problem,
-                                         reference_vec, interp_disp);
+                                         bp.reference_vec, bp.interp_disp);
 
   // Add a ground constraints to keep points close to their initial positions
-  int num_tri_residuals = 0;
+  int beg_tri = problem.NumResidualBlocks();
   if (opt.tri_weight > 0)
     asp::addTriConstraint(opt, cnet, crn, opt.image_files, orig_cams,
                           opt.tri_weight, opt.cost_function, opt.tri_robust_threshold,
                           // Outputs
-                          param_storage, problem, num_tri_residuals);
+                          param_storage, problem, bp.num_tri_residuals);
+
+  if (!opt.warm_start_passes)
+    return;
+
+  // Record the residual blocks before any are removed, when they are still in
+  // the order they were added.
+  problem.GetResidualBlocks(&bp.residual_blocks);
+  for (int it = beg_gcp_or_dem; it < end_gcp_or_dem; it++)
+    bp.gcp_or_dem_blocks.insert(bp.residual_blocks[it]);
+  for (int it = beg_tri; it < int(bp.residual_blocks.size()); it++)
+    bp.tri_blocks.insert(bp.residual_blocks[it]);
+
+  // Some points may have been flagged as outliers after some of their
+  // residuals were added. Remove those.
+  removeOutliersFromProblem(opt, param_storage, bp);
+}
+
+// One pass of bundle adjustment. With --warm-start-passes, the problem from
+// the previous pass is reused.
+int do_ba_ceres_one_pass(asp::BaOptions      & opt,
+                         asp::CRNJ      const& crn,
+                         bool                  first_pass,
+                         bool                  remove_outliers,
+                         asp::BAParams       & param_storage,
+                         asp::BAParams const & orig_parameters,
+                         BaProblem           & bp,
+                         bool                & convergence_reached,
+                         double              & final_cost) {
+
+  ControlNetwork & cnet = *opt.cnet;
+  int num_cameras = param_storage.num_cameras();
+  int num_points  = param_storage.num_points();
+
+  if ((int)crn.size() != num_cameras)
+    vw_throw(ArgumentErr() << "Book-keeping error, the size of CameraRelationNetwork "
+             << "must equal the number of images.\n");
+
+  convergence_reached = true;
+
+  if (opt.proj_win != BBox2(0, 0, 0, 0) && (!opt.proj_str.empty()))
+    initial_filter_by_proj_win(opt, param_storage, cnet);
+
+  Stopwatch sw;
+  sw.start();
+  if (opt.warm_start_passes && bp.problem.get() != NULL)
+    removeOutliersFromProblem(opt, param_storage, bp);
+  else
+    setupBaProblem(opt, crn, param_storage, orig_parameters, bp);
+  sw.stop();
+  vw_out() << "Problem setup time: " << sw.elapsed_seconds() << " s." << std::endl;
+
+  ceres::Problem & problem = *bp.problem;
+  std::vector<ceres::ResidualBlockId> const* residual_blocks = NULL;
+  if (opt.warm_start_passes)
+    residual_blocks = &bp.residual_blocks;
 
   const size_t MIN_KML_POINTS = 50;
   size_t kmlPointSkip = 30;
@@ -494,11 +629,11 @@ int do_ba_ceres_one_pass(asp::BaOptions      & opt,
     vw_out() << "Writing initial condition files." << std::endl;
     std::string residual_prefix = opt.out_prefix + "-initial_residuals";
     write_residual_logs(residual_prefix, opt, param_storage,
-                        cam_residual_counts, pixel_sigmas,
-                        num_gcp_or_dem_residuals,
-                        num_uncertainty_residuals, num_tri_residuals,
-                        num_cam_pos_residuals,
-                        reference_vec, cnet, crn, problem);
+                        bp.cam_residual_counts, bp.pixel_sigmas,
+                        bp.num_gcp_or_dem_residuals,
+                        bp.num_uncertainty_residuals, bp.num_tri_residuals,
+                        bp.num_cam_pos_residuals,
+                        bp.reference_vec, cnet, crn, problem, residual_blocks);
 
     std::string point_kml_path  = opt.out_prefix + "-initial_points.kml";
     std::string url = "http://maps.google.com/mapfiles/kml/shapes/placemark_circle.png";
@@ -540,6 +675,10 @@ int do_ba_ceres_one_pass(asp::BaOptions      & opt,
   if (num_cameras > 7000)
     options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
 
+  // Continue from where the previous pass left off
+  if (opt.warm_start_passes && bp.trust_region_radius > 0)
+    options.initial_trust_region_radius = bp.trust_region_radius;
+
   //options.ordering_type = ceres::SCHUR;
   //options.eta = 1e-3; // FLAGS_eta;
   //options->max_solver_time_in_seconds = FLAGS_max_solver_time;
@@ -551,6 +690,8 @@ int do_ba_ceres_one_pass(asp::BaOptions      & opt,
   ceres::Solver::Summary summary;
   ceres::Solve(options, &problem, &summary);
   final_cost = summary.final_cost;
+  if (!summary.iterations.empty())
+    bp.trust_region_radius = summary.iterations.back().trust_region_radius;
   vw_out() << summary.FullReport() << "\n";
   if (summary.termination_type == ceres::NO_CONVERGENCE) {
     // Print a clarifying message, so the user does not think that the algorithm failed.
@@ -563,11 +704,11 @@ int do_ba_ceres_one_pass(asp::BaOptions      & opt,
   vw_out() << "Writing final condition log files." << std::endl;
   std::string residual_prefix = opt.out_prefix + "-final_residuals";
   write_residual_logs(residual_prefix, opt, param_storage,
-                      cam_residual_counts, pixel_sigmas,
-                      num_gcp_or_dem_residuals,
-                      num_uncertainty_residuals, num_tri_residuals,
-                      num_cam_pos_residuals,
-                      reference_vec, cnet, crn, problem);
+                      bp.cam_residual_counts, bp.pixel_sigmas,
+                      bp.num_gcp_or_dem_residuals,
+                      bp.num_uncertainty_residuals, bp.num_tri_residuals,
+                      bp.num_cam_pos_residuals,
+                      bp.reference_vec, cnet, crn, problem, residual_blocks);
 
   std::string point_kml_path = opt.out_prefix + "-final_points.kml";
   std::string url
@@ -579,9 +720,11 @@ int do_ba_ceres_one_pass(asp::BaOptions      & opt,
   if (remove_outliers)
       add_to_outliers(cnet, crn,
                       param_storage,   // in-out
-                      opt, cam_residual_counts, pixel_sigmas, num_gcp_or_dem_residuals,
-                      num_uncertainty_residuals, num_tri_residuals,
-                      num_cam_pos_residuals, reference_vec, problem);
+                      opt, bp.cam_residual_counts, bp.pixel_sigmas,
+                      bp.num_gcp_or_dem_residuals,
+                      bp.num_uncertainty_residuals, bp.num_tri_residuals,
+                      bp.num_cam_pos_residuals, bp.reference_vec, problem,
+                      residual_blocks);
 
   return 0;
 } // End function do_ba_ceres_one_pass
@@ -613,12 +756,14 @@ void runRandomPasses(asp::BaOptions & opt, asp::BAParams & param_storage,
     // Write output files to a temporary prefix
     opt.out_prefix = orig_out_prefix + "_rand";
 
-    // Do another pass of bundle adjustment.
+    // Do another pass of bundle adjustment. The cameras were perturbed,
+    // so the problem is always created anew.
     bool first_pass = true; // this needs more thinking
     bool convergence_reached = true;
     double curr_cost = 0.0; // will be set
+    BaProblem bp;
     do_ba_ceres_one_pass(opt, crn, first_pass, remove_outliers,
-                         param_storage, orig_parameters,
+                         param_storage, orig_parameters, bp,
                          convergence_reached, curr_cost);
 
     // Record the parameters of the best result.
@@ -682,15 +827,7 @@ void do_ba_ceres(asp::BaOptions & opt, std::vector<Vector3> const& estimated_cam
         asp::updateCameraPoses(world_to_cam, opt.camera_models);
     } else {
       // Read matches into a control network
-      bool triangulate_control_points = true;
-      bool success = vw::ba::build_control_network(triangulate_control_points,
-                                                   cnet, opt.camera_models,
-                                                   opt.image_files,
-                                                   opt.match_files,
-                                                   opt.min_matches,
-                                                   opt.min_triangulation_angle*(M_PI/180.0),
-                                                   opt.forced_triangulation_distance,
-                                                   opt.max_pairwise_matches);
+      bool success = asp::buildControlNetwork(opt, cnet);
       if (!success) {
         vw_out() << "Failed to build a control network.\n"
                  << " - Consider removing all .vwip and .match files and \n"
@@ -858,6 +995,7 @@ void do_ba_ceres(asp::BaOptions & opt, std::vector<Vector3> const& estimated_cam
 
   bool remove_outliers = (opt.num_passes > 1);
   double final_cost = 0.0;
+  BaProblem bp; // reused across passes with --warm-start-passes
   for (int pass = 0; pass < opt.num_passes; pass++) {
 
     if (opt.apply_initial_transform_only)
@@ -868,7 +1006,7 @@ void do_ba_ceres(asp::BaOptions & opt, std::vector<Vector3> const& estimated_cam
     bool first_pass = (pass == 0);
     bool convergence_reached = true; // will change
     do_ba_ceres_one_pass(opt, crn, first_pass, remove_outliers,
-                         param_storage, orig_parameters,
+                         param_storage, orig_parameters, bp,
                          convergence_reached, final_cost);
     int num_points_remaining = num_points - param_storage.get_num_outliers();
     if (num_points_remaining < opt.min_matches && num_gcp == 0) {
@@ -1026,6 +1164,11 @@ void handle_arguments(int argc, char *argv[], asp::BaOptions& opt) {
      "Choose a cost function from: Cauchy, PseudoHuber, Huber, L1, L2, Trivial.")
     ("robust-threshold", po::value(&opt.robust_threshold)->default_value(0.5),
      "Set the threshold for robust cost functions. Increasing this makes the solver focus harder on the larger errors.")
+    ("jacobian-method", po::value(&opt.jacobian_method)->default_value("numeric"),
+     "How to find the derivatives of the reprojection errors. Options: numeric, "
+     "analytic. The latter finds the derivatives in the camera position and "
+     "orientation from the ones in the triangulated point, so it needs fewer "
+     "projections into the cameras. Does not apply to the option --reference-terrain.")
     ("inline-adjustments",   po::bool_switch(&inline_adjustments)->default_value(false),
      "If this is set, and the input cameras are of the pinhole or panoramic type, apply "
      "the adjustments directly to the cameras, rather than saving them separately as "
@@ -1172,6 +1315,12 @@ void handle_arguments(int argc, char *argv[], asp::BaOptions& opt) {
      "Interest point detection algorithm (0: Integral OBALoG (default), 1: OpenCV SIFT, 2: OpenCV ORB.")
     ("epipolar-threshold",      po::value(&opt.epipolar_threshold)->default_value(-1),
      "Maximum distance from the epipolar line to search for IP matches. Default: automatic calculation. A higher values will result in more matches.")
+    ("epipolar-band-matching",
+     po::bool_switch(&opt.epipolar_band_matching)->default_value(false)->implicit_value(true),
+     "When matching interest points with the help of cameras and a datum, find the "
+     "epipolar line for each point first, then compare its descriptor only with those "
+     "of the points near that line, rather than with all of them. Much faster for many "
+     "features.")
     ("ip-inlier-factor",        po::value(&opt.ip_inlier_factor)->default_value(0.2),
      "A higher factor will result in more interest points, but perhaps also more outliers.")
     ("ip-uniqueness-threshold", po::value(&opt.ip_uniqueness_thresh)->default_value(0.8),
@@ -1293,6 +1442,13 @@ void handle_arguments(int argc, char *argv[], asp::BaOptions& opt) {
      "--remove-outliers-params, and re-optimization will take place. Residual files and a "
      "copy of the match files with the outliers removed (*-clean.match) will be written to "
      "disk.")
+    ("warm-start-passes",
+     po::bool_switch(&opt.warm_start_passes)->default_value(false)->implicit_value(true),
+     "Create the optimization problem only once, rather than for each pass. Between "
+     "passes, remove from it the residuals for the outliers, and continue from the "
+     "trust region radius the previous pass ended with. This saves time with many "
+     "passes and large problems. The constraints for triangulated points and camera "
+     "positions are not updated between passes.")
     ("num-random-passes",           po::value(&opt.num_random_passes)->default_value(0),
      "After performing the normal bundle adjustment passes, do this many more passes using the same matches but adding random offsets to the initial parameter values with the goal of avoiding local minima that the optimizer may be getting stuck in.")
     ("remove-outliers-params",
@@ -1316,6 +1472,13 @@ void handle_arguments(int argc, char *argv[], asp::BaOptions& opt) {
     ("clean-match-files-prefix",  po::value(&opt.clean_match_files_prefix)->default_value(""),
      "Use as input the *-clean.match file from this prefix (this had the "
      "outliers filtered out by bundle_adjust). See also match-files-prefix.")
+    ("match-db", po::value(&opt.match_db)->default_value(""),
+     "Read the interest point matches from this single-file match database, created "
+     "with match_db, rather than from individual match files. The matches are looked "
+     "up by the names the match files would have, per --match-files-prefix, "
+     "--clean-match-files-prefix, or the output prefix. Matches not in the database "
+     "are read from disk. The clean matches are saved to "
+     "<output prefix>-clean-matches.mdb.")
     ("update-isis-cubes-with-csm-state",
      po::bool_switch(&opt.update_isis_cubes_with_csm_state)->default_value(false)->implicit_value(true),
      "Save the model state of optimized CSM cameras as part of the .cub files. Any prior "
@@ -1430,7 +1593,9 @@ void handle_arguments(int argc, char *argv[], asp::BaOptions& opt) {
       "slower but deterministic, 'kdtree': faster (up to 6x) but not deterministic "
       "(starting with FLANN 1.9.2). The default ('auto') is to use 'kmeans' for "
       "25,000 features or less and 'kdtree' otherwise. This does not apply to ORB "
-      "feature matching.")
+      "feature matching. The option 'brute' compares all descriptors. It is exact "
+      "and deterministic, fast enough for up to about 100,000 features, and applies "
+      "also to ORB.")
     ("csv-proj4", po::value(&opt.csv_proj4_str)->default_value(""),
      "An alias for --csv-srs, for backward compatibility.")
     ("save-vwip", po::bool_switch(&opt.save_vwip)->default_value(false)->implicit_value(true),
@@ -1709,6 +1874,11 @@ void handle_arguments(int argc, char *argv[], asp::BaOptions& opt) {
     vw_throw(ArgumentErr() << "Solving for intrinsic parameters is only supported with "
               << "pinhole, optical bar, and CSM cameras.\n");
 
+  boost::to_lower(opt.jacobian_method);
+  if (opt.jacobian_method != "numeric" && opt.jacobian_method != "analytic")
+    vw_throw(ArgumentErr() << "Unknown value for --jacobian-method: "
+             << opt.jacobian_method << ".\n");
+
   if ((opt.camera_type!=BaCameraType_Pinhole) && opt.approximate_pinhole_intrinsics)
     vw_throw(ArgumentErr() << "Cannot approximate intrinsics unless using pinhole cameras.\n");
 
@@ -1997,6 +2167,9 @@ void handle_arguments(int argc, char *argv[], asp::BaOptions& opt) {
               << "Cannot specify both --match-files-prefix and "
               << "--clean-match-files-prefix.\n");
 
+  if (!opt.match_db.empty() && !fs::exists(opt.match_db))
+    vw_throw(ArgumentErr() << "Cannot find the match database: " << opt.match_db << ".\n");
+
   if (int(opt.proj_win != BBox2(0, 0, 0, 0)) + int(!opt.proj_str.empty()) == 1)
     vw_throw(ArgumentErr()
              << "Must specify both or neither of --proj-win and --proj-str.\n");
@@ -2521,14 +2694,23 @@ void findPairwiseMatches(asp::BaOptions & opt, // will change
 
   // When using match-files-prefix or clean_match_files_prefix, form the list of
   // match files, rather than searching for them exhaustively on disk, which can
-  // get very slow.
+  // get very slow. With a match database, the directory is listed only if it
+  // exists, for the matches not in the database.
   std::set<std::string> existing_files;
   if (external_matches && !need_no_matches) {
     std::string prefix = asp::match_file_prefix(opt.clean_match_files_prefix,
                                                 opt.match_files_prefix,
                                                 opt.out_prefix);
     vw_out() << "Computing the list of existing match files.\n";
-    asp::listExistingMatchFiles(prefix, existing_files);
+    std::string match_dir = fs::path(prefix).parent_path().string();
+    if (opt.match_db.empty() || match_dir.empty() || fs::exists(match_dir))
+      asp::listExistingMatchFiles(prefix, existing_files);
+  }
+  boost::shared_ptr<asp::MatchDb> match_db;
+  if (!opt.match_db.empty() && !need_no_matches) {
+    match_db.reset(new asp::MatchDb(opt.match_db));
+    vw_out() << "Read the index of " << match_db->size() << " match files from: "
+             << opt.match_db << "\n";
   }
 
   vw::cartography::GeoReference dem_georef;
@@ -2557,16 +2739,18 @@ void findPairwiseMatches(asp::BaOptions & opt, // will change
                             opt.out_prefix, image1_path, image2_path);
 
     // The external match file does not exist, don't try to load it
-    if (external_matches && existing_files.find(match_file) == existing_files.end())
+    bool in_db = (match_db && match_db->has(match_file));
+    if (external_matches && !in_db &&
+        existing_files.find(match_file) == existing_files.end())
       continue;
 
     opt.match_files[std::make_pair(i, j)] = match_file;
 
     // If we skip matching (which is the case, among other situations, when
     // using external matches), there's no point in checking if the match
-    // files are recent.
+    // files are recent. Matches in the database are always reused.
     bool inputs_changed = false;
-    if (!opt.skip_matching) {
+    if (!opt.skip_matching && !in_db) {
       inputs_changed = (!asp::first_is_newer(match_file,
                                              image1_path,  image2_path,
                                              camera1_path, camera2_path));
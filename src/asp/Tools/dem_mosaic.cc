@@ -26,7 +26,7 @@
 #include <asp/Core/GdalUtils.h>
 #include <asp/Core/DemMosaic.h>
 
-#include <vw/FileIO/DiskImageManager.h>
+#include <vw/Core/Stopwatch.h>
 #include <vw/Image/InpaintView.h>
 #include <vw/Image/Algorithms2.h>
 #include <vw/Image/Filter.h>
@@ -44,6 +44,7 @@
 #include <vector>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <limits>
 #include <algorithm>
@@ -56,148 +57,6 @@ namespace fs = boost::filesystem;
 // This is used for various tolerances
 double g_tol = 1e-6;
 
-// Compute a weight that is zero, then rises, plateaus, and then falls.
-// - hCenterLine contains the center column at each row/col
-// - hMaxDistArray contains the width of the column at each row/col
-// TODO(oalexan1): Move this to VW, and see about overwriting 
-// the other weight functions. The other one uses normalization, which is bad.
-double compute_plateaued_weights(Vector2 const& pix, bool horizontal,
-                                 std::vector<double> const& centers,
-                                 std::vector<double> const& widths,
-                                 double max_weight_val) {
-  
-  int primary_axis = 0, secondary_axis = 1; // Vertical
-  if (horizontal) {
-    primary_axis   = 1;
-    secondary_axis = 0;
-  }
-  
-  // We round below, to avoid issues when we are within numerical value
-  // to an integer value for row/col.
-  // To do: Need to do interpolation here.
-
-  int pos = (int)round(pix[primary_axis]); // The row or column
-  if (pos < 0 || pos >= (int)widths.size() || pos >= (int)centers.size())
-    return 0;
-  
-  double max_dist = widths[pos]/2.0; // Half column width
-  double center   = centers[pos];
-  double dist     = fabs(pix[secondary_axis]-center); // Pixel distance from center column
-
-  if (max_dist <= 0 || dist < 0)
-    return 0;
-
-  // We want to make sure the weight is positive (even if small) at
-  // the first/last valid pixel.
-  double tol = 1e-8*max_dist;
-  
-  // The weight is not normalized. This is a bugfix. Normalized weights result
-  // in higher weights in narrow regions, which is not what we want.
-  double weight = std::max(0.0, max_dist - dist + tol);
-  weight = std::min(max_weight_val, weight);
-
-  return weight;
-}
-
-// TODO(oalexan1): Fold modifications into VW.
-template<class ImageT>
-void centerline_weights2(ImageT const& img, ImageView<double> & weights,
-                         double max_weight_val, double hole_fill_value=0, 
-                         double border_fill_value=-1, BBox2i roi=BBox2i()) {
-
-  int numRows = img.rows();
-  int numCols = img.cols();
-
-  // Arrays to be returned out of this function
-  std::vector<double> hCenterLine  (numRows, 0);
-  std::vector<double> hMaxDistArray(numRows, 0);
-  std::vector<double> vCenterLine  (numCols, 0);
-  std::vector<double> vMaxDistArray(numCols, 0);
-
-  std::vector<int> minValInRow(numRows, 0);
-  std::vector<int> maxValInRow(numRows, 0);
-  std::vector<int> minValInCol(numCols, 0);
-  std::vector<int> maxValInCol(numCols, 0);
-
-  for (int k = 0; k < numRows; k++) {
-    minValInRow[k] = numCols;
-    maxValInRow[k] = 0;
-  }
-  for (int col = 0; col < numCols; col++) {
-    minValInCol[col] = numRows;
-    maxValInCol[col] = 0;
-  }
-
-  // Note that we do just a single pass through the image to compute
-  // both the horizontal and vertical min/max values.
-  for (int row = 0 ; row < numRows; row++) {
-    for (int col = 0; col < numCols; col++) {
-
-      if (!is_valid(img(col,row))) continue;
-      
-      // Record the first and last valid column in each row
-      if (col < minValInRow[row]) minValInRow[row] = col;
-      if (col > maxValInRow[row]) maxValInRow[row] = col;
-      
-      // Record the first and last valid row in each column
-      if (row < minValInCol[col]) minValInCol[col] = row;
-      if (row > maxValInCol[col]) maxValInCol[col] = row;   
-    }
-  }
-  
-  // For each row, record central column and the column width
-  for (int row = 0; row < numRows; row++) {
-    hCenterLine   [row] = (minValInRow[row] + maxValInRow[row])/2.0;
-    hMaxDistArray [row] =  maxValInRow[row] - minValInRow[row];
-    if (hMaxDistArray[row] < 0) {
-      hMaxDistArray[row]=0;
-    }
-  }
-
-  // For each row, record central column and the column width
-  for (int col = 0 ; col < numCols; col++) {
-    vCenterLine   [col] = (minValInCol[col] + maxValInCol[col])/2.0;
-    vMaxDistArray [col] =  maxValInCol[col] - minValInCol[col];
-    if (vMaxDistArray[col] < 0) {
-      vMaxDistArray[col]=0;
-    }
-  }
-
-  BBox2i output_bbox = roi;
-  if (roi.empty())
-    output_bbox = bounding_box(img);
-
-  // Compute the weighting for each pixel in the image
-  weights.set_size(output_bbox.width(), output_bbox.height());
-  fill(weights, 0);
-  
-  for (int row = output_bbox.min().y(); row < output_bbox.max().y(); row++) {
-    for (int col = output_bbox.min().x(); col < output_bbox.max().x(); col++) {
-      bool inner_row = ((row >= minValInCol[col]) && (row <= maxValInCol[col]));
-      bool inner_col = ((col >= minValInRow[row]) && (col <= maxValInRow[row]));
-      bool inner_pixel = inner_row && inner_col;
-      vw::Vector2 pix(col, row);
-      double new_weight = 0; // Invalid pixels usually get zero weight
-      if (is_valid(img(col,row))) {
-        double weight_h = compute_plateaued_weights(pix, true,  hCenterLine, hMaxDistArray,
-                                                    max_weight_val);
-        double weight_v = compute_plateaued_weights(pix, false, vCenterLine, vMaxDistArray,
-                                                    max_weight_val);
-        new_weight = weight_h*weight_v;
-      }
-      else { // Invalid pixel
-        if (inner_pixel)
-          new_weight = hole_fill_value;
-        else // Border pixel
-          new_weight = border_fill_value;
-      }
-      weights(col-output_bbox.min().x(), row-output_bbox.min().y()) = new_weight;
-      
-    }
-  }
-
-} // End function centerline_weights2
-
 // An S-shaped function. Value at 0 is 0. Value at M is M.
 // Flat before 0 and after M. Higher value of L means
 // more flatness at the ends, but higher growth
@@ -244,25 +103,17 @@ BBox2 custom_point_to_pixel_bbox(GeoReference const& georef, BBox2 const& ptbox)
   return pix_box;
 }
 
-GeoReference read_georef(std::string const& file) {
-  // Read a georef, and check for success
-  GeoReference geo;
-  bool is_good = read_georeference(geo, file);
-  if (!is_good)
-    vw_throw(ArgumentErr() << "No georeference found in " << file << ".\n");
-  return geo;
-}
-
 struct Options: vw::GdalWriteOptions {
   std::string dem_list, out_prefix, target_srs_string,
-    output_type, tile_list_str, this_dem_as_reference, weight_list, dem_list_file;
+    output_type, tile_list_str, this_dem_as_reference, weight_list, dem_list_file,
+    dem_header_cache;
   std::vector<std::string> dem_files, weight_files;
   double tr, geo_tile_size;
   bool   has_out_nodata, force_projwin;
   double out_nodata_value;
   int    tile_size, tile_index, erode_len, priority_blending_len,
          extra_crop_len, hole_fill_len, block_size, save_dem_weight,
-         fill_num_passes;
+         fill_num_passes, median_sketch_size;
   double weights_exp, weights_blur_sigma, dem_blur_sigma;
   double nodata_threshold, fill_search_radius, fill_power, fill_percent, min_weight;
   bool   first, last, min, max, block_max, mean, stddev, median, nmad,
@@ -272,7 +123,7 @@ struct Options: vw::GdalWriteOptions {
   BBox2 projwin;
   Options(): tr(0), geo_tile_size(0), has_out_nodata(false), force_projwin(false), 
              tile_index(-1), erode_len(0), priority_blending_len(0), extra_crop_len(0),
-             hole_fill_len(0), block_size(0), save_dem_weight(-1), 
+             hole_fill_len(0), block_size(0), save_dem_weight(-1), median_sketch_size(0),
              fill_search_radius(0), fill_power(0), fill_percent(0), fill_num_passes(0),
              weights_exp(0), weights_blur_sigma(0.0), dem_blur_sigma(0.0),
              nodata_threshold(std::numeric_limits<double>::quiet_NaN()),
@@ -709,36 +560,66 @@ void processMedianOrNmad(BBox2i const& bbox,
   return;
 }
 
+// Same as processMedianOrNmad(), but with the approximate statistics
+// accumulated in a sketch. Return the largest rank error bound in the tile.
+double processMedianOrNmadSketch(BBox2i const& bbox,
+                                 double out_nodata_value,
+                                 bool is_median,
+                                 asp::QuantileSketchTile const& sketch,
+                                 ImageView<double> & tile) {
+
+  fill(tile, out_nodata_value);
+  double max_rank_error = 0.0;
+  for (int c = 0; c < bbox.width(); c++) {
+    for (int r = 0; r < bbox.height(); r++) {
+      double val = 0.0;
+      bool success = is_median ? sketch.median(c, r, val) : sketch.nmad(c, r, val);
+      if (!success)
+        continue;
+      tile(c, r) = val;
+      max_rank_error = std::max(max_rank_error, sketch.rank_error(c, r));
+    }
+  }
+
+  return max_rank_error;
+}
+
 /// Class that does the actual image processing work
 class DemMosaicView: public ImageViewBase<DemMosaicView>{
   int m_cols, m_rows, m_bias;
   Options                   const& m_opt;              // alias
-  DiskImageManager<float>        & m_imgMgr;           // alias
+  asp::DemHandleCache            & m_imgMgr;           // alias
   std::vector<GeoReference> const& m_georefs;          // alias
   GeoReference                     m_out_georef;
   std::vector<double>       const& m_nodata_values;    // alias
   std::vector<vw::BBox2i>          const& m_dem_pixel_bboxes; // alias
+  asp::DemFootprintIndex    const& m_dem_index;        // alias
   long long int                  & m_num_valid_pixels; // alias, to populate on output
   vw::Mutex                      & m_count_mutex;      // alias, a lock for m_num_valid_pixels
+  double                         & m_max_rank_error;   // alias, for --median-sketch-size
 
 public:
   DemMosaicView(int cols, int rows, int bias,
                 Options                   const& opt,
-                DiskImageManager<float>        & imgMgr,
+                asp::DemHandleCache            & imgMgr,
                 std::vector<GeoReference> const& georefs,
                 GeoReference              const& out_georef,
                 std::vector<double>       const& nodata_values,
                 std::vector<BBox2i>       const& dem_pixel_bboxes,
+                asp::DemFootprintIndex    const& dem_index,
                 long long int                  & num_valid_pixels,
-                vw::Mutex                      & count_mutex):
+                vw::Mutex                      & count_mutex,
+                double                         & max_rank_error):
     m_cols(cols), m_rows(rows), m_bias(bias), m_opt(opt),
     m_imgMgr(imgMgr), m_georefs(georefs),
     m_out_georef(out_georef), m_nodata_values(nodata_values),
-    m_dem_pixel_bboxes(dem_pixel_bboxes), m_num_valid_pixels(num_valid_pixels),
-    m_count_mutex(count_mutex) {
+    m_dem_pixel_bboxes(dem_pixel_bboxes), m_dem_index(dem_index),
+    m_num_valid_pixels(num_valid_pixels),
+    m_count_mutex(count_mutex), m_max_rank_error(max_rank_error) {
 
     // How many valid pixels we will have
     m_num_valid_pixels = 0;
+    m_max_rank_error = 0.0;
     
     if (imgMgr.size() != georefs.size()       ||
         imgMgr.size() != nodata_values.size() ||
@@ -817,7 +698,7 @@ public:
     std::vector<ImageView<double>> tile_vec, weight_vec;
     std::vector<std::string> dem_vec;
     initializeTileVector(num_images, bbox, m_opt, tile, tile_vec, weight_vec);
-    
+
     // This will ensure that pixels from earlier images are
     // mostly used unmodified except being blended at the boundary.
     vw::ImageView<double> weight_modifier;
@@ -853,8 +734,24 @@ public:
 
     ImageView<double> first_dem;
 
-    // Loop through all input DEMs
-    for (int dem_iter = 0; dem_iter < (int)m_imgMgr.size(); dem_iter++) {
+    // The DEMs which may intersect this tile. Their footprints were grown
+    // enough to account for the expansion of the tile below.
+    std::vector<int> dem_indices;
+    m_dem_index.query(BBox2(bbox), dem_indices);
+
+    // With a sketch, the median and nmad use bounded memory rather than a
+    // copy of the output tile for each input DEM. If there are no more DEMs
+    // than the sketch size, the exact computation uses no more memory.
+    const bool use_sketch = ((m_opt.median || m_opt.nmad) && m_opt.median_sketch_size > 0 &&
+                             int(dem_indices.size()) > m_opt.median_sketch_size);
+    boost::shared_ptr<asp::QuantileSketchTile> sketch;
+    if (use_sketch)
+      sketch.reset(new asp::QuantileSketchTile(bbox.width(), bbox.height(),
+                                               m_opt.median_sketch_size));
+    
+    // Loop through these input DEMs
+    for (size_t index_iter = 0; index_iter < dem_indices.size(); index_iter++) {
+      int dem_iter = dem_indices[index_iter];
 
       // Load the information for this DEM
       GeoReference georef        = m_georefs         [dem_iter];
@@ -890,7 +787,7 @@ public:
 
       // Crop the disk dem to a 2-channel in-memory image. First
       // channel is the image pixels, second will be the weights.
-      ImageViewRef<double> disk_dem = pixel_cast<double>(m_imgMgr.get_handle(dem_iter, bbox));
+      ImageViewRef<double> disk_dem = pixel_cast<double>(m_imgMgr.get_handle(dem_iter));
       ImageView<DoubleGrayA> dem    = crop(disk_dem, in_box);
 
       if (m_opt.first_dem_as_reference && dem_iter == 0) {
@@ -965,11 +862,6 @@ public:
                                           kernel_size),
                                          m_opt.dem_blur_sigma), nodata_value);
       }
-      
-      // Mark the handle to the image as not in use, though we still
-      // keep that image file open, for increased performance, unless
-      // their number becomes too large.
-      m_imgMgr.release(dem_iter);
 
       if (dem_iter == 0 && m_opt.this_dem_as_reference != "") {
         // We won't actually use this DEM, we just do all in reference to it.
@@ -983,18 +875,16 @@ public:
 
       if (m_opt.use_centerline_weights) {
         // Erode based on grassfire weights, and then overwrite the grassfire
-        // weights with centerline weights
-        ImageView<DoubleGrayA> dem2 = copy(dem);
-        for (int col = 0; col < dem2.cols(); col++) {
-          for (int row = 0; row < dem2.rows(); row++) {
-            if (local_wts(col, row) <= m_opt.erode_len) {
-              dem2(col, row) = DoubleGrayA(nodata_value);
-            }
+        // weights with centerline weights. A pixel stays valid if above
+        // the no-data value and not eroded.
+        ImageView<uint8> valid(dem.cols(), dem.rows());
+        for (int row = 0; row < dem.rows(); row++) {
+          for (int col = 0; col < dem.cols(); col++) {
+            valid(col, row) = (!(dem(col, row)[0] <= nodata_value) &&
+                               local_wts(col, row) > m_opt.erode_len);
           }
         }
-        // TODO(oalexan1): Generalize this modification and move it to VW.
-        centerline_weights2(create_mask_less_or_equal(select_channel(dem2, 0), nodata_value),
-          local_wts, m_bias, -1.0);
+        asp::centerlineWeights(valid, local_wts, m_bias, -1.0);
         
       } // End centerline weights case
 
@@ -1005,8 +895,8 @@ public:
       // With centerline weights, that is handled before 1D weights are multiplied
       // to get the 2D weights.
       if (!use_priority_blend && !m_opt.use_centerline_weights) {
-        for (int col = 0; col < local_wts.cols(); col++) {
-          for (int row = 0; row < local_wts.rows(); row++) {
+        for (int row = 0; row < local_wts.rows(); row++) {
+          for (int col = 0; col < local_wts.cols(); col++) {
             local_wts(col, row) = std::min(local_wts(col, row), double(m_bias));
           }
         }
@@ -1030,8 +920,8 @@ public:
       // delay this process.
       // TODO(oalexan1): This must be a function
       if (m_opt.weights_exp != 1 && !use_priority_blend) {
-        for (int col = 0; col < dem.cols(); col++) {
-          for (int row = 0; row < dem.rows(); row++) {
+        for (int row = 0; row < dem.rows(); row++) {
+          for (int col = 0; col < dem.cols(); col++) {
             if (local_wts(col, row) > 0)
               local_wts(col, row) = pow(local_wts(col, row), m_opt.weights_exp);
           }
@@ -1059,8 +949,8 @@ public:
                                   m_opt.invert_weights, in_box, local_wts);
 
       // Set the weights in the alpha channel
-      for (int col = 0; col < dem.cols(); col++) {
-        for (int row = 0; row < dem.rows(); row++) {
+      for (int row = 0; row < dem.rows(); row++) {
+        for (int col = 0; col < dem.cols(); col++) {
           dem(col, row).a() = local_wts(col, row);
         }
       }
@@ -1077,7 +967,9 @@ public:
 
       // For the median option, keep a copy of the output tile for each input DEM.
       // Also do it for max per block. This will be memory intensive. 
-      if (m_opt.median || m_opt.nmad || m_opt.block_max) {
+      if (use_sketch) {
+        sketch->add(tile, m_opt.out_nodata_value);
+      } else if (m_opt.median || m_opt.nmad || m_opt.block_max) {
         tile_vec.push_back(copy(tile));
         dem_vec.push_back(dem_name);
       }
@@ -1118,7 +1010,13 @@ public:
     } // End stddev case
 
     // Median and nmad operations
-    if (m_opt.median || m_opt.nmad)
+    if (use_sketch) {
+      double max_rank_error
+        = processMedianOrNmadSketch(bbox, m_opt.out_nodata_value, m_opt.median, *sketch,
+                                    tile); // output
+      vw::Mutex::Lock lock(m_count_mutex);
+      m_max_rank_error = std::max(m_max_rank_error, max_rank_error);
+    } else if (m_opt.median || m_opt.nmad)
       processMedianOrNmad(bbox, m_opt.out_nodata_value, m_opt.median, m_opt.save_index_map,
                           clip2dem_index, tile_vec, 
                           // Outputs
@@ -1197,7 +1095,7 @@ public:
       // Wipe from the tile all values outside the perimeter of
       // first_dem. So we don't wipe values that happen to be
       // in the holes of first_dem.
-      // TODO(oalexan1): How about using here the function centerline_weights2()?
+      // TODO(oalexan1): How about using here the function asp::centerlineWeights()?
       vw::ImageView<double> local_wts;
       bool fill_holes = true;
       centerline_weights(create_mask(first_dem, m_opt.out_nodata_value), local_wts,
@@ -1229,6 +1127,7 @@ public:
 /// - dem_proj_bboxes and dem_pixel_bboxes are the locations of
 ///   each input DEM in the output DEM in projected and pixel coordinates.
 void load_dem_bounding_boxes(Options       const& opt,
+                             std::vector<asp::DemHeader> const& headers,
                              GeoReference  const& mosaic_georef,
                              BBox2              & mosaic_bbox, // Projected coordinates
                              std::vector<BBox2> & dem_proj_bboxes,
@@ -1250,10 +1149,11 @@ void load_dem_bounding_boxes(Options       const& opt,
   // Loop through all DEMs
   for (int dem_iter = 0; dem_iter < (int)opt.dem_files.size(); dem_iter++) { 
 
-    // Open a handle to this DEM file
-    DiskImageResourceGDAL in_rsrc(opt.dem_files[dem_iter]);
-    DiskImageView<float>  img(opt.dem_files[dem_iter]);
-    GeoReference          georef = read_georef(opt.dem_files[dem_iter]);
+    // The DEM header was read before. The constant view stands in for the
+    // DEM, as only its dimensions are needed.
+    asp::DemHeader const& header = headers[dem_iter];
+    GeoReference const&   georef = header.georef;
+    ImageViewRef<float>   img = constant_view(0.0f, header.cols, header.rows);
     BBox2i                pixel_box = bounding_box(img);
 
     dem_pixel_bboxes.push_back(pixel_box);
@@ -1308,6 +1208,22 @@ void load_dem_bounding_boxes(Options       const& opt,
   
 } // End function load_dem_bounding_boxes
 
+// Each input DEM being read holds a GDAL handle, and with many inputs the
+// soft limit on the number of open files can be reached. Raise it to the
+// hard limit. Return the resulting limit, or 0 if it cannot be found.
+rlim_t raise_open_files_limit() {
+  struct rlimit lim;
+  if (getrlimit(RLIMIT_NOFILE, &lim) != 0)
+    return 0;
+  if (lim.rlim_cur < lim.rlim_max) {
+    struct rlimit new_lim = lim;
+    new_lim.rlim_cur = lim.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &new_lim) == 0)
+      lim = new_lim;
+  }
+  return lim.rlim_cur;
+}
+
 void handle_arguments(int argc, char *argv[], Options& opt) {
 
   po::options_description general_options("Options");
@@ -1355,6 +1271,13 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Find the median DEM value (this can be memory-intensive, fewer threads are suggested).")
     ("nmad",  po::bool_switch(&opt.nmad)->default_value(false),
       "Find the normalized median absolute deviation DEM value (this can be memory-intensive, fewer threads are suggested).")
+    ("median-sketch-size", po::value<int>(&opt.median_sketch_size)->default_value(0),
+     "With --median or --nmad, find the result approximately, keeping for each pixel a "
+     "sketch with up to this many values per level (an even number, such as 64), rather "
+     "than all values. Then memory use does not depend on the number of overlapping DEMs. "
+     "The result is exact where there are no more values than this, and tiles "
+     "overlapping no more DEMs than this use the exact computation. A bound on the "
+     "error in the rank of the median is printed. Set to 0 for the exact computation.")
     ("count",   po::bool_switch(&opt.count)->default_value(false),
      "Each pixel is set to the number of valid DEM heights at that pixel.")
     ("weight-list", po::value<std::string>(&opt.weight_list),
@@ -1417,6 +1340,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "For each output pixel, save the index of the input DEM it came from (applicable only for --first, --last, --min, --max, --median, and --nmad). A text file with the index assigned to each input DEM is saved as well.")
     ("dem-list-file", po::value<std::string>(&opt.dem_list_file),
      "Alias for --dem-list, kept for backward compatibility.")
+    ("dem-header-cache", po::value<std::string>(&opt.dem_header_cache)->default_value(""),
+     "Save to this file the size, georeference, and no-data value of each input DEM, and "
+     "reuse them on later runs for the DEMs which did not change since. This speeds up "
+     "the startup with many inputs.")
     ;
 
   // Use in GdalWriteOptions '--tif-tile-size' rather than '--tile-size', to not conflict
@@ -1523,6 +1450,14 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
                            << "--first, --last, --min, --max, --median, --nmad is invoked.\n"
                            << usage << general_options);
 
+  if (opt.median_sketch_size < 0 || opt.median_sketch_size % 2 != 0)
+    vw_throw(ArgumentErr() << "The value of --median-sketch-size must be a "
+                           << "non-negative even number.\n" << usage << general_options);
+
+  if (opt.median_sketch_size > 0 && opt.save_index_map)
+    vw_throw(ArgumentErr() << "Cannot save an index map with --median-sketch-size.\n"
+                           << usage << general_options);
+
   if (opt.save_dem_weight >= 0 && opt.save_index_map)
     vw_throw(ArgumentErr()
        << "Cannot save both the index map and the DEM weights at the same time.\n"
@@ -1733,16 +1668,39 @@ int main(int argc, char *argv[]) {
 
     handle_arguments(argc, argv, opt);
 
+    Stopwatch startup_sw;
+    startup_sw.start();
+
+    // Keep at most half as many DEMs open as the limit on open files, as
+    // GDAL may use more than one file per DEM, other files are opened as
+    // well, and each thread may still hold a DEM the cache closed.
+    rlim_t open_files_limit = raise_open_files_limit();
+    size_t max_open_dems = 1000;
+    if (open_files_limit > 0)
+      max_open_dems = std::max(size_t(std::min(open_files_limit / 2, rlim_t(1000000))),
+                               size_t(16));
+    vw_out(DebugMessage, "asp") << "Limit on the number of open files: "
+                                << open_files_limit << ". Will keep open at most "
+                                << max_open_dems << " input DEMs.\n";
+
+    // Read the sizes, georeferences, and no-data values of all DEMs, with
+    // a single open of each file, or from the cache.
+    vw_out() << "Reading the DEM headers.\n";
+    std::vector<asp::DemHeader> dem_headers;
+    int num_cached = asp::readDemHeaders(opt.dem_files, opt.dem_header_cache, dem_headers);
+    if (opt.dem_header_cache != "")
+      vw_out() << "Found " << num_cached << " of " << opt.dem_files.size()
+               << " DEM headers in: " << opt.dem_header_cache << "\n";
+
     // TODO: Fix here. If the DEM is double, read the nodata as double,
     // without casting to float. If it is float, cast to float.
     
     // Read nodata from first DEM, unless the user chooses to specify it.
     if (!opt.has_out_nodata) {
-      DiskImageResourceGDAL in_rsrc(opt.dem_files[0]);
       // Since the DEMs have float pixels, we must read the no-data as
       // float as well. (this is a bug fix). Yet we store it in a
       // double, as we will cast the DEM pixels to double as well.
-      if (in_rsrc.has_nodata_read()) opt.out_nodata_value = float(in_rsrc.nodata_read());
+      if (dem_headers[0].has_nodata) opt.out_nodata_value = float(dem_headers[0].nodata);
     }
 
     // Watch for underflow, if mixing doubles and float. Particularly problematic
@@ -1760,7 +1718,7 @@ int main(int argc, char *argv[]) {
     // initial guess unless user wants to change the resolution and projection.
 
     // By default the output georef is equal to the first input georef
-    GeoReference mosaic_georef = read_georef(opt.dem_files[0]);
+    GeoReference mosaic_georef = dem_headers[0].georef;
 
     double spacing = opt.tr;
     if (opt.target_srs_string != "" && spacing <= 0) {
@@ -1779,8 +1737,8 @@ int main(int argc, char *argv[]) {
     // Use desired spacing if user-specified
     if (spacing > 0.0) {
       // Get lonlat bounding box of the first DEM.
-      DiskImageView<float> dem0(opt.dem_files[0]);
-      BBox2 llbox0 = mosaic_georef.pixel_to_lonlat_bbox(bounding_box(dem0));
+      BBox2i dem0_box(0, 0, dem_headers[0].cols, dem_headers[0].rows);
+      BBox2 llbox0 = mosaic_georef.pixel_to_lonlat_bbox(dem0_box);
       
       // Reset transform with user provided spacing.
       Matrix<double,3,3> transform = mosaic_georef.transform();
@@ -1815,7 +1773,7 @@ int main(int argc, char *argv[]) {
     vw::BBox2 mosaic_bbox;
     std::vector<BBox2> dem_proj_bboxes;
     std::vector<BBox2i> dem_pixel_bboxes, loaded_dem_pixel_bboxes;
-    load_dem_bounding_boxes(opt, mosaic_georef, mosaic_bbox,
+    load_dem_bounding_boxes(opt, dem_headers, mosaic_georef, mosaic_bbox,
                             dem_proj_bboxes, dem_pixel_bboxes);
 
 
@@ -1933,23 +1891,12 @@ int main(int argc, char *argv[]) {
       tile_pixel_bboxes.push_back(tile_box);
     }
 
-    // Store the no-data values, pointers to images, and georeferences (for speed).
-    vw_out() << "Reading the input DEMs.\n";
-    std::vector<double>       nodata_values;
-    std::vector<GeoReference> georefs;
-    std::vector<std::string>  loaded_dems;
-    DiskImageManager<float>   imgMgr;
-
-    BBox2i output_dem_box = BBox2i(0, 0, cols, rows); // output DEM box
-    
-    // Loop through all DEMs
-    for (int dem_iter = 0; dem_iter < (int)opt.dem_files.size(); dem_iter++) {
-
-      // Get the DEM bounding box that we previously computed (output projected coords)
-      BBox2 dem_bbox = dem_proj_bboxes[dem_iter];
-
-      // Go through each of the tile bounding boxes and see they intersect this DEM
-      bool use_this_dem = false;
+    // Find the DEMs intersecting the tiles to produce. Use an R-tree over
+    // the DEM boxes, rather than checking each DEM against each tile.
+    std::vector<char> use_dem(opt.dem_files.size(), 0);
+    {
+      asp::DemFootprintIndex proj_index(dem_proj_bboxes);
+      std::vector<int> dem_indices;
       for (int tile_id = start_tile; tile_id < end_tile; tile_id++) {
 
         if (!opt.tile_list.empty() && opt.tile_list.find(tile_id) == opt.tile_list.end()) 
@@ -1959,43 +1906,70 @@ int main(int argc, char *argv[]) {
         BBox2i tile_pixel_box = tile_pixel_bboxes[tile_id - start_tile];
         BBox2  tile_proj_box  = mosaic_georef.pixel_to_point_bbox(tile_pixel_box);
 
-        if (tile_proj_box.intersects(dem_bbox)) {
-          use_this_dem = true;
-          break;
+        // The index can return more DEMs than needed, so check each one
+        proj_index.query(tile_proj_box, dem_indices);
+        for (size_t it = 0; it < dem_indices.size(); it++) {
+          if (tile_proj_box.intersects(dem_proj_bboxes[dem_indices[it]]))
+            use_dem[dem_indices[it]] = 1;
         }
       }
-      if (use_this_dem == false)
+    }
+    
+    // Store the no-data values, pointers to images, and georeferences (for speed).
+    vw_out() << "Reading the input DEMs.\n";
+    std::vector<double>       nodata_values;
+    std::vector<GeoReference> georefs;
+    std::vector<std::string>  loaded_dems;
+    std::vector<BBox2>        loaded_dem_footprints;
+    asp::DemHandleCache       imgMgr(max_open_dems);
+
+    BBox2i output_dem_box = BBox2i(0, 0, cols, rows); // output DEM box
+    
+    // Loop through all DEMs
+    for (int dem_iter = 0; dem_iter < (int)opt.dem_files.size(); dem_iter++) {
+
+      if (!use_dem[dem_iter])
         continue; // Skip to the next DEM if we don't need this one.
 
       // The GeoTransform will hide the messy details of conversions
       // from pixels to points and lon-lat.
-      GeoReference georef  = read_georef(opt.dem_files[dem_iter]);
+      GeoReference georef  = dem_headers[dem_iter].georef;
       BBox2i dem_pixel_box = dem_pixel_bboxes[dem_iter];
       GeoTransform geotrans(georef, mosaic_georef, dem_pixel_box, output_dem_box);
 
       // Get the current DEM bounding box in pixel units of the output mosaicked DEM
       BBox2 curr_box = geotrans.forward_bbox(dem_pixel_box);
+
+      // The footprint of this DEM, used to find the DEMs for each output
+      // tile. For a tile, the region read from this DEM is the tile mapped to
+      // the DEM pixels, grown by the bias, which accounts for the blending,
+      // erosion, and blur lengths, and by the interpolation buffer. It is
+      // grown by one more pixel if it is too thin. So a tile needs this DEM
+      // only if it intersects the DEM box grown by as much, and mapped to the
+      // output pixels. Add one output pixel for rounding. An empty footprint,
+      // such as if the grown box cannot be mapped, is used for all tiles.
+      BBox2 footprint;
+      if (!curr_box.empty()) {
+        BBox2i grown_box = dem_pixel_box;
+        grown_box.expand(bias + BilinearInterpolation::pixel_buffer + 2);
+        try {
+          footprint = geotrans.forward_bbox(grown_box);
+          footprint.expand(1.0);
+        } catch (...) {
+          footprint = BBox2();
+        }
+      }
+      
       curr_box.crop(output_dem_box);
 
-      // This is a fix for GDAL crashing when there are too many open
-      // file handles. In such situation, just selectively close the
-      // handles furthest from the current location.
-      imgMgr.add_file_handle_not_thread_safe(opt.dem_files[dem_iter], curr_box);
+      // Too many open GDAL handles make GDAL fail, so the cache keeps
+      // open only the most recently used DEMs.
+      imgMgr.add(opt.dem_files[dem_iter]);
       
+      // Get the nodata-value from the header read earlier
       double curr_nodata_value = opt.out_nodata_value;
-      try {
-        // Get the nodata-value. Need a try block, in case we can't
-        // open more handles.
-        DiskImageResourceGDAL in_rsrc(opt.dem_files[dem_iter]);
-        if (in_rsrc.has_nodata_read())
-          curr_nodata_value = float(in_rsrc.nodata_read());
-      } catch(std::exception const& e) {
-        // Try again
-        imgMgr.freeup_handles_not_thread_safe();
-        DiskImageResourceGDAL in_rsrc(opt.dem_files[dem_iter]);
-        if (in_rsrc.has_nodata_read())
-          curr_nodata_value = float(in_rsrc.nodata_read());
-      }
+      if (dem_headers[dem_iter].has_nodata)
+        curr_nodata_value = float(dem_headers[dem_iter].nodata);
       
       loaded_dems.push_back(opt.dem_files[dem_iter]);
 
@@ -2006,8 +1980,16 @@ int main(int argc, char *argv[]) {
       nodata_values.push_back(curr_nodata_value);
       georefs.push_back(georef);
       loaded_dem_pixel_bboxes.push_back(dem_pixel_box);
+      loaded_dem_footprints.push_back(footprint);
     } // End loop through DEM files
 
+    // The index for finding the DEMs intersecting each output tile
+    asp::DemFootprintIndex loaded_dem_index(loaded_dem_footprints);
+
+    startup_sw.stop();
+    vw_out() << "Using " << loaded_dems.size() << " of " << opt.dem_files.size()
+             << " input DEMs. Elapsed time: " << startup_sw.elapsed_seconds() << " s.\n";
+
     // If there are 17 tiles, let them be tile-00, ..., tile-16.
     int num_digits = 1;
     int tens = 10;
@@ -2022,6 +2004,9 @@ int main(int argc, char *argv[]) {
       if (!opt.tile_list.empty() && opt.tile_list.find(tile_id) == opt.tile_list.end()) 
         continue;
       
+      Stopwatch tile_sw;
+      tile_sw.start();
+
       // Get the bounding box we previously computed
       vw::BBox2i tile_box = tile_pixel_bboxes[tile_id - start_tile];
 
@@ -2039,13 +2024,14 @@ int main(int argc, char *argv[]) {
       // Set up tile image and metadata
       long long int num_valid_pixels; // Will be populated when saving to disk
       vw::Mutex count_mutex; // to lock when updating num_valid_pixels
+      double max_rank_error = 0.0; // the median sketch accuracy
 
       ImageViewRef<float> out_dem
         = crop(DemMosaicView(cols, rows, bias, opt,
                              imgMgr, georefs,
                              mosaic_georef, nodata_values,
-                             loaded_dem_pixel_bboxes,
-                             num_valid_pixels, count_mutex),
+                             loaded_dem_pixel_bboxes, loaded_dem_index,
+                             num_valid_pixels, count_mutex, max_rank_error),
                tile_box);
       GeoReference crop_georef = crop(mosaic_georef, tile_box.min().x(),
                       tile_box.min().y());
@@ -2096,6 +2082,13 @@ int main(int argc, char *argv[]) {
 
       vw_out() << "Number of valid (not no-data) pixels written: " << num_valid_pixels
                << ".\n";
+      tile_sw.stop();
+      vw_out() << "Tile time: " << tile_sw.elapsed_seconds() << " s.\n";
+      vw_out(DebugMessage, "asp") << "Input DEMs opened so far: "
+                                  << imgMgr.num_opens() << "\n";
+      if ((opt.median || opt.nmad) && opt.median_sketch_size > 0)
+        vw_out() << "Largest error in the rank of the approximate median, as a fraction "
+                 << "of the number of values at a pixel: " << max_rank_error << ".\n";
       if (num_valid_pixels == 0) {
         vw_out() << "Removing tile with no valid pixels: " << dem_tile << "\n";
         boost::filesystem::remove(dem_tile);
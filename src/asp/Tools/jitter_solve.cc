@@ -44,6 +44,7 @@
 #include <asp/Core/BaseCameraUtils.h>
 #include <asp/Core/BundleAdjustUtils.h>
 #include <asp/Core/IpMatchingAlgs.h>
+#include <asp/Core/MatchDb.h>
 #include <asp/Core/CameraTransforms.h>
 #include <asp/Core/ImageUtils.h>
 #include <asp/Core/PointUtils.h>
@@ -116,6 +117,11 @@ void handle_arguments(int argc, char *argv[], Options& opt, rig::RigSet & rig) {
     ("clean-match-files-prefix",  po::value(&opt.clean_match_files_prefix)->default_value(""),
      "Use as input match files the *-clean.match files from this prefix. The order of "
      "images in each interest point match file need not be the same as for input images.")
+    ("match-db", po::value(&opt.match_db)->default_value(""),
+     "Read the interest point matches from this single-file match database, created "
+     "with match_db, rather than from individual match files. The matches are looked "
+     "up by the names the match files would have, per --match-files-prefix or "
+     "--clean-match-files-prefix. Matches not in the database are read from disk.")
     ("isis-cnet", po::value(&opt.isis_cnet)->default_value(""),
      "Read a control network having interest point matches from this binary file "
      "in the ISIS jigsaw format. This can be used with any images and cameras "
@@ -141,6 +147,12 @@ void handle_arguments(int argc, char *argv[], Options& opt, rig::RigSet & rig) {
     ("robust-threshold", po::value(&opt.robust_threshold)->default_value(0.5),
      "Set the threshold for the Cauchy robust cost function. Increasing this makes "
      "the solver focus harder on the larger errors.")
+    ("jacobian-method", po::value(&opt.jacobian_method)->default_value("numeric"),
+     "How to find the derivatives of the linescan camera reprojection errors. Options: "
+     "numeric, analytic. The latter uses that only the few position and orientation "
+     "samples near the time of the pixel affect it, and needs many fewer projections "
+     "into the camera. This helps most with a small --num-lines-per-position and "
+     "--num-lines-per-orientation.")
     ("image-list", po::value(&opt.image_list)->default_value(""),
      "A file containing the list of images, when they are too many to specify on the "
      "command line. Use space or newline as separator. See also --camera-list.")
@@ -458,6 +470,9 @@ void handle_arguments(int argc, char *argv[], Options& opt, rig::RigSet & rig) {
     vw_throw(ArgumentErr() << "Must specify precisely one of: --match-files-prefix, "
              << "--clean-match-files-prefix, --isis-cnet, --nvm.\n");
 
+  if (!opt.match_db.empty() && !fs::exists(opt.match_db))
+    vw_throw(ArgumentErr() << "Cannot find the match database: " << opt.match_db << ".\n");
+
   if (opt.max_init_reproj_error <= 0.0)
     vw_throw(ArgumentErr() << "Must have a positive --max-initial-reprojection-error.\n");
 
@@ -467,6 +482,11 @@ void handle_arguments(int argc, char *argv[], Options& opt, rig::RigSet & rig) {
   if (opt.robust_threshold <= 0.0) 
     vw_throw(ArgumentErr() << "The value of --robust-threshold must be positive.\n");
 
+  boost::to_lower(opt.jacobian_method);
+  if (opt.jacobian_method != "numeric" && opt.jacobian_method != "analytic")
+    vw_throw(ArgumentErr() << "Unknown value for --jacobian-method: "
+             << opt.jacobian_method << ".\n");
+
   if (opt.tri_robust_threshold <= 0.0) 
     vw_throw(ArgumentErr() << "The value of --tri-robust-threshold must be positive.\n");
   
@@ -1342,7 +1362,12 @@ void run_jitter_solve(int argc, char* argv[]) {
                                                 opt.match_files_prefix,  
                                                 opt.out_prefix);
     std::set<std::string> existing_files;
-    asp::listExistingMatchFiles(prefix, existing_files);
+    std::string match_dir = fs::path(prefix).parent_path().string();
+    if (opt.match_db.empty() || match_dir.empty() || fs::exists(match_dir))
+      asp::listExistingMatchFiles(prefix, existing_files);
+    boost::shared_ptr<asp::MatchDb> match_db;
+    if (!opt.match_db.empty())
+      match_db.reset(new asp::MatchDb(opt.match_db));
 
     // TODO(oalexan1): Make this into a function
     // Load match files
@@ -1358,7 +1383,8 @@ void run_jitter_solve(int argc, char* argv[]) {
         = asp::match_filename(opt.clean_match_files_prefix, opt.match_files_prefix,  
                               opt.out_prefix, image1_path, image2_path);
       // The external match file does not exist, don't try to load it
-      if (existing_files.find(match_file) == existing_files.end())
+      if (existing_files.find(match_file) == existing_files.end() &&
+          !(match_db && match_db->has(match_file)))
         continue;
       opt.match_files[std::make_pair(i, j)] = match_file;
     }
@@ -1379,14 +1405,7 @@ void run_jitter_solve(int argc, char* argv[]) {
       rig::readNvmAsCnet(opt.nvm, opt.image_files, nvm_no_shift, 
                          cnet, world_to_cam, optical_offsets); // outputs
   } else {
-    bool triangulate_control_points = true;
-    vw::ba::build_control_network(triangulate_control_points,
-                                  cnet, // output
-                                  opt.camera_models, opt.image_files,
-                                  opt.match_files, opt.min_matches,
-                                  opt.min_triangulation_angle*(M_PI/180.0),
-                                  opt.forced_triangulation_distance,
-                                  opt.max_pairwise_matches);
+    asp::buildControlNetwork(opt, cnet); // output is cnet
   }
   
   if (!opt.gcp_files.empty()) {
@@ -0,0 +1,201 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file match_db.cc
+///
+/// Pack interest point match files into a single-file match database, which
+/// can be read by bundle_adjust, jitter_solve, and stereo_gui, unpack a
+/// database into individual match files, or list its contents.
+
+#include <asp/Core/Common.h>
+#include <asp/Core/Macros.h>
+#include <asp/Core/IpMatchingAlgs.h>
+#include <asp/Core/MatchDb.h>
+
+#include <vw/Core/ProgressCallback.h>
+#include <vw/InterestPoint/InterestData.h>
+#include <vw/InterestPoint/MatcherIO.h>
+
+#include <boost/filesystem.hpp>
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+using namespace vw;
+
+struct Options: vw::GdalWriteOptions {
+  std::string match_db, match_files_prefix, output_dir;
+  std::vector<std::string> match_files;
+  bool pack, unpack, list, remove_packed_files;
+  Options(): pack(false), unpack(false), list(false), remove_packed_files(false) {}
+};
+
+void handle_arguments(int argc, char *argv[], Options& opt) {
+  po::options_description general_options("");
+  general_options.add(vw::GdalWriteOptionsDescription(opt));
+  general_options.add_options()
+    ("match-db", po::value(&opt.match_db)->default_value(""),
+     "The match database to create, unpack, or list.")
+    ("pack", po::bool_switch(&opt.pack)->default_value(false)->implicit_value(true),
+     "Create the match database from the match files with the prefix given by "
+     "--match-files-prefix and the ones passed on the command line.")
+    ("unpack", po::bool_switch(&opt.unpack)->default_value(false)->implicit_value(true),
+     "Write the matches in the database as individual match files in --output-dir.")
+    ("list", po::bool_switch(&opt.list)->default_value(false)->implicit_value(true),
+     "List the match files in the database and the number of matches in each.")
+    ("match-files-prefix", po::value(&opt.match_files_prefix)->default_value(""),
+     "Pack all match files having this prefix, such as ba/run for ba/run-*.match.")
+    ("output-dir", po::value(&opt.output_dir)->default_value(""),
+     "The directory in which to unpack the match files.")
+    ("remove-packed-files",
+     po::bool_switch(&opt.remove_packed_files)->default_value(false)->implicit_value(true),
+     "After the database is written, remove the match files that were packed.");
+
+  po::options_description positional("");
+  positional.add_options()
+    ("match-files", po::value(&opt.match_files));
+
+  po::positional_options_description positional_desc;
+  positional_desc.add("match-files", -1);
+
+  std::string usage("--pack --match-db <output.mdb> [--match-files-prefix <prefix>] "
+                    "[<match files>]\n  or: --unpack --match-db <input.mdb> "
+                    "--output-dir <dir>\n  or: --list --match-db <input.mdb>");
+  bool allow_unregistered = false;
+  std::vector<std::string> unregistered;
+  po::variables_map vm =
+    asp::check_command_line(argc, argv, opt, general_options, general_options,
+                            positional, positional_desc, usage,
+                            allow_unregistered, unregistered);
+
+  if (int(opt.pack) + int(opt.unpack) + int(opt.list) != 1)
+    vw_throw(ArgumentErr() << "Must specify exactly one of --pack, --unpack, --list.\n"
+             << usage << general_options);
+
+  if (opt.match_db.empty())
+    vw_throw(ArgumentErr() << "Must specify the match database.\n"
+             << usage << general_options);
+
+  if (opt.pack && opt.match_files_prefix.empty() && opt.match_files.empty())
+    vw_throw(ArgumentErr() << "No match files to pack were specified.\n"
+             << usage << general_options);
+
+  if (opt.unpack && opt.output_dir.empty())
+    vw_throw(ArgumentErr() << "Must specify the output directory.\n"
+             << usage << general_options);
+}
+
+// Find the match files with given prefix. Skip other files in the same
+// directory, such as those for a different prefix.
+void matchFilesWithPrefix(std::string const& prefix,
+                          std::vector<std::string> & match_files) {
+  std::set<std::string> existing_files;
+  asp::listExistingMatchFiles(prefix, existing_files);
+  std::string ext = ".match";
+  for (auto const& f: existing_files) {
+    if (f.find(prefix + "-") != 0 || f.size() < ext.size() ||
+        f.compare(f.size() - ext.size(), ext.size(), ext) != 0)
+      continue;
+    match_files.push_back(f);
+  }
+}
+
+void packMatches(Options const& opt) {
+
+  std::vector<std::string> match_files = opt.match_files;
+  if (!opt.match_files_prefix.empty())
+    matchFilesWithPrefix(opt.match_files_prefix, match_files);
+
+  // Two files with the same name in different directories cannot be told
+  // apart in the database
+  std::map<std::string, std::string> names;
+  for (auto const& f: match_files) {
+    std::string name = asp::matchDbName(f);
+    auto it = names.find(name);
+    if (it != names.end() && it->second != f)
+      vw_throw(ArgumentErr() << "The match files " << it->second << " and " << f
+               << " have the same name. Cannot store both.\n");
+    names[name] = f;
+  }
+  if (names.empty())
+    vw_throw(ArgumentErr() << "No match files were found.\n");
+
+  vw_out() << "Packing " << names.size() << " match files into: "
+           << opt.match_db << "\n";
+  vw::TerminalProgressCallback tpc("asp", "\t--> ");
+  tpc.report_progress(0);
+  double inc_amount = 1.0 / double(names.size());
+
+  asp::MatchDbWriter writer(opt.match_db);
+  std::vector<vw::ip::InterestPoint> ip1, ip2;
+  std::uint64_t num_matches = 0;
+  for (auto const& it: names) {
+    vw::ip::read_binary_match_file(it.second, ip1, ip2);
+    writer.write(it.second, ip1, ip2);
+    num_matches += ip1.size();
+    tpc.report_incremental_progress(inc_amount);
+  }
+  writer.close();
+  tpc.report_finished();
+  vw_out() << "Wrote " << num_matches << " matches.\n";
+
+  if (!opt.remove_packed_files)
+    return;
+
+  vw_out() << "Removing the packed match files.\n";
+  for (auto const& it: names)
+    fs::remove(it.second);
+}
+
+void unpackMatches(Options const& opt) {
+
+  asp::MatchDb db(opt.match_db);
+  fs::create_directories(opt.output_dir);
+  vw_out() << "Writing " << db.size() << " match files to: " << opt.output_dir << "\n";
+
+  std::vector<vw::ip::InterestPoint> ip1, ip2;
+  for (auto const& name: db.names()) {
+    db.read(name, ip1, ip2);
+    vw::ip::write_binary_match_file((fs::path(opt.output_dir) / name).string(), ip1, ip2);
+  }
+}
+
+void listMatches(Options const& opt) {
+
+  asp::MatchDb db(opt.match_db);
+  for (auto const& name: db.names())
+    vw_out() << name << " " << db.numMatches(name) << "\n";
+}
+
+int main(int argc, char *argv[]) {
+
+  Options opt;
+  try {
+
+    handle_arguments(argc, argv, opt);
+
+    if (opt.pack)
+      packMatches(opt);
+    else if (opt.unpack)
+      unpackMatches(opt);
+    else
+      listMatches(opt);
+
+  } ASP_STANDARD_CATCHES;
+
+  return 0;
+}
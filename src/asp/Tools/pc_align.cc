@@ -41,6 +41,7 @@
 #include <vw/InterestPoint/MatcherIO.h>
 
 #include <limits>
+#include <fstream>
 #include <cstring>
 #include <thread>
 #include <omp.h>
@@ -62,7 +63,9 @@ struct Options: public vw::GdalWriteOptions {
   // Input
   string reference, source, init_transform_file, alignment_method, 
     datum, csv_format_str, csv_srs, match_file, hillshade_options,
-    ipfind_options, ipmatch_options, nuth_options, fgr_options, csv_proj4_str;
+    ipfind_options, ipmatch_options, nuth_options, fgr_options, csv_proj4_str,
+    ref_cloud_cache, source_list;
+  std::vector<std::string> batch_sources; // read from source_list
   Vector2 initial_transform_ransac_params;
   Eigen::MatrixXd init_transform;
   int    num_iter,
@@ -174,6 +177,21 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Read the full reference COPC file, ignoring the --ref-copc-win option.")
     ("src-copc-read-all", po::bool_switch(&opt.src_copc_read_all)->default_value(false), 
      "Read the full source COPC file, ignoring the --src-copc-win option.")
+    ("ref-cloud-cache", po::value(&opt.ref_cloud_cache)->default_value(""),
+     "Save the loaded and subsampled reference cloud to a file with this name, with a hash "
+     "of the loading options inserted before the extension, and reuse it in later runs "
+     "with the same reference cloud and options, such as when aligning many source clouds "
+     "to the same reference. The cached reference is not cropped to the extent of the "
+     "source, so it can be reused for any source. That crop is done after reading it. "
+     "Hence --max-num-reference-points applies to the full reference when this is set.")
+    ("source-list", po::value(&opt.source_list)->default_value(""),
+     "Align each source cloud in this list to the same reference cloud, in one run. The "
+     "reference is loaded only once, cropped to the union of the regions shared with the "
+     "sources, with --max-num-reference-points scaled up to keep the density of the "
+     "reference points. The sources are aligned sequentially, not concurrently, each "
+     "using multiple threads. The source cloud must not be set on the command "
+     "line. The outputs for each source have its name appended to the output prefix. "
+     "A summary is written to <output prefix>-batch-report.csv.")
     ("csv-proj4", po::value(&opt.csv_proj4_str)->default_value(""), 
      "An alias for --csv-srs, for backward compatibility.");
 
@@ -203,7 +221,16 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     vw_throw( ArgumentErr() << "No input arguments provided.\n" 
              << usage << general_options);
 
-  if (opt.reference.empty() || opt.source.empty())
+  if (!opt.source_list.empty()) {
+    if (!opt.source.empty())
+      vw_throw(ArgumentErr() << "Cannot set both a source cloud and --source-list.\n");
+    asp::read_list(opt.source_list, opt.batch_sources);
+    if (opt.hillshading_transform != "" || opt.match_file != "")
+      vw_throw(ArgumentErr() << "The options --hillshading-transform and --match-file "
+               << "are not supported with --source-list.\n");
+  }
+
+  if (opt.reference.empty() || (opt.source.empty() && opt.batch_sources.empty()))
     vw_throw( ArgumentErr() << "Missing input files.\n");
 
   if (opt.out_prefix.empty())
@@ -300,11 +327,16 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
 
   if (opt.alignment_method == "nuth") {
          
-    if (asp::get_cloud_type(opt.reference) != "DEM" ||
-        asp::get_cloud_type(opt.source)    != "DEM")
-      vw_throw(ArgumentErr()
-          << "Nuth and Kaab alignment can be used only when both "
-          << "the reference and source clouds are DEMs.\n");
+    std::vector<std::string> sources = opt.batch_sources;
+    if (sources.empty())
+      sources.push_back(opt.source);
+    for (size_t it = 0; it < sources.size(); it++) {
+      if (asp::get_cloud_type(opt.reference) != "DEM" ||
+          asp::get_cloud_type(sources[it])   != "DEM")
+        vw_throw(ArgumentErr()
+            << "Nuth and Kaab alignment can be used only when both "
+            << "the reference and source clouds are DEMs.\n");
+    }
       
     if (!opt.init_transform_file.empty() ||
         !opt.initial_ned_translation.empty() ||
@@ -355,6 +387,24 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     opt.src_copc_win = opt.ref_copc_win;
   }
 
+  // In batch mode the source proj win is not estimated, as that is done
+  // together with the reference box, which is computed only once.
+  for (size_t it = 0; it < opt.batch_sources.size(); it++) {
+    if (!asp::isCopc(opt.batch_sources[it]) || opt.src_copc_read_all)
+      continue;
+    if (opt.src_copc_win == BBox2() && opt.ref_copc_win != BBox2()) {
+      vw::vw_out() << "Using --ref-copc-win for --src-copc-win.\n";
+      opt.src_copc_win = opt.ref_copc_win;
+    }
+    if (opt.src_copc_win == BBox2())
+      vw_throw(ArgumentErr() << "With --source-list, for COPC source clouds, set "
+               << "--src-copc-win or --src-copc-read-all.\n");
+  }
+
+  // The cache is keyed by the reference file size and modification time
+  if (!opt.ref_cloud_cache.empty() && !fs::exists(opt.reference))
+    vw_throw(ArgumentErr() << "The option --ref-cloud-cache needs a reference cloud "
+             << "on local disk.\n");
 }
 
 /// Compute output statistics for pc_align
@@ -1029,6 +1079,592 @@ void checkNeeForSrcProjWin(Options const& opt,
   
 }
                                          
+// Estimate the lon-lat bounding box of the reference cloud, extended by
+// --max-displacement, and the same box with the inverse of the initial
+// transform applied to it. These do not depend on the source cloud, unless
+// the proj win of a source COPC file must be estimated, when that is done too.
+void estimate_ref_boxes(Options & opt,
+                        vw::cartography::GeoReference const& geo,
+                        asp::CsvConv const& csv_conv,
+                        BBox2 & ref_box, BBox2 & trans_ref_box) {
+
+  Stopwatch sw;
+  sw.start();
+  int num_sample_pts = std::max(4000000,
+                                std::max(opt.max_num_source_points,
+                                         opt.max_num_reference_points)/4);
+  num_sample_pts = std::min(1.0e+6, 1.0 * num_sample_pts); // avoid being slow
+
+  // Compute GDC bounding box of the reference cloud
+  vw_out() << "Computing the bounding box of the reference points using "
+           << num_sample_pts << " sample points.\n";
+
+  // See if we have to estimate the proj win of the src points
+  bool need_src_projwin = false;
+  vw::cartography::GeoReference src_georef;
+  vw::BBox2 src_projwin;
+  checkNeeForSrcProjWin(opt, need_src_projwin, src_georef);
+
+  Eigen::MatrixXd inv_init_trans = opt.init_transform.inverse();
+  calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
+                            opt.reference, opt.max_disp, inv_init_trans,
+                            opt.ref_copc_win, opt.ref_copc_read_all,
+                            need_src_projwin, src_georef,
+                            ref_box, trans_ref_box, src_projwin); // outputs
+
+  if (need_src_projwin) {
+    opt.src_copc_win = src_projwin;
+    vw::vw_out() << "Estimated: --src-copc-win "
+      << opt.src_copc_win.min().x() << " " << opt.src_copc_win.min().y() << " "
+      << opt.src_copc_win.max().x() << " " << opt.src_copc_win.max().y() << "\n";
+  }
+
+  sw.stop();
+  vw_out() << "Computation of the reference bounding box took "
+           << sw.elapsed_seconds() << " s\n";
+}
+
+// Find the intersection of ref and source bounding boxes. This does not need
+// a lot of samples as it is expanded by max_disp in either case. The inputs
+// are from estimate_ref_boxes(). On output, ref_box is the region of the
+// reference to load, and source_box the one of the source.
+void estimate_shared_boxes(Options const& opt,
+                           vw::cartography::GeoReference const& geo,
+                           asp::CsvConv const& csv_conv,
+                           BBox2 & ref_box, BBox2 trans_ref_box,
+                           BBox2 & source_box) {
+
+  Stopwatch sw;
+  sw.start();
+  int num_sample_pts = std::max(4000000,
+                                std::max(opt.max_num_source_points,
+                                         opt.max_num_reference_points)/4);
+  num_sample_pts = std::min(1.0e+6, 1.0 * num_sample_pts); // avoid being slow
+
+  // Compute GDC bounding box of the source cloud
+  vw_out() << "Computing the bounding box of the source points using "
+           << num_sample_pts << " sample points.\n";
+
+  bool dummy_flag = false;
+  vw::cartography::GeoReference dummy_georef;
+  vw::BBox2 trans_source_box, dummy_projwin;
+  calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
+                            opt.source, opt.max_disp, opt.init_transform,
+                            opt.src_copc_win, opt.src_copc_read_all,
+                            dummy_flag, dummy_georef,
+                            source_box, trans_source_box, dummy_projwin); // outputs
+  sw.stop();
+  vw_out() << "Computation of bounding boxes took "
+          << sw.elapsed_seconds() << " s\n";
+
+  // When boxes are huge, it is hard to do the optimization of intersecting
+  // them, as they may differ not by 0 or 360, but by 180. Better do nothing
+  // in that case. The solution may degrade a bit, as we may load points
+  // not in the intersection of the boxes, but at least it won't be wrong.
+  // In this case, there is a chance the boxes were computed wrong anyway.
+  if (ref_box.width() > 180.0 || source_box.width() > 180.0) {
+    vw_out() << "Warning: Your input point clouds are spread over more than half "
+              << "the planet. It is suggested that they be cropped, to get more "
+              << "accurate results. Giving up on estimating their bounding boxes "
+              << "and filtering outliers based on them.\n";
+            
+    ref_box = BBox2();
+    source_box = BBox2();
+  }
+
+  // This is useful to point out issues when the reference and source
+  // boxes are shifted by 360 degrees relative to each other.
+  vw_out() << "Reference points box: " << ref_box << "\n";
+  vw_out() << "Source points box:    " << source_box << "\n";
+  
+  if (!ref_box.empty() && !source_box.empty()) {
+    adjust_and_intersect_ref_source_boxes(ref_box, trans_source_box, 
+                                          opt.reference, opt.source);
+    adjust_and_intersect_ref_source_boxes(trans_ref_box, source_box, 
+                                          opt.reference, opt.source);
+  }
+  if (ref_box == source_box) {
+    // Leave some space here to align the text to the earlier printouts
+    vw_out() << "Intersection box:     " << ref_box    << "\n";
+  } else {
+    // This can happen when the projections are offset by 360 degrees
+    vw_out() << "Intersection reference box: " << ref_box    << "\n";
+    vw_out() << "Intersection source    box: " << source_box << "\n";
+  }
+}
+
+// The reference cloud and what else is needed to align the source to it.
+// In batch mode this is loaded once and used for all sources.
+struct RefCloud {
+  DP          cloud; // shifted by the shift below
+  Vector3     shift;
+  bool        is_lola_rdr_format;
+  double      median_longitude;
+  cartography::GeoReference dem_georef;
+  vw::ImageViewRef<PixelMask<float>> dem; // set if using DEM distances
+  RefCloud(): is_lola_rdr_format(false), median_longitude(0.0) {}
+};
+
+// Load the subsampled reference point cloud, or read it from the cache. Shift
+// it so its centroid is at the origin. The cache has the reference cropped only
+// by the reference options, so it can be reused for any source. Then the crop
+// to ref_box is done in memory.
+void load_ref_cloud(Options const& opt,
+                    vw::cartography::GeoReference const& geo,
+                    asp::CsvConv const& csv_conv,
+                    BBox2 ref_box,
+                    RefCloud & ref) {
+
+  // Shift points so the first point is (0,0,0)
+  bool calc_shift = true;
+  Stopwatch sw1;
+  sw1.start();
+  bool loaded_from_cache = false;
+  std::string ref_cache_key, ref_cache_file;
+  bool use_cache = !opt.ref_cloud_cache.empty();
+  if (use_cache) {
+    ref_cache_key = ref_cloud_cache_key(opt.reference, opt.max_num_reference_points,
+                                        opt.ref_copc_win, opt.ref_copc_read_all,
+                                        geo, opt.csv_format_str, opt.csv_srs);
+    ref_cache_file = ref_cloud_cache_file(opt.ref_cloud_cache, ref_cache_key);
+    loaded_from_cache = read_ref_cloud_cache(ref_cache_file, ref_cache_key, ref.shift,
+                                             ref.is_lola_rdr_format, ref.median_longitude,
+                                             ref.cloud);
+  }
+  if (!loaded_from_cache) {
+    BBox2 load_box = use_cache ? BBox2() : ref_box;
+    load_cloud(opt.reference, opt.max_num_reference_points, load_box,
+               opt.ref_copc_win, opt.ref_copc_read_all,
+               calc_shift, ref.shift, geo, csv_conv, ref.is_lola_rdr_format,
+               ref.median_longitude, opt.verbose, ref.cloud);
+    if (use_cache) {
+      vw_out() << "Writing: " << ref_cache_file << "\n";
+      write_ref_cloud_cache(ref_cache_file, ref_cache_key, ref.shift,
+                            ref.is_lola_rdr_format, ref.median_longitude, ref.cloud);
+    }
+  }
+  if (use_cache && !ref_box.empty()) {
+    crop_to_lonlat_box(ref_box, ref.shift, geo.datum(), ref.cloud);
+    if (ref.cloud.features.cols() == 0)
+      vw_throw(ArgumentErr() << "No reference points are in the region shared with "
+               << "the source: " << ref_box << "\n");
+  }
+  sw1.stop();
+  if (loaded_from_cache)
+    vw_out() << "Read " << ref.cloud.features.cols()
+             << " reference points from " << ref_cache_file << " in "
+             << sw1.elapsed_seconds() << " s\n";
+  else if (opt.verbose)
+    vw_out() << "Loading the reference point cloud took "
+             << sw1.elapsed_seconds() << " s\n";
+  //ref.cloud.save(outputBaseFile + "_ref.vtk");
+
+  // So far we shifted by first point in reference point cloud to reduce
+  // the magnitude of all loaded points. Now that we have loaded all
+  // points, shift one more time, to place the centroid of the
+  // reference at the origin.
+  // Note: If this code is ever converting to using floats,
+  // the operation below needs to be re-implemented to be accurate.
+  int numRefPts = ref.cloud.features.cols();
+  Eigen::VectorXd meanRef = ref.cloud.features.rowwise().sum() / numRefPts;
+  ref.cloud.features.topRows(DIM).colwise()    -= meanRef.head(DIM);
+  for (int row = 0; row < DIM; row++)
+    ref.shift[row] += meanRef(row); // Update the shift variable as well as the points
+  if (opt.verbose)
+    vw_out() << "Data shifted internally by subtracting: " << ref.shift << "\n";
+
+  // If the reference point cloud came from a DEM, also load the data in DEM format.
+  if (opt.use_dem_distances()) {
+    // Load the dem, then wrap it inside an ImageViewRef object. This is done
+    // because the actual DEM type cannot be created without being
+    // initialized.
+    InterpolationReadyDem 
+    reference_dem(load_interpolation_ready_dem(opt.reference, ref.dem_georef));
+    ref.dem.reset(reference_dem);
+  }
+}
+
+// A summary of aligning one source cloud, for the batch mode report
+struct AlignSummary {
+  double beg_median_error, end_median_error, translation_magnitude;
+  AlignSummary(): beg_median_error(0), end_median_error(0), translation_magnitude(0) {}
+};
+
+double median_error(Eigen::MatrixXd const& errors) {
+  std::vector<double> errs(errors.data(), errors.data() + errors.size());
+  if (errs.empty())
+    return std::numeric_limits<double>::quiet_NaN();
+  std::sort(errs.begin(), errs.end());
+  int len = errs.size();
+  return errs[std::min(len-1, (int)round(len*0.50))];
+}
+
+// Load the source cloud, align it to the reference, and save the results.
+// The reference tree must be already be built.
+AlignSummary align_source(Options const& opt,
+                          vw::cartography::GeoReference const& geo,
+                          asp::CsvConv const& csv_conv,
+                          BBox2 const& source_box,
+                          RefCloud const& ref,
+                          PM::ICP & icp) {
+
+  // These may be overwritten only within processSourceCloud()
+  Vector3 shift = ref.shift;
+  bool   is_lola_rdr_format    = ref.is_lola_rdr_format;
+  double mean_source_longitude = 0.0;
+  double elapsed_time;
+
+  // The point clouds are shifted, so shift the initial transform as well.
+  Eigen::MatrixXd shiftInitT = apply_shift(opt.init_transform, shift);
+
+  // Load, filter, transform, and resample the source point cloud
+  DP source_point_cloud;
+  processSourceCloud(opt, ref.cloud, shiftInitT, ref.dem_georef, geo, csv_conv, 
+                     source_box, ref.dem, is_lola_rdr_format, 
+                     mean_source_longitude, icp, shift, 
+                     source_point_cloud); // output
+
+  // Make the libpointmatcher error message clearer
+  std::string libpointmatcher_error = "no point to minimize";
+  std::string pc_align_error = 
+     "This likely means that the clouds are too far. Consider increasing the "
+     "--max-displacement value to something somewhat larger than the expected "
+     "length of the displacement that may be needed to align the clouds.\n";
+  
+  Eigen::MatrixXd beg_errors;
+  try {
+    elapsed_time = compute_registration_error(ref.cloud, source_point_cloud, icp,
+                                              shift, ref.dem_georef, ref.dem,
+                                              opt, beg_errors);
+  } catch(std::exception const& e) {
+    std::string error = e.what();
+    if (error.find(libpointmatcher_error) != std::string::npos)
+      error += ".\n" + pc_align_error; // clarify the error
+    vw_throw(ArgumentErr() << error);
+  }
+  
+  calc_stats("Input", beg_errors);
+  if (opt.verbose)
+    vw_out() << "Initial error computation took " << elapsed_time << " s\n";
+
+  // Set up the ICP object
+  Stopwatch sw4;
+  sw4.start();
+  bool verbose = false;
+  Eigen::MatrixXd Id = Eigen::MatrixXd::Identity(DIM + 1, DIM + 1);
+  icp.setParams(opt.out_prefix, opt.num_iter, opt.outlier_ratio,
+                (2.0*M_PI/360.0)*opt.diff_rotation_err, // convert to radians
+                opt.diff_translation_err, 
+                alignment_method_fallback(opt.alignment_method),
+                verbose);
+
+  // Compute the transformation to align the source to reference.
+  // We bypass calling ICP if the user explicitly asks for 0 iterations.
+  Eigen::MatrixXd T = Id;
+  if (opt.num_iter > 0) {
+    if (opt.alignment_method == "nuth") {
+      T = asp::nuthAlignment(opt.reference, opt.source, opt.out_prefix, 
+                             opt.max_disp, opt.num_iter,
+                             opt.num_threads, opt.compute_translation_only,
+                             opt.nuth_options);
+      // Nuth does not use the shift, so apply it after it is returned.
+      T = apply_shift(T, shift);
+    } else if (opt.alignment_method == "fgr") {
+      T = fgr_alignment(source_point_cloud, ref.cloud, opt.fgr_options);
+    } else if (opt.alignment_method == "point-to-plane" ||
+               opt.alignment_method == "point-to-point" ||
+               opt.alignment_method == "similarity-point-to-point" ||
+               opt.alignment_method == "similarity-point-to-plane") {
+      // Use libpointmatcher
+      try {
+        T = icp(source_point_cloud, ref.cloud, Id, opt.compute_translation_only);
+      } catch(std::exception const& e) {
+        std::string error = e.what();
+        if (error.find(libpointmatcher_error) != std::string::npos)
+          error += ".\n" + pc_align_error; // clarify the error
+        vw_throw(ArgumentErr() << error);
+      }
+      
+      vw_out() << "Match ratio: "
+               << icp.errorMinimizer->getWeightedPointUsedRatio() << endl;
+    } else if (opt.alignment_method == "least-squares" ||
+              opt.alignment_method == "similarity-least-squares") {
+      // Compute alignment using least squares
+      T = least_squares_alignment(source_point_cloud, shift,
+                                  ref.dem_georef, ref.dem, opt.alignment_method,
+                                  opt.num_iter, opt.num_threads);
+    } else
+      vw_throw( ArgumentErr() << "Unknown alignment method: " << opt.alignment_method);
+  }
+  sw4.stop();
+  if (opt.verbose)
+    vw_out() << "Alignment took " << sw4.elapsed_seconds() << " s\n";
+
+  // Transform the source to make it close to reference.
+  DP trans_source_point_cloud(source_point_cloud);
+  apply_transform_to_cloud(T, trans_source_point_cloud);
+
+  // Calculate by how much points move as result of T
+  double max_obtained_disp = calc_max_displacement(source_point_cloud, trans_source_point_cloud);
+  Vector3 source_ctr_vec, source_ctr_llh;
+  Vector3 trans_xyz, trans_ned, trans_llh;
+  vw::Matrix3x3 NedToEcef;
+  calc_translation_vec(shiftInitT, source_point_cloud, trans_source_point_cloud, shift,
+                       geo.datum(), source_ctr_vec, source_ctr_llh,
+                       trans_xyz, trans_ned, trans_llh, NedToEcef);
+
+  // For each point, compute the distance to the nearest reference point.
+  Eigen::MatrixXd end_errors;
+  elapsed_time 
+    = compute_registration_error(ref.cloud, trans_source_point_cloud, icp,
+                                 shift, ref.dem_georef, ref.dem, opt, 
+                                 end_errors);
+  calc_stats("Output", end_errors);
+  if (opt.verbose)
+    vw_out() << "Final error computation took " << elapsed_time << " s\n";
+
+  // Go back to the original coordinate system, by applying the shifted initial
+  // transform to the shifted computed transform and then undoing the shift.
+  Eigen::MatrixXd globalT = apply_shift(T * shiftInitT, -shift);
+
+  // Print statistics
+  vw_out() << std::setprecision(16)
+           << "Alignment transform (origin is planet center):\n" << globalT << "\n";
+  vw_out() << std::setprecision(8); // undo the higher precision
+
+  vw_out() << "Centroid of source points (Cartesian, meters): " << source_ctr_vec << "\n";
+  // Swap lat and lon, as we want to print lat first
+  std::swap(source_ctr_llh[0], source_ctr_llh[1]);
+  vw_out() << "Centroid of source points (lat,lon,z): " << source_ctr_llh << "\n";
+  vw_out() << "\n";
+
+  vw_out() << "Translation vector (Cartesian, meters): " << trans_xyz << "\n";
+  vw_out() << "Translation vector (North-East-Down, meters): "
+           << trans_ned << "\n";
+  vw_out() << "Translation vector magnitude (meters): " << norm_2(trans_xyz)
+           << "\n";
+  vw::vw_out() << "Maximum displacement of points between the source "
+               << "cloud with any initial transform applied to it and the "
+               << "source cloud after alignment to the reference: " 
+               << max_obtained_disp << " m" << "\n";
+  if (opt.max_disp > 0 && opt.max_disp < max_obtained_disp)
+    vw_out() << "Warning: The input --max-displacement value is smaller than the "
+             << "final observed displacement. It may be advised to increase the former "
+             << "and rerun the tool.\n";
+
+  // Swap lat and lon, as we want to print lat first
+  std::swap(trans_llh[0], trans_llh[1]);
+  vw_out() << "Translation vector (lat,lon,z): " << trans_llh << "\n";
+  vw_out() << "\n";
+
+  Matrix3x3 rot;
+  for (int r = 0; r < DIM; r++)
+    for (int c = 0; c < DIM; c++)
+      rot(r, c) = globalT(r, c);
+
+  double scale = pow(det(rot), 1.0/3.0);
+  for (int r = 0; r < DIM; r++)
+    for (int c = 0; c < DIM; c++)
+      rot(r, c) /= scale;
+
+  // Subtract one before printing the scale, to see a lot of digits of precision
+  vw_out() << "Transform scale - 1 = " << (scale-1.0) << "\n";
+  
+  Matrix3x3 rot_NED = inverse(NedToEcef) * rot * NedToEcef;
+ 
+  Vector3 euler_angles = math::rotation_matrix_to_euler_xyz(rot) * 180/M_PI;
+  Vector3 euler_angles_NED = math::rotation_matrix_to_euler_xyz(rot_NED) * 180/M_PI;
+  Vector3 axis_angles = math::matrix_to_axis_angle(rot) * 180/M_PI;
+  vw_out() << "Euler angles (degrees): " << euler_angles  << endl;
+  vw_out() << "Euler angles (North-East-Down, degrees): " << euler_angles_NED  << endl;
+  vw_out() << "Axis of rotation and angle (degrees): "
+           << axis_angles/norm_2(axis_angles) << ' '
+           << norm_2(axis_angles) << endl;
+
+  Stopwatch sw5;
+  sw5.start();
+  write_transforms(opt, globalT);
+
+  if (opt.save_trans_ref) {
+    string trans_ref_prefix = opt.out_prefix + "-trans_reference";
+    save_trans_point_cloud(opt, opt.reference, trans_ref_prefix,
+                           opt.ref_copc_win, opt.ref_copc_read_all,
+                           geo, csv_conv, globalT.inverse());
+  }
+
+  if (opt.save_trans_source) {
+    string trans_source_prefix = opt.out_prefix + "-trans_source";
+    save_trans_point_cloud(opt, opt.source, trans_source_prefix,
+                           opt.src_copc_win, opt.src_copc_read_all,
+                           geo, csv_conv, globalT);
+  }
+
+  save_errors(source_point_cloud, beg_errors,  opt.out_prefix + "-beg_errors.csv",
+              shift, geo, csv_conv, is_lola_rdr_format, mean_source_longitude);
+  save_errors(trans_source_point_cloud, end_errors,  opt.out_prefix + "-end_errors.csv",
+              shift, geo, csv_conv, is_lola_rdr_format, mean_source_longitude);
+
+  if (opt.verbose) vw_out() << "Writing: " << opt.out_prefix
+    + "-iterationInfo.csv" << "\n";
+
+  sw5.stop();
+  if (opt.verbose) vw_out() << "Saving to disk took "
+                            << sw5.elapsed_seconds() << " s\n";
+
+  AlignSummary summary;
+  summary.beg_median_error      = median_error(beg_errors);
+  summary.end_median_error      = median_error(end_errors);
+  summary.translation_magnitude = norm_2(trans_xyz);
+  return summary;
+}
+
+// Build the reference tree, used for finding the closest reference point
+// to a source point.
+void build_ref_tree(Options const& opt, RefCloud const& ref, PM::ICP & icp) {
+  Stopwatch sw3;
+  if (opt.verbose)
+    vw_out() << "Building the reference cloud tree.\n";
+  sw3.start();
+  icp.initRefTree(ref.cloud, alignment_method_fallback(opt.alignment_method),
+                  opt.highest_accuracy, false /*opt.verbose*/);
+  sw3.stop();
+  if (opt.verbose || !opt.ref_cloud_cache.empty())
+    vw_out() << "Reference point cloud processing took " << sw3.elapsed_seconds() << " s\n";
+}
+
+// The output prefix for each source in batch mode. Use the source file
+// name, and add the index if the same name shows up more than once.
+std::string batch_out_prefix(Options const& opt, size_t index) {
+  std::string stem = fs::path(opt.batch_sources[index]).stem().string();
+  int count = 0;
+  for (size_t it = 0; it < opt.batch_sources.size(); it++) {
+    if (fs::path(opt.batch_sources[it]).stem().string() == stem)
+      count++;
+  }
+  std::string prefix = opt.out_prefix + "-" + stem;
+  if (count > 1)
+    prefix += "-" + vw::num_to_str(index);
+  return prefix;
+}
+
+// Align each source in the list from --source-list to the reference, which
+// is loaded only once, and with its tree built only once. The sources are
+// aligned one after another. The failure to align a source is recorded in the
+// report, and the next source is tried.
+void align_batch(Options const& opt,
+                 vw::cartography::GeoReference const& geo,
+                 asp::CsvConv const& csv_conv,
+                 BBox2 const& ref_box, BBox2 const& trans_ref_box) {
+
+  // Estimate the region of the reference shared with each source. The
+  // reference is shared by all sources, so it is cropped to the union of
+  // these regions. A source whose region cannot be estimated is reported as
+  // failed below.
+  size_t num = opt.batch_sources.size();
+  std::vector<BBox2> source_boxes(num);
+  std::vector<std::string> box_errors(num);
+  BBox2 batch_ref_box;
+  double min_area = std::numeric_limits<double>::max();
+  bool crop_ref = !opt.skip_shared_box_estimation && !ref_box.empty();
+  for (size_t it = 0; it < num && !opt.skip_shared_box_estimation; it++) {
+    Options src_opt = opt;
+    src_opt.source = opt.batch_sources[it];
+    BBox2 src_ref_box = ref_box;
+    try {
+      estimate_shared_boxes(src_opt, geo, csv_conv, src_ref_box, trans_ref_box,
+                            source_boxes[it]);
+    } catch (std::exception const& e) {
+      box_errors[it] = e.what();
+      continue;
+    }
+    if (src_ref_box.empty()) {
+      crop_ref = false; // the boxes are too large to intersect
+    } else {
+      batch_ref_box.grow(src_ref_box);
+      min_area = std::min(min_area, src_ref_box.width() * src_ref_box.height());
+    }
+  }
+  if (!crop_ref)
+    batch_ref_box = BBox2();
+  vw_out() << "Reference points box for all sources: " << batch_ref_box << "\n";
+
+  // The reference is subsampled to --max-num-reference-points after it is
+  // cropped to the union of the regions. So that each source sees about as
+  // dense a reference as when aligned alone, scale the number of points by the
+  // ratio of the union area to the smallest region area, up to a limit. With
+  // the cache the budget is for the full reference, so it is not changed.
+  Options ref_opt = opt;
+  if (crop_ref && opt.ref_cloud_cache.empty() && min_area > 0.0) {
+    double scale = batch_ref_box.width() * batch_ref_box.height() / min_area;
+    double max_scale = 10.0;
+    if (scale > max_scale) {
+      vw_out(WarningMessage) << "The region of the reference shared with all sources "
+                             << "is " << scale << " times larger than for the smallest "
+                             << "source. The sources with small regions will see a "
+                             << "sparser reference than when aligned alone. Consider "
+                             << "splitting the source list by region.\n";
+      scale = max_scale;
+    }
+    if (scale > 1.0) {
+      double num_points = std::min(scale * opt.max_num_reference_points,
+                                   double(std::numeric_limits<int>::max()));
+      ref_opt.max_num_reference_points = int(num_points);
+      vw_out() << "Using up to " << ref_opt.max_num_reference_points
+               << " reference points for all sources.\n";
+    }
+  }
+
+  RefCloud ref;
+  load_ref_cloud(ref_opt, geo, csv_conv, batch_ref_box, ref);
+  PM::ICP icp;
+  build_ref_tree(opt, ref, icp);
+
+  std::string report_file = opt.out_prefix + "-batch-report.csv";
+  std::ofstream report(report_file.c_str());
+  if (!report.good())
+    vw_throw(ArgumentErr() << "Cannot write: " << report_file << "\n");
+  report.precision(8);
+  report << "# source, output_prefix, status, input_median_error, "
+         << "output_median_error, translation_magnitude, elapsed_seconds\n";
+
+  int num_failed = 0;
+  for (size_t it = 0; it < num; it++) {
+
+    Options src_opt = opt;
+    src_opt.source = opt.batch_sources[it];
+    src_opt.out_prefix = batch_out_prefix(opt, it);
+    vw_out() << "\nAligning source " << it + 1 << " of " << num << ": "
+             << src_opt.source << "\n";
+
+    Stopwatch sw;
+    sw.start();
+    AlignSummary summary;
+    std::string status = "success";
+    try {
+      if (!box_errors[it].empty())
+        vw_throw(ArgumentErr() << box_errors[it]);
+      summary = align_source(src_opt, geo, csv_conv, source_boxes[it], ref, icp);
+    } catch (std::exception const& e) {
+      vw_out(WarningMessage) << "Failed to align: " << src_opt.source << ". "
+                             << e.what() << "\n";
+      status = "failed";
+      double nan = std::numeric_limits<double>::quiet_NaN();
+      summary.beg_median_error = summary.end_median_error = nan;
+      summary.translation_magnitude = nan;
+      num_failed++;
+    }
+    sw.stop();
+
+    report << src_opt.source << ", " << src_opt.out_prefix << ", " << status << ", "
+           << summary.beg_median_error << ", " << summary.end_median_error << ", "
+           << summary.translation_magnitude << ", " << sw.elapsed_seconds() << "\n";
+    report.flush(); // so that progress can be seen
+  }
+
+  vw_out() << "Writing: " << report_file << "\n";
+  vw_out() << "Aligned " << num - num_failed << " of " << num << " source clouds.\n";
+}
+
 int main(int argc, char *argv[]) {
 
   // Mandatory line for Eigen
@@ -1051,7 +1687,10 @@ int main(int argc, char *argv[]) {
     GeoReference geo;
     std::vector<std::string> clouds;
     clouds.push_back(opt.reference);
-    clouds.push_back(opt.source);
+    if (opt.batch_sources.empty())
+      clouds.push_back(opt.source);
+    else
+      clouds.insert(clouds.end(), opt.batch_sources.begin(), opt.batch_sources.end());
     read_georef(clouds, opt.datum, opt.csv_srs,  
                 opt.semi_major_axis, opt.semi_minor_axis,  
                 opt.csv_format_str,  csv_conv, geo);
@@ -1096,344 +1735,31 @@ int main(int argc, char *argv[]) {
           * opt.init_transform;
     }
 
-    // Find the intersection of ref and source bounding boxs. This does not need
-    // a lot of samples as it is expanded by max_disp in either case.
-    BBox2 ref_box, source_box, trans_ref_box, trans_source_box;
-    if (!opt.skip_shared_box_estimation) {
-      Stopwatch sw0;
-      sw0.start();
-      int num_sample_pts = std::max(4000000,
-                                    std::max(opt.max_num_source_points,
-                                             opt.max_num_reference_points)/4);
-      num_sample_pts = std::min(1.0e+6, 1.0 * num_sample_pts); // avoid being slow
-      
-      // Compute GDC bounding box of the source and reference clouds.
-      vw_out() << "Computing the bounding boxes of the reference and source points using " 
-               << num_sample_pts << " sample points.\n";
-
-      // See if we have to estimate the proj win of the src points
-      bool need_src_projwin = false, dummy_flag = false;
-      vw::cartography::GeoReference src_georef, dummy_georef;
-      vw::BBox2 src_projwin, dummy_projwin;
-      checkNeeForSrcProjWin(opt, need_src_projwin, src_georef);
-      
-      Eigen::MatrixXd inv_init_trans = opt.init_transform.inverse();
-      calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
-                                opt.reference, opt.max_disp, inv_init_trans,
-                                opt.ref_copc_win, opt.ref_copc_read_all,
-                                need_src_projwin, src_georef,
-                                ref_box, trans_ref_box, src_projwin); // outputs
-
-      if (need_src_projwin) {
-        opt.src_copc_win = src_projwin;
-        vw::vw_out() << "Estimated: --src-copc-win "
-          << opt.src_copc_win.min().x() << " " << opt.src_copc_win.min().y() << " "
-          << opt.src_copc_win.max().x() << " " << opt.src_copc_win.max().y() << "\n";
-      }
+    // Estimate the region of the reference that is needed
+    BBox2 ref_box, trans_ref_box;
+    if (!opt.skip_shared_box_estimation)
+      estimate_ref_boxes(opt, geo, csv_conv, ref_box, trans_ref_box);
 
-      calc_extended_lonlat_bbox(geo, num_sample_pts, csv_conv,
-                                opt.source, opt.max_disp, opt.init_transform,
-                                opt.src_copc_win, opt.src_copc_read_all,
-                                dummy_flag, dummy_georef,
-                                source_box, trans_source_box, dummy_projwin); // outputs
-      sw0.stop();
-      vw_out() << "Computation of bounding boxes took " 
-              << sw0.elapsed_seconds() << " s\n";
-
-      // When boxes are huge, it is hard to do the optimization of intersecting
-      // them, as they may differ not by 0 or 360, but by 180. Better do nothing
-      // in that case. The solution may degrade a bit, as we may load points
-      // not in the intersection of the boxes, but at least it won't be wrong.
-      // In this case, there is a chance the boxes were computed wrong anyway.
-      if (ref_box.width() > 180.0 || source_box.width() > 180.0) {
-        vw_out() << "Warning: Your input point clouds are spread over more than half "
-                  << "the planet. It is suggested that they be cropped, to get more "
-                  << "accurate results. Giving up on estimating their bounding boxes "
-                  << "and filtering outliers based on them.\n";
-                
-        ref_box = BBox2();
-        source_box = BBox2();
-      }
-    
-      // This is useful to point out issues when the reference and source
-      // boxes are shifted by 360 degrees relative to each other.
-      vw_out() << "Reference points box: " << ref_box << "\n";
-      vw_out() << "Source points box:    " << source_box << "\n";
-      
-      if (!ref_box.empty() && !source_box.empty()) {
-        adjust_and_intersect_ref_source_boxes(ref_box, trans_source_box, 
-                                              opt.reference, opt.source);
-        adjust_and_intersect_ref_source_boxes(trans_ref_box, source_box, 
-                                              opt.reference, opt.source);
-      }
-      if (ref_box == source_box) {
-        // Leave some space here to align the text to the earlier printouts
-        vw_out() << "Intersection box:     " << ref_box    << "\n";
-      } else {
-        // This can happen when the projections are offset by 360 degrees
-        vw_out() << "Intersection reference box: " << ref_box    << "\n";
-        vw_out() << "Intersection source    box: " << source_box << "\n";
-      }
+    if (!opt.batch_sources.empty()) {
+      align_batch(opt, geo, csv_conv, ref_box, trans_ref_box);
+      return 0;
     }
-    
-    // Load the point clouds. We will shift both point clouds by the
-    // centroid of the first one to bring them closer to origin.
-
-    // Load the subsampled reference point cloud.
-    Vector3 shift;
-    bool   calc_shift = true; // Shift points so the first point is (0,0,0)
-    bool   is_lola_rdr_format = false;   // may get overwritten
-    double mean_ref_longitude    = 0.0;  // may get overwritten
-    double mean_source_longitude = 0.0;  // may get overwritten
-    Stopwatch sw1;
-    sw1.start();
-    DP ref_point_cloud;
-    load_cloud(opt.reference, opt.max_num_reference_points, ref_box,
-               opt.ref_copc_win, opt.ref_copc_read_all,
-               calc_shift, shift, geo, csv_conv, is_lola_rdr_format,
-               mean_ref_longitude, opt.verbose, ref_point_cloud);
-    sw1.stop();
-    if (opt.verbose)
-      vw_out() << "Loading the reference point cloud took "
-               << sw1.elapsed_seconds() << " s\n";
-    //ref_point_cloud.save(outputBaseFile + "_ref.vtk");
-
-    // So far we shifted by first point in reference point cloud to reduce
-    // the magnitude of all loaded points. Now that we have loaded all
-    // points, shift one more time, to place the centroid of the
-    // reference at the origin.
-    // Note: If this code is ever converting to using floats,
-    // the operation below needs to be re-implemented to be accurate.
-    int numRefPts = ref_point_cloud.features.cols();
-    Eigen::VectorXd meanRef = ref_point_cloud.features.rowwise().sum() / numRefPts;
-    ref_point_cloud.features.topRows(DIM).colwise()    -= meanRef.head(DIM);
-    for (int row = 0; row < DIM; row++)
-      shift[row] += meanRef(row); // Update the shift variable as well as the points
-    if (opt.verbose)
-      vw_out() << "Data shifted internally by subtracting: " << shift << "\n";
 
-    // The point clouds are shifted, so shift the initial transform as well.
-    Eigen::MatrixXd shiftInitT = apply_shift(opt.init_transform, shift);
-
-    // If the reference point cloud came from a DEM, also load the data in DEM format.
-    cartography::GeoReference dem_georef;
-    vw::ImageViewRef<PixelMask<float>> reference_dem_ref;
-    if (opt.use_dem_distances()) {
-      // Load the dem, then wrap it inside an ImageViewRef object. This is done
-      // because the actual DEM type cannot be created without being
-      // initialized.
-      InterpolationReadyDem 
-      reference_dem(load_interpolation_ready_dem(opt.reference, dem_georef));
-      reference_dem_ref.reset(reference_dem);
-    }
+    // Intersect with the region of the source
+    BBox2 source_box;
+    if (!opt.skip_shared_box_estimation)
+      estimate_shared_boxes(opt, geo, csv_conv, ref_box, trans_ref_box, source_box);
 
+    // Load the point clouds. We will shift both point clouds by the
+    // centroid of the first one to bring them closer to origin.
+    RefCloud ref;
+    load_ref_cloud(opt, geo, csv_conv, ref_box, ref);
+    
     // Filter the reference and initialize the reference tree
-    double elapsed_time;
     PM::ICP icp; // libpointmatcher object
+    build_ref_tree(opt, ref, icp);
 
-    Stopwatch sw3;
-    if (opt.verbose)
-      vw_out() << "Building the reference cloud tree.\n";
-    sw3.start();
-    icp.initRefTree(ref_point_cloud, alignment_method_fallback(opt.alignment_method),
-            opt.highest_accuracy, false /*opt.verbose*/);
-    sw3.stop();
-    if (opt.verbose)
-      vw_out() << "Reference point cloud processing took " << sw3.elapsed_seconds() << " s\n";
-
-   // Load, filter, transform, and resample the source point cloud
-   DP source_point_cloud;
-   processSourceCloud(opt, ref_point_cloud, shiftInitT, dem_georef, geo, csv_conv, 
-                      source_box, reference_dem_ref, is_lola_rdr_format, 
-                      mean_source_longitude, icp, shift, 
-                      source_point_cloud); // output
-
-    // Make the libpointmatcher error message clearer
-    std::string libpointmatcher_error = "no point to minimize";
-    std::string pc_align_error = 
-       "This likely means that the clouds are too far. Consider increasing the "
-       "--max-displacement value to something somewhat larger than the expected "
-       "length of the displacement that may be needed to align the clouds.\n";
-    
-    Eigen::MatrixXd beg_errors;
-    try {
-      elapsed_time = compute_registration_error(ref_point_cloud, source_point_cloud, icp,
-                                                shift, dem_georef, reference_dem_ref,
-                                                opt, beg_errors);
-    } catch(std::exception const& e) {
-      std::string error = e.what();
-      if (error.find(libpointmatcher_error) != std::string::npos)
-        error += ".\n" + pc_align_error; // clarify the error
-      vw_throw(ArgumentErr() << error);
-    }
-    
-    calc_stats("Input", beg_errors);
-    if (opt.verbose)
-      vw_out() << "Initial error computation took " << elapsed_time << " s\n";
-
-    // Set up the ICP object
-    Stopwatch sw4;
-    sw4.start();
-    bool verbose = false;
-    Eigen::MatrixXd Id = Eigen::MatrixXd::Identity(DIM + 1, DIM + 1);
-    icp.setParams(opt.out_prefix, opt.num_iter, opt.outlier_ratio,
-                  (2.0*M_PI/360.0)*opt.diff_rotation_err, // convert to radians
-                  opt.diff_translation_err, 
-                  alignment_method_fallback(opt.alignment_method),
-                  verbose);
-
-    // Compute the transformation to align the source to reference.
-    // We bypass calling ICP if the user explicitly asks for 0 iterations.
-    Eigen::MatrixXd T = Id;
-    if (opt.num_iter > 0) {
-      if (opt.alignment_method == "nuth") {
-        T = asp::nuthAlignment(opt.reference, opt.source, opt.out_prefix, 
-                               opt.max_disp, opt.num_iter,
-                               opt.num_threads, opt.compute_translation_only,
-                               opt.nuth_options);
-        // Nuth does not use the shift, so apply it after it is returned.
-        T = apply_shift(T, shift);
-      } else if (opt.alignment_method == "fgr") {
-        T = fgr_alignment(source_point_cloud, ref_point_cloud, opt.fgr_options);
-      } else if (opt.alignment_method == "point-to-plane" ||
-                 opt.alignment_method == "point-to-point" ||
-                 opt.alignment_method == "similarity-point-to-point" ||
-                 opt.alignment_method == "similarity-point-to-plane") {
-        // Use libpointmatcher
-        try {
-          T = icp(source_point_cloud, ref_point_cloud, Id, opt.compute_translation_only);
-        } catch(std::exception const& e) {
-          std::string error = e.what();
-          if (error.find(libpointmatcher_error) != std::string::npos)
-            error += ".\n" + pc_align_error; // clarify the error
-          vw_throw(ArgumentErr() << error);
-        }
-        
-        vw_out() << "Match ratio: "
-                 << icp.errorMinimizer->getWeightedPointUsedRatio() << endl;
-      } else if (opt.alignment_method == "least-squares" ||
-                opt.alignment_method == "similarity-least-squares") {
-        // Compute alignment using least squares
-        T = least_squares_alignment(source_point_cloud, shift,
-                                    dem_georef, reference_dem_ref, opt.alignment_method,
-                                    opt.num_iter, opt.num_threads);
-      } else
-        vw_throw( ArgumentErr() << "Unknown alignment method: " << opt.alignment_method);
-    }
-    sw4.stop();
-    if (opt.verbose)
-      vw_out() << "Alignment took " << sw4.elapsed_seconds() << " s\n";
-
-    // Transform the source to make it close to reference.
-    DP trans_source_point_cloud(source_point_cloud);
-    apply_transform_to_cloud(T, trans_source_point_cloud);
-
-    // Calculate by how much points move as result of T
-    double max_obtained_disp = calc_max_displacement(source_point_cloud, trans_source_point_cloud);
-    Vector3 source_ctr_vec, source_ctr_llh;
-    Vector3 trans_xyz, trans_ned, trans_llh;
-    vw::Matrix3x3 NedToEcef;
-    calc_translation_vec(shiftInitT, source_point_cloud, trans_source_point_cloud, shift,
-                         geo.datum(), source_ctr_vec, source_ctr_llh,
-                         trans_xyz, trans_ned, trans_llh, NedToEcef);
-
-    // For each point, compute the distance to the nearest reference point.
-    Eigen::MatrixXd end_errors;
-    elapsed_time 
-      = compute_registration_error(ref_point_cloud, trans_source_point_cloud, icp,
-                                   shift, dem_georef, reference_dem_ref, opt, 
-                                   end_errors);
-    calc_stats("Output", end_errors);
-    if (opt.verbose)
-      vw_out() << "Final error computation took " << elapsed_time << " s\n";
-
-    // Go back to the original coordinate system, by applying the shifted initial
-    // transform to the shifted computed transform and then undoing the shift.
-    Eigen::MatrixXd globalT = apply_shift(T * shiftInitT, -shift);
-
-    // Print statistics
-    vw_out() << std::setprecision(16)
-             << "Alignment transform (origin is planet center):\n" << globalT << "\n";
-    vw_out() << std::setprecision(8); // undo the higher precision
-
-    vw_out() << "Centroid of source points (Cartesian, meters): " << source_ctr_vec << "\n";
-    // Swap lat and lon, as we want to print lat first
-    std::swap(source_ctr_llh[0], source_ctr_llh[1]);
-    vw_out() << "Centroid of source points (lat,lon,z): " << source_ctr_llh << "\n";
-    vw_out() << "\n";
-
-    vw_out() << "Translation vector (Cartesian, meters): " << trans_xyz << "\n";
-    vw_out() << "Translation vector (North-East-Down, meters): "
-             << trans_ned << "\n";
-    vw_out() << "Translation vector magnitude (meters): " << norm_2(trans_xyz)
-             << "\n";
-    vw::vw_out() << "Maximum displacement of points between the source "
-                 << "cloud with any initial transform applied to it and the "
-                 << "source cloud after alignment to the reference: " 
-                 << max_obtained_disp << " m" << "\n";
-    if (opt.max_disp > 0 && opt.max_disp < max_obtained_disp)
-      vw_out() << "Warning: The input --max-displacement value is smaller than the "
-               << "final observed displacement. It may be advised to increase the former "
-               << "and rerun the tool.\n";
-
-    // Swap lat and lon, as we want to print lat first
-    std::swap(trans_llh[0], trans_llh[1]);
-    vw_out() << "Translation vector (lat,lon,z): " << trans_llh << "\n";
-    vw_out() << "\n";
-
-    Matrix3x3 rot;
-    for (int r = 0; r < DIM; r++)
-      for (int c = 0; c < DIM; c++)
-        rot(r, c) = globalT(r, c);
-
-    double scale = pow(det(rot), 1.0/3.0);
-    for (int r = 0; r < DIM; r++)
-      for (int c = 0; c < DIM; c++)
-        rot(r, c) /= scale;
-
-    // Subtract one before printing the scale, to see a lot of digits of precision
-    vw_out() << "Transform scale - 1 = " << (scale-1.0) << "\n";
-    
-    Matrix3x3 rot_NED = inverse(NedToEcef) * rot * NedToEcef;
-   
-    Vector3 euler_angles = math::rotation_matrix_to_euler_xyz(rot) * 180/M_PI;
-    Vector3 euler_angles_NED = math::rotation_matrix_to_euler_xyz(rot_NED) * 180/M_PI;
-    Vector3 axis_angles = math::matrix_to_axis_angle(rot) * 180/M_PI;
-    vw_out() << "Euler angles (degrees): " << euler_angles  << endl;
-    vw_out() << "Euler angles (North-East-Down, degrees): " << euler_angles_NED  << endl;
-    vw_out() << "Axis of rotation and angle (degrees): "
-             << axis_angles/norm_2(axis_angles) << ' '
-             << norm_2(axis_angles) << endl;
-
-    Stopwatch sw5;
-    sw5.start();
-    write_transforms(opt, globalT);
-
-    if (opt.save_trans_ref) {
-      string trans_ref_prefix = opt.out_prefix + "-trans_reference";
-      save_trans_point_cloud(opt, opt.reference, trans_ref_prefix,
-                             opt.ref_copc_win, opt.ref_copc_read_all,
-                             geo, csv_conv, globalT.inverse());
-    }
-
-    if (opt.save_trans_source) {
-      string trans_source_prefix = opt.out_prefix + "-trans_source";
-      save_trans_point_cloud(opt, opt.source, trans_source_prefix,
-                             opt.src_copc_win, opt.src_copc_read_all,
-                             geo, csv_conv, globalT);
-    }
-
-    save_errors(source_point_cloud, beg_errors,  opt.out_prefix + "-beg_errors.csv",
-                shift, geo, csv_conv, is_lola_rdr_format, mean_source_longitude);
-    save_errors(trans_source_point_cloud, end_errors,  opt.out_prefix + "-end_errors.csv",
-                shift, geo, csv_conv, is_lola_rdr_format, mean_source_longitude);
-
-    if (opt.verbose) vw_out() << "Writing: " << opt.out_prefix
-      + "-iterationInfo.csv" << "\n";
-
-    sw5.stop();
-    if (opt.verbose) vw_out() << "Saving to disk took "
-                              << sw5.elapsed_seconds() << " s\n";
+    align_source(opt, geo, csv_conv, source_box, ref, icp);
 
   } ASP_STANDARD_CATCHES;
 
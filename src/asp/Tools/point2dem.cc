@@ -26,6 +26,7 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/OutlierProcessing.h>
 #include <asp/Core/PointCloudProcessing.h>
+#include <asp/Core/PdalUtils.h>
 
 #include <vw/Image/InpaintView.h>
 #include <vw/Core/Stopwatch.h>
@@ -215,6 +216,23 @@ void handle_arguments(int argc, char *argv[], DemOptions& opt) {
      "maxx maxy, or minx maxy maxx miny, with no quotes.")
     ("copc-read-all", po::bool_switch(&opt.copc_read_all)->default_value(false), 
      "Read the full COPC file, ignoring the --copc-win option.")
+    ("single-pass", po::bool_switch(&opt.single_pass)->default_value(false),
+     "Produce the DEM and any of the orthoimage, intersection error, and stddev "
+     "outputs with a single pass over the point cloud, rather than one pass per "
+     "output. The orthoimage is produced separately if "
+     "--orthoimage-hole-fill-len is set.")
+    ("use-bbox-cache", po::bool_switch(&opt.use_bbox_cache)->default_value(false),
+     "Save the point cloud extent and the extents of its blocks to a file next to the "
+     "first input cloud, with the extension .bbox_cache, and reuse it in later runs "
+     "with the same input clouds, projection, and outlier removal options. That avoids "
+     "reading the full cloud before rasterizing, such as when only the grid size or "
+     "filter changes. Not used with LAS, CSV, or PCD input.")
+    ("copc-stream", po::bool_switch(&opt.copc_stream)->default_value(false),
+     "Read the input COPC LAZ files directly, fetching the points for each region "
+     "with spatial queries, rather than first converting them to temporary tif files. "
+     "This saves disk space and I/O for large clouds, though parts of the files may be "
+     "read more than once. All input clouds must be COPC files, as plain LAS files have "
+     "no spatial index. Use with --copc-win or --copc-read-all.")
     ;
 
   general_options.add(manipulation_options);
@@ -365,6 +383,21 @@ void handle_arguments(int argc, char *argv[], DemOptions& opt) {
       std::swap(opt.copc_win.min().y(), opt.copc_win.max().y());
     vw_out() << "Reading COPC LAZ file with bounding box " << opt.copc_win << ".\n";
   }
+  if (opt.copc_stream) {
+    for (size_t i = 0; i < opt.pointcloud_files.size(); i++) {
+      if (!asp::isCopc(opt.pointcloud_files[i]))
+        vw_throw(ArgumentErr() << "The option --copc-stream requires COPC LAZ files. "
+                 << "Got: " << opt.pointcloud_files[i] << ".\n");
+    }
+    if (opt.copc_win == BBox2() && !opt.copc_read_all)
+      vw_throw(ArgumentErr() << "The option --copc-stream requires either "
+               << "--copc-win or --copc-read-all.\n");
+    if (opt.do_error) {
+      vw_out(WarningMessage) << "The COPC files have no intersection error. "
+                             << "Ignoring --errorimage.\n";
+      opt.do_error = false;
+    }
+  }
   
   // Must specify either csv_srs or csv_proj4_str, but not both. The latter is 
   // for backward compatibility.
@@ -426,7 +459,9 @@ void rasterize_cloud_multi_spacing(const ImageViewRef<Vector3>& proj_points,
                                    cartography::GeoReference& georef,
                                    ImageViewRef<double> const& error_image,
                                    double estim_max_error,
-                                   vw::BBox3 const& estim_proj_box) {
+                                   vw::BBox3 const& estim_proj_box,
+                                   asp::PointCloudBoundaryCache * boundary_cache,
+                                   std::string const& boundary_cache_file) {
 
   asp::OutlierRemovalMethod outlier_removal_method = asp::NO_OUTLIER_REMOVAL_METHOD;
   if (opt.remove_outliers_with_pct)
@@ -449,9 +484,15 @@ void rasterize_cloud_multi_spacing(const ImageViewRef<Vector3>& proj_points,
                error_image, estim_max_error, estim_proj_box, opt.max_valid_triangulation_error,
                opt.median_filter_params, opt.erode_len, opt.has_las_or_csv_or_pcd,
                opt.filter, opt.default_grid_size_multiplier,
-               &num_invalid_pixels, &count_mutex,
+               &num_invalid_pixels, &count_mutex, boundary_cache,
                TerminalProgressCallback("asp", "Point cloud extent estimation: "));
 
+  // Save the extent for future runs
+  if (boundary_cache != NULL && !boundary_cache->loaded) {
+    vw_out() << "Writing: " << boundary_cache_file << "\n";
+    boundary_cache->write(boundary_cache_file);
+  }
+
   // Perform other rasterizer configuration
   rasterizer.set_use_alpha(opt.has_alpha);
   rasterizer.set_use_minz_as_default(false);
@@ -504,15 +545,27 @@ int main(int argc, char *argv[]) {
     //   themselves specify a different datum.
     // - Should all be XYZ format when finished, unless option 
     //  --input-is-projected is set.
+    // - With --copc-stream, the COPC files are read directly instead.
     std::vector<std::string> conv_files;
-    chip_convert_to_tif(opt, csv_conv, csv_georef, 
-                        opt.pointcloud_files, conv_files); // outputs
-
-    // Generate a merged xyz point cloud consisting of all inputs. By now, each
-    // input exists in xyz tif format.
-    ImageViewRef<Vector3> point_image
-      = asp::form_point_cloud_composite<Vector3>(opt.pointcloud_files,
-                                                 ASP_MAX_SUBBLOCK_SIZE);
+    ImageViewRef<Vector3> point_image;
+    if (opt.copc_stream) {
+      // Each window of the files becomes a strip having as many rows as the
+      // blocks in which the rasterizer traverses the cloud, so the windows are
+      // visited in order. Keep a few windows per thread in memory.
+      int cache_size = 2 * vw_settings().default_num_threads() + 2;
+      point_image = asp::copc_stream_cloud(opt.pointcloud_files,
+                                           opt.copc_win, opt.copc_read_all,
+                                           asp::ASPGlobalOptions::tri_tile_size(),
+                                           ASP_MAX_SUBBLOCK_SIZE, cache_size);
+    } else {
+      chip_convert_to_tif(opt, csv_conv, csv_georef, 
+                          opt.pointcloud_files, conv_files); // outputs
+
+      // Generate a merged xyz point cloud consisting of all inputs. By now, each
+      // input exists in xyz tif format.
+      point_image = asp::form_point_cloud_composite<Vector3>(opt.pointcloud_files,
+                                                             ASP_MAX_SUBBLOCK_SIZE);
+    }
     
     // Apply an (optional) rotation to the 3D points before building the mesh.
     if (opt.phi_rot != 0 || opt.omega_rot != 0 || opt.kappa_rot != 0) {
@@ -524,11 +577,12 @@ int main(int argc, char *argv[]) {
                                                      opt.kappa_rot, opt.rot_order));
     }
 
-    // Set up the error image
+    // Set up the error image. The COPC files read directly have no error.
     ImageViewRef<double> error_image;
     if (opt.remove_outliers_with_pct || opt.use_tukey_outlier_removal ||
         opt.max_valid_triangulation_error > 0.0) {
-      error_image = asp::point_cloud_error_image(opt.pointcloud_files);
+      if (!opt.copc_stream)
+        error_image = asp::point_cloud_error_image(opt.pointcloud_files);
       
       if (error_image.rows() == 0 || error_image.cols() == 0) {
         vw_out() << "The point cloud files must have an equal number of channels which "
@@ -619,17 +673,42 @@ int main(int argc, char *argv[]) {
       }
     }
 
+    // See if the point cloud extent can be read from a previous run
+    asp::PointCloudBoundaryCache boundary_cache;
+    asp::PointCloudBoundaryCache * boundary_cache_ptr = NULL;
+    std::string boundary_cache_file;
+    if (opt.use_bbox_cache) {
+      if (!conv_files.empty() || opt.copc_stream) {
+        vw_out(WarningMessage) << "Ignoring --use-bbox-cache for LAS, CSV, "
+                               << "or PCD input.\n";
+      } else {
+        boundary_cache_ptr  = &boundary_cache;
+        boundary_cache_file = asp::bbox_cache_file(opt);
+        boundary_cache.key  = asp::bbox_cache_key(opt, output_georef);
+        if (boundary_cache.read(boundary_cache_file, boundary_cache.key))
+          vw_out() << "Read: " << boundary_cache_file << "\n";
+      }
+    }
+
     // Estimate the proj box size, and the max intersection error (if having an error iamge)
     double estim_max_error = 0.0;
     BBox3 estim_proj_box;
-    estim_max_error 
-    = asp::estim_max_tri_error_and_proj_box(proj_points, error_image,
-                                            opt.remove_outliers_params,
-                                            estim_proj_box);
+    if (boundary_cache.loaded) {
+      estim_max_error = boundary_cache.estim_max_error;
+      estim_proj_box  = boundary_cache.estim_proj_box;
+    } else {
+      estim_max_error 
+      = asp::estim_max_tri_error_and_proj_box(proj_points, error_image,
+                                              opt.remove_outliers_params,
+                                              estim_proj_box);
+      boundary_cache.estim_max_error = estim_max_error;
+      boundary_cache.estim_proj_box  = estim_proj_box;
+    }
 
     // Create the DEM
     rasterize_cloud_multi_spacing(proj_points, opt, output_georef, error_image,
-                                  estim_max_error, estim_proj_box);
+                                  estim_max_error, estim_proj_box,
+                                  boundary_cache_ptr, boundary_cache_file);
     // Wipe the temporary converted files
     for (size_t i = 0; i < conv_files.size(); i++)
       if (fs::exists(conv_files[i])) 
@@ -133,7 +133,7 @@ void callTop() {
 }
 
 struct Options: public vw::GdalWriteOptions {
-  std::string input_dem, image_list, camera_list, out_prefix, stereo_session, bundle_adjust_prefix, input_albedo;
+  std::string input_dem, image_list, camera_list, out_prefix, stereo_session, bundle_adjust_prefix, input_albedo, approx_camera_models_dir;
   std::vector<std::string> input_images, input_cameras;
   std::string shadow_thresholds, custom_shadow_threshold_list, max_valid_image_vals, skip_images_str, image_exposures_prefix, model_coeffs_prefix, model_coeffs, image_haze_prefix, sun_positions_list, sun_angles_list;
   std::vector<float> shadow_threshold_vec, max_valid_image_vals_vec;
@@ -1876,7 +1876,15 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("save-dem-with-nodata",   po::bool_switch(&opt.save_dem_with_nodata)->default_value(false)->implicit_value(true),
      "Save a copy of the DEM while using a no-data value at a DEM grid point where all images show shadows. To be used if shadow thresholds are set.")
     ("use-approx-camera-models",   po::bool_switch(&opt.use_approx_camera_models)->default_value(false)->implicit_value(true),
-     "Use approximate camera models for speed. Only with ISIS .cub cameras.")
+     "Use approximate camera models for speed. These are lookup tables that can be "
+     "used from multiple threads, even with ISIS cameras. With ISIS cameras, this "
+     "option is needed to use more than one thread, as ISIS is single-threaded. The "
+     "largest error of each table, over the range of DEM heights, is printed.")
+    ("approx-camera-models-dir", po::value(&opt.approx_camera_models_dir)->default_value(""),
+     "With --use-approx-camera-models, save the approximate camera models to this "
+     "directory, and reuse them on later runs with the same images, cameras, and input "
+     "DEM, such as for the steps of parallel_sfs. The file names include a hash of "
+     "these inputs, so the models for different DEM tiles do not overwrite each other.")
     ("crop-input-images",   po::bool_switch(&opt.crop_input_images)->default_value(false)->implicit_value(true),
      "Crop the images to a region that was computed to be large enough, and keep them fully in memory, for speed. This is the default in the latest builds.")
     ("blending-dist", po::value(&opt.blending_dist)->default_value(0),
@@ -3213,13 +3221,6 @@ int main(int argc, char* argv[]) {
       vw::vw_out(vw::WarningMessage) << "The input DEM is large and this program "
         << "may run out of memory. Use parallel_sfs instead, with small tiles.\n";
         
-    // This check must be here, after we find the session
-    if (opt.stereo_session != "isis" && opt.use_approx_camera_models) {
-      vw_out() << "Computing approximate models works only with ISIS cameras. "
-               << "Ignoring this option.\n";
-      opt.use_approx_camera_models = false;
-    }
-
     // Ensure our camera models are always adjustable. 
     // TODO(oalexan1): This is likely not needed anymore.
     for (int image_iter = 0; image_iter < num_images; image_iter++) {
@@ -3274,11 +3275,35 @@ int main(int argc, char* argv[]) {
         vw_out() << "Creating an approximate camera model for "
                 << opt.input_images[image_iter] << "\n";
         BBox2i img_bbox = crop_boxes[image_iter];
+
+        // The prefix of the file in which the model may have been saved
+        // before, and the inputs it depends on, other than the DEM and
+        // adjustments. The model appends to the prefix a hash of all these,
+        // so that the parallel_sfs tiles, with different DEMs, do not
+        // overwrite each other's models.
+        std::string cache_prefix, cache_id;
+        if (opt.approx_camera_models_dir != "") {
+          std::ostringstream os;
+          os << opt.approx_camera_models_dir << "/"
+             << fs::path(opt.input_images[image_iter]).stem().string()
+             << "-approx-camera-" << image_iter;
+          cache_prefix = os.str();
+          std::string const& img = opt.input_images[image_iter];
+          std::string const& cam = opt.input_cameras[image_iter];
+          std::ostringstream id;
+          id << opt.stereo_session << " " << fs::absolute(img).string() << " "
+             << fs::file_size(img) << " " << fs::last_write_time(img) << " "
+             << fs::absolute(cam).string() << " " << fs::file_size(cam) << " "
+             << fs::last_write_time(cam) << " " << opt.bundle_adjust_prefix;
+          cache_id = id.str();
+        }
+        
         Stopwatch sw;
         sw.start();
         boost::shared_ptr<CameraModel> apcam;
         apcam.reset(new asp::ApproxCameraModel(exact_camera, img_bbox, dem, geo,
-                                               dem_nodata_val, camera_mutex));
+                                               dem_nodata_val, camera_mutex,
+                                               cache_prefix, cache_id));
         cameras[image_iter] = apcam;
         
         sw.stop();
@@ -3293,10 +3318,13 @@ int main(int argc, char* argv[]) {
 
         bool model_is_valid = cam_ptr->model_is_valid();
         
-        // Compared original and approximate models
+        // Compared original and approximate models. If the model was loaded
+        // from disk, that was done before, and the crop box was found.
         double max_curr_err = 0.0;
 
-        if (model_is_valid) {
+        if (cam_ptr->loaded()) {
+          max_curr_err = cam_ptr->dem_error();
+        } else if (model_is_valid) {
           for (int col = 0; col < dem.cols(); col++) {
             for (int row = 0; row < dem.rows(); row++) {
               Vector2 ll = geo.pixel_to_lonlat(Vector2(col, row));
@@ -3333,6 +3361,12 @@ int main(int argc, char* argv[]) {
       
         cam_ptr->crop_box().crop(img_bbox);
         vw_out() << "Crop box dimensions: " << cam_ptr->crop_box() << std::endl;
+
+        if (cam_ptr->cache_file() != "" && !cam_ptr->loaded()) {
+          cam_ptr->dem_error() = max_curr_err;
+          vw::create_out_dir(cam_ptr->cache_file());
+          cam_ptr->write_table();
+        }
   
         // Copy the crop box
         if (opt.crop_input_images)
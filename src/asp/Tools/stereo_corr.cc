@@ -23,6 +23,7 @@
 #include <asp/Core/InterestPointMatching.h>
 #include <asp/Core/IpMatchingAlgs.h>
 #include <asp/Core/LocalAlignment.h>
+#include <asp/Core/StereoPlugin.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Core/Macros.h>
@@ -1082,6 +1083,7 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
   Matrix<double> left_local_mat  = math::identity_matrix<3>();
   Matrix<double> right_local_mat = math::identity_matrix<3>();
   std::string left_aligned_file, right_aligned_file;
+  vw::ImageView<float> left_aligned_tile, right_aligned_tile;
   int min_disp = -1, max_disp = -1;
   std::string out_disp_file = opt.out_prefix + "-D.tif";
 
@@ -1105,6 +1107,31 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
     write_nodata = false; // To avoid warnings from the tif reader in msmw
   }
 
+  // Look up the plugin for an external algorithm. The ASP algorithms and
+  // the plugins built as shared libraries take the locally aligned tiles in
+  // memory, so these are written to disk only for the other ones, or for
+  // inspection.
+  vw::stereo::CorrelationAlgorithm stereo_alg
+    = asp::stereo_alg_to_num(stereo_settings().stereo_algorithm);
+  std::string plugin_path, plugin_lib;
+  bool write_tiles = false;
+  if (stereo_alg == vw::stereo::VW_CORRELATION_OTHER) {
+    write_tiles = true;
+    if (alg_name != "opencv_bm" && alg_name != "opencv_sgbm") {
+      std::map<std::string, std::string> plugins, plugin_libs;
+      asp::parse_plugins_list(plugins, plugin_libs);
+      auto it1 = plugins.find(alg_name);
+      auto it2 = plugin_libs.find(alg_name);
+      if (it1 == plugins.end() || it2 == plugin_libs.end()) 
+        vw_throw(ArgumentErr() << "Could not lookup plugin: " << alg_name << ".\n");
+      plugin_path = it1->second;
+      plugin_lib = it2->second;
+      write_tiles = !asp::isLibraryStereoPlugin(plugin_path);
+    }
+  }
+  if (stereo_settings().local_alignment_debug)
+    write_tiles = true;
+
   double left_extra_factor = 1.0, right_extra_factor = 1.0;
   bool success = false;
   std::string err_msg;
@@ -1131,7 +1158,7 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
       local_alignment(// Inputs
                       opt, alg_name, opt.session->name(),
                       max_tile_size, left_extra_factor, right_extra_factor,
-                      tile_crop_win, write_nodata,
+                      tile_crop_win, write_nodata, write_tiles,
                       left_camera_model.get(),
                       right_camera_model.get(),
                       datum,
@@ -1139,6 +1166,7 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
                       left_trans_crop_win, right_trans_crop_win,
                       left_local_mat, right_local_mat,
                       left_aligned_file, right_aligned_file,  
+                      left_aligned_tile, right_aligned_tile,
                       min_disp, max_disp);
       success = true;
       break;
@@ -1168,19 +1196,17 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
   
   vw::ImageView<PixelMask<Vector2f>> unaligned_disp_2d;
   vw::ImageView<vw::PixelMask<float>> unaligned_lr_disp_diff;
-  vw::stereo::CorrelationAlgorithm stereo_alg
-    = asp::stereo_alg_to_num(stereo_settings().stereo_algorithm);
   
   if (stereo_alg < vw::stereo::VW_CORRELATION_OTHER) {
 
     // ASP algorithms
 
-    // Mask the locally alignment images which were written with NaN nodata.
+    // Mask the locally aligned images, which have NaN nodata.
     float nan  = std::numeric_limits<float>::quiet_NaN();
     ImageView<PixelMask<PixelGray<float>>> left_image
-      = vw::create_mask(DiskImageView<PixelGray<float>>(left_aligned_file), nan);
+      = vw::create_mask(pixel_cast<PixelGray<float>>(left_aligned_tile), nan);
     ImageView<PixelMask<PixelGray<float>>> right_image
-      = vw::create_mask(DiskImageView<PixelGray<float>>(right_aligned_file), nan);
+      = vw::create_mask(pixel_cast<PixelGray<float>>(right_aligned_tile), nan);
     
     ImageView<vw::uint8> left_mask
       = channel_cast_rescale<vw::uint8>(select_channel(left_image, 1));
@@ -1293,7 +1319,7 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
         + "-s 0 -b 0 -o -0.25 -f 0 -P 32 -D 0 -O 25 -c 0 "
         + "-m " + vw::num_to_str(min_disp) + " -M " + vw::num_to_str(max_disp);
       
-    } else if (alg_name == "libelas"){
+    } else if (alg_name == "libelas" || alg_name == "libelas_lib") {
       // For some reasons libelas fails with a tight search range
       int extra = 10 + std::max(0, min_disp);
       vw_out() << "For libelas, grow the search range on each end by " << extra << ".\n";
@@ -1369,90 +1395,102 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
                              aligned_disp);
     } else {
 
-      // Read the list of plugins
-      std::map<std::string, std::string> plugins, plugin_libs;
-      asp::parse_plugins_list(plugins, plugin_libs);
+      if (asp::isLibraryStereoPlugin(plugin_path)) {
+        // Run the plugin in-process on the tiles in memory. A failure to load
+        // it is fatal, but if it fails on this tile, write an empty disparity
+        // as below. The environmental variables are set before loading it.
+        if (env_vars != "") 
+          vw_out() << "Using environmental variables: " << env_vars << std::endl;
+        asp::StereoPlugin const& plugin = asp::loadStereoPlugin(plugin_path, env_vars_map);
+        vw_out() << "Running: " << plugin_path << " " << options << std::endl;
+        
+        std::vector<std::string> plugin_opts;
+        std::istringstream is(options);
+        std::string val;
+        while (is >> val)
+          plugin_opts.push_back(val);
+        
+        try {
+          plugin.run(plugin_opts, left_aligned_tile, right_aligned_tile,
+                     min_disp, max_disp, aligned_disp);
+        } catch(std::exception const& e){
+          vw_out() << e.what() << std::endl;
+          save_empty_disparity(opt, tile_crop_win, out_disp_file);
+          return;
+        }
+      } else {
 
-      auto it1 = plugins.find(alg_name);
-      auto it2 = plugin_libs.find(alg_name);
-      if (it1 == plugins.end() || it2 == plugin_libs.end()) 
-        vw_throw(ArgumentErr() << "Could not lookup plugin: " << alg_name << ".\n");
+        // Set up the environemnt
+        asp::setEnvVar("LD_LIBRARY_PATH", plugin_lib);   // For Linux
+        asp::setEnvVar("DYLD_LIBRARY_PATH", plugin_lib); // For OSX
+        vw_out() << "Path to libraries: " << plugin_lib << std::endl;
+        for (auto it = env_vars_map.begin(); it != env_vars_map.end(); it++)
+          asp::setEnvVar(it->first, it->second);
       
-      std::string plugin_path = it1->second;
-      std::string plugin_lib = it2->second;
-
-      // Set up the environemnt
-      asp::setEnvVar("LD_LIBRARY_PATH", plugin_lib);   // For Linux
-      asp::setEnvVar("DYLD_LIBRARY_PATH", plugin_lib); // For OSX
-      vw_out() << "Path to libraries: " << plugin_lib << std::endl;
-      for (auto it = env_vars_map.begin(); it != env_vars_map.end(); it++)
-        asp::setEnvVar(it->first, it->second);
+        // Call an external program which will write the disparity to disk
+        std::string cmd = plugin_path + " " + options + " " 
+          + left_aligned_file + " " + right_aligned_file + " " + aligned_disp_file;
       
-      // Call an external program which will write the disparity to disk
-      std::string cmd = plugin_path + " " + options + " " 
-        + left_aligned_file + " " + right_aligned_file + " " + aligned_disp_file;
-      
-      if (alg_name == "msmw" || alg_name == "msmw2")
-        cmd += " " + mask_file; // Provide the mask file
+        if (alg_name == "msmw" || alg_name == "msmw2")
+          cmd += " " + mask_file; // Provide the mask file
 
-      int timeout = stereo_settings().corr_timeout;
+        int timeout = stereo_settings().corr_timeout;
 
-      if (env_vars != "") 
-        vw_out() << "Using environmental variables: " << env_vars << std::endl;
+        if (env_vars != "") 
+          vw_out() << "Using environmental variables: " << env_vars << std::endl;
 
-      vw_out() << cmd << std::endl;
+        vw_out() << cmd << std::endl;
 
-      // Use a system call
-      system(cmd.c_str());
+        // Use a system call
+        system(cmd.c_str());
       
-      // Read the disparity from disk. This may fail, for example, the
-      // disparity may time out or it may not have good data. In that
-      // case just make an empty disparity, as we don't want
-      // the processing of the full image to fail because of a tile.
-      try {
-        aligned_disp = DiskImageView<float>(aligned_disp_file);
-      } catch(std::exception const& e){
-        // If this tile fails, write an empty disparity
-        vw_out() << e.what() << std::endl;
-        save_empty_disparity(opt, tile_crop_win, out_disp_file);
-        return;
-      }
+        // Read the disparity from disk. This may fail, for example, the
+        // disparity may time out or it may not have good data. In that
+        // case just make an empty disparity, as we don't want
+        // the processing of the full image to fail because of a tile.
+        try {
+          aligned_disp = DiskImageView<float>(aligned_disp_file);
+        } catch(std::exception const& e){
+          // If this tile fails, write an empty disparity
+          vw_out() << e.what() << std::endl;
+          save_empty_disparity(opt, tile_crop_win, out_disp_file);
+          return;
+        }
       
-      if (alg_name == "msmw" || alg_name == "msmw2") {
-        // TODO(oalexan1): Make this into a function
-        // Apply the mask, which for this algorithm is stored separately.
-        // For that need to read things in memory.
-        ImageView<float> local_disp(aligned_disp.cols(), aligned_disp.rows());
-        DiskImageView<vw::uint8> mask(mask_file);
-
-        if (local_disp.cols() != mask.cols() || local_disp.rows() != mask.rows()) 
-          vw_throw(ArgumentErr() << "Expecting that the following images would "
-                   << "have the same dimensions: "
-                   << aligned_disp_file << ' ' << mask_file << ".\n");
+        if (alg_name == "msmw" || alg_name == "msmw2") {
+          // TODO(oalexan1): Make this into a function
+          // Apply the mask, which for this algorithm is stored separately.
+          // For that need to read things in memory.
+          ImageView<float> local_disp(aligned_disp.cols(), aligned_disp.rows());
+          DiskImageView<vw::uint8> mask(mask_file);
+
+          if (local_disp.cols() != mask.cols() || local_disp.rows() != mask.rows()) 
+            vw_throw(ArgumentErr() << "Expecting that the following images would "
+                     << "have the same dimensions: "
+                     << aligned_disp_file << ' ' << mask_file << ".\n");
           
-        float nan = std::numeric_limits<float>::quiet_NaN();
-        for (int col = 0; col < local_disp.cols(); col++) {
-          for (int row = 0; row < local_disp.rows(); row++) {
-            if (mask(col, row) != 0) 
-              local_disp(col, row) = aligned_disp(col, row);
-            else
-              local_disp(col, row) = nan;
+          float nan = std::numeric_limits<float>::quiet_NaN();
+          for (int col = 0; col < local_disp.cols(); col++) {
+            for (int row = 0; row < local_disp.rows(); row++) {
+              if (mask(col, row) != 0) 
+                local_disp(col, row) = aligned_disp(col, row);
+              else
+                local_disp(col, row) = nan;
+            }
           }
-        }
         
-        // Assign the image we just made to the handle
-        aligned_disp = local_disp;
-      }
+          // Assign the image we just made to the handle
+          aligned_disp = local_disp;
+        }
+      } // End running an external program
     }
 
     try {
-      // Sanity check. Temporarily load the left image.
-      DiskImageView<float> left_image(left_aligned_file);
-      if (aligned_disp.cols() != left_image.cols() || 
-          aligned_disp.rows() != left_image.rows() ) 
-        vw_throw(ArgumentErr() << "Expecting that the 1D disparity " << aligned_disp_file
-                 << " would have the same dimensions as the left image " << left_aligned_file
-                 << ".\n");
+      // Sanity check
+      if (aligned_disp.cols() != left_aligned_tile.cols() || 
+          aligned_disp.rows() != left_aligned_tile.rows()) 
+        vw_throw(ArgumentErr() << "Expecting that the 1D disparity would have "
+                 << "the same dimensions as the left aligned tile.\n");
     } catch(std::exception const& e){
       // If this tile fails, write an empty disparity
       vw_out() << e.what() << std::endl;
@@ -1466,9 +1504,9 @@ void stereo_correlation_1D(ASPGlobalOptions& opt) {
       // Wipe disparities which map to an invalid pixel
       float nan  = std::numeric_limits<float>::quiet_NaN();
       ImageView<PixelMask<PixelGray<float>>> left_masked_image
-        = vw::create_mask(DiskImageView<PixelGray<float>>(left_aligned_file), nan);
+        = vw::create_mask(pixel_cast<PixelGray<float>>(left_aligned_tile), nan);
       ImageView<PixelMask<PixelGray<float>>> right_masked_image
-        = vw::create_mask(DiskImageView<PixelGray<float>>(right_aligned_file), nan);
+        = vw::create_mask(pixel_cast<PixelGray<float>>(right_aligned_tile), nan);
       
       // invalid value for a PixelMask
       PixelMask<PixelGray<float>> nodata_mask = PixelMask<PixelGray<float>>(); 
@@ -92,11 +92,128 @@ void find_tile_at_loc(std::string const& tile_at_loc, ASPGlobalOptions const& op
     vw_out() << "No tile found at location.\n"; 
 }
 
-// Produce the list of tiles for which D_sub has valid values.
+// A parallel_stereo tile and its estimated correlation cost
+struct TileCost {
+  vw::BBox2i box;
+  double cost;
+};
+
+// Estimate the cost of correlation in a tile as the number of its pixels
+// having valid low-res disparity, times the area of the search range, which
+// is found as in stereo_corr, from D_sub and D_sub_spread. Return 0 if
+// there are no valid disparities in the padded tile.
+double tileCorrCost(vw::BBox2i const& box,
+                    vw::ImageView<vw::PixelMask<vw::Vector2f>> const& sub_disp,
+                    vw::ImageView<vw::PixelMask<vw::Vector2f>> const& sub_disp_spread,
+                    vw::Vector2 const& upsample_scale, int sgm_collar_size) {
+
+  int min_sub_x = floor((box.min().x() - sgm_collar_size) / upsample_scale[0]);
+  int min_sub_y = floor((box.min().y() - sgm_collar_size) / upsample_scale[1]);
+  int max_sub_x = ceil((box.max().x() + sgm_collar_size) / upsample_scale[0]);
+  int max_sub_y = ceil((box.max().y() + sgm_collar_size) / upsample_scale[1]);
+
+  min_sub_x = std::max(min_sub_x, 0);
+  min_sub_y = std::max(min_sub_y, 0);
+  max_sub_x = std::min(max_sub_x, sub_disp.cols() - 1);
+  max_sub_y = std::min(max_sub_y, sub_disp.rows() - 1);
+
+  bool has_spread = (sub_disp_spread.cols() == sub_disp.cols() &&
+                     sub_disp_spread.rows() == sub_disp.rows());
+
+  int num_valid = 0, num_total = 0;
+  vw::BBox2 range;
+  vw::Vector2 spread(0, 0);
+  for (int y = min_sub_y; y <= max_sub_y; y++) {
+    for (int x = min_sub_x; x <= max_sub_x; x++) {
+      num_total++;
+      if (!is_valid(sub_disp(x, y)))
+        continue;
+      num_valid++;
+      range.grow(sub_disp(x, y).child());
+      if (has_spread && is_valid(sub_disp_spread(x, y))) {
+        spread[0] = std::max(spread[0], double(sub_disp_spread(x, y).child()[0]));
+        spread[1] = std::max(spread[1], double(sub_disp_spread(x, y).child()[1]));
+      }
+    }
+  }
+
+  if (num_valid == 0)
+    return 0.0;
+
+  // The search range is expanded by the spread and by 1 on each side, then
+  // scaled to full resolution, as in stereo_corr.
+  double search_w = (range.width()  + 2.0 * spread[0] + 2.0) * upsample_scale[0];
+  double search_h = (range.height() + 2.0 * spread[1] + 2.0) * upsample_scale[1];
+
+  double valid_frac = double(num_valid) / double(num_total);
+  return valid_frac * double(box.width()) * double(box.height()) * search_w * search_h;
+}
+
+// Split into four the tiles whose cost exceeds the given multiple of the
+// median cost, recursively, without making tiles smaller than min_size.
+void splitExpensiveTiles(double max_cost_ratio, int min_size,
+                         vw::ImageView<vw::PixelMask<vw::Vector2f>> const& sub_disp,
+                         vw::ImageView<vw::PixelMask<vw::Vector2f>> const& sub_disp_spread,
+                         vw::Vector2 const& upsample_scale,
+                         std::vector<TileCost> & tiles) {
+
+  std::vector<double> costs;
+  for (size_t it = 0; it < tiles.size(); it++)
+    costs.push_back(tiles[it].cost);
+  if (costs.empty())
+    return;
+  std::sort(costs.begin(), costs.end());
+  double max_cost = max_cost_ratio * costs[costs.size()/2];
+
+  std::vector<TileCost> out_tiles;
+  std::vector<TileCost> stack;
+  int num_split = 0;
+  for (size_t it = 0; it < tiles.size(); it++) {
+    stack.push_back(tiles[it]);
+    while (!stack.empty()) {
+      TileCost tile = stack.back();
+      stack.pop_back();
+      vw::BBox2i const& b = tile.box;
+      if (tile.cost <= max_cost || b.width() < 2 * min_size || b.height() < 2 * min_size) {
+        if (tile.cost > 0)
+          out_tiles.push_back(tile);
+        continue;
+      }
+
+      num_split++;
+      int half_x = b.width() / 2, half_y = b.height() / 2;
+      vw::BBox2i sub_boxes[4] = {
+        vw::BBox2i(b.min().x(),          b.min().y(),          half_x,             half_y),
+        vw::BBox2i(b.min().x() + half_x, b.min().y(),          b.width() - half_x, half_y),
+        vw::BBox2i(b.min().x(),          b.min().y() + half_y, half_x,             b.height() - half_y),
+        vw::BBox2i(b.min().x() + half_x, b.min().y() + half_y, b.width() - half_x, b.height() - half_y)};
+
+      // Push in reverse, so the pieces come out in row-major order
+      for (int s = 3; s >= 0; s--) {
+        TileCost sub_tile;
+        sub_tile.box = sub_boxes[s];
+        int sgm_collar_size = 0; // splitting is not done for padded tiles
+        sub_tile.cost = tileCorrCost(sub_tile.box, sub_disp, sub_disp_spread,
+                                     upsample_scale, sgm_collar_size);
+        stack.push_back(sub_tile);
+      }
+    }
+  }
+
+  if (num_split > 0)
+    vw_out() << "Split " << num_split << " tiles with estimated cost more than "
+             << max_cost_ratio << " times the median.\n";
+
+  tiles = out_tiles;
+}
+
+// Produce the list of tiles for which D_sub has valid values. Save as well
+// the estimated correlation cost for each tile, for parallel_stereo to
+// schedule the most expensive tiles first.
 void produceTiles(std::string const& output_prefix, 
                   vw::Vector2 const& trans_left_image_size,
                   vw::Vector2i const& parallel_tile_size,
-                  int sgm_collar_size) {
+                  int sgm_collar_size, bool using_tiles) {
 
   if (trans_left_image_size == vw::Vector2(0, 0))
       vw_throw(ArgumentErr() << "Cannot produce tiles without a valid L.tif.\n");
@@ -105,7 +222,8 @@ void produceTiles(std::string const& output_prefix,
   // run, as that one is tricky to get right, given that each pair run has its own D_sub.
   bool have_D_sub = false;
   std::string d_sub_file = output_prefix + "-D_sub.tif";
-  vw::ImageView<vw::PixelMask<vw::Vector2f>> sub_disp;
+  std::string spread_file = output_prefix + "-D_sub_spread.tif";
+  vw::ImageView<vw::PixelMask<vw::Vector2f>> sub_disp, sub_disp_spread;
   vw::Vector2 upsample_scale(0, 0);
   bool is_multiview = stereo_settings().part_of_multiview_run;
   if (stereo_settings().seed_mode != 0 && !is_multiview) {
@@ -117,6 +235,12 @@ void produceTiles(std::string const& output_prefix,
       // with no data then.
       have_D_sub = false;
     }
+    // The spread is optional. It only makes the cost estimate better.
+    if (have_D_sub && fs::exists(spread_file)) {
+      try {
+        vw::read_image(sub_disp_spread, spread_file);
+      } catch(...) {}
+    }
   }
 
   int tile_x = parallel_tile_size[0];
@@ -124,11 +248,8 @@ void produceTiles(std::string const& output_prefix,
   int tiles_nx = int(ceil(double(trans_left_image_size[0]) / tile_x));
   int tiles_ny = int(ceil(double(trans_left_image_size[1]) / tile_y));
 
-  // Open the file for writing
-  std::string dirList = output_prefix + "-dirList.txt";
-  std::ofstream ofs(dirList.c_str()); 
-
   // Iterate in iy from 0 to tiles_ny - 1, and in ix from 0 to tiles_nx - 1.
+  std::vector<TileCost> tiles;
   for (int iy = 0; iy < tiles_ny; iy++) {
     for (int ix = 0; ix < tiles_nx; ix++) {
       
@@ -140,40 +261,43 @@ void produceTiles(std::string const& output_prefix,
       if (iy == tiles_ny - 1)
         curr_tile_y = std::max(int(trans_left_image_size[1]) - iy * tile_y, 0);
         
-      int beg_x = ix * tile_x;
-      int beg_y = iy * tile_y;
-      
-      bool has_valid_vals = true;
-      if (have_D_sub) {
-        has_valid_vals = false;
-        int min_sub_x = floor((beg_x - sgm_collar_size) / upsample_scale[0]);
-        int min_sub_y = floor((beg_y - sgm_collar_size) / upsample_scale[1]);
-        int max_sub_x = ceil((beg_x + curr_tile_x + sgm_collar_size) / upsample_scale[0]);
-        int max_sub_y = ceil((beg_y + curr_tile_y + sgm_collar_size) / upsample_scale[1]);
-        
-        min_sub_x = std::max(min_sub_x, 0);
-        min_sub_y = std::max(min_sub_y, 0);
-        max_sub_x = std::min(max_sub_x, sub_disp.cols() - 1);
-        max_sub_y = std::min(max_sub_y, sub_disp.rows() - 1);
-      
-        for (int y = min_sub_y; y <= max_sub_y; y++) {
-          for (int x = min_sub_x; x <= max_sub_x; x++) {
-            if (is_valid(sub_disp(x, y))) {
-              has_valid_vals = true;
-              break;
-            }
-          }
-          if (has_valid_vals) 
-            break;
-        } 
-      }
-      
-      if (has_valid_vals)
-        ofs << output_prefix << "-" << beg_x << "_" << beg_y << "_" 
-            << curr_tile_x << "_" << curr_tile_y << "\n";
+      TileCost tile;
+      tile.box = vw::BBox2i(ix * tile_x, iy * tile_y, curr_tile_x, curr_tile_y);
+
+      // Without D_sub, all tiles are assumed to have valid values and the same cost
+      tile.cost = double(curr_tile_x) * double(curr_tile_y);
+      if (have_D_sub)
+        tile.cost = tileCorrCost(tile.box, sub_disp, sub_disp_spread,
+                                 upsample_scale, sgm_collar_size);
+
+      if (tile.cost > 0)
+        tiles.push_back(tile);
     }
   }
 
+  // Tiles with padding are blended with their neighbors on a regular grid,
+  // so they cannot be split.
+  double max_cost_ratio = stereo_settings().parallel_max_tile_cost_ratio;
+  if (max_cost_ratio > 0 && have_D_sub && !using_tiles) {
+    int min_size = ASPGlobalOptions::corr_tile_size() / 2;
+    splitExpensiveTiles(max_cost_ratio, min_size, sub_disp, sub_disp_spread,
+                        upsample_scale, tiles);
+  }
+
+  // Open the files for writing
+  std::string dirList = output_prefix + "-dirList.txt";
+  std::ofstream ofs(dirList.c_str()); 
+  std::string costList = output_prefix + "-tile-costs.txt";
+  std::ofstream ofs_cost(costList.c_str());
+  ofs_cost.precision(17);
+  for (size_t it = 0; it < tiles.size(); it++) {
+    vw::BBox2i const& b = tiles[it].box;
+    std::ostringstream os;
+    os << output_prefix << "-" << b.min().x() << "_" << b.min().y() << "_"
+       << b.width() << "_" << b.height();
+    ofs << os.str() << "\n";
+    ofs_cost << os.str() << " " << tiles[it].cost << "\n";
+  }
 }
 
 int main(int argc, char* argv[]) {
@@ -293,10 +417,12 @@ int main(int argc, char* argv[]) {
     vw_out() << "corr_memory_limit_mb," << stereo_settings().corr_memory_limit_mb << "\n";
     vw_out() << "save_lr_disp_diff," << stereo_settings().save_lr_disp_diff << "\n";
     vw_out() << "correlator_mode," << stereo_settings().correlator_mode << "\n";
+    vw_out() << "fuse_rfne_fltr_tri," << stereo_settings().fuse_rfne_fltr_tri << "\n";
 
     if (asp::stereo_settings().parallel_tile_size != vw::Vector2i(0, 0)) 
       produceTiles(output_prefix, trans_left_image_size, 
-                   asp::stereo_settings().parallel_tile_size, sgm_collar_size);
+                   asp::stereo_settings().parallel_tile_size, sgm_collar_size,
+                   using_tiles);
 
     // Attach a georeference to this disparity. 
     // TODO(oalexan1): Make this into a function
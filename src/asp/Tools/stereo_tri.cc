@@ -29,7 +29,10 @@
 
 #include <asp/Core/PointUtils.h>
 #include <asp/Camera/RPCModel.h>
+#include <asp/Camera/CsmModel.h>
 #include <asp/Core/DisparityProcessing.h>
+#include <asp/Core/DisparityRefinement.h>
+#include <asp/Core/DisparityFilter.h>
 #include <asp/Core/Bathymetry.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Tools/ccd_adjust.h>
@@ -41,6 +44,7 @@
 #include <vw/Stereo/StereoView.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <vw/Image/Filter.h>
+#include <vw/Image/EdgeExtension.h>
 #include <vw/InterestPoint/MatcherIO.h>
 #include <vw/Cartography/Map2CamTrans.h>
 
@@ -119,19 +123,8 @@ public:
   inline result_type operator()(size_t i, size_t j, size_t p = 0) const {
 
     // For each input image, de-warp the pixel in to the native camera coordinates
-    int num_disp = m_disparity_maps.size();
-    std::vector<Vector2> pixVec(num_disp + 1);
-    pixVec[0] = m_transforms[0]->reverse(Vector2(i,j)); // De-warp "left" pixel
-    for (int c = 0; c < num_disp; c++){
-      Vector2 pix;
-      DPixelT disp = m_disparity_maps[c](i,j,p); // Disparity value at this pixel
-      if (is_valid(disp)) // De-warp the "right" pixel
-        pix = m_transforms[c+1]->reverse(Vector2(i,j) + stereo::DispHelper(disp));
-      else // Insert flag values
-        pix = Vector2(std::numeric_limits<double>::quiet_NaN(),
-                      std::numeric_limits<double>::quiet_NaN());
-      pixVec[c+1] = pix;
-    }
+    std::vector<Vector2> pixVec;
+    camera_pixels(i, j, pixVec);
     
     // Compute the location of the 3D point observed by each input pixel
     // when no bathymetry correction is needed.
@@ -237,9 +230,23 @@ public:
     return result; // Contains location and error vector
   }
   
-  typedef StereoTriangulation prerasterize_type;
+  typedef CropView<ImageView<pixel_type>> prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-    return PreRasterHelper(bbox, m_transforms);
+
+    StereoTriangulation tri = PreRasterHelper(bbox, m_transforms);
+
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    if (tri.can_batch_rays()) {
+      for (int row = bbox.min().y(); row < bbox.max().y(); row++)
+        tri.triangulate_row(row, bbox, tile);
+    } else {
+      for (int row = 0; row < bbox.height(); row++) {
+        for (int col = 0; col < bbox.width(); col++)
+          tile(col, row) = tri(col + bbox.min().x(), row + bbox.min().y());
+      }
+    }
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
   }
   template <class DestT>
   inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
@@ -248,6 +255,156 @@ public:
 
 private:
 
+  /// For a given pixel in the left aligned image, find the left and right
+  /// pixels in the native camera coordinates. The right pixel is NaN where
+  /// the disparity is invalid.
+  void camera_pixels(size_t i, size_t j, std::vector<Vector2> & pixVec) const {
+
+    int num_disp = m_disparity_maps.size();
+    pixVec.resize(num_disp + 1);
+    pixVec[0] = m_transforms[0]->reverse(Vector2(i,j)); // De-warp "left" pixel
+    for (int c = 0; c < num_disp; c++){
+      Vector2 pix;
+      DPixelT disp = m_disparity_maps[c](i,j); // Disparity value at this pixel
+      if (is_valid(disp)) // De-warp the "right" pixel
+        pix = m_transforms[c+1]->reverse(Vector2(i,j) + stereo::DispHelper(disp));
+      else // Insert flag values
+        pix = Vector2(std::numeric_limits<double>::quiet_NaN(),
+                      std::numeric_limits<double>::quiet_NaN());
+      pixVec[c+1] = pix;
+    }
+  }
+
+  /// If the rays for a whole row of pixels can be found at once, rather than
+  /// per pixel, which is faster. Done for CSM and RPC cameras, also when
+  /// adjusted by bundle adjustment, with no bathymetry, error propagation, or
+  /// least squares refinement.
+  bool can_batch_rays() const {
+    if (m_bathy_correct || stereo_settings().propagate_errors ||
+        stereo_settings().use_least_squares)
+      return false;
+    for (size_t c = 0; c < m_camera_ptrs.size(); c++) {
+      if (batch_camera(m_camera_ptrs[c]) == NULL)
+        return false;
+    }
+    return true;
+  }
+
+  /// The CSM or RPC camera with which to find the rays for many pixels at
+  /// once. This is the given camera, or the one it wraps, if it is an adjusted
+  /// camera with no pixel adjustment. Return NULL otherwise.
+  static vw::camera::CameraModel const* batch_camera(vw::camera::CameraModel const* cam) {
+    vw::camera::AdjustedCameraModel const* adj_cam
+      = dynamic_cast<vw::camera::AdjustedCameraModel const*>(cam);
+    if (adj_cam != NULL) {
+      if (adj_cam->pixel_offset() != Vector2() || adj_cam->scale() != 1.0)
+        return NULL;
+      cam = adj_cam->unadjusted_model().get();
+    }
+    if (dynamic_cast<asp::CsmModel const*>(cam) != NULL ||
+        dynamic_cast<asp::RPCModel const*>(cam) != NULL)
+      return cam;
+    return NULL;
+  }
+
+  /// Find the rays for all given pixels with a camera for which
+  /// batch_camera() is not NULL. For an adjusted camera, the rays of the
+  /// wrapped camera are transformed by the adjustment.
+  static void camera_rays(vw::camera::CameraModel const* cam,
+                          std::vector<Vector2> const& pixels,
+                          std::vector<Vector3> & ctrs, std::vector<Vector3> & dirs) {
+    vw::camera::CameraModel const* ucam = batch_camera(cam);
+    asp::CsmModel const* csm_cam = dynamic_cast<asp::CsmModel const*>(ucam);
+    asp::RPCModel const* rpc_cam = dynamic_cast<asp::RPCModel const*>(ucam);
+    if (csm_cam != NULL)
+      csm_cam->pixels_to_rays(pixels, ctrs, dirs);
+    else if (rpc_cam != NULL)
+      rpc_cam->pixels_to_rays(pixels, ctrs, dirs);
+    else
+      vw_throw(ArgumentErr() << "Cannot find the rays for multiple pixels at once "
+               << "for this camera model.\n");
+
+    vw::camera::AdjustedCameraModel const* adj_cam
+      = dynamic_cast<vw::camera::AdjustedCameraModel const*>(cam);
+    if (adj_cam == NULL)
+      return;
+    Matrix4x4 T = adj_cam->ecef_transform();
+    Matrix3x3 R = submatrix(T, 0, 0, 3, 3);
+    Vector3 shift(T(0, 3), T(1, 3), T(2, 3));
+    for (size_t k = 0; k < pixels.size(); k++) {
+      if (ctrs[k] == Vector3() && dirs[k] == Vector3())
+        continue; // no ray
+      ctrs[k] = R * ctrs[k] + shift;
+      dirs[k] = R * dirs[k];
+    }
+  }
+
+  /// Triangulate the given row of the box, finding first the rays for all
+  /// pixels in the row for each camera. Same result as operator(). For CSM
+  /// linescan cameras, pixels_to_rays() checks the batched rays against the
+  /// camera model, and finds them one pixel at a time if they disagree. For
+  /// RPC cameras it does the same computation as for one pixel.
+  void triangulate_row(int row, BBox2i const& bbox, ImageView<pixel_type> & tile) const {
+
+    int num_cams = m_camera_ptrs.size();
+    int num_pix = bbox.width();
+    Vector2 nan_pix(std::numeric_limits<double>::quiet_NaN(),
+                    std::numeric_limits<double>::quiet_NaN());
+
+    std::vector<std::vector<Vector2>> pixels(num_cams, std::vector<Vector2>(num_pix));
+    std::vector<Vector2> pixVec;
+    for (int k = 0; k < num_pix; k++) {
+      camera_pixels(bbox.min().x() + k, row, pixVec);
+      for (int c = 0; c < num_cams; c++) {
+        if (pixVec[c] == camera::CameraModel::invalid_pixel())
+          pixVec[c] = nan_pix; // skip it, as the stereo model does
+        pixels[c][k] = pixVec[c];
+      }
+    }
+
+    std::vector<std::vector<Vector3>> ctrs(num_cams), dirs(num_cams);
+    for (int c = 0; c < num_cams; c++)
+      camera_rays(m_camera_ptrs[c], pixels[c], ctrs[c], dirs[c]);
+
+    double max_tri_err = stereo_settings().max_valid_triangulation_error;
+    std::vector<Vector3> camDirs, camCtrs;
+    for (int k = 0; k < num_pix; k++) {
+
+      // Pick the valid rays. If a ray could not be found, there is no result.
+      camDirs.clear();
+      camCtrs.clear();
+      bool success = true;
+      for (int c = 0; c < num_cams; c++) {
+        if (pixels[c][k] != pixels[c][k]) // NaN
+          continue;
+        if (dirs[c][k] == Vector3()) {
+          success = false;
+          break;
+        }
+        camDirs.push_back(dirs[c][k]);
+        camCtrs.push_back(ctrs[c][k]);
+      }
+
+      pixel_type result;
+      if (success) {
+        try {
+          Vector3 errorVec;
+          subvector(result, 0, 3) = m_bathy_model.triangulateRays(camDirs, camCtrs,
+                                                                  errorVec);
+          subvector(result, 3, 3) = errorVec;
+
+          // Filter by triangulation error, if desired
+          if (max_tri_err > 0.0 && norm_2(errorVec) > max_tri_err)
+            result = pixel_type();
+        } catch(...) {
+          result = pixel_type();
+        }
+      }
+
+      tile(k, row - bbox.min().y()) = result;
+    }
+  }
+
   // Find the region associated with the right image that we need to bring in memory
   // based on the disparity 
   BBox2i calc_right_bbox(BBox2i const& left_bbox, ImageView<DPixelT> const& disparity) const {
@@ -260,7 +417,7 @@ private:
   
   /// RPC Map Transform needs to be explicitly copied and told to cache for performance.
   template <class T>
-  prerasterize_type PreRasterHelper(BBox2i const& bbox, std::vector<T> const& transforms) const {
+  StereoTriangulation PreRasterHelper(BBox2i const& bbox, std::vector<T> const& transforms) const {
 
     ImageViewRef<PixelMask<float>> in_memory_left_aligned_bathy_mask;
     ImageViewRef<PixelMask<float>> in_memory_right_aligned_bathy_mask;
@@ -297,11 +454,11 @@ private:
         }
       }
 
-      return prerasterize_type(disparity_cropviews, m_camera_ptrs, transforms, m_datum,
-                               m_stereo_model, m_bathy_model,
-                               m_is_map_projected, m_bathy_correct, m_cloud_type,
-                               in_memory_left_aligned_bathy_mask,
-                               in_memory_right_aligned_bathy_mask);
+      return StereoTriangulation(disparity_cropviews, m_camera_ptrs, transforms, m_datum,
+                                 m_stereo_model, m_bathy_model,
+                                 m_is_map_projected, m_bathy_correct, m_cloud_type,
+                                 in_memory_left_aligned_bathy_mask,
+                                 in_memory_right_aligned_bathy_mask);
     }
 
     // Code for MAP-PROJECTED session types.
@@ -363,11 +520,11 @@ private:
       transforms_copy[p+1]->reverse_bbox(right_bbox);
     }
 
-    return prerasterize_type(disparity_cropviews, m_camera_ptrs, transforms_copy, m_datum,
-                             m_stereo_model, m_bathy_model, m_is_map_projected,
-                             m_bathy_correct, m_cloud_type,
-                             in_memory_left_aligned_bathy_mask,
-                             in_memory_right_aligned_bathy_mask);
+    return StereoTriangulation(disparity_cropviews, m_camera_ptrs, transforms_copy, m_datum,
+                               m_stereo_model, m_bathy_model, m_is_map_projected,
+                               m_bathy_correct, m_cloud_type,
+                               in_memory_left_aligned_bathy_mask,
+                               in_memory_right_aligned_bathy_mask);
   } // End function PreRasterHelper() mapprojected version
 }; // End class StereoTriangulation
 
@@ -392,6 +549,99 @@ stereo_triangulation(std::vector<DispImageType> const& disparities,
 }
 
 
+/// Refine and filter the disparity in each tile in memory, so that the RD.tif
+/// and F.tif files need not be written. The filters look beyond the tile, so
+/// the unfiltered disparity is found in the tile expanded by the filter
+/// margin, and is treated as invalid outside of that.
+class FusedRfneFltrView: public ImageViewBase<FusedRfneFltrView> {
+  DispImageType m_disp;
+  ImageViewRef<PixelGray<float>> m_left_image;
+  ImageViewRef<vw::uint8> m_left_edge_mask, m_right_edge_mask;
+  int m_margin;
+
+public:
+  FusedRfneFltrView(DispImageType const& disp,
+                    ImageViewRef<PixelGray<float>> const& left_image,
+                    ImageViewRef<vw::uint8> const& left_edge_mask,
+                    ImageViewRef<vw::uint8> const& right_edge_mask):
+    m_disp(disp), m_left_image(left_image),
+    m_left_edge_mask(left_edge_mask), m_right_edge_mask(right_edge_mask),
+    m_margin(asp::disparityFilterMargin()) {}
+
+  // Image View interface
+  typedef PixelMask<Vector2f>                        pixel_type;
+  typedef pixel_type                                 result_type;
+  typedef ProceduralPixelAccessor<FusedRfneFltrView> pixel_accessor;
+
+  inline int32 cols  () const { return m_disp.cols(); }
+  inline int32 rows  () const { return m_disp.rows(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+  inline pixel_type operator()(double /*i*/, double /*j*/, int32 /*p*/ = 0) const {
+    vw_throw(NoImplErr() << "FusedRfneFltrView::operator()(...) is not implemented");
+    return pixel_type();
+  }
+
+  typedef CropView<ImageView<pixel_type>> prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    BBox2i bbox2 = bbox;
+    bbox2.expand(m_margin);
+    bbox2.crop(bounding_box(m_disp));
+    ImageView<pixel_type> disp_tile = crop(m_disp, bbox2);
+
+    // Pretend this is the entire disparity
+    ImageViewRef<pixel_type> disp
+      = crop(edge_extend(disp_tile, ValueEdgeExtension<pixel_type>(pixel_type())),
+             -bbox2.min().x(), -bbox2.min().y(), cols(), rows());
+
+    ImageViewRef<pixel_type> filtered_disp
+      = asp::filteredDisparity(disp, m_left_image, m_left_edge_mask, m_right_edge_mask);
+    if (stereo_settings().erode_max_size > 0)
+      filtered_disp = asp::per_tile_erode(filtered_disp);
+
+    ImageView<pixel_type> tile = crop(filtered_disp, bbox);
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
+// Find the filtered disparity from the output of correlation or blending,
+// with refinement and filtering done per tile, in memory.
+DispImageType fused_rfne_fltr_disparity(ASPGlobalOptions const& opt) {
+
+  if (stereo_settings().enable_fill_holes ||
+      stereo_settings().gotcha_disparity_refinement)
+    vw_throw(ArgumentErr() << "Cannot use --enable-fill-holes or "
+             << "--gotcha-disparity-refinement with --fuse-rfne-fltr-tri, "
+             << "as these need the full disparity.\n");
+  if (stereo_settings().unalign_disparity ||
+      stereo_settings().num_matches_from_disparity > 0 ||
+      stereo_settings().num_matches_from_disp_triplets > 0)
+    vw_throw(ArgumentErr() << "Cannot use --unalign-disparity, "
+             << "--num-matches-from-disparity, or --num-matches-from-disp-triplets "
+             << "with --fuse-rfne-fltr-tri.\n");
+
+  bool skip_img_norm = asp::skip_image_normalization(opt);
+  bool do_not_exceed_min_max = (opt.session->name() == "isis" ||
+                                opt.session->name() == "isismapisis");
+  DispImageType disp = asp::refinedDisparity(opt, skip_img_norm, do_not_exceed_min_max);
+
+  ImageViewRef<vw::uint8> left_edge_mask, right_edge_mask;
+  asp::disparityEdgeMasks(opt, left_edge_mask, right_edge_mask);
+  ImageViewRef<PixelGray<float>> left_image
+    = DiskImageView<PixelGray<float>>(opt.out_prefix + "-L.tif");
+
+  vw_out() << "\t--> Refining and filtering the disparity in each tile.\n";
+  return FusedRfneFltrView(disp, left_image, left_edge_mask, right_edge_mask);
+}
+
 // TODO(oalexan1): Move some of these functions to a class or something!
   
 // ImageView operator that takes the last three elements of a vector
@@ -701,9 +951,13 @@ void stereo_triangulation(std::string const& output_prefix,
     } // End try/catch
 
     std::vector<DispImageType> disparity_maps;
-    for (int p = 0; p < (int)opt_vec.size(); p++)
-      disparity_maps.push_back
-        (opt_vec[p].session->pre_pointcloud_hook(opt_vec[p].out_prefix+"-F.tif"));
+    for (int p = 0; p < (int)opt_vec.size(); p++) {
+      if (stereo_settings().fuse_rfne_fltr_tri)
+        disparity_maps.push_back(fused_rfne_fltr_disparity(opt_vec[p]));
+      else
+        disparity_maps.push_back
+          (opt_vec[p].session->pre_pointcloud_hook(opt_vec[p].out_prefix+"-F.tif"));
+    }
 
     bool do_disp_or_matches_work
       = (stereo_settings().unalign_disparity                        ||
@@ -897,15 +1151,25 @@ int main(int argc, char* argv[]) {
                        output_prefix);
     }
 
-    // Keep only those stereo pairs for which filtered disparity exists
+    // Keep only those stereo pairs for which filtered disparity exists. If
+    // refining and filtering here, need the disparity before that.
+    bool fuse = asp::stereo_settings().fuse_rfne_fltr_tri;
     std::vector<asp::ASPGlobalOptions> opt_vec_new;
     for (int p = 0; p < (int)opt_vec.size(); p++) {
-      if (fs::exists(opt_vec[p].out_prefix+"-F.tif"))
+      std::string prefix = opt_vec[p].out_prefix;
+      bool has_disp = fs::exists(prefix + "-F.tif");
+      if (fuse)
+        has_disp = fs::exists(prefix + (asp::stereo_settings().subpix_from_blend ?
+                                        "-B.tif" : "-D.tif"));
+      if (has_disp)
         opt_vec_new.push_back(opt_vec[p]);
     }
     opt_vec = opt_vec_new;
-    if (opt_vec.empty())
+    if (opt_vec.empty()) {
+      if (fuse)
+        vw_throw(ArgumentErr() << "No valid D.tif or B.tif files found.\n");
       vw_throw( ArgumentErr() << "No valid F.tif files found.\n" );
+    }
 
     // Triangulation uses small tiles.
     //---------------------------------------------------------